@@ -1,11 +1,68 @@
 #pragma once
 #include <concepts>
+#include <cstdint>
 #include <tuple>
 #include <queue>
 #include <list>
 #include <functional>
 #include <optional>
+#include <utility>
 #include <string.h>
+#include "BufferStats.hpp"
+#include "ReceiveTimestamps.hpp"
+
+// The async buffers hand the IOInterface callbacks that find the buffer
+// through an anchor, a heap cell holding the buffer's address. It stays put
+// when the buffer moves and is nulled when the buffer goes away, so a
+// callback completing late lands in the right buffer or in none. The
+// callbacks hold it by a plain pointer, an IO call costs no refcounting.
+
+// The anchor of 'buffer', allocated on its first IO call
+template <class Buffer>
+Buffer **anchorOf(Buffer **&anchor, Buffer *const &buffer)
+{
+  if (!anchor)
+  {
+    anchor = new Buffer *(buffer);
+  }
+  return anchor;
+}
+
+// The buffer a callback completes into, nullptr if the buffer is gone. The
+// callback pending when the buffer went away is the last one holding the
+// anchor, it frees it
+template <class Buffer>
+Buffer *landing(Buffer **const &anchor)
+{
+  if (!*anchor)
+  {
+    delete anchor;
+    return nullptr;
+  }
+  return *anchor;
+}
+
+// Detach the anchor from a buffer that goes away, with a callback pending
+// the callback frees it(see landing). An IOInterface that drops a pending
+// callback without invoking it leaks the anchor
+template <class Buffer>
+void abandonAnchor(Buffer **&anchor, const bool &callbackPending)
+{
+  if (!anchor)
+  {
+    return;
+  }
+
+  if (callbackPending)
+  {
+    *anchor = nullptr;
+  }
+  else
+  {
+    delete anchor;
+  }
+  anchor = nullptr;
+}
 
 // SizeType should be an unsigned integral type
 template <class SizeType>
@@ -30,7 +87,12 @@ struct AsyncIOReadBuffer
                                             m_tail(0),
                                             m_head(0),
                                             m_size(size),
-                                            m_lastOperation(LastOperation::NONE)
+                                            m_lastOperation(LastOperation::NONE),
+                                            m_position(0),
+                                            m_timestamps(nullptr),
+                                            m_stats(nullptr),
+                                            m_readOn(false),
+                                            m_anchor(nullptr)
   {
   }
 
@@ -69,16 +131,21 @@ struct AsyncIOReadBuffer
     {
       SizeType lengthTillEnd = m_size - m_head;
       SizeType toRead = std::min(freeBytes(), lengthTillEnd);
+      m_readOn = true;
       ioInterface(m_readBuff + m_head,
                   toRead,
-                  [this, out, toCopy, resHandler, ioInterface, len]
+                  [anchor = anchorOf(m_anchor, this), out, toCopy, resHandler, ioInterface, len]
                   (const SizeType &readLen)
-                  { onReadFromInterface(out,
-                                        len,
-                                        toCopy,
-                                        readLen,
-                                        ioInterface,
-                                        resHandler);
+                  {
+                    if (auto buffer = landing(anchor))
+                    {
+                      buffer->onReadFromInterface(out,
+                                                  len,
+                                                  toCopy,
+                                                  readLen,
+                                                  ioInterface,
+                                                  resHandler);
+                    }
                   });
     }
   }
@@ -108,19 +175,121 @@ struct AsyncIOReadBuffer
     return freeBytes();
   }
 
+  /**
+   * Absolute offset in the stream of the next byte to be handed out, i.e.
+   * no. of bytes consumed from this buffer since construction.
+   * Always 64-bit, regardless of SizeType
+   **/
+  uint64_t position()
+  {
+    return m_position;
+  }
+
+  /**
+   * Attach a TimestampRing that records when every read completed by the
+   * IOInterface happened, see timestampOf.
+   * The ring is borrowed, it has to outlive this buffer or be detached by
+   * passing nullptr
+   **/
+  void setTimestamps(TimestampRing *timestamps)
+  {
+    m_timestamps = timestamps;
+  }
+
+  /**
+   * Attach BufferStats to be kept up to date by this buffer. Residency is
+   * recorded only while a TimestampRing is attached too, occupancy always,
+   * there are no records to measure the length of.
+   * The stats are borrowed, they have to outlive this buffer or be detached
+   * by passing nullptr
+   **/
+  void setStats(BufferStats *stats)
+  {
+    m_stats = stats;
+  }
+
+  /**
+   * When the byte at 'position'(see position()) was read from the
+   * IOInterface
+   *
+   * @return  ns, in the domain of the TimestampRing's clock, std::nullopt if
+   *          no TimestampRing is attached or it no longer remembers the byte
+   **/
+  std::optional<uint64_t> timestampOf(const uint64_t &position)
+  {
+    return m_timestamps ? m_timestamps->timestampOf(position) : std::nullopt;
+  }
+
+  /**
+   * A read still in flight is abandoned, its resHandler is never invoked.
+   * The IOInterface must not write into the memory it was given once the
+   * buffer is gone
+   **/
   ~AsyncIOReadBuffer()
   {
+    abandon();
     free(m_readBuff);
   }
 
-  // Non copyable-assignable, Non moveable-move assinable for the reasons of
-  // Simplicity
+  // Non copyable-assignable, for the reasons of Simplicity
   AsyncIOReadBuffer(const AsyncIOReadBuffer &) = delete;
   AsyncIOReadBuffer &operator=(const AsyncIOReadBuffer &) = delete;
-  AsyncIOReadBuffer(AsyncIOReadBuffer &&) = delete;
-  AsyncIOReadBuffer &operator=(AsyncIOReadBuffer &&) = delete;
+
+  /**
+   * Takes over the memory, the buffered bytes and the attached helpers of
+   * 'other', which is left fit only to be destroyed or assigned to.
+   * 'other' may have a read in flight, the memory the IOInterface reads into
+   * doesn't move and the read completes into this buffer: the callbacks
+   * given to the IOInterface find the buffer through an anchor, which is
+   * repointed here
+   **/
+  AsyncIOReadBuffer(AsyncIOReadBuffer &&other) noexcept : m_size(other.m_size),
+                                                          m_readBuff(nullptr)
+  {
+    takeOver(other);
+  }
+
+  /**
+   * A read in flight on this buffer is abandoned, as on destruction
+   **/
+  AsyncIOReadBuffer &operator=(AsyncIOReadBuffer &&other) noexcept
+  {
+    if (this != &other)
+    {
+      abandon();
+      free(m_readBuff);
+      m_size = other.m_size;
+      takeOver(other);
+    }
+
+    return *this;
+  }
 
 private:
+  // Move the state of 'other' into this buffer, along with its anchor
+  void takeOver(AsyncIOReadBuffer &other)
+  {
+    m_lastOperation = std::exchange(other.m_lastOperation, LastOperation::NONE);
+    m_tail = std::exchange(other.m_tail, 0);
+    m_head = std::exchange(other.m_head, 0);
+    m_readBuff = std::exchange(other.m_readBuff, nullptr);
+    m_position = std::exchange(other.m_position, 0);
+    m_timestamps = std::exchange(other.m_timestamps, nullptr);
+    m_stats = std::exchange(other.m_stats, nullptr);
+    m_readOn = std::exchange(other.m_readOn, false);
+    m_anchor = std::exchange(other.m_anchor, nullptr);
+    if (m_anchor)
+    {
+      *m_anchor = this;
+    }
+  }
+
+  // Callbacks still held by the IOInterface find nothing from now on
+  void abandon()
+  {
+    abandonAnchor(m_anchor, m_readOn);
+  }
+
   /**
    * This is the callback that is called whenever some bytes are yielded by the externally provided
    * IOInterface. This method checks whether the no. of bytes requested in the original 'read'
@@ -144,6 +313,7 @@ private:
                            const IOInterface& ioInterface,
                            const ReadResultHandler& resHandler)
   {
+    m_readOn = false;
     // The IOINterface can no longer give any data, close the async read loop here
     if (!bytesInThisIOCall)
     {
@@ -153,6 +323,17 @@ private:
     {
       m_head = (m_head + bytesInThisIOCall) % m_size;
       m_lastOperation = LastOperation::PASTE;
+      if (m_timestamps)
+      {
+        uint64_t end = m_position + occupiedBytes();
+        m_timestamps->onPaste(end - bytesInThisIOCall, end);
+      }
+
+      if (m_stats)
+      {
+        m_stats->occupancy.record(occupiedBytes());
+      }
+
       SizeType totalLeftToRead = totalRequired - totalRead;
       SizeType toCopy = std::min(totalLeftToRead, occupiedBytes());
       copy(out + totalRead, toCopy);
@@ -172,16 +353,20 @@ private:
         // we have to read into the part that spans from m_head to the end of buffer
         SizeType toRead = std::min(lengthTillEnd, freeBytes());
 
+        m_readOn = true;
         ioInterface(m_readBuff + m_head,
                     toRead,
-                    [this, out, totalRequired, totalRead, toCopy, ioInterface, resHandler](const SizeType &readLen)
+                    [anchor = anchorOf(m_anchor, this), out, totalRequired, totalRead, toCopy, ioInterface, resHandler](const SizeType &readLen)
                     {
-                      onReadFromInterface(out,
-                                          totalRequired,
-                                          totalRead +  toCopy,
-                                          readLen,
-                                          ioInterface,
-                                          resHandler);
+                      if (auto buffer = landing(anchor))
+                      {
+                        buffer->onReadFromInterface(out,
+                                                    totalRequired,
+                                                    totalRead + toCopy,
+                                                    readLen,
+                                                    ioInterface,
+                                                    resHandler);
+                      }
                     });
       }
     }
@@ -197,6 +382,16 @@ void
       return;
     }
 
+    // One residency sample per call, for the first byte consumed
+    if (m_stats && m_timestamps)
+    {
+      if (auto timestamp = m_timestamps->timestampOf(m_position))
+      {
+        uint64_t now = m_timestamps->now();
+        m_stats->residency.record(now > *timestamp ? now - *timestamp : 0);
+      }
+    }
+
     // Case 1: m_tail < m_head:
     // Before:
     //                    len
@@ -257,6 +452,7 @@ void
       m_tail = l2;
     }
 
+    m_position += len;
     m_lastOperation = LastOperation::COPY;
     if (!occupiedBytes())
     {
@@ -290,12 +486,22 @@ void
   LastOperation m_lastOperation;
   SizeType m_tail;
   SizeType m_head;
-  const SizeType m_size;
-  char *const m_readBuff;
+  SizeType m_size;
+  char *m_readBuff;
+  uint64_t m_position;
+  TimestampRing *m_timestamps;
+  BufferStats *m_stats;
+  // A callback given to the IOInterface is pending
+  bool m_readOn;
+  // The buffer the callbacks given to the IOInterface complete into, moves
+  // with the buffer, nullptr once the buffer is gone. Allocated on the first
+  // IO call, the callbacks hold it by a plain pointer, see landing
+  AsyncIOReadBuffer **m_anchor;
 };
 
 // SizeType should be an unsigned integral type
 template <class SizeType>
+requires std::unsigned_integral<SizeType>
 struct AsyncIOWriteBuffer
 {
   typedef std::function<void(const SizeType &)> WriteResultHandler;
@@ -328,7 +534,10 @@ struct AsyncIOWriteBuffer
     m_size(size),
     m_ioInterface(ioInterface),
     m_lastOperation(LastOperation::NONE),
-    m_writeLoopOn(false)
+    m_writeLoopOn(false),
+    m_position(0),
+    m_flushedPosition(0),
+    m_anchor(nullptr)
   {}
 
   bool empty()
@@ -356,17 +565,67 @@ struct AsyncIOWriteBuffer
     return freeBytes();
   }
 
+  /**
+   * Absolute offset in the output stream of the next byte to be written,
+   * i.e. no. of bytes accepted by write since construction, minus the ones
+   * reported as not sent when the IOInterface gave up.
+   * Always 64-bit, regardless of SizeType
+   **/
+  uint64_t position()
+  {
+    return m_position;
+  }
+
+  /**
+   * No. of bytes confirmed as sent by the IOInterface since construction
+   **/
+  uint64_t flushedPosition()
+  {
+    return m_flushedPosition;
+  }
+
+  /**
+   * A write loop still running is abandoned, the pending resHandlers are
+   * never invoked. The IOInterface must not read the memory it was given
+   * once the buffer is gone
+   **/
   ~AsyncIOWriteBuffer()
   {
+    abandon();
     free(m_outBuff);
   }
 
-  // Non copyable-assignable, Non moveable-move assinable for the reasons of
-  // Simplicity
+  // Non copyable-assignable, for the reasons of Simplicity
   AsyncIOWriteBuffer(const AsyncIOWriteBuffer &) = delete;
   AsyncIOWriteBuffer &operator=(const AsyncIOWriteBuffer &) = delete;
-  AsyncIOWriteBuffer(AsyncIOWriteBuffer &&) = delete;
-  AsyncIOWriteBuffer &operator=(AsyncIOWriteBuffer &&) = delete;
+
+  /**
+   * Takes over the memory, the buffered bytes, the pending writes and the
+   * ioInterface of 'other', which is left fit only to be destroyed or
+   * assigned to. The write loop of 'other' may be running, it goes on in
+   * this buffer, see AsyncIOReadBuffer's move constructor
+   **/
+  AsyncIOWriteBuffer(AsyncIOWriteBuffer &&other) noexcept : m_size(other.m_size),
+                                                            m_outBuff(nullptr)
+  {
+    takeOver(other);
+  }
+
+  /**
+   * A write loop running on this buffer is abandoned, as on destruction
+   **/
+  AsyncIOWriteBuffer &operator=(AsyncIOWriteBuffer &&other) noexcept
+  {
+    if (this != &other)
+    {
+      abandon();
+      free(m_outBuff);
+      m_size = other.m_size;
+      takeOver(other);
+    }
+
+    return *this;
+  }
 
   void write(const char* out,
              const SizeType &len,
@@ -378,28 +637,57 @@ struct AsyncIOWriteBuffer
       return;
     }
 
-    uint32_t toPut = std::min(len, freeBytes());
+    SizeType toPut = std::min(len, freeBytes());
     put(out, toPut);
     m_pendingWriteQueue.push_back({out, len, toPut, 0, resHandler});
+    m_position += len;
 
     if (m_writeLoopOn)
     {
       return;
     }
 
-    uint32_t lengthTillEnd = m_size - m_tail;
-    uint32_t toWrite = std::min(occupiedBytes(), lengthTillEnd);
+    SizeType lengthTillEnd = m_size - m_tail;
+    SizeType toWrite = std::min(occupiedBytes(), lengthTillEnd);
 
     m_writeLoopOn = true;
     m_ioInterface(m_outBuff + m_tail,
                   toWrite,
-                  [this](const SizeType &writeLen)
+                  [anchor = anchorOf(m_anchor, this)](const SizeType &writeLen)
                   {
-                    onWriteToInterface(writeLen);
+                    if (auto buffer = landing(anchor))
+                    {
+                      buffer->onWriteToInterface(writeLen);
+                    }
                   });
   }
 
 private:
+  // Move the state of 'other' into this buffer, along with its anchor
+  void takeOver(AsyncIOWriteBuffer &other)
+  {
+    m_writeLoopOn = std::exchange(other.m_writeLoopOn, false);
+    m_pendingWriteQueue = std::move(other.m_pendingWriteQueue);
+    m_ioInterface = std::move(other.m_ioInterface);
+    m_lastOperation = std::exchange(other.m_lastOperation, LastOperation::NONE);
+    m_tail = std::exchange(other.m_tail, 0);
+    m_head = std::exchange(other.m_head, 0);
+    m_outBuff = std::exchange(other.m_outBuff, nullptr);
+    m_position = std::exchange(other.m_position, 0);
+    m_flushedPosition = std::exchange(other.m_flushedPosition, 0);
+    m_anchor = std::exchange(other.m_anchor, nullptr);
+    if (m_anchor)
+    {
+      *m_anchor = this;
+    }
+  }
+
+  // Callbacks still held by the IOInterface find nothing from now on
+  void abandon()
+  {
+    abandonAnchor(m_anchor, m_writeLoopOn);
+  }
+
   void onWriteToInterface(const SizeType& bytesInThisIOCall)
   {
     // The IOINterface can no longer give any data,
@@ -412,6 +700,7 @@ private:
            ++it)
       {
         auto &[buff, len, alreadyPut, alreadySent, resHandler] = *it;
+        m_position -= len - alreadySent;
         resHandler(alreadySent);
       }
 
@@ -424,17 +713,18 @@ private:
     // Update the m_tail pointer
     m_tail = (m_tail + bytesInThisIOCall) % m_size;
     m_lastOperation = LastOperation::WRITE;
+    m_flushedPosition += bytesInThisIOCall;
     if (!occupiedBytes())
     {
       m_head = m_tail = 0;
     }
 
     // Notify all the pending callabacks whose complete data has ben sent
-    uint32_t remainingLen = bytesInThisIOCall;
+    SizeType remainingLen = bytesInThisIOCall;
     while (remainingLen && !m_pendingWriteQueue.empty())
     {
       auto& [buff, len, alreadyPut, alreadySent, resHandler] = *m_pendingWriteQueue.begin();
-      uint32_t toIncrease = std::min(remainingLen, len - alreadySent);
+      SizeType toIncrease = std::min<SizeType>(remainingLen, len - alreadySent);
       alreadySent += toIncrease;
       if (alreadySent == len)
       {
@@ -457,19 +747,22 @@ private:
         ++it)
     {
       auto &[buff, len, alreadyPut, alreadySent, resHandler] = *it;
-      uint32_t toPut = std::min(len - alreadyPut, freeBytes());
+      SizeType toPut = std::min<SizeType>(len - alreadyPut, freeBytes());
       put(buff + alreadyPut, toPut);
       alreadyPut += toPut;
     }
 
-    uint32_t lengthTillEnd = m_size - m_tail;
-    uint32_t toWrite = std::min(occupiedBytes(), lengthTillEnd);
+    SizeType lengthTillEnd = m_size - m_tail;
+    SizeType toWrite = std::min(occupiedBytes(), lengthTillEnd);
 
     m_ioInterface(m_outBuff + m_tail,
                   toWrite,
-                  [this](const SizeType &writeLen)
+                  [anchor = anchorOf(m_anchor, this)](const SizeType &writeLen)
                   {
-                    onWriteToInterface(writeLen);
+                    if (auto buffer = landing(anchor))
+                    {
+                      buffer->onWriteToInterface(writeLen);
+                    }
                   });
   }
 
@@ -527,6 +820,11 @@ private:
   LastOperation m_lastOperation;
   SizeType m_tail;
   SizeType m_head;
-  const SizeType m_size;
-  char *const m_outBuff;
+  SizeType m_size;
+  char *m_outBuff;
+  uint64_t m_position;
+  uint64_t m_flushedPosition;
+  // See AsyncIOReadBuffer::m_anchor, m_writeLoopOn tells if a callback is
+  // pending
+  AsyncIOWriteBuffer **m_anchor;
 };
\ No newline at end of file
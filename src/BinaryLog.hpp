@@ -0,0 +1,539 @@
+#pragma once
+#include <concepts>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <string.h>
+#include "SmartBuffer.hpp"
+
+// Logging with deferred formatting: the hot thread writes the id of the
+// format string and the raw bytes of the arguments into a
+// SyncIOLazyWriteBuffer, the text is produced later, by BinaryLogDecoder(in
+// a background thread, or offline with the BinaryLogDecoder tool).
+//
+// The stream is a sequence of records, all the integers little endian(host
+// order, the decoder is expected to run on the same kind of machine):
+//
+// log record         |id(u32)|arg|arg|...|
+// definition record  |0(u32)|id(u32)|signature len(u16)|signature|format len(u32)|format|
+//
+// An arg is the raw bytes of an integer or floating point argument, or
+// |len(u32)|bytes| for a string. The signature has a character per argument
+// (see logTypeCode), a logger writes the definition of a format before the
+// first record using it
+
+// Signature character of an argument type, in the spirit of Python's struct:
+// b/h/i/l signed and B/H/I/L unsigned integers of 1/2/4/8 bytes, f float,
+// d double, s string
+template <class T>
+constexpr char logTypeCode()
+{
+  using Type = std::decay_t<T>;
+  if constexpr (std::is_same_v<Type, const char *> || std::is_same_v<Type, char *> ||
+                std::is_same_v<Type, std::string> || std::is_same_v<Type, std::string_view>)
+  {
+    return 's';
+  }
+  else if constexpr (std::is_same_v<Type, float>)
+  {
+    return 'f';
+  }
+  else if constexpr (std::is_same_v<Type, double>)
+  {
+    return 'd';
+  }
+  else
+  {
+    static_assert(std::is_integral_v<Type> && sizeof(Type) <= 8, "Only integers, float, double and strings can be logged");
+    constexpr char codes[] = "bhhiiiil";
+    constexpr char code = codes[sizeof(Type) - 1];
+    return std::is_signed_v<Type> ? code : code - 'a' + 'A';
+  }
+}
+
+// The format strings of all the LogFormats in the process, so that every
+// format gets an id unique across the loggers
+struct LogFormatRegistry
+{
+  struct Entry
+  {
+    std::string signature;
+    std::string format;
+  };
+
+  // @return  The id of the new format, starting from 1
+  static uint32_t add(const std::string &signature, const std::string &format)
+  {
+    std::lock_guard<std::mutex> lock(mutex());
+    entries().push_back({signature, format});
+    return static_cast<uint32_t>(entries().size());
+  }
+
+  static Entry get(const uint32_t &id)
+  {
+    std::lock_guard<std::mutex> lock(mutex());
+    return entries()[id - 1];
+  }
+
+private:
+  static std::mutex &mutex()
+  {
+    static std::mutex ret;
+    return ret;
+  }
+
+  static std::vector<Entry> &entries()
+  {
+    static std::vector<Entry> ret;
+    return ret;
+  }
+};
+
+// A printf style format string and the types of its arguments, meant to be
+// a static at the logging site, so it is registered once:
+//
+// static const LogFormat<uint64_t, double> filled("order %lu filled at %f");
+// logger.log(filled, orderId, price);
+template <class... Args>
+struct LogFormat
+{
+  LogFormat(const char *format) : id(LogFormatRegistry::add(std::string{logTypeCode<Args>()...}, format))
+  {
+  }
+
+  const uint32_t id;
+};
+
+// Writes log records into a SyncIOLazyWriteBuffer, which is borrowed. Not
+// thread safe, a logger(and a buffer) per thread. A record goes into the
+// buffer whole or not at all: room for all of it is made(see
+// SyncIOLazyWriteBuffer::reserve) before its first byte is copied, so a sink
+// that stops accepting bytes never leaves the stream cut mid-record. The
+// buffer has to be larger than the longest record
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct BinaryLogger
+{
+  BinaryLogger(SyncIOLazyWriteBuffer<SizeType> &buffer) : m_buffer(buffer)
+  {
+  }
+
+  /**
+   * Write a log record, no formatting takes place
+   *
+   * @return  false if the buffer couldn't make room for the whole record
+   *          (see SyncIOLazyWriteBuffer::reserve), or for the definition of
+   *          the format it needs, nothing of the record is written then and
+   *          the definition is tried again with the next record of the format
+   **/
+  template <class... Args>
+  bool log(const LogFormat<Args...> &format, const std::type_identity_t<Args> &...args)
+  {
+    if ((format.id >= m_defined.size() || !m_defined[format.id]) && !define(format.id))
+    {
+      return false;
+    }
+
+    if (!reserve(sizeof(format.id) + (argSize<Args>(args) + ... + 0)))
+    {
+      return false;
+    }
+
+    Record record;
+    put(record, format.id);
+    (putArg<Args>(record, args), ...);
+    return write(record);
+  }
+
+  BinaryLogger(const BinaryLogger &) = delete;
+  BinaryLogger &operator=(const BinaryLogger &) = delete;
+  BinaryLogger(BinaryLogger &&) = delete;
+  BinaryLogger &operator=(BinaryLogger &&) = delete;
+
+private:
+  // A record is assembled on the stack, so that it usually takes a single
+  // write into the buffer, the bytes that don't fit are written as they come,
+  // into the room reserved for the whole record
+  struct Record
+  {
+    char bytes[256];
+    size_t used = 0;
+    bool failed = false;
+  };
+
+  // No. of bytes 'arg' takes in a record
+  template <class T>
+  static size_t argSize(const T &arg)
+  {
+    if constexpr (logTypeCode<T>() == 's')
+    {
+      return sizeof(uint32_t) + std::string_view(arg).length();
+    }
+    else
+    {
+      return sizeof(T);
+    }
+  }
+
+  // @return  false if there's no room for 'len' bytes in the buffer
+  bool reserve(const size_t &len)
+  {
+    return len <= std::numeric_limits<SizeType>::max() && m_buffer.reserve(static_cast<SizeType>(len));
+  }
+
+  template <class T>
+  void putArg(Record &record, const T &arg)
+  {
+    if constexpr (logTypeCode<T>() == 's')
+    {
+      std::string_view str(arg);
+      put(record, static_cast<uint32_t>(str.length()));
+      put(record, str.data(), str.length());
+    }
+    else
+    {
+      put(record, arg);
+    }
+  }
+
+  // @return  false if the buffer didn't accept the whole definition
+  bool define(const uint32_t &id)
+  {
+    auto entry = LogFormatRegistry::get(id);
+    if (!reserve(sizeof(uint32_t) + sizeof(id) + sizeof(uint16_t) + entry.signature.length() +
+                 sizeof(uint32_t) + entry.format.length()))
+    {
+      return false;
+    }
+
+    Record record;
+    put(record, uint32_t(0));
+    put(record, id);
+    put(record, static_cast<uint16_t>(entry.signature.length()));
+    put(record, entry.signature.c_str(), entry.signature.length());
+    put(record, static_cast<uint32_t>(entry.format.length()));
+    put(record, entry.format.c_str(), entry.format.length());
+    if (!write(record))
+    {
+      return false;
+    }
+
+    m_defined.resize(std::max<size_t>(m_defined.size(), id + 1), false);
+    m_defined[id] = true;
+    return true;
+  }
+
+  // Fixed size, so that the copy is inlined
+  template <class T>
+  void put(Record &record, const T &value)
+  {
+    if (record.used + sizeof(T) > sizeof(record.bytes))
+    {
+      write(record);
+    }
+
+    memcpy(record.bytes + record.used, &value, sizeof(T));
+    record.used += sizeof(T);
+  }
+
+  void put(Record &record, const char *data, const size_t &len)
+  {
+    if (record.used + len > sizeof(record.bytes))
+    {
+      write(record);
+      if (len > sizeof(record.bytes))
+      {
+        record.failed |= !write(data, len);
+        return;
+      }
+    }
+
+    memcpy(record.bytes + record.used, data, len);
+    record.used += len;
+  }
+
+  // @return  false if this or an earlier write of the record failed
+  bool write(Record &record)
+  {
+    record.failed |= !write(record.bytes, record.used);
+    record.used = 0;
+    return !record.failed;
+  }
+
+  bool write(const char *data, size_t len)
+  {
+    while (len)
+    {
+      SizeType toWrite = static_cast<SizeType>(std::min<size_t>(len, std::numeric_limits<SizeType>::max()));
+      if (m_buffer.write(data, toWrite) != toWrite)
+      {
+        return false;
+      }
+      data += toWrite;
+      len -= toWrite;
+    }
+
+    return true;
+  }
+
+  SyncIOLazyWriteBuffer<SizeType> &m_buffer;
+  std::vector<bool> m_defined;
+};
+
+// Turns the records written by BinaryLoggers back into text, formatting
+// every argument with its conversion specification through snprintf. The
+// length modifiers of the specifications are ignored, the recorded type of
+// the argument decides
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct BinaryLogDecoder
+{
+  // Highest format id a definition can have, far more formats than a
+  // process registers, so that a corrupt id doesn't size the table of formats
+  static constexpr uint32_t MAX_FORMAT_ID = 1 << 20;
+
+  /**
+   * Decode the next log record, taking in the definitions on the way
+   *
+   * @param buffer      The buffer the records are read through
+   * @param ioInterface The ioInterface to read the records from
+   *
+   * @return            The formatted record, std::nullopt at the end of the
+   *                    stream. Throws std::runtime_error on a truncated
+   *                    record, a record with an unknown id, or a definition
+   *                    with an id out of range(0 or above MAX_FORMAT_ID)
+   **/
+  std::optional<std::string> next(SyncIOReadBuffer<SizeType> &buffer,
+                                  const typename SyncIOReadBuffer<SizeType>::IOInterface &ioInterface)
+  {
+    uint32_t id;
+    while (true)
+    {
+      SizeType len = buffer.read(reinterpret_cast<char *>(&id), sizeof(id), ioInterface);
+      if (!len)
+      {
+        return std::nullopt;
+      }
+
+      readExactly(buffer, ioInterface, reinterpret_cast<char *>(&id) + len, sizeof(id) - len);
+      if (id)
+      {
+        break;
+      }
+
+      uint32_t definedId;
+      uint16_t signatureLen;
+      uint32_t formatLen;
+      readExactly(buffer, ioInterface, reinterpret_cast<char *>(&definedId), sizeof(definedId));
+      if (!definedId || definedId > MAX_FORMAT_ID)
+      {
+        throw std::runtime_error("log format id out of range " + std::to_string(definedId));
+      }
+      readExactly(buffer, ioInterface, reinterpret_cast<char *>(&signatureLen), sizeof(signatureLen));
+      std::string signature(signatureLen, '\0');
+      readExactly(buffer, ioInterface, signature.data(), signatureLen);
+      readExactly(buffer, ioInterface, reinterpret_cast<char *>(&formatLen), sizeof(formatLen));
+      std::string format(formatLen, '\0');
+      readExactly(buffer, ioInterface, format.data(), formatLen);
+      m_formats.resize(std::max<size_t>(m_formats.size(), definedId + 1));
+      m_formats[definedId] = Format{signature, format};
+    }
+
+    if (id >= m_formats.size() || !m_formats[id])
+    {
+      throw std::runtime_error("undefined log format id " + std::to_string(id));
+    }
+
+    return format(*m_formats[id], buffer, ioInterface);
+  }
+
+private:
+  typedef LogFormatRegistry::Entry Format;
+
+  // An argument as it was recorded
+  struct Arg
+  {
+    char type;
+    int64_t i;
+    uint64_t u;
+    double d;
+    std::string s;
+  };
+
+  void readExactly(SyncIOReadBuffer<SizeType> &buffer,
+                   const typename SyncIOReadBuffer<SizeType>::IOInterface &ioInterface,
+                   char *out,
+                   size_t len)
+  {
+    while (len)
+    {
+      SizeType toRead = static_cast<SizeType>(std::min<size_t>(len, std::numeric_limits<SizeType>::max()));
+      SizeType ret = buffer.read(out, toRead, ioInterface);
+      if (!ret)
+      {
+        throw std::runtime_error("truncated log record");
+      }
+      out += ret;
+      len -= ret;
+    }
+  }
+
+  template <class T>
+  T readValue(SyncIOReadBuffer<SizeType> &buffer, const typename SyncIOReadBuffer<SizeType>::IOInterface &ioInterface)
+  {
+    T ret;
+    readExactly(buffer, ioInterface, reinterpret_cast<char *>(&ret), sizeof(ret));
+    return ret;
+  }
+
+  Arg readArg(const char &type,
+              SyncIOReadBuffer<SizeType> &buffer,
+              const typename SyncIOReadBuffer<SizeType>::IOInterface &ioInterface)
+  {
+    Arg ret{type, 0, 0, 0, {}};
+    switch (type)
+    {
+    case 'b': ret.i = readValue<int8_t>(buffer, ioInterface); break;
+    case 'h': ret.i = readValue<int16_t>(buffer, ioInterface); break;
+    case 'i': ret.i = readValue<int32_t>(buffer, ioInterface); break;
+    case 'l': ret.i = readValue<int64_t>(buffer, ioInterface); break;
+    case 'B': ret.u = readValue<uint8_t>(buffer, ioInterface); break;
+    case 'H': ret.u = readValue<uint16_t>(buffer, ioInterface); break;
+    case 'I': ret.u = readValue<uint32_t>(buffer, ioInterface); break;
+    case 'L': ret.u = readValue<uint64_t>(buffer, ioInterface); break;
+    case 'f': ret.d = readValue<float>(buffer, ioInterface); break;
+    case 'd': ret.d = readValue<double>(buffer, ioInterface); break;
+    case 's':
+      ret.s.resize(readValue<uint32_t>(buffer, ioInterface));
+      readExactly(buffer, ioInterface, ret.s.data(), ret.s.length());
+      break;
+    default:
+      throw std::runtime_error(std::string("unknown log argument type ") + type);
+    }
+
+    return ret;
+  }
+
+  std::string format(const Format &format,
+                     SyncIOReadBuffer<SizeType> &buffer,
+                     const typename SyncIOReadBuffer<SizeType>::IOInterface &ioInterface)
+  {
+    std::vector<Arg> args;
+    for (char type : format.signature)
+    {
+      args.push_back(readArg(type, buffer, ioInterface));
+    }
+
+    std::string ret;
+    size_t next = 0;
+    const std::string &text = format.format;
+    for (size_t i = 0; i < text.length(); ++i)
+    {
+      if (text[i] != '%')
+      {
+        ret += text[i];
+        continue;
+      }
+
+      if (i + 1 < text.length() && text[i + 1] == '%')
+      {
+        ret += '%';
+        ++i;
+        continue;
+      }
+
+      // %[flags][width][.precision][length]conversion
+      size_t end = i + 1;
+      std::string spec = "%";
+      while (end < text.length() && strchr("-+ #0", text[end]))
+      {
+        spec += text[end++];
+      }
+      while (end < text.length() && (isdigit(text[end]) || text[end] == '.'))
+      {
+        spec += text[end++];
+      }
+      while (end < text.length() && strchr("hlLqjzt", text[end]))
+      {
+        ++end;
+      }
+
+      if (end == text.length() || next == args.size())
+      {
+        // Malformed, or more specifications than arguments, left as is
+        ret += text.substr(i, end - i + 1);
+        i = end;
+        continue;
+      }
+
+      ret += formatArg(spec, text[end], args[next++]);
+      i = end;
+    }
+
+    return ret;
+  }
+
+  static std::string formatArg(std::string spec, const char &conversion, const Arg &arg)
+  {
+    bool integerConversion = strchr("diouxXc", conversion);
+    bool floatConversion = strchr("fFeEgGaA", conversion);
+    if (arg.type == 's')
+    {
+      return print(spec + 's', arg.s.c_str());
+    }
+    else if (arg.type == 'f' || arg.type == 'd')
+    {
+      if (integerConversion && conversion != 'c')
+      {
+        return print(spec + "ll" + conversion, static_cast<long long>(arg.d));
+      }
+
+      return print(spec + (floatConversion ? conversion : 'g'), arg.d);
+    }
+
+    bool isSigned = islower(arg.type);
+    if (floatConversion)
+    {
+      return print(spec + conversion, isSigned ? static_cast<double>(arg.i) : static_cast<double>(arg.u));
+    }
+    else if (conversion == 'c')
+    {
+      return print(spec + 'c', static_cast<int>(isSigned ? arg.i : arg.u));
+    }
+
+    spec += "ll";
+    spec += integerConversion ? conversion : 'd';
+    return isSigned ? print(spec, static_cast<long long>(arg.i))
+                    : print(spec, static_cast<unsigned long long>(arg.u));
+  }
+
+  template <class T>
+  static std::string print(const std::string &spec, const T &value)
+  {
+    char out[256];
+    int len = snprintf(out, sizeof(out), spec.c_str(), value);
+    if (len < 0)
+    {
+      return {};
+    }
+
+    if (static_cast<size_t>(len) < sizeof(out))
+    {
+      return std::string(out, len);
+    }
+
+    // Too long for the stack(e.g. a long string)
+    std::string ret(len + 1, '\0');
+    snprintf(ret.data(), ret.size(), spec.c_str(), value);
+    ret.resize(len);
+    return ret;
+  }
+
+  std::vector<std::optional<Format>> m_formats;
+};
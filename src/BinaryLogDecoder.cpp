@@ -0,0 +1,54 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "BinaryLog.hpp"
+
+// Turns a stream of BinaryLogger records into text, a line per record
+// Usage: BinaryLogDecoder <binary log file> > text log
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <binary log file>\n";
+    return 1;
+  }
+
+  std::ifstream file(argv[1], std::ios::binary);
+  if (!file)
+  {
+    std::cerr << argv[0] << ": can't open " << argv[1] << "\n";
+    return 1;
+  }
+
+  auto ioFileReader = [&file](char *out, const uint32_t &len)
+  {
+    file.read(out, len);
+    return static_cast<uint32_t>(file.gcount());
+  };
+
+  auto ioConsoleWriter = [](const char *out, const uint32_t &len)
+  {
+    std::cout.write(out, len);
+    return len;
+  };
+
+  SyncIOReadBuffer<uint32_t> readBuffer(1 << 16);
+  SyncIOLazyWriteBuffer<uint32_t> writeBuffer(1 << 16, ioConsoleWriter);
+  BinaryLogDecoder<uint32_t> decoder;
+  try
+  {
+    while (auto line = decoder.next(readBuffer, ioFileReader))
+    {
+      *line += '\n';
+      writeBuffer.write(line->c_str(), line->length());
+    }
+  }
+  catch (const std::runtime_error &e)
+  {
+    writeBuffer.flush();
+    std::cerr << argv[0] << ": " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include "BinaryLog.hpp"
+
+// Hot path cost of a log call, formatting with snprintf into a
+// SyncIOLazyWriteBuffer vs. BinaryLogger writing just the format id and the
+// raw arguments, both written to <output file> as it is, with a
+// <buffer size> buffer. The binary log is decoded afterwards to
+// <output file>.txt, off the hot path
+// Usage: BinaryLogTest <no. of log calls> <buffer size> <output file>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <no. of log calls> <buffer size> <output file>\n";
+    return 1;
+  }
+
+  uint64_t numCalls = atoll(argv[1]);
+  uint32_t buffSize = atoll(argv[2]);
+  std::string path = argv[3];
+  const char *symbols[] = {"AAPL", "MSFT", "GOOG", "AMZN"};
+  const char *format = "order %lu %s filled %u @ %.4f";
+  static const LogFormat<uint64_t, const char *, uint32_t, double> filled(format);
+
+  for (bool binary : {false, true})
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    auto ioFileWriter = [&file](const char *out, const uint32_t &len)
+    {
+      file.write(out, len);
+      return len;
+    };
+
+    uint64_t elapsed;
+    uint64_t bytes;
+    {
+      SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize, ioFileWriter);
+      BinaryLogger<uint32_t> logger(buffer);
+      uint64_t start = now();
+      for (uint64_t i = 0; i < numCalls; ++i)
+      {
+        if (binary)
+        {
+          logger.log(filled, i, symbols[i % 4], static_cast<uint32_t>(i % 1000), i * 0.0001);
+        }
+        else
+        {
+          char line[128];
+          int len = snprintf(line, sizeof(line), format, static_cast<unsigned long>(i), symbols[i % 4], static_cast<uint32_t>(i % 1000), i * 0.0001);
+          line[len++] = '\n';
+          buffer.write(line, len);
+        }
+      }
+      buffer.flush();
+      elapsed = now() - start;
+      bytes = buffer.position();
+    }
+
+    std::cout << (binary ? "BinaryLogger" : "snprintf") << ":\n"
+              << "  Time per call: " << static_cast<double>(elapsed) / numCalls << " ns\n"
+              << "  Bytes per call: " << static_cast<double>(bytes) / numCalls << "\n";
+  }
+
+  // Offline decoding, of the binary log written last
+  std::ifstream in(path, std::ios::binary);
+  std::ofstream out(path + ".txt", std::ios::binary | std::ios::trunc);
+  auto ioFileReader = [&in](char *buff, const uint32_t &len)
+  {
+    in.read(buff, len);
+    return static_cast<uint32_t>(in.gcount());
+  };
+
+  uint64_t start = now();
+  uint64_t lines = 0;
+  SyncIOReadBuffer<uint32_t> readBuffer(buffSize);
+  BinaryLogDecoder<uint32_t> decoder;
+  while (auto line = decoder.next(readBuffer, ioFileReader))
+  {
+    *line += '\n';
+    out.write(line->c_str(), line->length());
+    ++lines;
+  }
+
+  std::cout << "Decoding:\n"
+            << "  Time per line: " << static_cast<double>(now() - start) / lines << " ns\n";
+  return 0;
+}
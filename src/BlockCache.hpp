@@ -0,0 +1,618 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <unistd.h>
+
+// Fixed memory cache of file blocks, shared by any no. of RandomAccessReaders
+// (POSIX only).
+// The frames are split into shards, each with its own lock, map and CLOCK
+// hand, a block always lives in the shard its key hashes to, so readers of
+// different blocks rarely contend. A miss loads the block with pread while
+// holding the shard lock, other shards are unaffected.
+// Files are told apart by their device and inode, so every reader of a file
+// shares its cached blocks. The cache is not told of writes, a block stays
+// as it was loaded, except for a block cut short by the end of file, which
+// is loaded again when bytes past its end are wanted and the file has grown
+// past it since(an fstat per such read). A file that is deleted or replaced
+// has to be forgotten(see forgetFile), its device and inode may be reused.
+struct SharedBlockCache
+{
+  /**
+   *  Constructor
+   *  @param blockSize      Size of a block, throws if 0
+   *  @param capacity       Total memory for the blocks, rounded down to a
+   *                        multiple of blockSize * numShards, throws if that
+   *                        leaves no block per shard
+   *  @param numShards      No. of independently locked shards
+   **/
+  SharedBlockCache(const uint32_t &blockSize,
+                   const uint64_t &capacity,
+                   const uint32_t &numShards = 16) : m_blockSize(blockSize),
+                                                     m_nextFileId(0)
+  {
+    if (!blockSize || !numShards || capacity / blockSize / numShards == 0)
+    {
+      throw std::invalid_argument("capacity should fit at least one block per shard");
+    }
+
+    uint64_t framesPerShard = capacity / blockSize / numShards;
+    m_shards.reserve(numShards);
+    for (uint32_t i = 0; i < numShards; ++i)
+    {
+      m_shards.emplace_back(std::make_unique<Shard>(framesPerShard, blockSize));
+    }
+  }
+
+  /**
+   * Copy bytes of a block into 'out', loading the block on a miss
+   *
+   * @param fileId        Id of the file, from registerFile
+   * @param fd            The file, read with pread on a miss
+   * @param blockNo       No. of the block in the file
+   * @param offsetInBlock Offset of the first byte to copy
+   * @param out           The memory to copy the bytes into
+   * @param len           Max no. of bytes to copy
+   *
+   * @return              No. of bytes copied, less than len if the block
+   *                      ends before(i.e. at the end of file or on an error)
+   **/
+  uint32_t read(const uint64_t &fileId,
+                const int &fd,
+                const uint64_t &blockNo,
+                const uint32_t &offsetInBlock,
+                char *const &out,
+                const uint32_t &len)
+  {
+    Key key{fileId, blockNo};
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Frame &frame = shard.frames[lookup(shard, key, fd, wantedEnd(offsetInBlock, len))];
+    if (offsetInBlock >= frame.length)
+    {
+      return 0;
+    }
+
+    uint32_t toCopy = std::min(len, frame.length - offsetInBlock);
+    memcpy(out, shard.data.get() + frame.index * m_blockSize + offsetInBlock, toCopy);
+    return toCopy;
+  }
+
+  /**
+   * Same as read, but stops right after the first 'ender'
+   *
+   * @param found   Set to true if the 'ender' was met
+   **/
+  uint32_t readUntil(const uint64_t &fileId,
+                     const int &fd,
+                     const uint64_t &blockNo,
+                     const uint32_t &offsetInBlock,
+                     char *const &out,
+                     const uint32_t &len,
+                     const char &ender,
+                     bool &found)
+  {
+    Key key{fileId, blockNo};
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Frame &frame = shard.frames[lookup(shard, key, fd, wantedEnd(offsetInBlock, len))];
+    found = false;
+    if (offsetInBlock >= frame.length)
+    {
+      return 0;
+    }
+
+    const char *start = shard.data.get() + frame.index * m_blockSize + offsetInBlock;
+    uint32_t toCopy = std::min(len, frame.length - offsetInBlock);
+    if (const void *end = memchr(start, ender, toCopy); end)
+    {
+      toCopy = static_cast<const char *>(end) - start + 1;
+      found = true;
+    }
+
+    memcpy(out, start, toCopy);
+    return toCopy;
+  }
+
+  /**
+   * Load a block ahead of its use, no-op if it is already cached
+   **/
+  void prefetch(const uint64_t &fileId, const int &fd, const uint64_t &blockNo)
+  {
+    Key key{fileId, blockNo};
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!shard.map.count(key))
+    {
+      // Not yet used, but it is about to be, don't let it be the next victim
+      shard.frames[load(shard, key, fd)].referenced = true;
+      shard.prefetches.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Id of the file open as 'fd', the same for every fd of the same
+   * file(device and inode), distinct for every other file
+   * throws std::runtime_error if the file can't be stat'ed
+   **/
+  uint64_t registerFile(const int &fd)
+  {
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0)
+    {
+      throw std::runtime_error("unable to stat the file");
+    }
+
+    std::lock_guard<std::mutex> lock(m_filesMutex);
+    auto [it, inserted] = m_files.try_emplace({static_cast<uint64_t>(fileStat.st_dev),
+                                               static_cast<uint64_t>(fileStat.st_ino)},
+                                              m_nextFileId);
+    if (inserted)
+    {
+      ++m_nextFileId;
+    }
+    return it->second;
+  }
+
+  /**
+   * Drop every cached block of a file, and its id, e.g. once the file is
+   * deleted or replaced, as another file may get its device and inode. The
+   * next registerFile of them gets a new id. Readers still using the old id
+   * keep working, their blocks are cached apart
+   **/
+  void forgetFile(const uint64_t &fileId)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_filesMutex);
+      std::erase_if(m_files, [&fileId](const auto &file)
+                    { return file.second == fileId; });
+    }
+
+    for (auto &shard : m_shards)
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      for (auto &frame : shard->frames)
+      {
+        if (frame.valid && frame.key.fileId == fileId)
+        {
+          shard->map.erase(frame.key);
+          frame.valid = false;
+          frame.referenced = false;
+        }
+      }
+    }
+  }
+
+  uint32_t blockSize()
+  {
+    return m_blockSize;
+  }
+
+  uint64_t hits()
+  {
+    uint64_t ret = 0;
+    for (auto &shard : m_shards)
+    {
+      ret += shard->hits.load(std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  uint64_t misses()
+  {
+    uint64_t ret = 0;
+    for (auto &shard : m_shards)
+    {
+      ret += shard->misses.load(std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  uint64_t prefetches()
+  {
+    uint64_t ret = 0;
+    for (auto &shard : m_shards)
+    {
+      ret += shard->prefetches.load(std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  SharedBlockCache(const SharedBlockCache &) = delete;
+  SharedBlockCache &operator=(const SharedBlockCache &) = delete;
+  SharedBlockCache(SharedBlockCache &&) = delete;
+  SharedBlockCache &operator=(SharedBlockCache &&) = delete;
+
+private:
+  struct Key
+  {
+    uint64_t fileId;
+    uint64_t blockNo;
+
+    bool operator==(const Key &) const = default;
+  };
+
+  // Every bit of both the file id and the block no. reaches every bit of
+  // the hash(splitmix64 finalizer)
+  struct KeyHash
+  {
+    size_t operator()(const Key &key) const
+    {
+      uint64_t hash = key.fileId * 0x9E3779B97F4A7C15ull + key.blockNo;
+      hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+      hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+      return hash ^ (hash >> 31);
+    }
+  };
+
+  struct Frame
+  {
+    Key key;
+    uint64_t index;   // Position of the frame's memory in the shard
+    uint32_t length;  // Valid bytes, a block at the end of file is short
+    bool valid;
+    bool referenced;  // CLOCK bit, set on every hit
+  };
+
+  struct Shard
+  {
+    Shard(const uint64_t &numFrames, const uint32_t &blockSize) : data(new char[numFrames * blockSize]),
+                                                                   frames(numFrames),
+                                                                   hand(0),
+                                                                   hits(0),
+                                                                   misses(0),
+                                                                   prefetches(0)
+    {
+      for (uint64_t i = 0; i < numFrames; ++i)
+      {
+        frames[i] = {{0, 0}, i, 0, false, false};
+      }
+    }
+
+    std::mutex mutex;
+    std::unique_ptr<char[]> data;
+    std::vector<Frame> frames;
+    std::unordered_map<Key, uint64_t, KeyHash> map; // key -> frame
+    uint64_t hand;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> prefetches;
+  };
+
+  Shard &shardOf(const Key &key)
+  {
+    // The high bits, the map of the shard buckets by the low ones
+    return *m_shards[(KeyHash()(key) >> 32) % m_shards.size()];
+  }
+
+  // End of the bytes of a block a read wants
+  uint32_t wantedEnd(const uint32_t &offsetInBlock, const uint32_t &len)
+  {
+    return static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(offsetInBlock) + len, m_blockSize));
+  }
+
+  // Frame holding the block, loading it on a miss, shard lock must be held
+  uint64_t lookup(Shard &shard, const Key &key, const int &fd, const uint32_t &wantedEnd)
+  {
+    if (auto it = shard.map.find(key); it != shard.map.end())
+    {
+      Frame &frame = shard.frames[it->second];
+      frame.referenced = true;
+      if (frame.length >= wantedEnd || !grownPast(frame, fd))
+      {
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+      }
+
+      // Cut short by the end of file when loaded, the file has grown since
+      shard.misses.fetch_add(1, std::memory_order_relaxed);
+      fill(shard, it->second, fd);
+      return it->second;
+    }
+
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    return load(shard, key, fd);
+  }
+
+  // The file has bytes past the end of the(short) block of the frame
+  bool grownPast(const Frame &frame, const int &fd)
+  {
+    struct stat fileStat;
+    return fstat(fd, &fileStat) == 0 &&
+           static_cast<uint64_t>(fileStat.st_size) > frame.key.blockNo * m_blockSize + frame.length;
+  }
+
+  // CLOCK: sweep the hand, giving referenced frames a second chance
+  uint64_t load(Shard &shard, const Key &key, const int &fd)
+  {
+    uint64_t victim;
+    while (true)
+    {
+      Frame &frame = shard.frames[shard.hand];
+      victim = shard.hand;
+      shard.hand = (shard.hand + 1) % shard.frames.size();
+      if (!frame.valid || !frame.referenced)
+      {
+        break;
+      }
+      frame.referenced = false;
+    }
+
+    Frame &frame = shard.frames[victim];
+    if (frame.valid)
+    {
+      shard.map.erase(frame.key);
+    }
+
+    frame.key = key;
+    frame.valid = true;
+    frame.referenced = false;
+    shard.map[key] = victim;
+    fill(shard, victim, fd);
+    return victim;
+  }
+
+  // pread the block of a mapped frame into it. On an error the bytes read
+  // are still returned to the caller holding the shard lock, but the frame
+  // is unmapped, so the block is read again on its next use
+  void fill(Shard &shard, const uint64_t &index, const int &fd)
+  {
+    Frame &frame = shard.frames[index];
+    char *dest = shard.data.get() + index * m_blockSize;
+    off_t offset = static_cast<off_t>(frame.key.blockNo * m_blockSize);
+    uint32_t loaded = 0;
+    bool failed = false;
+    while (loaded < m_blockSize)
+    {
+      ssize_t ret = ::pread(fd, dest + loaded, m_blockSize - loaded, offset + loaded);
+      if (ret < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (ret <= 0)
+      {
+        failed = ret < 0;
+        break;
+      }
+      loaded += ret;
+    }
+
+    frame.length = loaded;
+    if (failed)
+    {
+      shard.map.erase(frame.key);
+      frame.valid = false;
+    }
+  }
+
+  const uint32_t m_blockSize;
+  std::mutex m_filesMutex;
+  std::map<std::pair<uint64_t, uint64_t>, uint64_t> m_files; // (device, inode) -> id
+  uint64_t m_nextFileId;
+  std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+// Random access reads from a file through a SharedBlockCache(POSIX only).
+// Unlike SyncIOReadBuffer it has no notion of a current position, every read
+// names its offset. Runs of reads that continue where the previous one ended
+// are detected as sequential access, and the blocks ahead are prefetched.
+// A reader is meant for one thread, the cache can be shared across threads.
+struct RandomAccessReader
+{
+  /**
+   *  Constructor, the fd is borrowed, it is not closed on destruction
+   *  throws std::runtime_error if the file can't be stat'ed
+   *  @param cache            The cache shared with other readers, of this
+   *                          file too
+   *  @param fd               An open file descriptor
+   *  @param readaheadBlocks  No. of blocks to prefetch on sequential access,
+   *                          0 disables readahead
+   **/
+  RandomAccessReader(SharedBlockCache &cache,
+                     const int &fd,
+                     const uint32_t &readaheadBlocks = 4) : RandomAccessReader(cache, fd, false, readaheadBlocks)
+  {
+  }
+
+  /**
+   *  Constructor, opens the file for reading, it is closed on destruction
+   *  throws std::runtime_error if the file can't be opened
+   **/
+  RandomAccessReader(SharedBlockCache &cache,
+                     const char *path,
+                     const uint32_t &readaheadBlocks = 4) : RandomAccessReader(cache, openFile(path), true, readaheadBlocks)
+  {
+  }
+
+  /**
+   * Read bytes at an absolute offset
+   *
+   * @param out     The memory to read the bytes into
+   * @param offset  Absolute offset of the first byte
+   * @param len     No. of bytes to read
+   *
+   * @return        No. of bytes read, less than len only at the end of file
+   **/
+  uint64_t readAt(char *const &out, const uint64_t &offset, const uint64_t &len)
+  {
+    const uint32_t blockSize = m_cache.blockSize();
+    uint64_t ret = 0;
+    while (ret < len)
+    {
+      uint64_t position = offset + ret;
+      uint32_t toRead = static_cast<uint32_t>(std::min<uint64_t>(len - ret, blockSize));
+      uint32_t copied = m_cache.read(m_fileId, m_fd, position / blockSize, position % blockSize, out + ret, toRead);
+      ret += copied;
+      if (copied < std::min<uint64_t>(toRead, blockSize - position % blockSize))
+      {
+        break;
+      }
+    }
+
+    onAccess(offset, offset + ret);
+    return ret;
+  }
+
+  /**
+   * Read bytes at an absolute offset until the character provided as
+   * 'ender' is met(included), the end of file, or 'maxLen' bytes
+   *
+   * @param out     The memory to read the bytes into
+   * @param offset  Absolute offset of the first byte
+   * @param ender   The character marking the end of this read
+   * @param maxLen  Max no. of bytes to read, i.e. the size of 'out'
+   *
+   * @return        No. of bytes read
+   **/
+  uint64_t readUntilAt(char *const &out,
+                       const uint64_t &offset,
+                       const char &ender,
+                       const uint64_t &maxLen)
+  {
+    const uint32_t blockSize = m_cache.blockSize();
+    uint64_t ret = 0;
+    bool found = false;
+    while (ret < maxLen && !found)
+    {
+      uint64_t position = offset + ret;
+      uint32_t toRead = static_cast<uint32_t>(std::min<uint64_t>(maxLen - ret, blockSize));
+      uint32_t copied = m_cache.readUntil(m_fileId, m_fd, position / blockSize, position % blockSize,
+                                          out + ret, toRead, ender, found);
+      ret += copied;
+      if (!found && copied < std::min<uint64_t>(toRead, blockSize - position % blockSize))
+      {
+        break;
+      }
+    }
+
+    onAccess(offset, offset + ret);
+    return ret;
+  }
+
+  // Id of the file in the cache, see SharedBlockCache::forgetFile
+  uint64_t fileId()
+  {
+    return m_fileId;
+  }
+
+  ~RandomAccessReader()
+  {
+    if (m_owned)
+    {
+      ::close(m_fd);
+    }
+  }
+
+  RandomAccessReader(const RandomAccessReader &) = delete;
+  RandomAccessReader &operator=(const RandomAccessReader &) = delete;
+  RandomAccessReader(RandomAccessReader &&) = delete;
+  RandomAccessReader &operator=(RandomAccessReader &&) = delete;
+
+private:
+  // Reads continuing where the previous one ended, for a few reads in a row,
+  // are taken as sequential access
+  static constexpr uint32_t SEQUENTIAL_THRESHOLD = 2;
+
+  RandomAccessReader(SharedBlockCache &cache,
+                     const int &fd,
+                     const bool &owned,
+                     const uint32_t &readaheadBlocks) : m_cache(cache),
+                                                        m_fd(fd),
+                                                        m_owned(owned),
+                                                        m_fileId(fileIdOf(cache, fd, owned)),
+                                                        m_readaheadBlocks(readaheadBlocks),
+                                                        m_lastEnd(UINT64_MAX),
+                                                        m_sequentialRun(0),
+                                                        m_prefetchedTill(0)
+  {
+  }
+
+  static int openFile(const char *path)
+  {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+      throw std::runtime_error("unable to open the file");
+    }
+    return fd;
+  }
+
+  // The fd is not left open if the constructor throws
+  static uint64_t fileIdOf(SharedBlockCache &cache, const int &fd, const bool &owned)
+  {
+    try
+    {
+      return cache.registerFile(fd);
+    }
+    catch (...)
+    {
+      if (owned)
+      {
+        ::close(fd);
+      }
+      throw;
+    }
+  }
+
+  void onAccess(const uint64_t &start, const uint64_t &end)
+  {
+    if (start == m_lastEnd)
+    {
+      ++m_sequentialRun;
+    }
+    else
+    {
+      m_sequentialRun = 0;
+      m_prefetchedTill = 0;
+    }
+    m_lastEnd = end;
+
+    if (!m_readaheadBlocks || m_sequentialRun < SEQUENTIAL_THRESHOLD)
+    {
+      return;
+    }
+
+    // Keep the window of m_readaheadBlocks blocks past the current one
+    // cached, every block is prefetched only once per run
+    const uint32_t blockSize = m_cache.blockSize();
+    uint64_t block = std::max(end / blockSize + 1, m_prefetchedTill);
+    uint64_t windowEnd = end / blockSize + 1 + m_readaheadBlocks;
+    if (block >= windowEnd)
+    {
+      return;
+    }
+
+    // Nothing to prefetch past the end of file
+    struct stat fileStat;
+    if (fstat(m_fd, &fileStat) < 0)
+    {
+      return;
+    }
+    uint64_t blocksInFile = (static_cast<uint64_t>(fileStat.st_size) + blockSize - 1) / blockSize;
+
+    for (; block < std::min(windowEnd, blocksInFile); ++block)
+    {
+      m_cache.prefetch(m_fileId, m_fd, block);
+    }
+    m_prefetchedTill = windowEnd;
+  }
+
+  SharedBlockCache &m_cache;
+  int m_fd;
+  bool m_owned;
+  const uint64_t m_fileId;
+  const uint32_t m_readaheadBlocks;
+  uint64_t m_lastEnd;
+  uint32_t m_sequentialRun;
+  uint64_t m_prefetchedTill;
+};
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <sys/stat.h>
+#include "BlockCache.hpp"
+
+// Hit rate and latency of RandomAccessReader over a SharedBlockCache under a
+// Zipf distributed access pattern
+// Usage: BlockCacheTest <file> <block size> <cache MB> <threads> <reads per thread> <zipf exponent> <seed>
+int main(int argc, char **argv)
+{
+  if (argc < 8)
+  {
+    std::cerr << "Usage: " << argv[0]
+              << " <file> <block size> <cache MB> <threads> <reads per thread> <zipf exponent> <seed>\n";
+    return 1;
+  }
+
+  const char *path = argv[1];
+  uint32_t blockSize = atoll(argv[2]);
+  uint64_t cacheBytes = atoll(argv[3]) * (1ull << 20);
+  uint32_t numThreads = atoll(argv[4]);
+  uint32_t numReads = atoll(argv[5]);
+  double exponent = atof(argv[6]);
+  uint64_t seed = atoll(argv[7]);
+  const uint32_t readLen = 128;
+
+  struct stat fileStat;
+  if (stat(path, &fileStat) < 0 || !fileStat.st_size)
+  {
+    std::cerr << "Unable to stat " << path << "\n";
+    return 1;
+  }
+  uint64_t numBlocks = (fileStat.st_size + blockSize - 1) / blockSize;
+
+  // Zipf over ranks, ranks scattered over the blocks of the file
+  std::vector<double> cdf(numBlocks);
+  double sum = 0;
+  for (uint64_t rank = 0; rank < numBlocks; ++rank)
+  {
+    sum += 1.0 / std::pow(rank + 1, exponent);
+    cdf[rank] = sum;
+  }
+  std::vector<uint64_t> blockOfRank(numBlocks);
+  for (uint64_t i = 0; i < numBlocks; ++i)
+  {
+    blockOfRank[i] = i;
+  }
+  std::shuffle(blockOfRank.begin(), blockOfRank.end(), std::mt19937_64(seed));
+
+  SharedBlockCache cache(blockSize, cacheBytes);
+  std::vector<std::vector<uint32_t>> latencies(numThreads);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::high_resolution_clock().now();
+  for (uint32_t t = 0; t < numThreads; ++t)
+  {
+    threads.emplace_back(
+        [&, t]()
+        {
+          RandomAccessReader reader(cache, path);
+          std::mt19937_64 rng(seed + t + 1);
+          std::uniform_real_distribution<double> uniform(0, sum);
+          char out[readLen];
+          latencies[t].reserve(numReads);
+          for (uint32_t i = 0; i < numReads; ++i)
+          {
+            uint64_t rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+            uint64_t offset = std::min<uint64_t>(blockOfRank[std::min(rank, numBlocks - 1)] * blockSize + rng() % blockSize,
+                                                 fileStat.st_size - 1);
+            auto readStart = std::chrono::steady_clock::now();
+            reader.readAt(out, offset, readLen);
+            latencies[t].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - readStart)
+                                       .count());
+          }
+        });
+  }
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+
+  std::vector<uint32_t> all;
+  for (auto &threadLatencies : latencies)
+  {
+    all.insert(all.end(), threadLatencies.begin(), threadLatencies.end());
+  }
+  std::sort(all.begin(), all.end());
+
+  double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+  uint64_t hits = cache.hits(), misses = cache.misses();
+  std::cout << "Blocks in file: " << numBlocks << ", in cache: " << cacheBytes / blockSize << "\n"
+            << "Hit rate:       " << 100.0 * hits / (hits + misses) << " %\n"
+            << "Reads/s:        " << all.size() / seconds << "\n"
+            << "Latency p50:    " << all[all.size() / 2] << " ns\n"
+            << "Latency p99:    " << all[all.size() * 99 / 100] << " ns\n"
+            << "Latency p99.9:  " << all[all.size() * 999 / 1000] << " ns\n";
+  return 0;
+}
@@ -0,0 +1,226 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include "BufferStats.hpp"
+#include "LineIndex.hpp"
+#include "ReceiveTimestamps.hpp"
+
+// Compile time policies of SyncIOReadBuffer and SyncIOLazyWriteBuffer, the
+// defaults(HeapStorage, AttachableStats, NoLock) are what the buffers always
+// did. A policy that isn't used is an empty struct held with
+// [[no_unique_address]] and the code for it is behind if constexpr, so it
+// costs neither memory nor time
+
+// StoragePolicy: where the memory of a buffer is. A storage policy has
+// data(), allocated(), allocate(size), release() and a static fits(size)
+
+// The memory is malloced, either at construction or lazily(see Allocation),
+// and can be given back by releaseIfIdle
+struct HeapStorage
+{
+  HeapStorage() : m_data(nullptr)
+  {
+  }
+
+  HeapStorage(HeapStorage &&other) noexcept : m_data(std::exchange(other.m_data, nullptr))
+  {
+  }
+
+  HeapStorage &operator=(HeapStorage &&other) noexcept
+  {
+    if (this != &other)
+    {
+      free(m_data);
+      m_data = std::exchange(other.m_data, nullptr);
+    }
+
+    return *this;
+  }
+
+  ~HeapStorage()
+  {
+    free(m_data);
+  }
+
+  char *data()
+  {
+    return m_data;
+  }
+
+  bool allocated()
+  {
+    return m_data != nullptr;
+  }
+
+  void allocate(const size_t &size)
+  {
+    if (!m_data)
+    {
+      m_data = reinterpret_cast<char *>(malloc(size));
+    }
+  }
+
+  // true if there was anything to release
+  bool release()
+  {
+    if (!m_data)
+    {
+      return false;
+    }
+
+    free(m_data);
+    m_data = nullptr;
+    return true;
+  }
+
+  static constexpr bool fits(const size_t &)
+  {
+    return true;
+  }
+
+private:
+  char *m_data;
+};
+
+// The memory is inside the buffer object, for buffers of at most N bytes,
+// nothing is ever allocated or released. Moving the buffer copies it
+template <size_t N>
+struct InlineStorage
+{
+  char *data()
+  {
+    return m_data;
+  }
+
+  bool allocated()
+  {
+    return true;
+  }
+
+  void allocate(const size_t &)
+  {
+  }
+
+  bool release()
+  {
+    return false;
+  }
+
+  static constexpr bool fits(const size_t &size)
+  {
+    return size <= N;
+  }
+
+private:
+  char m_data[N];
+};
+
+// StatsPolicy: what can be attached to a buffer to observe it. The
+// StatsPolicy that exports to a StatsSlot, ExportedStats, is in
+// StatsExporter.hpp
+struct StatsSlot;
+
+// What a StatsSlot is being used for
+enum class SlotKind : uint32_t
+{
+  FREE,
+  READ,
+  WRITE
+};
+
+// Why a SyncIOLazyWriteBuffer started draining to its ioInterface
+enum class FlushCause
+{
+  FULL,     // write/tryWrite ran out of room
+  EXPLICIT, // flush/tryFlush
+  CLOSE     // Destruction, or being assigned to
+};
+
+// A LineIndex, a TimestampRing and BufferStats can each be attached at
+// runtime, see SyncIOReadBuffer::setLineIndex, setTimestamps and setStats,
+// every consuming call checks for the ones its StatsPolicy allows. They are
+// independent of each other: a buffer can have a LineIndex and no stats
+// (Attachable<true, false, false>). The residency of BufferStats is recorded
+// only if a TimestampRing can be attached too
+struct AttachedLineIndex
+{
+  LineIndex *lineIndex = nullptr;
+};
+
+struct AttachedTimestamps
+{
+  TimestampRing *timestamps = nullptr;
+};
+
+struct AttachedStats
+{
+  BufferStats *stats = nullptr;
+};
+
+// Stands for an attachment that isn't allowed, a type per attachment so
+// that none of them takes room
+template <uint32_t>
+struct NotAttached
+{
+};
+
+template <bool LineIndexes, bool Timestamps, bool Stats>
+struct Attachable : std::conditional_t<LineIndexes, AttachedLineIndex, NotAttached<0>>,
+                    std::conditional_t<Timestamps, AttachedTimestamps, NotAttached<1>>,
+                    std::conditional_t<Stats, AttachedStats, NotAttached<2>>
+{
+  static constexpr bool LINE_INDEX = LineIndexes;
+  static constexpr bool TIMESTAMPS = Timestamps;
+  static constexpr bool STATS = Stats;
+  static constexpr bool EXPORTED = false;
+};
+
+// All of them can be attached
+typedef Attachable<true, true, true> AttachableStats;
+
+// Nothing can be attached, the checks are compiled away
+typedef Attachable<false, false, false> NoStats;
+
+// LockPolicy: whether the public methods of a buffer lock it. guard()
+// returns what holds the lock till the end of the scope
+
+// Not thread safe
+struct NoLock
+{
+  struct Guard
+  {
+  };
+
+  Guard guard()
+  {
+    return {};
+  }
+};
+
+// Every public method holds a std::mutex, so a buffer can be shared by
+// threads, e.g. a log written to by many. Moves are not synchronized
+struct MutexLock
+{
+  MutexLock() = default;
+  // The mutex stays with the object, a moved-to buffer gets a new one
+  MutexLock(MutexLock &&) noexcept
+  {
+  }
+
+  MutexLock &operator=(MutexLock &&) noexcept
+  {
+    return *this;
+  }
+
+  std::lock_guard<std::mutex> guard()
+  {
+    return std::lock_guard<std::mutex>(m_mutex);
+  }
+
+private:
+  std::mutex m_mutex;
+};
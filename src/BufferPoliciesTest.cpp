@@ -0,0 +1,108 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "SmartBuffer.hpp"
+#ifdef __linux__
+#include "StatsExporter.hpp"
+#endif
+
+// ns per record of <records> newline ended records of about 64 bytes, read
+// through SyncIOReadBuffer::readUntil and written through
+// SyncIOLazyWriteBuffer::write, with buffers of 4 KB, for each combination
+// of policies:
+// default - HeapStorage, AttachableStats(nothing attached), NoLock
+// nostats - HeapStorage, NoStats, NoLock
+// inline  - InlineStorage<4096>, NoStats, NoLock
+// mutex   - HeapStorage, AttachableStats, MutexLock(uncontended)
+// exported - HeapStorage, ExportedStats exporting to a StatsExporter, NoLock
+//            (Linux only)
+// Usage: BufferPoliciesTest <records>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static constexpr uint32_t SIZE = 4096;
+
+// 'attach' is called with the buffers before they are used
+template <class ReadBuffer, class WriteBuffer, class Attach>
+static void run(const char *name, const std::string &input, const Attach &attach)
+{
+  uint64_t records = 0, written = 0;
+  uint32_t offset = 0;
+  auto source = [&](char *out, const uint32_t &len)
+  {
+    uint32_t toRead = std::min<uint32_t>(len, input.length() - offset);
+    memcpy(out, input.c_str() + offset, toRead);
+    offset += toRead;
+    return toRead;
+  };
+
+  auto sink = [&written](const char *, const uint32_t &len)
+  {
+    written += len;
+    return len;
+  };
+
+  std::vector<char> record(SIZE);
+  uint64_t start = now();
+  {
+    ReadBuffer in(SIZE);
+    WriteBuffer out(SIZE, sink);
+    attach(in, out);
+    while (uint32_t len = in.readUntil(record.data(), source, '\n'))
+    {
+      out.write(record.data(), len);
+      ++records;
+    }
+  }
+  uint64_t elapsed = now() - start;
+
+  if (written != input.length())
+  {
+    std::cerr << "Unexpected no. of bytes written\n";
+  }
+  std::cout << name << "\t" << sizeof(ReadBuffer) << "\t" << sizeof(WriteBuffer) << "\t"
+            << static_cast<double>(elapsed) / records << "\n";
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <records>\n";
+    return 1;
+  }
+
+  uint64_t numRecords = atoll(argv[1]);
+  std::string input;
+  for (uint64_t i = 0; i < numRecords; ++i)
+  {
+    input += std::string(48 + i % 32, 'a' + i % 26) + "\n";
+  }
+
+  auto nothing = [](auto &, auto &) {};
+  std::cout << "Policies\tsizeof(read)\tsizeof(write)\tns/record\n";
+  run<SyncIOReadBuffer<uint32_t>,
+      SyncIOLazyWriteBuffer<uint32_t>>("default", input, nothing);
+  run<SyncIOReadBuffer<uint32_t, HeapStorage, NoStats>,
+      SyncIOLazyWriteBuffer<uint32_t>>("nostats", input, nothing);
+  run<SyncIOReadBuffer<uint32_t, InlineStorage<SIZE>, NoStats>,
+      SyncIOLazyWriteBuffer<uint32_t, InlineStorage<SIZE>>>("inline", input, nothing);
+  run<SyncIOReadBuffer<uint32_t, HeapStorage, AttachableStats, MutexLock>,
+      SyncIOLazyWriteBuffer<uint32_t, HeapStorage, MutexLock>>("mutex", input, nothing);
+#ifdef __linux__
+  StatsExporter exporter("/BufferPoliciesTest", 2);
+  StatsSlot *inSlot = exporter.add("in");
+  StatsSlot *outSlot = exporter.add("out");
+  run<SyncIOReadBuffer<uint32_t, HeapStorage, ExportedStats>,
+      SyncIOLazyWriteBuffer<uint32_t, HeapStorage, NoLock, ExportedStats>>("exported", input, [&](auto &in, auto &out)
+                                                                           {
+                                                                             in.setExport(inSlot);
+                                                                             out.setExport(outSlot); });
+#endif
+  return 0;
+}
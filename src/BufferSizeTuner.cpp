@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "SmartBuffer.hpp"
+
+// Picks the buffer size for a workload instead of guessing it: the lines of
+// <file> are run through a buffer of every size from MIN_SIZE to MAX_SIZE in
+// powers of 2(or till the size exceeds the file):
+// reader - read with SyncIOReadBuffer::readUntil from the file
+// writer - written with SyncIOLazyWriteBuffer::write to /dev/null, from
+//          memory
+// Every size is run REPETITIONS times, each run in a process of its own(this
+// tool, exec'd with --run) so its max RSS is its own, in an order shuffled
+// by [seed], the same seed gives the same runs in the same order. Measured:
+// throughput, no. of read/write calls, max RSS and the buffer occupancy at
+// every call, the record lengths come from a profiling pass with BufferStats
+// attached.
+// The recommendation is the smallest size whose median throughput is within
+// TOLERANCE of the best, and that holds the 99th percentile record. It is
+// printed as a config snippet, and written to [config file] if given
+// Usage: BufferSizeTuner <file> <reader|writer> [seed] [config file]
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static constexpr uint32_t MIN_SIZE = 256;
+static constexpr uint32_t MAX_SIZE = 1 << 20;
+static constexpr uint32_t REPETITIONS = 3;
+static constexpr double TOLERANCE = 0.05;
+
+// What a run reports back through a pipe
+struct Run
+{
+  uint64_t ns;
+  uint64_t calls;
+  uint64_t occupancyP50;
+  uint64_t occupancyP99;
+  int64_t maxRssKB;
+};
+
+static Run readFile(const char *path, const uint32_t &size, const uint64_t &maxRecord)
+{
+  int fd = open(path, O_RDONLY);
+  Run run{};
+  BufferStats stats;
+  SyncIOReadBuffer<uint32_t> buffer(size);
+  buffer.setStats(&stats);
+  SyncIOReadBuffer<uint32_t>::IOInterface source = [&](char *out, const uint32_t &len)
+  {
+    ++run.calls;
+    ssize_t ret = ::read(fd, out, len);
+    return ret > 0 ? static_cast<uint32_t>(ret) : 0;
+  };
+
+  std::vector<char> record(maxRecord);
+  uint64_t start = now();
+  while (buffer.readUntil(record.data(), source, '\n'))
+    ;
+  run.ns = now() - start;
+  run.occupancyP50 = stats.occupancy.percentile(50);
+  run.occupancyP99 = stats.occupancy.percentile(99);
+  close(fd);
+  return run;
+}
+
+// The write buffer keeps no stats, the occupancy is sampled at every call
+// to the ioInterface
+static Run writeFile(const char *path, const uint32_t &size)
+{
+  std::ifstream file(path, std::ios::binary);
+  std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  int fd = open("/dev/null", O_WRONLY);
+  Run run{};
+  LatencyHistogram occupancy;
+  SyncIOLazyWriteBuffer<uint32_t> *buffer = nullptr;
+  SyncIOLazyWriteBuffer<uint32_t>::IOInterface sink = [&](const char *out, const uint32_t &len)
+  {
+    ++run.calls;
+    occupancy.record(buffer->position() - buffer->flushedPosition());
+    ssize_t ret = ::write(fd, out, len);
+    return ret > 0 ? static_cast<uint32_t>(ret) : 0;
+  };
+
+  uint64_t start = now();
+  {
+    SyncIOLazyWriteBuffer<uint32_t> writeBuffer(size, sink);
+    buffer = &writeBuffer;
+    const char *record = content.c_str();
+    const char *end = record + content.length();
+    while (record < end)
+    {
+      const char *ender = reinterpret_cast<const char *>(memchr(record, '\n', end - record));
+      const char *next = ender ? ender + 1 : end;
+      writeBuffer.write(record, next - record);
+      record = next;
+    }
+  }
+  run.ns = now() - start;
+  run.occupancyP50 = occupancy.percentile(50);
+  run.occupancyP99 = occupancy.percentile(99);
+  close(fd);
+  return run;
+}
+
+// A run of this tool with --run, in a fresh process
+static Run inChild(const char *path, const std::string &mode, const uint32_t &size, const uint64_t &maxRecord)
+{
+  int fds[2];
+  if (pipe(fds))
+  {
+    throw std::runtime_error("pipe failed");
+  }
+
+  pid_t pid = fork();
+  if (!pid)
+  {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[1]);
+    std::string sizeArg = std::to_string(size), maxRecordArg = std::to_string(maxRecord);
+    execl("/proc/self/exe", "BufferSizeTuner", "--run", path, mode.c_str(), sizeArg.c_str(), maxRecordArg.c_str(), nullptr);
+    _exit(1);
+  }
+
+  close(fds[1]);
+  Run run{};
+  bool received = ::read(fds[0], &run, sizeof(run)) == sizeof(run);
+  close(fds[0]);
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid || !received || !WIFEXITED(status) || WEXITSTATUS(status))
+  {
+    throw std::runtime_error("run failed");
+  }
+
+  run.maxRssKB = usage.ru_maxrss;
+  return run;
+}
+
+// --run <file> <reader|writer> <size> <max record>
+static int runOnce(char **argv)
+{
+  std::string mode = argv[3];
+  uint32_t size = atoll(argv[4]);
+  Run run = mode == "reader" ? readFile(argv[2], size, atoll(argv[5])) : writeFile(argv[2], size);
+  return ::write(STDOUT_FILENO, &run, sizeof(run)) == sizeof(run) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 6 && std::string(argv[1]) == "--run")
+  {
+    return runOnce(argv);
+  }
+
+  if (argc < 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " <file> <reader|writer> [seed] [config file]\n";
+    return 1;
+  }
+
+  const char *path = argv[1];
+  std::string mode = argv[2];
+  uint32_t seed = argc > 3 ? atoll(argv[3]) : 1;
+  if (mode != "reader" && mode != "writer")
+  {
+    std::cerr << "Unknown mode " << mode << "\n";
+    return 1;
+  }
+
+  // Profiling pass, the lengths of the records
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Couldn't open " << path << "\n";
+    return 1;
+  }
+
+  BufferStats profile;
+  uint64_t fileSize = 0, numRecords = 0;
+  {
+    SyncIOReadBuffer<uint32_t> buffer(MAX_SIZE);
+    buffer.setStats(&profile);
+    SyncIOReadBuffer<uint32_t>::IOInterface source = [fd](char *out, const uint32_t &len)
+    {
+      ssize_t ret = ::read(fd, out, len);
+      return ret > 0 ? static_cast<uint32_t>(ret) : 0;
+    };
+
+    while (uint64_t len = buffer.skipUntil(source, '\n'))
+    {
+      fileSize += len;
+      ++numRecords;
+    }
+  }
+  close(fd);
+
+  if (!fileSize)
+  {
+    std::cerr << "Nothing to read from " << path << "\n";
+    return 1;
+  }
+  uint64_t recordP99 = profile.recordLength.percentile(99);
+
+  std::vector<uint32_t> sizes;
+  for (uint64_t size = MIN_SIZE; size <= MAX_SIZE && size / 2 < fileSize; size *= 2)
+  {
+    sizes.push_back(size);
+  }
+
+  std::vector<uint32_t> order;
+  for (uint32_t repetition = 0; repetition < REPETITIONS; ++repetition)
+  {
+    order.insert(order.end(), sizes.begin(), sizes.end());
+  }
+  std::mt19937 random(seed);
+  std::shuffle(order.begin(), order.end(), random);
+
+  std::vector<std::vector<Run>> runs(sizes.size());
+  for (auto &size : order)
+  {
+    auto index = std::find(sizes.begin(), sizes.end(), size) - sizes.begin();
+    runs[index].push_back(inChild(path, mode, size, profile.recordLength.max()));
+  }
+
+  std::cout << numRecords << " records, length p50/p99/max "
+            << profile.recordLength.percentile(50) << "/" << recordP99 << "/" << profile.recordLength.max() << " bytes\n";
+  std::cout << "Size\tMB/s\tCalls\tMax RSS(KB)\tOccupancy p50/p99\n";
+  std::vector<double> throughput(sizes.size());
+  for (size_t i = 0; i < sizes.size(); ++i)
+  {
+    auto &sizeRuns = runs[i];
+    std::sort(sizeRuns.begin(), sizeRuns.end(), [](const Run &a, const Run &b)
+              { return a.ns < b.ns; });
+    const Run &median = sizeRuns[sizeRuns.size() / 2];
+    throughput[i] = static_cast<double>(fileSize) * 1000 / median.ns;
+    std::cout << sizes[i] << "\t" << throughput[i] << "\t" << median.calls << "\t" << median.maxRssKB << "\t"
+              << median.occupancyP50 << "/" << median.occupancyP99 << "\n";
+  }
+
+  double best = *std::max_element(throughput.begin(), throughput.end());
+  size_t chosen = sizes.size() - 1;
+  for (size_t i = 0; i < sizes.size(); ++i)
+  {
+    if (throughput[i] >= best * (1 - TOLERANCE) && sizes[i] >= recordP99)
+    {
+      chosen = i;
+      break;
+    }
+  }
+
+  std::string snippet = "// BufferSizeTuner " + std::string(path) + " " + mode + " " + std::to_string(seed) + "\n" +
+                        "// " + std::to_string(static_cast<uint64_t>(throughput[chosen])) + " MB/s, " +
+                        std::to_string(runs[chosen][0].calls) + " calls, p99 record " + std::to_string(recordP99) + " bytes\n" +
+                        "constexpr uint32_t " + (mode == "reader" ? "READ" : "WRITE") + "_BUFFER_SIZE = " +
+                        std::to_string(sizes[chosen]) + ";\n";
+  std::cout << "\n" << snippet;
+  if (argc > 4)
+  {
+    std::ofstream config(argv[4]);
+    config << snippet;
+    if (!config)
+    {
+      std::cerr << "Couldn't write " << argv[4] << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+// Histogram of non-negative values(e.g. latencies in ns) with a bounded
+// relative error: the values are bucketed by their power of 2, and every
+// power of 2 is split into SUB_BUCKETS linear buckets, so a bucket is at most
+// 1/SUB_BUCKETS of its values wide. Fixed size, recording is a couple of
+// shifts and an increment, no allocation
+struct LatencyHistogram
+{
+  static constexpr unsigned SUB_BUCKET_BITS = 3;
+  static constexpr unsigned SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr unsigned NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram()
+  {
+    reset();
+  }
+
+  void record(const uint64_t &value)
+  {
+    ++m_counts[bucketOf(value)];
+    ++m_count;
+    m_sum += value;
+    m_max = std::max(m_max, value);
+  }
+
+  /**
+   * The value below which 'percent' % of the recorded values fall, as the
+   * upper bound of the bucket it falls in
+   *
+   * @return  0 if nothing has been recorded
+   **/
+  uint64_t percentile(const double &percent)
+  {
+    if (!m_count)
+    {
+      return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(m_count * percent / 100 + 0.5));
+    uint64_t seen = 0;
+    for (unsigned bucket = 0; bucket < NUM_BUCKETS; ++bucket)
+    {
+      if ((seen += m_counts[bucket]) >= rank)
+      {
+        return std::min(upperBoundOf(bucket), m_max);
+      }
+    }
+
+    return m_max;
+  }
+
+  uint64_t count()
+  {
+    return m_count;
+  }
+
+  uint64_t max()
+  {
+    return m_max;
+  }
+
+  double mean()
+  {
+    return m_count ? static_cast<double>(m_sum) / m_count : 0;
+  }
+
+  void reset()
+  {
+    m_counts.fill(0);
+    m_count = m_sum = m_max = 0;
+  }
+
+  // Values below SUB_BUCKETS get a bucket each, from there on each power of 2
+  // gets SUB_BUCKETS of them
+  static unsigned bucketOf(const uint64_t &value)
+  {
+    if (value < SUB_BUCKETS)
+    {
+      return static_cast<unsigned>(value);
+    }
+
+    unsigned exponent = 63 - std::countl_zero(value);
+    unsigned subBucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+  }
+
+  static uint64_t upperBoundOf(const unsigned &bucket)
+  {
+    if (bucket < SUB_BUCKETS)
+    {
+      return bucket;
+    }
+
+    unsigned exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t subBucket = bucket % SUB_BUCKETS;
+    uint64_t width = uint64_t(1) << (exponent - SUB_BUCKET_BITS);
+    return (uint64_t(1) << exponent) + (subBucket + 1) * width - 1;
+  }
+
+private:
+  std::array<uint64_t, NUM_BUCKETS> m_counts;
+  uint64_t m_count;
+  uint64_t m_sum;
+  uint64_t m_max;
+};
+
+// Statistics a buffer can be asked to keep(see SyncIOReadBuffer::setStats),
+// the buffer only borrows it, so it can be read(and reset) by the owner at
+// any time from the thread using the buffer
+struct BufferStats
+{
+  // ns from the paste that brought the bytes into a read buffer till they
+  // were consumed, one sample per run of bytes consumed between refills of
+  // the buffer(i.e. per consuming call, plus one per refill the call made),
+  // needs receive timestamps(see TimestampRing)
+  LatencyHistogram residency;
+  // Bytes of every record consumed through readUntil, tryReadUntil or
+  // skipUntil, including the ender, to size the buffer by
+  LatencyHistogram recordLength;
+  // Bytes buffered right after every read from the IOInterface, how much of
+  // the buffer is actually used
+  LatencyHistogram occupancy;
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include "SmartBuffer.hpp"
+
+// Test-only access to the private ring primitives of SyncIOReadBuffer and
+// SyncIOLazyWriteBuffer, so that the tests and the microbenchmarks
+// (RingPrimitivesTest) can check and time each of them in isolation. It
+// bypasses the LockPolicy and the invariants the public methods keep, not
+// for use outside of tests and benchmarks
+struct BufferTestAccess
+{
+  /**
+   *  Put a read buffer into a given layout, allocating its memory if needed
+   *  @param buffer    The buffer
+   *  @param tail      Offset of the first buffered byte
+   *  @param occupied  No. of buffered bytes, from tail onwards, wrapping
+   *                   around the end, <= capacity
+   **/
+  template <class SizeType, class StoragePolicy, class StatsPolicy, class LockPolicy>
+  static void place(SyncIOReadBuffer<SizeType, StoragePolicy, StatsPolicy, LockPolicy> &buffer,
+                    const SizeType &tail,
+                    const SizeType &occupied)
+  {
+    typedef typename SyncIOReadBuffer<SizeType, StoragePolicy, StatsPolicy, LockPolicy>::LastOperation LastOperation;
+    buffer.m_storage.allocate(buffer.m_size);
+    buffer.m_tail = tail;
+    buffer.m_head = (tail + occupied) % buffer.m_size;
+    buffer.m_lastOperation = occupied ? LastOperation::PASTE : LastOperation::COPY;
+  }
+
+  // Same for a write buffer
+  template <class SizeType, class StoragePolicy, class LockPolicy>
+  static void place(SyncIOLazyWriteBuffer<SizeType, StoragePolicy, LockPolicy> &buffer,
+                    const SizeType &tail,
+                    const SizeType &occupied)
+  {
+    typedef typename SyncIOLazyWriteBuffer<SizeType, StoragePolicy, LockPolicy>::LastOperation LastOperation;
+    buffer.m_storage.allocate(buffer.m_size);
+    buffer.m_tail = tail;
+    buffer.m_head = (tail + occupied) % buffer.m_size;
+    buffer.m_lastOperation = occupied ? LastOperation::PUT : LastOperation::FLUSH;
+  }
+
+  // Start a write buffer at 'position', as if that many bytes had been
+  // written and flushed already(a read buffer has reset for that)
+  template <class Buffer>
+  static void seek(Buffer &buffer, const uint64_t &position)
+  {
+    buffer.m_position = buffer.m_flushedPosition = position;
+  }
+
+  // The memory of the buffer, nullptr if not allocated
+  template <class Buffer>
+  static char *data(Buffer &buffer)
+  {
+    return buffer.m_storage.data();
+  }
+
+  template <class Buffer>
+  static auto occupiedBytes(Buffer &buffer)
+  {
+    return buffer.occupiedBytes();
+  }
+
+  template <class Buffer, class SizeType>
+  static void copy(Buffer &buffer, char *const &out, const SizeType &len)
+  {
+    buffer.copy(out, len);
+  }
+
+  template <class Buffer, class SizeType>
+  static void put(Buffer &buffer, const char *out, const SizeType &len)
+  {
+    buffer.put(out, len);
+  }
+
+  template <class Buffer>
+  static auto paste(Buffer &buffer, const typename Buffer::IOInterface &ioInterface)
+  {
+    return buffer.paste(ioInterface);
+  }
+
+  template <class Buffer, class SizeType>
+  static auto pasteFromInterface(Buffer &buffer,
+                                 const typename Buffer::IOInterface &ioInterface,
+                                 const SizeType &len)
+  {
+    return buffer.pasteFromInterface(ioInterface, len);
+  }
+
+  // The private findLengthTill, without the LockPolicy
+  template <class Buffer, class Ender>
+  static auto findLengthTill(Buffer &buffer, const Ender &ender)
+  {
+    return buffer.scan(ender);
+  }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Busy polling for the latency critical readers(see FdSource::setBusyPoll,
+// ShmRing::setBusyPoll): instead of going to sleep in the kernel and paying
+// for the wakeup, the reader spins checking for data, and parks(blocks) only
+// if nothing shows up within the spin budget
+struct BusyPollOptions
+{
+  // Upper bound of the spin budget, in polls, the budget adapts between
+  // minSpins and maxSpins. std::numeric_limits<uint64_t>::max() spins
+  // forever
+  uint64_t maxSpins = 1 << 16;
+  uint64_t minSpins = 1 << 6;
+  // Block once the budget is used up, otherwise keep spinning
+  bool park = true;
+  // Pin the thread calling setBusyPoll to this cpu, -1 leaves it alone.
+  // A spinning reader wants a core of its own
+  int cpu = -1;
+};
+
+// Tells the cpu that this is a spin loop(x86 pause, arm yield), which frees
+// up the pipeline for the sibling hyperthread and avoids the memory order
+// mis-speculation when the spin ends
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Pin the calling thread to 'cpu'
+// @return  false if the affinity couldn't be set
+inline bool pinToCpu(const int &cpu)
+{
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return !sched_setaffinity(0, sizeof(cpus), &cpus);
+#else
+  return false;
+#endif
+}
+
+// Spin-then-park helper with an adaptive budget. The budget grows to twice
+// the no. of polls it took for the data to show up, to have a margin, and
+// shrinks every time spinning didn't help, so a source that goes quiet for
+// long stretches doesn't burn the core for the full budget every time.
+// Every PROBE_INTERVALth wait spins the full maxSpins, so a budget that
+// shrank too far recovers once the source gets busy again
+struct SpinWaiter
+{
+  static constexpr uint64_t PROBE_INTERVAL = 16;
+
+  SpinWaiter(const BusyPollOptions &options = BusyPollOptions()) : m_options(options),
+                                                                   m_budget(options.maxSpins),
+                                                                   m_waits(0)
+  {
+  }
+
+  /**
+   * Poll 'ready' until it returns true or the spin budget is used up
+   *
+   * @return  true if ready, false if the caller should park. Never false
+   *          if parking is disabled
+   **/
+  template <class Ready>
+  bool spin(const Ready &ready)
+  {
+    uint64_t limit = ++m_waits % PROBE_INTERVAL ? m_budget : m_options.maxSpins;
+    uint64_t spins = 0;
+    while (spins < limit || !m_options.park)
+    {
+      if (ready())
+      {
+        m_budget = std::clamp(std::max(m_budget, spins * 2), m_options.minSpins, m_options.maxSpins);
+        return true;
+      }
+
+      cpuRelax();
+      ++spins;
+    }
+
+    m_budget = std::max(m_budget - m_budget / 8, m_options.minSpins);
+    return false;
+  }
+
+  // Current spin budget, in polls
+  uint64_t budget()
+  {
+    return m_budget;
+  }
+
+  const BusyPollOptions &options()
+  {
+    return m_options;
+  }
+
+private:
+  BusyPollOptions m_options;
+  uint64_t m_budget;
+  uint64_t m_waits;
+};
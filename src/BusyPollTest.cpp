@@ -0,0 +1,136 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "FdSource.hpp"
+#include "ShmRing.hpp"
+
+// Wakeup latency of a reader blocking in the kernel vs. busy polling, over a
+// pipe(FdSource) and a ShmRing. The writer sends a timestamp every
+// <interval> us, so the reader is idle(waiting) when each one arrives.
+// Busy polling needs a core of its own, give the reader one with <reader cpu>
+// Usage: BusyPollTest <no. of messages> <interval between messages in us> <reader cpu, -1 for none>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void report(const char *name, std::vector<uint64_t> &latencies)
+{
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << name << ":\n"
+            << "  Latency p50: " << latencies[latencies.size() / 2] << " ns\n"
+            << "  Latency p99: " << latencies[latencies.size() * 99 / 100] << " ns\n";
+}
+
+// The writer runs in its own thread, 'write' sends 8 bytes, 'done' ends the
+// stream. The reader reads the timestamps through a SyncIOReadBuffer
+static std::vector<uint64_t> run(const uint32_t &numMessages,
+                                 const uint32_t &interval,
+                                 const std::function<void(const char *)> &write,
+                                 const std::function<void()> &done,
+                                 const SyncIOReadBuffer<uint32_t>::IOInterface &ioInterface)
+{
+  std::thread writer(
+      [&]()
+      {
+        for (uint32_t i = 0; i < numMessages; ++i)
+        {
+          std::this_thread::sleep_for(std::chrono::microseconds(interval));
+          uint64_t sentAt = now();
+          write(reinterpret_cast<const char *>(&sentAt));
+        }
+        done();
+      });
+
+  std::vector<uint64_t> ret;
+  ret.reserve(numMessages);
+  SyncIOReadBuffer<uint32_t> buffer(1 << 12);
+  uint64_t sentAt;
+  while (buffer.read(reinterpret_cast<char *>(&sentAt), sizeof(sentAt), ioInterface) == sizeof(sentAt))
+  {
+    ret.push_back(now() - sentAt);
+  }
+
+  writer.join();
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <no. of messages> <interval between messages in us> <reader cpu, -1 for none>\n";
+    return 1;
+  }
+
+  uint32_t numMessages = atoll(argv[1]);
+  uint32_t interval = atoll(argv[2]);
+  BusyPollOptions options;
+  options.cpu = atoi(argv[3]);
+
+  for (bool busyPoll : {false, true})
+  {
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+      std::cerr << "pipe failed\n";
+      return 1;
+    }
+
+    FdSource source(fds[0]);
+    if (busyPoll && !source.setBusyPoll(options))
+    {
+      std::cerr << "Unable to set up busy polling\n";
+      return 1;
+    }
+    auto latencies = run(
+        numMessages, interval,
+        [&](const char *data)
+        {
+          if (::write(fds[1], data, sizeof(uint64_t)) < 0)
+          {
+            std::cerr << "write failed\n";
+          }
+        },
+        [&]()
+        {
+          ::close(fds[1]);
+        },
+        std::ref(source));
+    ::close(fds[0]);
+    report(busyPoll ? "pipe, busy poll" : "pipe, blocking", latencies);
+  }
+
+  for (bool busyPoll : {false, true})
+  {
+    int fd = ShmRing::create(1 << 16);
+    ShmRing writerRing(fd), readerRing(fd);
+    ::close(fd);
+    if (busyPoll && !readerRing.setBusyPoll(options))
+    {
+      std::cerr << "Unable to set up busy polling\n";
+      return 1;
+    }
+    auto latencies = run(
+        numMessages, interval,
+        [&](const char *data)
+        {
+          writerRing.write(data, static_cast<uint32_t>(sizeof(uint64_t)));
+        },
+        [&]()
+        {
+          writerRing.close();
+        },
+        [&readerRing](char *out, const uint32_t &len)
+        {
+          return readerRing.read(out, len);
+        });
+    report(busyPoll ? "ShmRing, busy poll" : "ShmRing, blocking", latencies);
+  }
+  return 0;
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include <stdio.h>
+#include <sys/types.h>
+#include <limits>
+#include <memory>
+#include "SmartBuffer.hpp"
+
+// Exposes SyncIOReadBuffer/SyncIOLazyWriteBuffer as a stdio FILE*, so that
+// code which only speaks FILE*(fprintf, fgets, fread...) can go through our
+// buffers. Relies on glibc's fopencookie, so it is only available on Linux.
+//
+// The FILE* returned is unbuffered(_IONBF), stdio hands every call straight to
+// the cookie functions, so each byte is buffered exactly once, in our buffer.
+template <class SizeType>
+requires std::unsigned_integral<SizeType>
+struct CFileAdapter
+{
+  typedef SyncIOReadBuffer<SizeType> ReadBuffer;
+  typedef SyncIOLazyWriteBuffer<SizeType> WriteBuffer;
+
+  /**
+   * Wrap an existing SyncIOLazyWriteBuffer into a writable FILE*
+   * The buffer is borrowed, it has to outlive the FILE*.
+   * fclose() flushes the buffer to its IOInterface, fflush() does not, as
+   * stdio has nothing buffered of its own, call flush() on the buffer instead
+   *
+   * @param buffer  The buffer all the writes on the FILE* go through
+   *
+   * @return        The FILE*, nullptr if fopencookie fails
+   **/
+  static FILE *open(WriteBuffer &buffer)
+  {
+    return openWriter(new WriterCookie{nullptr, &buffer});
+  }
+
+  /**
+   * Create a SyncIOLazyWriteBuffer owned by the returned FILE*
+   * The buffer is flushed and destroyed on fclose()
+   *
+   * @param size        Size of the Buffer, throws if size is 0
+   * @param ioInterface The synchronous IOInterface to write bytes to
+   *
+   * @return            The FILE*, nullptr if fopencookie fails
+   **/
+  static FILE *openWriter(const SizeType &size,
+                          const typename WriteBuffer::IOInterface &ioInterface)
+  {
+    auto owned = std::make_unique<WriteBuffer>(size, ioInterface);
+    WriteBuffer *buffer = owned.get();
+    return openWriter(new WriterCookie{std::move(owned), buffer});
+  }
+
+  /**
+   * Wrap an existing SyncIOReadBuffer into a readable FILE*
+   * The buffer is borrowed, it has to outlive the FILE*.
+   *
+   * @param buffer      The buffer all the reads on the FILE* go through
+   * @param ioInterface The synchronous IOInterface the buffer reads from
+   *
+   * @return            The FILE*, nullptr if fopencookie fails
+   **/
+  static FILE *open(ReadBuffer &buffer,
+                    const typename ReadBuffer::IOInterface &ioInterface)
+  {
+    return openReader(new ReaderCookie{nullptr, &buffer, ioInterface});
+  }
+
+  /**
+   * Create a SyncIOReadBuffer owned by the returned FILE*
+   * The buffer is destroyed on fclose()
+   *
+   * @param size        Size of the Buffer, throws if size is 0
+   * @param ioInterface The synchronous IOInterface to read bytes from
+   *
+   * @return            The FILE*, nullptr if fopencookie fails
+   **/
+  static FILE *openReader(const SizeType &size,
+                          const typename ReadBuffer::IOInterface &ioInterface)
+  {
+    auto owned = std::make_unique<ReadBuffer>(size);
+    ReadBuffer *buffer = owned.get();
+    return openReader(new ReaderCookie{std::move(owned), buffer, ioInterface});
+  }
+
+private:
+  struct WriterCookie
+  {
+    std::unique_ptr<WriteBuffer> owned;
+    WriteBuffer *buffer;
+  };
+
+  struct ReaderCookie
+  {
+    std::unique_ptr<ReadBuffer> owned;
+    ReadBuffer *buffer;
+    typename ReadBuffer::IOInterface ioInterface;
+  };
+
+  static FILE *openWriter(WriterCookie *cookie)
+  {
+    cookie_io_functions_t functions = {nullptr, &onWrite, nullptr, &onWriterClose};
+    return finishOpen(fopencookie(cookie, "w", functions), cookie);
+  }
+
+  static FILE *openReader(ReaderCookie *cookie)
+  {
+    cookie_io_functions_t functions = {&onRead, nullptr, nullptr, &onReaderClose};
+    return finishOpen(fopencookie(cookie, "r", functions), cookie);
+  }
+
+  template <class Cookie>
+  static FILE *finishOpen(FILE *file, Cookie *cookie)
+  {
+    if (!file)
+    {
+      delete cookie;
+      return nullptr;
+    }
+
+    // Our buffer is the only buffer
+    setvbuf(file, nullptr, _IONBF, 0);
+    return file;
+  }
+
+  // stdio treats a short write as an error, so the whole of 'size' has to be
+  // accepted, SyncIOLazyWriteBuffer::write only returns less when its
+  // IOInterface fails
+  static ssize_t onWrite(void *cookie, const char *buf, size_t size)
+  {
+    WriteBuffer &buffer = *static_cast<WriterCookie *>(cookie)->buffer;
+    size_t written = 0;
+    while (written < size)
+    {
+      SizeType chunk = static_cast<SizeType>(
+          std::min<size_t>(size - written, std::numeric_limits<SizeType>::max()));
+      SizeType ret = buffer.write(buf + written, chunk);
+      written += ret;
+      if (ret < chunk)
+      {
+        break;
+      }
+    }
+
+    return written ? static_cast<ssize_t>(written) : -1;
+  }
+
+  static ssize_t onRead(void *cookie, char *buf, size_t size)
+  {
+    ReaderCookie &readerCookie = *static_cast<ReaderCookie *>(cookie);
+    SizeType chunk = static_cast<SizeType>(
+        std::min<size_t>(size, std::numeric_limits<SizeType>::max()));
+    return readerCookie.buffer->read(buf, chunk, readerCookie.ioInterface);
+  }
+
+  static int onWriterClose(void *cookie)
+  {
+    WriterCookie *writerCookie = static_cast<WriterCookie *>(cookie);
+    writerCookie->buffer->flush();
+    delete writerCookie;
+    return 0;
+  }
+
+  static int onReaderClose(void *cookie)
+  {
+    delete static_cast<ReaderCookie *>(cookie);
+    return 0;
+  }
+};
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include "CFileAdapter.hpp"
+
+// Compares fprintf through a plain fopen FILE* with fprintf through a FILE*
+// wrapping SyncIOLazyWriteBuffer
+// Usage: CFileAdapterTest <buffer size> <no. of lines> <output file>
+static double measure(const std::function<void()> &work)
+{
+  auto start = std::chrono::high_resolution_clock().now();
+  work();
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+}
+
+static void writeLines(FILE *file, uint32_t numLines)
+{
+  for (uint32_t i = 0; i < numLines; ++i)
+  {
+    fprintf(file, "%u %u %s\n", i, i * 7, "some payload");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <buffer size> <no. of lines> <output file>\n";
+    return 1;
+  }
+
+  uint32_t buffSize = atoll(argv[1]);
+  uint32_t numLines = atoll(argv[2]);
+  const char *path = argv[3];
+
+  double stdioDuration = measure(
+      [&]()
+      {
+        FILE *file = fopen(path, "w");
+        setvbuf(file, nullptr, _IOFBF, buffSize);
+        writeLines(file, numLines);
+        fclose(file);
+      });
+
+  double adapterDuration = measure(
+      [&]()
+      {
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        auto fdWriter =
+            [fd](const char *out, const uint32_t &len)
+        {
+          ssize_t ret = ::write(fd, out, len);
+          return static_cast<uint32_t>(ret < 0 ? 0 : ret);
+        };
+
+        FILE *file = CFileAdapter<uint32_t>::openWriter(buffSize, fdWriter);
+        writeLines(file, numLines);
+        fclose(file);
+        ::close(fd);
+      });
+
+  std::cout << "fopen FILE*:        " << stdioDuration << " s\n"
+            << "CFileAdapter FILE*: " << adapterDuration << " s\n";
+  return 0;
+}
@@ -0,0 +1,264 @@
+#pragma once
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <string.h>
+#include "SmartBuffer.hpp"
+
+// SyncIOLazyWriteBuffer cut down for millions of small buffers(e.g. one per
+// key), where the bookkeeping of a buffer rivals its payload:
+// - The IOInterface is borrowed, a sink shared by all the buffers instead of
+//   a std::function per buffer
+// - Whether a buffer with m_head == m_tail is full or empty is the top bit of
+//   m_capacity instead of a LastOperation, so the size has to fit in the
+//   rest of the bits, e.g. at most 32767 with uint16_t as SizeType
+// - No positions, onDirty callback or non-blocking mode
+//
+// sizeof is 24 bytes with uint16_t, 32 with uint32_t(vs. 120 for a
+// SyncIOLazyWriteBuffer<uint32_t>). Same behaviour as SyncIOLazyWriteBuffer
+// otherwise, including Allocation::LAZY and releaseIfIdle, minus the idle
+// sweep count: releaseIfIdle frees the memory of any empty buffer
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct CompactLazyWriteBuffer
+{
+  typedef std::function<SizeType(const char *, const SizeType &)> IOInterface;
+
+  /**
+   *  Constructor
+   *  @param size         Size of the Buffer, throws if 0 or if the top bit of
+   *                      SizeType is set
+   *  @param sink         The IOInterface to write bytes to, borrowed, it has to
+   *                      outlive the buffer, many buffers may share it
+   *  @param allocation   When to allocate the memory of the buffer
+   **/
+  CompactLazyWriteBuffer(const SizeType &size,
+                         const IOInterface &sink,
+                         const Allocation &allocation = Allocation::EAGER) : m_outBuff(nullptr),
+                                                                             m_sink(&sink),
+                                                                             m_tail(0),
+                                                                             m_head(0),
+                                                                             m_capacity(size)
+  {
+    if (!size || (size & FULL))
+    {
+      throw std::invalid_argument("size should  be passed as a positive integer below 2^(bits in SizeType - 1)");
+    }
+
+    if (allocation == Allocation::EAGER)
+    {
+      m_outBuff = reinterpret_cast<char *>(malloc(size));
+    }
+  }
+
+  // The sink is borrowed, a temporary wouldn't outlive the buffer
+  CompactLazyWriteBuffer(const SizeType &size,
+                         IOInterface &&sink,
+                         const Allocation &allocation = Allocation::EAGER) = delete;
+
+  /**
+   *  Same as SyncIOLazyWriteBuffer::write
+   *  @return     No. of bytes accepted, less than len only if the sink
+   *              stopped accepting bytes
+   **/
+  SizeType write(const char *out, const SizeType &len)
+  {
+    SizeType ret = 0;
+    while (true)
+    {
+      SizeType toPut = std::min<SizeType>(len - ret, freeBytes());
+      put(out + ret, toPut);
+      ret += toPut;
+      if (ret == len || !drain(std::min<SizeType>(len - ret, capacity())))
+      {
+        break;
+      }
+    }
+
+    return ret;
+  }
+
+  // Same as SyncIOLazyWriteBuffer::flush
+  SizeType flush()
+  {
+    return drain(occupiedBytes());
+  }
+
+  // Same as SyncIOLazyWriteBuffer::flush(atLeast)
+  SizeType flush(const SizeType &atLeast)
+  {
+    return drain(atLeast);
+  }
+
+  bool empty()
+  {
+    return occupiedBytes() == 0;
+  }
+
+  SizeType size()
+  {
+    return occupiedBytes();
+  }
+
+  SizeType capacity()
+  {
+    return m_capacity & ~FULL;
+  }
+
+  /**
+   *  Give the memory of the buffer back to the allocator if the buffer is
+   *  empty, it is allocated again by the next write
+   *
+   *  @return true if the memory was released by this call
+   **/
+  bool releaseIfIdle()
+  {
+    if (!m_outBuff || occupiedBytes())
+    {
+      return false;
+    }
+
+    free(m_outBuff);
+    m_outBuff = nullptr;
+    return true;
+  }
+
+  // Whether the buffer holds its memory right now
+  bool allocated()
+  {
+    return m_outBuff != nullptr;
+  }
+
+  ~CompactLazyWriteBuffer()
+  {
+    flush();
+    free(m_outBuff);
+  }
+
+  CompactLazyWriteBuffer(const CompactLazyWriteBuffer &) = delete;
+  CompactLazyWriteBuffer &operator=(const CompactLazyWriteBuffer &) = delete;
+
+  // 'other' is left empty and without memory, still writing to the same sink
+  CompactLazyWriteBuffer(CompactLazyWriteBuffer &&other) noexcept : m_outBuff(std::exchange(other.m_outBuff, nullptr)),
+                                                                    m_sink(other.m_sink),
+                                                                    m_tail(std::exchange(other.m_tail, 0)),
+                                                                    m_head(std::exchange(other.m_head, 0)),
+                                                                    m_capacity(other.m_capacity)
+  {
+    other.m_capacity &= ~FULL;
+  }
+
+  // The bytes buffered by this buffer are flushed first, as on destruction
+  CompactLazyWriteBuffer &operator=(CompactLazyWriteBuffer &&other)
+  {
+    if (this != &other)
+    {
+      flush();
+      free(m_outBuff);
+      m_outBuff = std::exchange(other.m_outBuff, nullptr);
+      m_sink = other.m_sink;
+      m_tail = std::exchange(other.m_tail, 0);
+      m_head = std::exchange(other.m_head, 0);
+      m_capacity = other.m_capacity;
+      other.m_capacity &= ~FULL;
+    }
+
+    return *this;
+  }
+
+private:
+  static constexpr SizeType FULL = SizeType(1) << (std::numeric_limits<SizeType>::digits - 1);
+
+  // Same as SyncIOLazyWriteBuffer::put, assumes that len <= freeBytes()
+  void put(const char *outData, const SizeType &len)
+  {
+    if (!len)
+    {
+      return;
+    }
+
+    if (!m_outBuff)
+    {
+      m_outBuff = reinterpret_cast<char *>(malloc(capacity()));
+    }
+
+    SizeType size = capacity();
+    if (m_head < m_tail ||
+        len <= size - m_head)
+    {
+      memcpy(m_outBuff + m_head, outData, len);
+      m_head = (m_head + len) % size;
+    }
+    else
+    {
+      const SizeType l1 = size - m_head;
+      const SizeType l2 = len - l1;
+      memcpy(m_outBuff + m_head, outData, l1);
+      memcpy(m_outBuff, outData + l1, l2);
+      m_head = l2;
+    }
+
+    if (m_head == m_tail)
+    {
+      m_capacity |= FULL;
+    }
+  }
+
+  // Same as SyncIOLazyWriteBuffer::drain
+  SizeType drain(const SizeType &atLeast)
+  {
+    SizeType ret = 0;
+    SizeType size = capacity();
+    SizeType toDrain = std::min<SizeType>(atLeast, occupiedBytes());
+    while (ret < toDrain)
+    {
+      SizeType toWrite = m_tail < m_head ? m_head - m_tail : size - m_tail;
+      SizeType written = (*m_sink)(m_outBuff + m_tail, toWrite);
+      if (!written)
+      {
+        break;
+      }
+
+      m_tail = (m_tail + written) % size;
+      m_capacity &= ~FULL;
+      ret += written;
+      if (m_tail == m_head)
+      {
+        m_tail = m_head = 0;
+      }
+    }
+
+    return ret;
+  }
+
+  SizeType occupiedBytes()
+  {
+    if (m_tail == m_head)
+    {
+      return m_capacity & FULL ? capacity() : 0;
+    }
+    else if (m_tail < m_head)
+    {
+      return m_head - m_tail;
+    }
+    else
+    {
+      return capacity() - (m_tail - m_head);
+    }
+  }
+
+  SizeType freeBytes()
+  {
+    return capacity() - occupiedBytes();
+  }
+
+  char *m_outBuff;
+  const IOInterface *m_sink;
+  SizeType m_tail;
+  SizeType m_head;
+  // The size, with FULL set when the buffer is full
+  SizeType m_capacity;
+};
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include "CompactBuffer.hpp"
+
+// Bytes per buffer of <buffers> per-key write buffers of <buffer size>
+// bytes, all writing into one sink, and the time per write of 16 byte
+// records to random keys. One type per run, RSS is per process:
+// sync      - SyncIOLazyWriteBuffer<uint32_t>
+// compact32 - CompactLazyWriteBuffer<uint32_t>
+// compact16 - CompactLazyWriteBuffer<uint16_t>
+// Usage: CompactBufferTest <sync|compact32|compact16> <buffers> <buffer size> <writes>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static uint64_t rssKB()
+{
+  uint64_t pages = 0, resident = 0;
+  if (FILE *statm = fopen("/proc/self/statm", "r"))
+  {
+    if (fscanf(statm, "%lu %lu", &pages, &resident) != 2)
+    {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+template <class Buffer, class MakeBuffer>
+static int run(const uint32_t &numBuffers, const uint64_t &numWrites, const MakeBuffer &makeBuffer)
+{
+  uint64_t baseline = rssKB();
+  std::vector<Buffer> buffers;
+  buffers.reserve(numBuffers);
+  for (uint32_t i = 0; i < numBuffers; ++i)
+  {
+    buffers.emplace_back(makeBuffer());
+  }
+  uint64_t rss = rssKB();
+  rss -= std::min(rss, baseline);
+
+  std::mt19937 random(42);
+  const char record[16] = "0123456789abcde";
+  uint64_t start = now();
+  for (uint64_t i = 0; i < numWrites; ++i)
+  {
+    buffers[random() % numBuffers].write(record, sizeof(record));
+  }
+  uint64_t elapsed = now() - start;
+
+  std::cout << "sizeof\t" << sizeof(Buffer) << " bytes\n"
+            << "RSS\t" << rss * 1024 / numBuffers << " bytes/buffer\n"
+            << "write\t" << static_cast<double>(elapsed) / numWrites << " ns\n";
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 5)
+  {
+    std::cerr << "Usage: " << argv[0] << " <sync|compact32|compact16> <buffers> <buffer size> <writes>\n";
+    return 1;
+  }
+
+  std::string type = argv[1];
+  uint32_t numBuffers = atoll(argv[2]);
+  uint32_t size = atoll(argv[3]);
+  uint64_t numWrites = atoll(argv[4]);
+  uint64_t written = 0;
+  auto count = [&written](const char *, const auto &len)
+  {
+    written += len;
+    return len;
+  };
+
+  std::cout << type << ", " << numBuffers << " buffers of " << size << " bytes\n";
+  if (type == "sync")
+  {
+    return run<SyncIOLazyWriteBuffer<uint32_t>>(numBuffers, numWrites, [&]()
+                                                { return SyncIOLazyWriteBuffer<uint32_t>(size, count); });
+  }
+  else if (type == "compact32")
+  {
+    CompactLazyWriteBuffer<uint32_t>::IOInterface sink = count;
+    return run<CompactLazyWriteBuffer<uint32_t>>(numBuffers, numWrites, [&]()
+                                                 { return CompactLazyWriteBuffer<uint32_t>(size, sink); });
+  }
+  else if (type == "compact16")
+  {
+    CompactLazyWriteBuffer<uint16_t>::IOInterface sink = count;
+    return run<CompactLazyWriteBuffer<uint16_t>>(numBuffers, numWrites, [&]()
+                                                 { return CompactLazyWriteBuffer<uint16_t>(size, sink); });
+  }
+
+  std::cerr << "Unknown type " << type << "\n";
+  return 1;
+}
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <chrono>
+#include "SmartBuffer.hpp"
+
+// A table of <connections> connections, each a SyncIOReadBuffer and a
+// SyncIOLazyWriteBuffer(lazily allocated, so only the structs take memory),
+// kept by value in a std::vector against one of std::unique_ptr, allocated
+// in random order as connections come and go. Timed: a sweep over all of
+// them(as for idle release or flush deadlines) and random lookups, each
+// <rounds> times
+// Usage: ConnectionTableTest <connections> <rounds>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct Connection
+{
+  Connection(const uint64_t &id) : id(id),
+                                   in(4096, Allocation::LAZY),
+                                   out(4096, [](const char *, const uint32_t &len)
+                                       { return len; },
+                                       Allocation::LAZY)
+  {
+  }
+
+  uint64_t id;
+  SyncIOReadBuffer<uint32_t> in;
+  SyncIOLazyWriteBuffer<uint32_t> out;
+};
+
+static Connection &get(Connection &connection)
+{
+  return connection;
+}
+
+static Connection &get(std::unique_ptr<Connection> &connection)
+{
+  return *connection;
+}
+
+// ns per connection visited, a sweep and random lookups
+template <class Table>
+static std::pair<double, double> run(Table &table,
+                                     const std::vector<uint32_t> &lookups,
+                                     const uint32_t &rounds)
+{
+  uint64_t sum = 0;
+  uint64_t start = now();
+  for (uint32_t round = 0; round < rounds; ++round)
+  {
+    for (auto &connection : table)
+    {
+      Connection &c = get(connection);
+      sum += c.id + c.in.size() + c.out.position();
+    }
+  }
+  double sweep = static_cast<double>(now() - start) / rounds / table.size();
+
+  start = now();
+  for (uint32_t round = 0; round < rounds; ++round)
+  {
+    for (auto &index : lookups)
+    {
+      Connection &c = get(table[index]);
+      sum += c.id + c.in.size() + c.out.position();
+    }
+  }
+  double lookup = static_cast<double>(now() - start) / rounds / lookups.size();
+
+  if (!sum)
+  {
+    std::cerr << "Unexpected sum\n";
+  }
+  return {sweep, lookup};
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " <connections> <rounds>\n";
+    return 1;
+  }
+
+  uint32_t numConnections = atoll(argv[1]);
+  uint32_t rounds = atoll(argv[2]);
+  std::mt19937 random(42);
+  std::vector<uint32_t> lookups(numConnections);
+  for (auto &index : lookups)
+  {
+    index = random() % numConnections;
+  }
+
+  // Grown without reserve, the connections are moved on every reallocation
+  std::vector<Connection> byValue;
+  for (uint32_t i = 0; i < numConnections; ++i)
+  {
+    byValue.emplace_back(i);
+  }
+
+  // Allocated in one order, kept in another
+  std::vector<std::unique_ptr<Connection>> byPointer;
+  byPointer.reserve(numConnections);
+  for (uint32_t i = 0; i < numConnections; ++i)
+  {
+    byPointer.emplace_back(std::make_unique<Connection>(i));
+  }
+  std::shuffle(byPointer.begin(), byPointer.end(), random);
+
+  std::cout << "sizeof(Connection): " << sizeof(Connection) << " bytes\n";
+  std::cout << "Table\tSweep(ns/connection)\tLookup(ns/connection)\n";
+  auto [sweep, lookup] = run(byValue, lookups, rounds);
+  std::cout << "Inline\t" << sweep << "\t" << lookup << "\n";
+  std::tie(sweep, lookup) = run(byPointer, lookups, rounds);
+  std::cout << "unique_ptr\t" << sweep << "\t" << lookup << "\n";
+  return 0;
+}
@@ -0,0 +1,327 @@
+#pragma once
+#include <concepts>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <sys/socket.h>
+
+// Message framed counterparts of SyncIOReadBuffer and SyncIOLazyWriteBuffer
+// for datagram sockets(Linux only), where every datagram is a message and
+// the boundaries between them matter. Instead of a call per datagram, the
+// reader receives a whole batch of datagrams with one recvmmsg and the writer
+// sends all the queued messages with one sendmmsg
+
+// IOInterface of the datagram buffers, receives/sends up to 'len' datagrams
+// using the provided headers, e.g. recvmmsg/sendmmsg on a socket
+// @return  No. of datagrams received/sent, <= 0 if none
+typedef std::function<int(mmsghdr *, const unsigned &)> DatagramIOInterface;
+
+/**
+ * Reader side IOInterface on a socket, blocks till at least 1 datagram
+ * arrives and then takes whatever else is already queued(MSG_WAITFORONE)
+ **/
+inline DatagramIOInterface recvmmsgInterface(const int &fd)
+{
+  return [fd](mmsghdr *msgs, const unsigned &len)
+  {
+    return recvmmsg(fd, msgs, len, MSG_WAITFORONE, nullptr);
+  };
+}
+
+/**
+ * Writer side IOInterface on a connected socket
+ **/
+inline DatagramIOInterface sendmmsgInterface(const int &fd)
+{
+  return [fd](mmsghdr *msgs, const unsigned &len)
+  {
+    return sendmmsg(fd, msgs, len, 0);
+  };
+}
+
+// Reads datagrams a batch at a time. The buffer is an array of 'batch'
+// slots, each one a length prefix followed by room for the largest
+// datagram expected:
+//
+// m_readBuff |len|datagram.......|len|datagram.......|len|datagram.......|
+//             <---- slot 0 ----->
+//
+// A batch is received only once all the datagrams of the previous one are
+// read, so the slots are always filled from the start
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct DatagramReadBuffer
+{
+  /**
+   *  Constructor
+   *  @param maxDatagramSize  Size of the largest datagram expected, a bigger
+   *                          one is truncated to this size, throws if 0
+   *  @param batch            Max. no. of datagrams received per call to the
+   *                          ioInterface, throws if 0
+   **/
+  DatagramReadBuffer(const SizeType &maxDatagramSize,
+                     const unsigned &batch = 64) : m_maxDatagramSize(maxDatagramSize),
+                                                   m_slotSize(sizeof(SizeType) + maxDatagramSize),
+                                                   m_batch(batch),
+                                                   m_readBuff(reinterpret_cast<char *>(malloc(static_cast<size_t>(m_slotSize) * batch))),
+                                                   m_msgs(batch),
+                                                   m_iovecs(batch),
+                                                   m_next(0),
+                                                   m_count(0),
+                                                   m_truncated(0)
+  {
+    if (!maxDatagramSize || !batch)
+    {
+      throw std::invalid_argument("maxDatagramSize and batch should  be passed as positive integers");
+    }
+
+    for (unsigned i = 0; i < batch; ++i)
+    {
+      m_iovecs[i] = {m_readBuff + slot(i) + sizeof(SizeType), maxDatagramSize};
+    }
+  }
+
+  /**
+   * The next datagram, without copying it, receives the next batch if
+   * all the datagrams received earlier are already read
+   *
+   * @param ioInterface The ioInterface to receive the datagrams from, see
+   *                    DatagramIOInterface
+   *
+   * @return            The datagram, valid until the next call, std::nullopt
+   *                    if the ioInterface didn't receive anything
+   **/
+  std::optional<std::string_view> next(const DatagramIOInterface &ioInterface)
+  {
+    if (m_next == m_count && !paste(ioInterface))
+    {
+      return std::nullopt;
+    }
+
+    const char *entry = m_readBuff + slot(m_next++);
+    SizeType len;
+    memcpy(&len, entry, sizeof(SizeType));
+    return std::string_view(entry + sizeof(SizeType), len);
+  }
+
+  /**
+   * Read the next datagram into 'out'
+   *
+   * @param out         The memory to read the datagram into, at least
+   *                    maxDatagramSize bytes
+   * @param ioInterface The ioInterface to receive the datagrams from, see
+   *                    DatagramIOInterface
+   *
+   * @return            Length of the datagram(0 is a valid length),
+   *                    std::nullopt if the ioInterface didn't receive anything
+   **/
+  std::optional<SizeType> read(char *const &out, const DatagramIOInterface &ioInterface)
+  {
+    auto datagram = next(ioInterface);
+    if (!datagram)
+    {
+      return std::nullopt;
+    }
+
+    memcpy(out, datagram->data(), datagram->length());
+    return static_cast<SizeType>(datagram->length());
+  }
+
+  // No. of datagrams received but not yet read
+  unsigned pending()
+  {
+    return m_count - m_next;
+  }
+
+  // No. of datagrams truncated to maxDatagramSize so far
+  uint64_t truncated()
+  {
+    return m_truncated;
+  }
+
+  ~DatagramReadBuffer()
+  {
+    free(m_readBuff);
+  }
+
+  DatagramReadBuffer(const DatagramReadBuffer &) = delete;
+  DatagramReadBuffer &operator=(const DatagramReadBuffer &) = delete;
+  DatagramReadBuffer(DatagramReadBuffer &&) = delete;
+  DatagramReadBuffer &operator=(DatagramReadBuffer &&) = delete;
+
+private:
+  size_t slot(const unsigned &index)
+  {
+    return static_cast<size_t>(m_slotSize) * index;
+  }
+
+  // Receive a batch into the slots, the headers are reset every time as
+  // the ioInterface overwrites them
+  unsigned paste(const DatagramIOInterface &ioInterface)
+  {
+    for (unsigned i = 0; i < m_batch; ++i)
+    {
+      memset(&m_msgs[i], 0, sizeof(mmsghdr));
+      m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+      m_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int received = ioInterface(m_msgs.data(), m_batch);
+    m_next = 0;
+    m_count = received > 0 ? received : 0;
+    for (unsigned i = 0; i < m_count; ++i)
+    {
+      SizeType len = static_cast<SizeType>(m_msgs[i].msg_len);
+      memcpy(m_readBuff + slot(i), &len, sizeof(SizeType));
+      m_truncated += (m_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+
+    return m_count;
+  }
+
+  const SizeType m_maxDatagramSize;
+  const uint64_t m_slotSize;
+  const unsigned m_batch;
+  char *const m_readBuff;
+  std::vector<mmsghdr> m_msgs;
+  std::vector<iovec> m_iovecs;
+  unsigned m_next;
+  unsigned m_count;
+  uint64_t m_truncated;
+};
+
+// Queues messages and sends them a batch at a time, all the queued messages
+// go out with a single call to the ioInterface, when 'batch' messages are
+// queued, when the next one doesn't fit or on flush
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct DatagramWriteBuffer
+{
+  /**
+   *  Constructor
+   *  @param size         Size of the Buffer, the total bytes of the messages
+   *                      queued at a time, throws if 0
+   *  @param batch        Max. no. of messages queued, throws if 0
+   *  @param ioInterface  The ioInterface to send the messages to, see
+   *                      DatagramIOInterface
+   **/
+  DatagramWriteBuffer(const SizeType &size,
+                      const unsigned &batch,
+                      const DatagramIOInterface &ioInterface) : m_size(size),
+                                                                m_batch(batch),
+                                                                m_ioInterface(ioInterface),
+                                                                m_outBuff(reinterpret_cast<char *>(malloc(size))),
+                                                                m_msgs(batch),
+                                                                m_iovecs(batch),
+                                                                m_used(0),
+                                                                m_first(0),
+                                                                m_count(0)
+  {
+    if (!size || !batch)
+    {
+      throw std::invalid_argument("size and batch should  be passed as positive integers");
+    }
+  }
+
+  /**
+   *  Queue a message, sending the queued ones first if there isn't room
+   *  for it
+   *
+   *  @param out  The message
+   *  @param len  Length of the message
+   *
+   *  @return     false if the message is bigger than the buffer, or there
+   *              was no room for it and the ioInterface didn't send anything
+   **/
+  bool write(const char *out, const SizeType &len)
+  {
+    if (len > m_size)
+    {
+      return false;
+    }
+
+    if (m_count == m_batch || len > m_size - m_used)
+    {
+      flush();
+      if (m_count)
+      {
+        return false;
+      }
+    }
+
+    memcpy(m_outBuff + m_used, out, len);
+    m_iovecs[m_count] = {m_outBuff + m_used, len};
+    memset(&m_msgs[m_count], 0, sizeof(mmsghdr));
+    m_msgs[m_count].msg_hdr.msg_iov = &m_iovecs[m_count];
+    m_msgs[m_count].msg_hdr.msg_iovlen = 1;
+    m_used += len;
+    if (++m_count == m_batch)
+    {
+      flush();
+    }
+
+    return true;
+  }
+
+  /**
+   *  Send all the queued messages, resuming after partial sends
+   *
+   *  @return No. of messages sent, the ones not sent stay queued if the
+   *          ioInterface stops sending
+   **/
+  unsigned flush()
+  {
+    unsigned ret = 0;
+    while (m_first < m_count)
+    {
+      int sent = m_ioInterface(m_msgs.data() + m_first, m_count - m_first);
+      if (sent <= 0)
+      {
+        break;
+      }
+
+      m_first += sent;
+      ret += sent;
+    }
+
+    if (m_first == m_count)
+    {
+      m_used = m_first = m_count = 0;
+    }
+
+    return ret;
+  }
+
+  // No. of messages queued
+  unsigned pending()
+  {
+    return m_count - m_first;
+  }
+
+  ~DatagramWriteBuffer()
+  {
+    flush();
+    free(m_outBuff);
+  }
+
+  DatagramWriteBuffer(const DatagramWriteBuffer &) = delete;
+  DatagramWriteBuffer &operator=(const DatagramWriteBuffer &) = delete;
+  DatagramWriteBuffer(DatagramWriteBuffer &&) = delete;
+  DatagramWriteBuffer &operator=(DatagramWriteBuffer &&) = delete;
+
+private:
+  const SizeType m_size;
+  const unsigned m_batch;
+  const DatagramIOInterface m_ioInterface;
+  char *const m_outBuff;
+  std::vector<mmsghdr> m_msgs;
+  std::vector<iovec> m_iovecs;
+  SizeType m_used;
+  unsigned m_first;
+  unsigned m_count;
+};
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "DatagramBuffer.hpp"
+
+// Packets/s over UDP loopback with a send/recv per packet vs. batches of
+// sendmmsg/recvmmsg through DatagramWriteBuffer/DatagramReadBuffer.
+// Datagrams dropped for the lack of room in the receiver's socket buffer are
+// reported as lost, the receiver gives up after 200ms without a packet
+// Usage: DatagramTest <no. of packets> <packet size> <batch>
+static double seconds(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / (double)1000000000;
+}
+
+struct Result
+{
+  double sendRate;
+  double receiveRate;
+  uint64_t received;
+};
+
+static Result run(const uint32_t &numPackets,
+                  const uint32_t &packetSize,
+                  const std::function<void(int, const std::string &)> &send,
+                  const std::function<uint64_t(int)> &receive)
+{
+  int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(receiver, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  socklen_t addrLen = sizeof(addr);
+  getsockname(receiver, reinterpret_cast<sockaddr *>(&addr), &addrLen);
+  int rcvBuf = 8 << 20;
+  setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+  timeval timeout{0, 200000};
+  setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+  connect(sender, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+
+  Result ret{};
+  std::thread receiving(
+      [&]()
+      {
+        auto start = std::chrono::steady_clock::now();
+        ret.received = receive(receiver);
+        // Minus the timeout that ended it
+        ret.receiveRate = ret.received / (seconds(start) - 0.2);
+      });
+
+  std::string packet(packetSize, 'p');
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < numPackets; ++i)
+  {
+    send(sender, packet);
+  }
+  send(-1, packet);
+  ret.sendRate = numPackets / seconds(start);
+
+  receiving.join();
+  ::close(sender);
+  ::close(receiver);
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <no. of packets> <packet size> <batch>\n";
+    return 1;
+  }
+
+  uint32_t numPackets = atoll(argv[1]);
+  uint32_t packetSize = atoll(argv[2]);
+  unsigned batch = atoll(argv[3]);
+
+  Result single = run(
+      numPackets, packetSize,
+      [](int fd, const std::string &packet)
+      {
+        if (fd >= 0)
+        {
+          ::send(fd, packet.c_str(), packet.length(), 0);
+        }
+      },
+      [packetSize](int fd)
+      {
+        std::vector<char> out(packetSize);
+        uint64_t received = 0;
+        while (::recv(fd, out.data(), packetSize, 0) >= 0)
+        {
+          ++received;
+        }
+        return received;
+      });
+
+  std::unique_ptr<DatagramWriteBuffer<uint32_t>> writeBuffer;
+  Result batched = run(
+      numPackets, packetSize,
+      [&](int fd, const std::string &packet)
+      {
+        // fd -1 marks the end
+        if (fd < 0)
+        {
+          writeBuffer.reset();
+          return;
+        }
+        if (!writeBuffer)
+        {
+          writeBuffer = std::make_unique<DatagramWriteBuffer<uint32_t>>(packetSize * batch, batch, sendmmsgInterface(fd));
+        }
+        writeBuffer->write(packet.c_str(), packet.length());
+      },
+      [packetSize, batch](int fd)
+      {
+        DatagramReadBuffer<uint32_t> buffer(packetSize, batch);
+        DatagramIOInterface ioInterface = recvmmsgInterface(fd);
+        uint64_t received = 0;
+        while (buffer.next(ioInterface))
+        {
+          ++received;
+        }
+        return received;
+      });
+
+  std::cout << "send/recv per packet:\n"
+            << "  Sent:     " << single.sendRate << " packets/s\n"
+            << "  Received: " << single.receiveRate << " packets/s, lost " << numPackets - single.received << "\n"
+            << "sendmmsg/recvmmsg, batch " << batch << ":\n"
+            << "  Sent:     " << batched.sendRate << " packets/s\n"
+            << "  Received: " << batched.receiveRate << " packets/s, lost " << numPackets - batched.received << "\n";
+  return 0;
+}
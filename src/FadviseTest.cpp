@@ -0,0 +1,109 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "FdSource.hpp"
+
+// Cold cache read throughput and page cache footprint of FdSource with
+// different AccessHints. The file is dropped from the page cache before every
+// run, it must not be dirty(e.g. just written) for that to work
+// Usage: FadviseTest <file> <buffer size> <readahead window KB> <drop chunk KB>
+static double measure(const std::function<void()> &work)
+{
+  auto start = std::chrono::high_resolution_clock().now();
+  work();
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+}
+
+static uint64_t residentPages(const char *path, const uint64_t &fileSize)
+{
+  int fd = ::open(path, O_RDONLY);
+  void *addr = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+  uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  std::vector<unsigned char> residency((fileSize + pageSize - 1) / pageSize);
+  mincore(addr, fileSize, residency.data());
+  munmap(addr, fileSize);
+  ::close(fd);
+
+  uint64_t ret = 0;
+  for (auto page : residency)
+  {
+    ret += page & 1;
+  }
+  return ret;
+}
+
+static void dropFromPageCache(const char *path)
+{
+  int fd = ::open(path, O_RDONLY);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 5)
+  {
+    std::cerr << "Usage: " << argv[0] << " <file> <buffer size> <readahead window KB> <drop chunk KB>\n";
+    return 1;
+  }
+
+  const char *path = argv[1];
+  uint32_t buffSize = atoll(argv[2]);
+  uint64_t readaheadWindow = atoll(argv[3]) << 10;
+  uint64_t dropChunk = atoll(argv[4]) << 10;
+
+  struct stat fileStat;
+  if (stat(path, &fileStat) < 0 || !fileStat.st_size)
+  {
+    std::cerr << "Unable to stat " << path << "\n";
+    return 1;
+  }
+  uint64_t fileSize = fileStat.st_size;
+  uint64_t pageSize = sysconf(_SC_PAGESIZE);
+
+  struct Mode
+  {
+    const char *name;
+    bool sequential;
+    bool dropBehind;
+  };
+  const Mode modes[] = {{"none", false, false},
+                        {"sequential", true, false},
+                        {"dropBehind", false, true},
+                        {"sequential+dropBehind", true, true}};
+
+  std::vector<char> out(buffSize);
+  for (auto &mode : modes)
+  {
+    dropFromPageCache(path);
+    uint64_t total = 0;
+    double duration = measure(
+        [&]()
+        {
+          FdSource source(path);
+          AccessHints hints;
+          hints.sequential = mode.sequential;
+          hints.readaheadWindow = readaheadWindow;
+          hints.dropBehind = mode.dropBehind;
+          hints.dropChunk = dropChunk;
+          source.setAccessHints(hints);
+
+          SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+          SyncIOReadBuffer<uint32_t> buffer(buffSize);
+          while (auto len = buffer.read(out.data(), buffSize, ioInterface))
+          {
+            total += len;
+          }
+        });
+
+    std::cout << mode.name << ":\n"
+              << "  Throughput:     " << total / duration / (1 << 20) << " MB/s\n"
+              << "  Resident after: " << residentPages(path, fileSize) * pageSize / (1 << 20) << " MB of "
+              << fileSize / (1 << 20) << " MB\n";
+  }
+  return 0;
+}
@@ -0,0 +1,527 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "BusyPoll.hpp"
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+#include "SmartBuffer.hpp"
+
+// Access pattern hints for the kernel, see FdSource::setAccessHints
+struct AccessHints
+{
+  // POSIX_FADV_SEQUENTIAL, plus keeping 'readaheadWindow' bytes ahead of the
+  // reads in flight with explicit readahead requests
+  bool sequential = false;
+  // Bytes to keep in flight ahead of the reads, 0 leaves it to the kernel
+  uint64_t readaheadWindow = 0;
+  // POSIX_FADV_DONTNEED on the ranges already read, in chunks of
+  // 'dropChunk' bytes, so a one-pass read doesn't fill the page cache
+  bool dropBehind = false;
+  uint64_t dropChunk = 1 << 20;
+};
+
+// IOInterface reading from a file descriptor(POSIX only), for
+// SyncIOReadBuffer.
+// It keeps state(the read offset), so it is non-copyable, hand it over to the
+// buffer as std::ref(source), preferably stored once in an IOInterface:
+//
+//   FdSource source("data.txt");
+//   SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+//   buffer.readUntil(out, ioInterface, '\n');
+//
+// A file still being written to can be followed(Linux only), see follow()
+struct FdSource
+{
+  /**
+   *  Constructor, the fd is borrowed, it is not closed on destruction
+   *  @param fd An open file descriptor
+   **/
+  FdSource(const int &fd) : m_fd(fd),
+                            m_owned(false),
+                            m_offset(0),
+                            m_readaheadTill(0),
+                            m_droppedTill(0),
+                            m_inotifyFd(-1),
+                            m_fileWatch(-1),
+                            m_eventFd(-1),
+                            m_restarted(false),
+                            m_stopped(false),
+                            m_busyPoll(false)
+  {
+  }
+
+  /**
+   *  Constructor, opens the file for reading, it is closed on destruction
+   *  @param path Path of the file, throws std::runtime_error if the file
+   *              can't be opened
+   **/
+  FdSource(const char *path) : m_fd(::open(path, O_RDONLY)),
+                               m_owned(true),
+                               m_offset(0),
+                               m_readaheadTill(0),
+                               m_droppedTill(0),
+                               m_path(path),
+                               m_inotifyFd(-1),
+                               m_fileWatch(-1),
+                               m_eventFd(-1),
+                               m_restarted(false),
+                               m_stopped(false),
+                               m_busyPoll(false)
+  {
+    if (m_fd < 0)
+    {
+      throw std::runtime_error("unable to open the file");
+    }
+  }
+
+  /**
+   * The IOInterface, reads at most len bytes
+   *
+   * @return  No. of bytes read, 0 at the end of file or on an error
+   **/
+  template <class SizeType>
+  SizeType operator()(char *out, const SizeType &len)
+  {
+    ssize_t ret;
+    while ((ret = ::read(m_fd, out, len)) < 0 && errno == EINTR)
+      ;
+
+    if (ret < 0 && errno == EAGAIN && m_busyPoll)
+    {
+      ret = busyRead(out, len);
+    }
+
+    if (ret <= 0)
+    {
+      return 0;
+    }
+
+    m_offset += ret;
+    applyAccessHints();
+    return static_cast<SizeType>(ret);
+  }
+
+  /**
+   * Tell the kernel how the file is going to be read, the buffer reads
+   * 'capacity' sized chunks, left to itself the kernel can only guess
+   * how far ahead to read and when to let go of the pages
+   **/
+  void setAccessHints(const AccessHints &hints)
+  {
+    m_hints = hints;
+    posix_fadvise(m_fd, 0, 0, hints.sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+    m_readaheadTill = m_offset;
+    m_droppedTill = m_offset - m_offset % pageSize();
+    applyAccessHints();
+  }
+
+  /**
+   * Switch to busy polling, for pipes, sockets etc.(a regular file never
+   * makes a read wait). Instead of blocking in read, the fd is made
+   * non-blocking(on the open file description, so it affects other users
+   * of a borrowed fd too) and read is retried in a spin loop, parking in
+   * poll only once the spin budget is used up, see BusyPollOptions
+   *
+   * @return  false if the fd couldn't be made non-blocking or the thread
+   *          couldn't be pinned
+   **/
+  bool setBusyPoll(const BusyPollOptions &options)
+  {
+    int flags = fcntl(m_fd, F_GETFL);
+    if (flags < 0 || fcntl(m_fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+      return false;
+    }
+
+    m_spinWaiter = SpinWaiter(options);
+    m_busyPoll = true;
+    return options.cpu < 0 || pinToCpu(options.cpu);
+  }
+
+  /**
+   * Reposition the fd, the buffer reading from this source has to be
+   * reset(see SyncIOReadBuffer::reset) as whatever it holds is now stale
+   *
+   * @return  false if the fd isn't seekable
+   **/
+  bool seek(const uint64_t &offset)
+  {
+    if (::lseek(m_fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+    {
+      return false;
+    }
+
+    m_offset = offset;
+    m_readaheadTill = offset;
+    m_droppedTill = offset - offset % pageSize();
+    return true;
+  }
+
+  /**
+   * Move the reader to the start of line no. 'line'(0 based), using the
+   * index to skip to the closest indexed line and reading on from there.
+   * The index has to be attached to the buffer(see
+   * SyncIOReadBuffer::setLineIndex), so lines read past the end of the index
+   * keep extending it
+   *
+   * @return  false if the fd isn't seekable or the stream has fewer lines
+   **/
+  template <class SizeType>
+  bool seekToLine(SyncIOReadBuffer<SizeType> &buffer,
+                  LineIndex &lineIndex,
+                  const uint64_t &line)
+  {
+    auto [offset, indexedLine] = lineIndex.locate(line);
+    // Already on the way, reading on is cheaper than seeking back
+    if (lineIndex.currentLine() <= line && lineIndex.currentLine() > indexedLine)
+    {
+      indexedLine = lineIndex.currentLine();
+    }
+    else
+    {
+      if (!seek(offset))
+      {
+        return false;
+      }
+
+      buffer.reset(offset);
+      lineIndex.setCurrentLine(indexedLine);
+    }
+
+    typename SyncIOReadBuffer<SizeType>::IOInterface ioInterface = std::ref(*this);
+    while (lineIndex.currentLine() < line)
+    {
+      if (!buffer.skipUntil(ioInterface, lineIndex.delimiter()))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // Offset of the next byte to be read from the fd
+  uint64_t offset()
+  {
+    return m_offset;
+  }
+
+  int fd()
+  {
+    return m_fd;
+  }
+
+#ifdef __linux__
+  /**
+   * Switch to follow mode(like tail -F), for files that are still being
+   * written to. Reaching the end of the file doesn't end the stream anymore,
+   * followUntil waits(with inotify, no polling) for more data instead.
+   * The file getting truncated is detected by its size dropping below the
+   * read offset, reading restarts from the beginning(a truncation followed
+   * by writes past the read offset before the follower gets to look at the
+   * file goes unnoticed, as with tail -F). If the source was
+   * constructed from a path, the file getting rotated(the path pointing to
+   * a new inode) is detected too, the new file is opened and read from the
+   * beginning. Either way followUntil resets the buffer, a partial record
+   * buffered before is dropped rather than glued onto the first record of
+   * the new contents
+   *
+   * @return  false if the notifications couldn't be set up, the source is
+   *          then not in follow mode, and follow can be tried again
+   **/
+  bool follow()
+  {
+    if (m_inotifyFd >= 0)
+    {
+      return true;
+    }
+
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_inotifyFd < 0 || m_eventFd < 0 || !watchFile())
+    {
+      unfollow();
+      return false;
+    }
+
+    // Rotation creates/moves a new file at the path
+    if (!m_path.empty())
+    {
+      auto slash = m_path.rfind('/');
+      std::string dir = slash == std::string::npos ? "." : slash ? m_path.substr(0, slash) : "/";
+      inotify_add_watch(m_inotifyFd, dir.c_str(), IN_CREATE | IN_MOVED_TO);
+    }
+
+    return true;
+  }
+
+  /**
+   * Read the next record in follow mode, same as
+   * SyncIOReadBuffer::readUntil except that at the end of the file it waits
+   * for the record to be completed instead of returning the partial record.
+   * The partial record stays in the buffer meanwhile(see
+   * SyncIOReadBuffer::tryReadUntil), so the buffer must not be read from
+   * in any other way while following
+   *
+   * On a truncation or a rotation the buffer is reset to offset 0, which
+   * also moves an attached LineIndex back to line 0(the offsets it already
+   * holds describe the old contents, after a truncation it should be
+   * rebuilt)
+   *
+   * @return  No. of bytes read, 0 once the source is stopped(see stop()),
+   *          the trailing bytes without an 'ender' are returned first
+   **/
+  template <class SizeType>
+  SizeType followUntil(SyncIOReadBuffer<SizeType> &buffer,
+                       char *const &out,
+                       const char &ender)
+  {
+    typename SyncIOReadBuffer<SizeType>::NonBlockingIOInterface ioInterface =
+        [this](char *data, const SizeType &len)
+    {
+      return readAvailable(data, len);
+    };
+
+    while (true)
+    {
+      auto result = buffer.tryReadUntil(out, ioInterface, ender);
+      if (result.status != IOStatus::WOULD_BLOCK)
+      {
+        return result.bytes;
+      }
+
+      // The source is already repositioned, read on without waiting
+      if (m_restarted)
+      {
+        m_restarted = false;
+        buffer.reset(0);
+        continue;
+      }
+
+      waitForChange();
+    }
+  }
+
+  /**
+   * End the follow mode, can be called from any thread. A followUntil
+   * waiting for data wakes up, the data already in the file is still read,
+   * after that followUntil returns 0
+   **/
+  void stop()
+  {
+    m_stopped = true;
+    if (m_eventFd >= 0)
+    {
+      uint64_t one = 1;
+      while (::write(m_eventFd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+    }
+  }
+#endif
+
+  ~FdSource()
+  {
+    if (m_owned)
+    {
+      ::close(m_fd);
+    }
+
+    if (m_inotifyFd >= 0)
+    {
+      ::close(m_inotifyFd);
+    }
+
+    if (m_eventFd >= 0)
+    {
+      ::close(m_eventFd);
+    }
+  }
+
+  FdSource(const FdSource &) = delete;
+  FdSource &operator=(const FdSource &) = delete;
+  FdSource(FdSource &&) = delete;
+  FdSource &operator=(FdSource &&) = delete;
+
+private:
+  static uint64_t pageSize()
+  {
+    static const uint64_t ret = sysconf(_SC_PAGESIZE);
+    return ret;
+  }
+
+  // Retry the non-blocking read until it gives data, an end of file or an
+  // error, spinning first and then waiting in poll
+  ssize_t busyRead(char *out, const size_t &len)
+  {
+    ssize_t ret = -1;
+    auto ready = [&]()
+    {
+      ret = ::read(m_fd, out, len);
+      return ret >= 0 || (errno != EAGAIN && errno != EINTR);
+    };
+
+    while (!m_spinWaiter.spin(ready))
+    {
+      pollfd fds = {m_fd, POLLIN, 0};
+      ::poll(&fds, 1, -1);
+      if (ready())
+      {
+        break;
+      }
+    }
+
+    return ret;
+  }
+
+  void applyAccessHints()
+  {
+    // Top up the readahead window when half of it has been consumed
+    if (m_hints.sequential && m_hints.readaheadWindow &&
+        m_offset + m_hints.readaheadWindow / 2 >= m_readaheadTill)
+    {
+      uint64_t from = std::max(m_offset, m_readaheadTill);
+      uint64_t till = m_offset + m_hints.readaheadWindow;
+#ifdef __linux__
+      ::readahead(m_fd, static_cast<off64_t>(from), till - from);
+#else
+      posix_fadvise(m_fd, static_cast<off_t>(from), static_cast<off_t>(till - from), POSIX_FADV_WILLNEED);
+#endif
+      m_readaheadTill = till;
+    }
+
+    // Everything before m_offset is already in the buffer, the page cache
+    // copy of it won't be needed again on a one-pass read. Only whole pages
+    // are dropped, the one being read from is kept
+    if (m_hints.dropBehind && m_offset - m_droppedTill >= m_hints.dropChunk)
+    {
+      uint64_t till = m_offset - m_offset % pageSize();
+      posix_fadvise(m_fd, static_cast<off_t>(m_droppedTill), static_cast<off_t>(till - m_droppedTill), POSIX_FADV_DONTNEED);
+      m_droppedTill = till;
+    }
+  }
+
+#ifdef __linux__
+  // The NonBlockingIOInterface for the follow mode, the end of the file is
+  // IOStatus::WOULD_BLOCK, unless the source is stopped. A truncation or a
+  // rotation is IOStatus::WOULD_BLOCK too, with m_restarted set, the buffer
+  // can't be reset from within its own IOInterface
+  template <class SizeType>
+  IOResult<SizeType> readAvailable(char *out, const SizeType &len)
+  {
+    if (SizeType ret = (*this)(out, len))
+    {
+      return {ret, IOStatus::OK};
+    }
+
+    if (truncated() || rotated())
+    {
+      m_restarted = true;
+      return {0, IOStatus::WOULD_BLOCK};
+    }
+
+    return {0, m_stopped ? IOStatus::END_OF_STREAM : IOStatus::WOULD_BLOCK};
+  }
+
+  bool truncated()
+  {
+    struct stat fileStat;
+    if (fstat(m_fd, &fileStat) < 0 || static_cast<uint64_t>(fileStat.st_size) >= m_offset)
+    {
+      return false;
+    }
+
+    return seek(0);
+  }
+
+  bool rotated()
+  {
+    struct stat current, atPath;
+    if (!m_owned || m_path.empty() ||
+        fstat(m_fd, &current) < 0 ||
+        stat(m_path.c_str(), &atPath) < 0 ||
+        (current.st_ino == atPath.st_ino && current.st_dev == atPath.st_dev))
+    {
+      return false;
+    }
+
+    int fd = ::open(m_path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    ::close(m_fd);
+    m_fd = fd;
+    m_offset = 0;
+    inotify_rm_watch(m_inotifyFd, m_fileWatch);
+    watchFile();
+    setAccessHints(m_hints);
+    return true;
+  }
+
+  // Undo a follow that failed half way
+  void unfollow()
+  {
+    if (m_inotifyFd >= 0)
+    {
+      ::close(m_inotifyFd);
+      m_inotifyFd = -1;
+    }
+
+    if (m_eventFd >= 0)
+    {
+      ::close(m_eventFd);
+      m_eventFd = -1;
+    }
+  }
+
+  bool watchFile()
+  {
+    // Without a path the file is reached through the fd
+    std::string path = m_path.empty() ? "/proc/self/fd/" + std::to_string(m_fd) : m_path;
+    m_fileWatch = inotify_add_watch(m_inotifyFd,
+                                    path.c_str(),
+                                    IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+    return m_fileWatch >= 0;
+  }
+
+  // Block until the file(or the directory it is in) changes or the source
+  // is stopped. The notifications are drained before returning, anything
+  // written after that wakes up the next wait
+  void waitForChange()
+  {
+    pollfd fds[2] = {{m_inotifyFd, POLLIN, 0}, {m_eventFd, POLLIN, 0}};
+    while (!m_stopped && ::poll(fds, 2, -1) < 0 && errno == EINTR)
+      ;
+
+    char events[4096];
+    while (::read(m_inotifyFd, events, sizeof(events)) > 0)
+      ;
+  }
+#endif
+
+  int m_fd;
+  bool m_owned;
+  uint64_t m_offset;
+  AccessHints m_hints;
+  uint64_t m_readaheadTill;
+  uint64_t m_droppedTill;
+  std::string m_path;
+  int m_inotifyFd;
+  int m_fileWatch;
+  int m_eventFd;
+  bool m_restarted;
+  std::atomic<bool> m_stopped;
+  bool m_busyPoll;
+  SpinWaiter m_spinWaiter;
+};
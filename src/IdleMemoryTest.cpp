@@ -0,0 +1,123 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <malloc.h>
+#include "SmartBuffer.hpp"
+
+// RSS of <connections> connections, each a SyncIOReadBuffer and a
+// SyncIOLazyWriteBuffer of <buffer size> bytes, that exchange one message
+// each, a wave of 1024 connections after another, and then go idle:
+// eager - allocated at construction and kept, as before
+// lazy  - allocated on first use, releaseIfIdle(2) is swept over all the
+//         connections after every wave, as a daemon would from a timer
+// One mode per run, RSS is per process
+// Usage: IdleMemoryTest <eager|lazy> <connections> <buffer size>
+static uint64_t rssKB()
+{
+  uint64_t pages = 0, resident = 0;
+  if (FILE *statm = fopen("/proc/self/statm", "r"))
+  {
+    if (fscanf(statm, "%lu %lu", &pages, &resident) != 2)
+    {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+struct Connection
+{
+  Connection(const uint32_t &size,
+             const Allocation &allocation) : in(size, allocation),
+                                             out(size, [](const char *, const uint32_t &len)
+                                                 { return len; },
+                                                 allocation)
+  {
+  }
+
+  SyncIOReadBuffer<uint32_t> in;
+  SyncIOLazyWriteBuffer<uint32_t> out;
+};
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <eager|lazy> <connections> <buffer size>\n";
+    return 1;
+  }
+
+  Allocation allocation = std::string(argv[1]) == "lazy" ? Allocation::LAZY : Allocation::EAGER;
+  uint32_t numConnections = atoll(argv[2]);
+  uint32_t size = atoll(argv[3]);
+  uint64_t baseline = rssKB();
+
+  auto report = [&](const char *phase)
+  {
+    uint64_t rss = rssKB();
+    std::cout << phase << "\t" << rss / 1024 << " MB\t"
+              << (rss - std::min(rss, baseline)) * 1024 / numConnections << " bytes/connection" << std::endl;
+  };
+
+  std::cout << argv[1] << ", " << numConnections << " connections, 2 x " << size << " byte buffers each\n";
+  std::vector<std::unique_ptr<Connection>> connections;
+  connections.reserve(numConnections);
+  for (uint32_t i = 0; i < numConnections; ++i)
+  {
+    connections.emplace_back(std::make_unique<Connection>(size, allocation));
+  }
+  report("Created");
+
+  uint32_t released = 0;
+  auto sweep = [&]()
+  {
+    for (auto &connection : connections)
+    {
+      released += connection->in.releaseIfIdle(2);
+      released += connection->out.releaseIfIdle(2);
+    }
+  };
+
+  // A request in, a response out, both as big as the buffers, so every page
+  // of them is touched
+  std::string request(size - 1, 'r');
+  request += '\n';
+  std::string response(size, 'w');
+  std::vector<char> line(size);
+  for (uint32_t i = 0; i < numConnections; ++i)
+  {
+    auto &connection = connections[i];
+    uint32_t offset = 0;
+    connection->in.readUntil(line.data(), [&](char *out, const uint32_t &len)
+                             {
+                               uint32_t toRead = std::min<uint32_t>(len, request.length() - offset);
+                               memcpy(out, request.c_str() + offset, toRead);
+                               offset += toRead;
+                               return toRead; },
+                             '\n');
+    connection->out.write(response.c_str(), response.length());
+    connection->out.flush();
+    if (allocation == Allocation::LAZY && i % 1024 == 1023)
+    {
+      sweep();
+    }
+  }
+  report("Used once");
+
+  if (allocation == Allocation::LAZY)
+  {
+    sweep();
+    sweep();
+    report("Idle");
+  }
+#ifdef __GLIBC__
+  // Freed chunks below the mmap threshold stay in the heap until trimmed
+  malloc_trim(0);
+  report("Trimmed");
+#endif
+
+  return allocation == Allocation::EAGER || released == 2 * numConnections ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+#include <utility>
+
+// Sparse index of line start offsets, filled in by SyncIOReadBuffer while the
+// lines are being read anyway(see SyncIOReadBuffer::setLineIndex), so that
+// random access to a line later doesn't need another pass over the stream.
+//
+// Only the start of every 'every'th line is kept, seeking to any line means
+// seeking to the closest indexed line before it and skipping at most
+// 'every' - 1 lines from there.
+struct LineIndex
+{
+  /**
+   *  Constructor
+   *  @param every      Keep the offset of every 'every'th line,
+   *                    throws if every is 0
+   *  @param delimiter  The character ending a line
+   **/
+  LineIndex(const uint64_t &every, const char &delimiter = '\n') : m_every(every),
+                                                                   m_delimiter(delimiter),
+                                                                   m_currentLine(0),
+                                                                   m_offsets(1, 0)
+  {
+    if (!every)
+    {
+      throw std::invalid_argument("every should  be passed as a positive integer");
+    }
+  }
+
+  /**
+   * To be called whenever a delimiter is consumed, i.e. a new line starts
+   *
+   * @param nextLineStart Absolute offset of the byte following the delimiter
+   **/
+  void onLine(const uint64_t &nextLineStart)
+  {
+    // Only the frontier is recorded, so revisiting already indexed lines
+    // (after a seek) never produces duplicates
+    if (++m_currentLine == m_offsets.size() * m_every)
+    {
+      m_offsets.push_back(nextLineStart);
+    }
+  }
+
+  /**
+   * Closest indexed line at or before 'line'
+   *
+   * @return  {absolute offset of that line, its line no.}
+   **/
+  std::pair<uint64_t, uint64_t> locate(const uint64_t &line) const
+  {
+    uint64_t entry = std::min<uint64_t>(line / m_every, m_offsets.size() - 1);
+    return {m_offsets[entry], entry * m_every};
+  }
+
+  /**
+   * Line no. of the line that starts at the current read position,
+   * to be updated by whoever repositions the reader
+   **/
+  uint64_t currentLine() const
+  {
+    return m_currentLine;
+  }
+
+  void setCurrentLine(const uint64_t &line)
+  {
+    m_currentLine = line;
+  }
+
+  // No. of lines known to the index, lines beyond it can only be reached by
+  // reading on from the last indexed line
+  uint64_t indexedLines() const
+  {
+    return (m_offsets.size() - 1) * m_every;
+  }
+
+  uint64_t every() const
+  {
+    return m_every;
+  }
+
+  char delimiter() const
+  {
+    return m_delimiter;
+  }
+
+  /**
+   * Persist the index into a sidecar file
+   * Format: "LIDX", then varints: every, delimiter, no. of entries, followed
+   * by the delta of every offset from the previous one
+   *
+   * @return  false if the file couldn't be written
+   **/
+  bool save(const char *path) const
+  {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+      return false;
+    }
+
+    std::vector<unsigned char> out{'L', 'I', 'D', 'X'};
+    putVarint(out, m_every);
+    putVarint(out, static_cast<unsigned char>(m_delimiter));
+    putVarint(out, m_offsets.size());
+    for (size_t i = 1; i < m_offsets.size(); ++i)
+    {
+      putVarint(out, m_offsets[i] - m_offsets[i - 1]);
+    }
+
+    bool ret = fwrite(out.data(), 1, out.size(), file) == out.size();
+    return (fclose(file) == 0) && ret;
+  }
+
+  /**
+   * Load an index saved with 'save'
+   * throws std::runtime_error if the file is missing or malformed
+   **/
+  static LineIndex load(const char *path)
+  {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+      throw std::runtime_error("unable to open the line index file");
+    }
+
+    std::vector<unsigned char> in;
+    unsigned char chunk[4096];
+    for (size_t len; (len = fread(chunk, 1, sizeof(chunk), file));)
+    {
+      in.insert(in.end(), chunk, chunk + len);
+    }
+    fclose(file);
+
+    size_t pos = 4;
+    if (in.size() < pos || in[0] != 'L' || in[1] != 'I' || in[2] != 'D' || in[3] != 'X')
+    {
+      throw std::runtime_error("not a line index file");
+    }
+
+    uint64_t every = getVarint(in, pos);
+    char delimiter = static_cast<char>(getVarint(in, pos));
+    uint64_t entries = getVarint(in, pos);
+    LineIndex ret(every, delimiter);
+    for (uint64_t i = 1; i < entries; ++i)
+    {
+      ret.m_offsets.push_back(ret.m_offsets.back() + getVarint(in, pos));
+    }
+
+    return ret;
+  }
+
+private:
+  static void putVarint(std::vector<unsigned char> &out, uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      out.push_back(static_cast<unsigned char>(value) | 0x80);
+      value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+  }
+
+  static uint64_t getVarint(const std::vector<unsigned char> &in, size_t &pos)
+  {
+    uint64_t ret = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+      if (pos == in.size())
+      {
+        break;
+      }
+
+      unsigned char byte = in[pos++];
+      ret |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+      {
+        return ret;
+      }
+    }
+
+    throw std::runtime_error("truncated line index file");
+  }
+
+  uint64_t m_every;
+  char m_delimiter;
+  uint64_t m_currentLine;
+  // m_offsets[i] is the offset of line no. i * m_every
+  std::vector<uint64_t> m_offsets;
+};
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "FdSource.hpp"
+
+// Random line access with a LineIndex vs. rescanning the file from the start
+// Usage: LineIndexTest <file> <index every Nth line> <no. of lookups> <seed>
+// e.g. on a 10 GB file: LineIndexTest big.txt 1024 1000 1
+static double measure(const std::function<void()> &work)
+{
+  auto start = std::chrono::high_resolution_clock().now();
+  work();
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 5)
+  {
+    std::cerr << "Usage: " << argv[0] << " <file> <index every Nth line> <no. of lookups> <seed>\n";
+    return 1;
+  }
+
+  const char *path = argv[1];
+  uint64_t every = atoll(argv[2]);
+  uint32_t numLookups = atoll(argv[3]);
+  std::mt19937_64 rng(atoll(argv[4]));
+  const uint32_t buffSize = 1 << 16;
+  const uint32_t maxLineLen = 1 << 20;
+  std::vector<char> line(maxLineLen);
+  std::string indexPath = std::string(path) + ".lidx";
+
+  LineIndex lineIndex(every);
+  uint64_t numLines = 0;
+  double indexDuration = measure(
+      [&]()
+      {
+        FdSource source(path);
+        SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+        SyncIOReadBuffer<uint32_t> buffer(buffSize);
+        buffer.setLineIndex(&lineIndex);
+        while (buffer.skipUntil(ioInterface, '\n'))
+          ;
+        numLines = lineIndex.currentLine();
+        lineIndex.save(indexPath.c_str());
+      });
+
+  if (!numLines)
+  {
+    std::cerr << "No lines in " << path << "\n";
+    return 1;
+  }
+
+  std::vector<uint64_t> targets(numLookups);
+  for (auto &target : targets)
+  {
+    target = rng() % numLines;
+  }
+
+  uint64_t checksum = 0;
+  double indexedDuration = measure(
+      [&]()
+      {
+        LineIndex loaded = LineIndex::load(indexPath.c_str());
+        FdSource source(path);
+        SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+        SyncIOReadBuffer<uint32_t> buffer(buffSize);
+        buffer.setLineIndex(&loaded);
+        for (auto &target : targets)
+        {
+          source.seekToLine(buffer, loaded, target);
+          checksum += buffer.readUntil(line.data(), ioInterface, '\n');
+        }
+      });
+
+  // A full rescan per lookup is slow on big files, a handful is enough
+  uint32_t numRescans = std::min<uint32_t>(numLookups, 3);
+  double rescanDuration = measure(
+      [&]()
+      {
+        for (uint32_t i = 0; i < numRescans; ++i)
+        {
+          FdSource source(path);
+          SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+          SyncIOReadBuffer<uint32_t> buffer(buffSize);
+          for (uint64_t skipped = 0; skipped < targets[i]; ++skipped)
+          {
+            buffer.skipUntil(ioInterface, '\n');
+          }
+          checksum += buffer.readUntil(line.data(), ioInterface, '\n');
+        }
+      });
+
+  std::cout << "Lines:                 " << numLines << "\n"
+            << "Index build(1 pass):   " << indexDuration << " s\n"
+            << "Indexed lookup:        " << indexedDuration / numLookups * 1e6 << " us/lookup\n"
+            << "Rescan lookup:         " << rescanDuration / numRescans * 1e6 << " us/lookup\n"
+            << "Checksum:              " << checksum << "\n";
+  return 0;
+}
@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Tuning of MappedFileSink
+struct MappedSinkOptions
+{
+  // Bytes of the file mapped at a time, rounded up to whole pages
+  uint64_t windowSize = 64 << 20;
+  // The file is grown(fallocate) in steps of this many bytes, ahead of the
+  // writes
+  uint64_t growthStep = 256 << 20;
+  // msync a window before unmapping it, the write back of the window is
+  // waited for
+  bool syncCompleted = false;
+  // MADV_DONTNEED a window before unmapping it
+  bool dropCompleted = false;
+};
+
+// IOInterface writing into a memory mapped file(POSIX only), for
+// SyncIOLazyWriteBuffer.
+// A flush is a memcpy into the mapping instead of a write() call. Only a
+// window of the file is mapped at a time, it slides forward as the file
+// fills up, the file itself is preallocated ahead of the window and cut to
+// the bytes actually written on close().
+// It keeps state, so it is non-copyable, hand it over to the buffer as
+// std::ref(sink):
+//
+//   MappedFileSink sink("out.bin");
+//   SyncIOLazyWriteBuffer<uint32_t> buffer(1 << 16, std::ref(sink));
+//
+// As the mapping already is memory, the buffer can be skipped altogether, by
+// writing into the mapping directly through reserve()/commit()
+struct MappedFileSink
+{
+  /**
+   *  Constructor, creates(or truncates) the file
+   *  @param path     Path of the file, throws std::runtime_error if the file
+   *                  can't be opened
+   *  @param options  See MappedSinkOptions
+   **/
+  MappedFileSink(const char *path,
+                 const MappedSinkOptions &options = MappedSinkOptions()) : m_fd(::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)),
+                                                                           m_options(options),
+                                                                           m_window(nullptr),
+                                                                           m_windowStart(0),
+                                                                           m_windowLen(0),
+                                                                           m_size(0),
+                                                                           m_allocated(0),
+                                                                           m_reserved(0)
+  {
+    if (m_fd < 0)
+    {
+      throw std::runtime_error("unable to open the file");
+    }
+
+    m_options.windowSize = roundUp(std::max<uint64_t>(m_options.windowSize, 1));
+  }
+
+  /**
+   * The IOInterface, copies the bytes into the mapping
+   *
+   * @return  No. of bytes written, less than len only if the file couldn't
+   *          be grown or mapped(e.g. the disk is full)
+   **/
+  template <class SizeType>
+  SizeType operator()(const char *data, const SizeType &len)
+  {
+    // Whatever was reserved is overwritten
+    m_reserved = 0;
+    SizeType ret = 0;
+    while (ret < len)
+    {
+      if (!m_window || m_size == m_windowStart + m_windowLen)
+      {
+        if (!mapWindow(m_size, 1))
+        {
+          break;
+        }
+      }
+
+      SizeType toCopy = static_cast<SizeType>(std::min<uint64_t>(m_windowStart + m_windowLen - m_size, len - ret));
+      memcpy(m_window + (m_size - m_windowStart), data + ret, toCopy);
+      m_size += toCopy;
+      ret += toCopy;
+    }
+
+    return ret;
+  }
+
+  /**
+   * Get 'len' contiguous bytes of the file to write into directly, they
+   * become part of the file on commit(). Slides the window, if the bytes are
+   * beyond it, the pointers handed out earlier are invalid after that
+   *
+   * @return  Pointer to the bytes, nullptr if the file couldn't be grown or
+   *          mapped
+   **/
+  char *reserve(const uint64_t &len)
+  {
+    if (!m_window || m_size + len > m_windowStart + m_windowLen)
+    {
+      if (!mapWindow(m_size, len))
+      {
+        m_reserved = 0;
+        return nullptr;
+      }
+    }
+
+    m_reserved = len;
+    return m_window + (m_size - m_windowStart);
+  }
+
+  /**
+   * Append 'len' bytes written into the memory returned by the last
+   * reserve(), 'len' can be less than what was reserved, the rest stays
+   * reserved for the next commit. Throws std::invalid_argument if 'len' is
+   * more than what is left of the reservation
+   **/
+  void commit(const uint64_t &len)
+  {
+    if (len > m_reserved)
+    {
+      throw std::invalid_argument("len should  be passed as at most the no. of bytes reserved");
+    }
+
+    m_reserved -= len;
+    m_size += len;
+  }
+
+  /**
+   * Unmap the window, cut the file to the bytes written and close it
+   *
+   * @return  false if the file couldn't be cut to size
+   **/
+  bool close()
+  {
+    if (m_fd < 0)
+    {
+      return true;
+    }
+
+    unmapWindow();
+    bool ret = !ftruncate(m_fd, static_cast<off_t>(m_size));
+    ::close(m_fd);
+    m_fd = -1;
+    return ret;
+  }
+
+  // No. of bytes written
+  uint64_t size()
+  {
+    return m_size;
+  }
+
+  ~MappedFileSink()
+  {
+    close();
+  }
+
+  MappedFileSink(const MappedFileSink &) = delete;
+  MappedFileSink &operator=(const MappedFileSink &) = delete;
+  MappedFileSink(MappedFileSink &&) = delete;
+  MappedFileSink &operator=(MappedFileSink &&) = delete;
+
+private:
+  static uint64_t pageSize()
+  {
+    static const uint64_t ret = sysconf(_SC_PAGESIZE);
+    return ret;
+  }
+
+  static uint64_t roundUp(const uint64_t &len)
+  {
+    return (len + pageSize() - 1) / pageSize() * pageSize();
+  }
+
+  // Map a window covering [offset, offset + len), starting at the page
+  // 'offset' falls in
+  bool mapWindow(const uint64_t &offset, const uint64_t &len)
+  {
+    unmapWindow();
+    uint64_t start = offset - offset % pageSize();
+    uint64_t windowLen = std::max(m_options.windowSize, roundUp(offset + len - start));
+    if (!allocate(start + windowLen))
+    {
+      return false;
+    }
+
+    void *addr = mmap(nullptr, windowLen, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, static_cast<off_t>(start));
+    if (addr == MAP_FAILED)
+    {
+      return false;
+    }
+
+    m_window = static_cast<char *>(addr);
+    m_windowStart = start;
+    m_windowLen = windowLen;
+    return true;
+  }
+
+  void unmapWindow()
+  {
+    if (!m_window)
+    {
+      return;
+    }
+
+    if (m_options.syncCompleted)
+    {
+      msync(m_window, m_windowLen, MS_SYNC);
+    }
+
+    if (m_options.dropCompleted)
+    {
+      madvise(m_window, m_windowLen, MADV_DONTNEED);
+    }
+
+    munmap(m_window, m_windowLen);
+    m_window = nullptr;
+  }
+
+  // Make sure the file is at least 'till' bytes, touching a mapped page
+  // beyond the end of the file is a SIGBUS
+  bool allocate(const uint64_t &till)
+  {
+    if (till <= m_allocated)
+    {
+      return true;
+    }
+
+    uint64_t newAllocated = std::max(till, m_allocated + m_options.growthStep);
+#ifdef __linux__
+    // Reserves the blocks as well, a full disk shows up here instead of as a
+    // SIGBUS while copying into the mapping
+    if (fallocate(m_fd, 0, static_cast<off_t>(m_allocated), static_cast<off_t>(newAllocated - m_allocated)) < 0 &&
+        (errno != EOPNOTSUPP || ftruncate(m_fd, static_cast<off_t>(newAllocated)) < 0))
+#else
+    if (ftruncate(m_fd, static_cast<off_t>(newAllocated)) < 0)
+#endif
+    {
+      return false;
+    }
+
+    m_allocated = newAllocated;
+    return true;
+  }
+
+  int m_fd;
+  MappedSinkOptions m_options;
+  char *m_window;
+  uint64_t m_windowStart;
+  uint64_t m_windowLen;
+  uint64_t m_size;
+  uint64_t m_allocated;
+  uint64_t m_reserved; // Left of the last reserve(), from m_size on
+};
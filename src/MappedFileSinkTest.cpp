@@ -0,0 +1,87 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include "MappedFileSink.hpp"
+#include "SmartBuffer.hpp"
+
+// Large sequential output through SyncIOLazyWriteBuffer flushing with write()
+// vs. flushing into a MappedFileSink vs. writing into the mapping directly
+// with reserve()/commit()
+// Usage: MappedFileSinkTest <buffer size> <MB to write> <record size> <output file>
+static double measure(const std::function<void()> &work)
+{
+  auto start = std::chrono::high_resolution_clock().now();
+  work();
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 5)
+  {
+    std::cerr << "Usage: " << argv[0] << " <buffer size> <MB to write> <record size> <output file>\n";
+    return 1;
+  }
+
+  uint32_t buffSize = atoll(argv[1]);
+  uint64_t total = atoll(argv[2]) << 20;
+  uint32_t recordSize = atoll(argv[3]);
+  const char *path = argv[4];
+  std::string record(recordSize, 'x');
+  record.back() = '\n';
+
+  double writeDuration = measure(
+      [&]()
+      {
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        SyncIOLazyWriteBuffer<uint32_t>::IOInterface ioInterface =
+            [fd](const char *out, const uint32_t &len)
+        {
+          ssize_t ret = ::write(fd, out, len);
+          return static_cast<uint32_t>(ret < 0 ? 0 : ret);
+        };
+
+        SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize, ioInterface);
+        for (uint64_t written = 0; written < total; written += recordSize)
+        {
+          buffer.write(record.c_str(), recordSize);
+        }
+        buffer.flush();
+        ::close(fd);
+      });
+
+  double mappedDuration = measure(
+      [&]()
+      {
+        MappedFileSink sink(path);
+        SyncIOLazyWriteBuffer<uint32_t>::IOInterface ioInterface = std::ref(sink);
+        SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize, ioInterface);
+        for (uint64_t written = 0; written < total; written += recordSize)
+        {
+          buffer.write(record.c_str(), recordSize);
+        }
+        buffer.flush();
+        sink.close();
+      });
+
+  double reserveDuration = measure(
+      [&]()
+      {
+        MappedFileSink sink(path);
+        for (uint64_t written = 0; written < total; written += recordSize)
+        {
+          memcpy(sink.reserve(recordSize), record.c_str(), recordSize);
+          sink.commit(recordSize);
+        }
+        sink.close();
+      });
+
+  double mb = total / (double)(1 << 20);
+  std::cout << "write() flush:      " << writeDuration << " s, " << mb / writeDuration << " MB/s\n"
+            << "Mapped flush:       " << mappedDuration << " s, " << mb / mappedDuration << " MB/s\n"
+            << "Reserve/commit:     " << reserveDuration << " s, " << mb / reserveDuration << " MB/s\n";
+  return 0;
+}
@@ -0,0 +1,363 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SmartBuffer.hpp"
+
+// Layout of the first page of the file backing a PersistentLazyWriteBuffer,
+// the ring follows it.
+// head and tail are stream positions(no. of bytes put/no. of bytes accepted by
+// the ioInterface) rather than indices into the ring, the ring index being
+// position % capacity. So, unlike m_head/m_tail of SyncIOLazyWriteBuffer, they
+// are unambiguous on their own, without a "last operation", and each of them
+// is updated by a single store
+struct PersistentBufferHeader
+{
+  char magic[8];
+  uint64_t capacity;
+  uint64_t head;
+  uint64_t tail;
+};
+
+// Lazy write buffer whose ring lives in a memory mapped file instead of the
+// heap. If the process dies, the bytes that were put but not yet flushed are
+// still in the file(the page cache owns them, not the process) and are
+// replayed to the ioInterface by recover(), which the constructor calls
+// first thing. So a big buffer doesn't mean a big loss on a crash.
+// The bytes are put before the head is advanced, and the tail is advanced
+// only after the ioInterface accepted the bytes, so a crash loses nothing
+// but may lead to a replay of the bytes the ioInterface accepted just before
+// the crash(at least once delivery).
+// Survives the process crashing, surviving the machine crashing needs sync()
+// A backing file is used by one buffer at a time: a buffer holds an
+// exclusive flock on it for its whole life, so that a second buffer(or
+// recover) on the same path, in this process or another, throws rather than
+// replaying and reinitialising a live ring
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct PersistentLazyWriteBuffer
+{
+  typedef std::function<SizeType(const char *, const SizeType &)> IOInterface;
+
+  /**
+   *  Constructor, replays whatever an earlier instance left unflushed in
+   *  the file(see recover) and starts afresh with an empty ring
+   *  @param path         Path of the backing file, created if it doesn't
+   *                      exist, throws std::runtime_error if it can't be
+   *                      opened/mapped, is in use by another buffer, is not
+   *                      a backing file or its unflushed bytes couldn't be
+   *                      replayed
+   *  @param size         Size of the Buffer
+   *                      throws if size is 0
+   *  @param ioInterface  The synchronous IOInterface to write bytes to,
+   *                      it's an std::function<SizeType(const char*, const SizeType&)>
+   **/
+  PersistentLazyWriteBuffer(const char *path,
+                            const SizeType &size,
+                            const IOInterface &ioInterface) : m_ioInterface(ioInterface),
+                                                              m_size(size),
+                                                              m_fd(-1),
+                                                              m_header(nullptr),
+                                                              m_outBuff(nullptr),
+                                                              m_recoveredBytes(0)
+  {
+    if (!size)
+    {
+      throw std::invalid_argument("size should  be passed as a positive integer");
+    }
+
+    m_fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (m_fd < 0)
+    {
+      throw std::runtime_error("unable to create the backing file");
+    }
+
+    if (flock(m_fd, LOCK_EX | LOCK_NB) < 0)
+    {
+      ::close(m_fd);
+      throw std::runtime_error("the backing file is in use");
+    }
+
+    try
+    {
+      m_recoveredBytes = recoverLocked(m_fd, ioInterface);
+    }
+    catch (...)
+    {
+      ::close(m_fd);
+      throw;
+    }
+
+    if (ftruncate(m_fd, static_cast<off_t>(headerSize() + size)) < 0)
+    {
+      ::close(m_fd);
+      throw std::runtime_error("unable to create the backing file");
+    }
+
+    void *addr = mmap(nullptr, headerSize() + size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      ::close(m_fd);
+      throw std::runtime_error("unable to map the backing file");
+    }
+
+    m_header = static_cast<PersistentBufferHeader *>(addr);
+    m_outBuff = static_cast<char *>(addr) + headerSize();
+    // The magic goes last, a crash before it leaves a file recover() ignores
+    memset(m_header->magic, 0, sizeof(m_header->magic));
+    m_header->capacity = size;
+    m_header->head = m_header->tail = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_header->magic, MAGIC, sizeof(MAGIC));
+  }
+
+  /**
+   *  Write data to interface, same as SyncIOLazyWriteBuffer::write
+   *
+   *  @param out  The data to write
+   *  @param len  No. of bytes to write
+   *
+   *  @return     No. of bytes accepted, less than len only if the
+   *              ioInterface stopped accepting bytes
+   **/
+  SizeType write(const char *out, const SizeType &len)
+  {
+    return lazyWrite(out, len, m_size, [this]()
+                     { return freeBytes(); },
+                     [this](const char *data, const SizeType &toPut)
+                     { put(data, toPut); },
+                     [this](const SizeType &atLeast)
+                     { return drain(atLeast); });
+  }
+
+  /*
+  * Put all of the buffered data to the ioInterface
+  *
+  * @return No. of bytes flushed
+  */
+  SizeType flush()
+  {
+    return drain(occupiedBytes());
+  }
+
+  /*
+  * Write the ring and the header back to the disk(msync), after this
+  * the buffered bytes survive the machine crashing as well
+  *
+  * @return false if msync failed
+  */
+  bool sync()
+  {
+    return !msync(m_header, headerSize() + m_size, MS_SYNC);
+  }
+
+  /**
+   *  Replay the bytes a PersistentLazyWriteBuffer left unflushed in its
+   *  backing file to the ioInterface. The file is updated as the bytes are
+   *  accepted, so a recovery that gets interrupted resumes on the next call
+   *
+   *  @param path         Path of the backing file, a missing or empty file
+   *                      has nothing to recover, a file in use by a buffer
+   *                      or any other file that isn't a backing file throws
+   *                      std::runtime_error
+   *  @param ioInterface  The IOInterface to replay the bytes to
+   *
+   *  @return             No. of bytes replayed, throws std::runtime_error if
+   *                      the ioInterface stops accepting bytes before all the
+   *                      bytes are replayed
+   **/
+  static uint64_t recover(const char *path, const IOInterface &ioInterface)
+  {
+    int fd = ::open(path, O_RDWR);
+    if (fd < 0)
+    {
+      return 0;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+    {
+      ::close(fd);
+      throw std::runtime_error("the backing file is in use");
+    }
+
+    try
+    {
+      uint64_t ret = recoverLocked(fd, ioInterface);
+      ::close(fd);
+      return ret;
+    }
+    catch (...)
+    {
+      ::close(fd);
+      throw;
+    }
+  }
+
+  // No. of bytes replayed by the constructor
+  uint64_t recoveredBytes()
+  {
+    return m_recoveredBytes;
+  }
+
+  /**
+   *  Absolute offset in the output stream of the next byte to be written,
+   *  i.e. no. of bytes accepted by this buffer since construction
+   **/
+  uint64_t position()
+  {
+    return m_header->head;
+  }
+
+  /**
+   *  No. of bytes handed over to the ioInterface since construction
+   **/
+  uint64_t flushedPosition()
+  {
+    return m_header->tail;
+  }
+
+  ~PersistentLazyWriteBuffer()
+  {
+    flush();
+    munmap(m_header, headerSize() + m_size);
+    ::close(m_fd);
+  }
+
+  PersistentLazyWriteBuffer(const PersistentLazyWriteBuffer &) = delete;
+  PersistentLazyWriteBuffer &operator=(const PersistentLazyWriteBuffer &) = delete;
+  PersistentLazyWriteBuffer(PersistentLazyWriteBuffer &&) = delete;
+  PersistentLazyWriteBuffer &operator=(PersistentLazyWriteBuffer &&) = delete;
+
+private:
+  static constexpr char MAGIC[8] = {'B', 'I', 'O', 'P', 'W', 'B', '0', '1'};
+
+  // recover, on a backing file already open and locked, which stays open
+  static uint64_t recoverLocked(const int &fd, const IOInterface &ioInterface)
+  {
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 || !fileStat.st_size)
+    {
+      return 0;
+    }
+
+    uint64_t fileSize = fileStat.st_size;
+    void *addr = fileSize >= headerSize() ? mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (addr == MAP_FAILED)
+    {
+      throw std::runtime_error("not a persistent buffer file");
+    }
+
+    auto *header = static_cast<PersistentBufferHeader *>(addr);
+    const char *ring = static_cast<char *>(addr) + headerSize();
+    uint64_t capacity = header->capacity;
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) ||
+        !capacity ||
+        capacity > fileSize - headerSize() ||
+        header->tail > header->head ||
+        header->head - header->tail > capacity)
+    {
+      // A backing file whose initialisation didn't complete has no magic
+      // and nothing to recover
+      bool initialising = std::all_of(header->magic, header->magic + sizeof(header->magic), [](const char &ch)
+                                      { return !ch; });
+      munmap(addr, fileSize);
+      if (initialising)
+      {
+        return 0;
+      }
+      throw std::runtime_error("not a persistent buffer file");
+    }
+
+    uint64_t ret = 0;
+    while (header->tail < header->head)
+    {
+      uint64_t index = header->tail % capacity;
+      uint64_t toWrite = std::min({header->head - header->tail,
+                                   capacity - index,
+                                   static_cast<uint64_t>(std::numeric_limits<SizeType>::max())});
+      SizeType written = ioInterface(ring + index, static_cast<SizeType>(toWrite));
+      if (!written)
+      {
+        break;
+      }
+
+      std::atomic_ref<uint64_t>(header->tail).store(header->tail + written, std::memory_order_release);
+      ret += written;
+    }
+
+    bool complete = header->tail == header->head;
+    munmap(addr, fileSize);
+    if (!complete)
+    {
+      throw std::runtime_error("unable to replay the unflushed bytes");
+    }
+
+    return ret;
+  }
+
+  // The ring starts on a page boundary
+  static uint64_t headerSize()
+  {
+    static const uint64_t ret = sysconf(_SC_PAGESIZE);
+    return ret;
+  }
+
+  // Copy the bytes into the ring, then publish them by advancing the head
+  void put(const char *outData, const SizeType &len)
+  {
+    if (!len)
+    {
+      return;
+    }
+
+    uint64_t head = m_header->head;
+    SizeType index = static_cast<SizeType>(head % m_size);
+    SizeType l1 = std::min<SizeType>(len, m_size - index);
+    memcpy(m_outBuff + index, outData, l1);
+    memcpy(m_outBuff, outData + l1, len - l1);
+    std::atomic_ref<uint64_t>(m_header->head).store(head + len, std::memory_order_release);
+  }
+
+  // Same as SyncIOLazyWriteBuffer::drain, the tail is advanced only after
+  // the ioInterface accepted the bytes
+  SizeType drain(const SizeType &atLeast)
+  {
+    return drainRing(std::min(atLeast, occupiedBytes()), [this]()
+                     {
+                       uint64_t tail = m_header->tail;
+                       SizeType index = static_cast<SizeType>(tail % m_size);
+                       SizeType toWrite = static_cast<SizeType>(std::min<uint64_t>(m_header->head - tail, m_size - index));
+                       SizeType written = m_ioInterface(m_outBuff + index, toWrite);
+                       return IOResult<SizeType>{written, written ? IOStatus::OK : IOStatus::FAILURE}; },
+                     [this](const SizeType &written)
+                     { std::atomic_ref<uint64_t>(m_header->tail).store(m_header->tail + written, std::memory_order_release); })
+        .bytes;
+  }
+
+  SizeType occupiedBytes()
+  {
+    return static_cast<SizeType>(m_header->head - m_header->tail);
+  }
+
+  SizeType freeBytes()
+  {
+    return m_size - occupiedBytes();
+  }
+
+  const IOInterface m_ioInterface;
+  const SizeType m_size;
+  int m_fd;
+  PersistentBufferHeader *m_header;
+  char *m_outBuff;
+  uint64_t m_recoveredBytes;
+};
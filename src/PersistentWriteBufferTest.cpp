@@ -0,0 +1,90 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include "PersistentWriteBuffer.hpp"
+#include "SmartBuffer.hpp"
+
+// What crash safety costs: a big SyncIOLazyWriteBuffer(fast, loses up to a
+// buffer worth of data on a crash) vs. a PersistentLazyWriteBuffer of the same
+// size vs. a SyncIOLazyWriteBuffer flushed after every record(the usual way to
+// not lose data)
+// Usage: PersistentWriteBufferTest <buffer size> <no. of records> <record size> <output file>
+static double measure(const std::function<void()> &work)
+{
+  auto start = std::chrono::high_resolution_clock().now();
+  work();
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 5)
+  {
+    std::cerr << "Usage: " << argv[0] << " <buffer size> <no. of records> <record size> <output file>\n";
+    return 1;
+  }
+
+  uint32_t buffSize = atoll(argv[1]);
+  uint32_t numRecords = atoll(argv[2]);
+  uint32_t recordSize = atoll(argv[3]);
+  const char *path = argv[4];
+  std::string ringPath = std::string(path) + ".ring";
+  std::string record(recordSize, 'x');
+  record.back() = '\n';
+
+  int fd = -1;
+  auto fdWriter =
+      [&fd](const char *out, const uint32_t &len)
+  {
+    ssize_t ret = ::write(fd, out, len);
+    return static_cast<uint32_t>(ret < 0 ? 0 : ret);
+  };
+
+  double heapDuration = measure(
+      [&]()
+      {
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize, fdWriter);
+        for (uint32_t i = 0; i < numRecords; ++i)
+        {
+          buffer.write(record.c_str(), recordSize);
+        }
+        buffer.flush();
+        ::close(fd);
+      });
+
+  double persistentDuration = measure(
+      [&]()
+      {
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        PersistentLazyWriteBuffer<uint32_t> buffer(ringPath.c_str(), buffSize, fdWriter);
+        for (uint32_t i = 0; i < numRecords; ++i)
+        {
+          buffer.write(record.c_str(), recordSize);
+        }
+        buffer.flush();
+        ::close(fd);
+      });
+
+  double flushEachDuration = measure(
+      [&]()
+      {
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize, fdWriter);
+        for (uint32_t i = 0; i < numRecords; ++i)
+        {
+          buffer.write(record.c_str(), recordSize);
+          buffer.flush();
+        }
+        ::close(fd);
+      });
+
+  unlink(ringPath.c_str());
+  std::cout << "Heap buffer:               " << heapDuration << " s\n"
+            << "Persistent buffer:         " << persistentDuration << " s\n"
+            << "Heap buffer, flush/record: " << flushEachDuration << " s\n";
+  return 0;
+}
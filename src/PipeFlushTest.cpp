@@ -0,0 +1,133 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "SmartBuffer.hpp"
+
+// Throughput of SyncIOLazyWriteBuffer draining into a pipe, whose writes
+// routinely come back short once it is non-blocking
+// Usage: PipeFlushTest <buffer size> <total MB> <record size>
+struct PipeRun
+{
+  int fds[2];
+  std::thread drainer;
+
+  PipeRun(bool nonBlocking)
+  {
+    if (pipe(fds))
+    {
+      throw std::runtime_error("pipe failed");
+    }
+
+    if (nonBlocking)
+    {
+      fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    }
+
+    drainer = std::thread(
+        [fd = fds[0]]()
+        {
+          std::vector<char> sinkBuff(1 << 16);
+          while (::read(fd, sinkBuff.data(), sinkBuff.size()) > 0)
+            ;
+        });
+  }
+
+  ~PipeRun()
+  {
+    ::close(fds[1]);
+    drainer.join();
+    ::close(fds[0]);
+  }
+};
+
+static double measure(const std::function<void()> &work)
+{
+  auto start = std::chrono::high_resolution_clock().now();
+  work();
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <buffer size> <total MB> <record size>\n";
+    return 1;
+  }
+
+  uint32_t buffSize = atoll(argv[1]);
+  uint64_t totalBytes = atoll(argv[2]) * (1ull << 20);
+  uint32_t recordSize = atoll(argv[3]);
+  std::string record(recordSize, 'x');
+  uint64_t numRecords = totalBytes / recordSize;
+
+  double blockingDuration = measure(
+      [&]()
+      {
+        PipeRun run(false);
+        SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize,
+                                               [fd = run.fds[1]](const char *out, const uint32_t &len)
+                                               {
+                                                 ssize_t ret = ::write(fd, out, len);
+                                                 return static_cast<uint32_t>(ret < 0 ? 0 : ret);
+                                               });
+        for (uint64_t i = 0; i < numRecords; ++i)
+        {
+          buffer.write(record.c_str(), recordSize);
+        }
+        buffer.flush();
+      });
+
+  uint64_t shortWrites = 0;
+  double nonBlockingDuration = measure(
+      [&]()
+      {
+        PipeRun run(true);
+        int fd = run.fds[1];
+        SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize,
+                                               [fd, &shortWrites](const char *out, const uint32_t &len)
+                                               {
+                                                 ssize_t ret = ::write(fd, out, len);
+                                                 if (ret < 0)
+                                                 {
+                                                   return IOResult<uint32_t>{0, errno == EAGAIN ? IOStatus::WOULD_BLOCK : IOStatus::FAILURE};
+                                                 }
+                                                 shortWrites += static_cast<uint32_t>(ret) < len;
+                                                 return IOResult<uint32_t>{static_cast<uint32_t>(ret), IOStatus::OK};
+                                               });
+
+        auto waitWritable =
+            [fd]()
+        {
+          pollfd pfd{fd, POLLOUT, 0};
+          poll(&pfd, 1, -1);
+        };
+
+        for (uint64_t i = 0; i < numRecords; ++i)
+        {
+          uint32_t accepted = 0;
+          while ((accepted += buffer.tryWrite(record.c_str() + accepted, recordSize - accepted).bytes) < recordSize)
+          {
+            waitWritable();
+          }
+        }
+
+        while (buffer.tryFlush().status == IOStatus::WOULD_BLOCK)
+        {
+          waitWritable();
+        }
+      });
+
+  double mb = numRecords * recordSize / (double)(1 << 20);
+  std::cout << "Blocking pipe:     " << mb / blockingDuration << " MB/s\n"
+            << "Non-blocking pipe: " << mb / nonBlockingDuration << " MB/s ("
+            << shortWrites << " short writes)\n";
+  return 0;
+}
@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <vector>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define RECEIVE_TIMESTAMPS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RECEIVE_TIMESTAMPS_TSC
+#endif
+#ifdef __linux__
+#include <sys/socket.h>
+#include <time.h>
+#endif
+
+// Where the receive timestamps come from
+enum class TimestampClock
+{
+  MONOTONIC, // std::chrono::steady_clock at the paste
+  TSC,       // rdtsc at the paste, converted to ns(x86 only, MONOTONIC elsewhere)
+  SOCKET     // the kernel's receive timestamp(SO_TIMESTAMPNS, i.e. std::chrono::system_clock), see socketTimestampReader
+};
+
+// Side ring of receive timestamps for a read buffer(see
+// SyncIOReadBuffer::setTimestamps, AsyncIOReadBuffer::setTimestamps).
+// The buffer reports every paste with the stream positions it covers, the
+// ring keeps the last 'capacity' of them with the time of the paste:
+//
+// m_entries |[start, end) time|[start, end) time|...
+//
+// The positions only grow, so the entry a byte came in with is found with a
+// binary search. Once more than 'capacity' pastes are in the buffer at once,
+// the oldest ones lose their timestamps
+struct TimestampRing
+{
+  /**
+   *  Constructor
+   *  @param capacity No. of pastes to remember, deemed 1 if 0
+   *  @param clock    See TimestampClock
+   **/
+  TimestampRing(const uint32_t &capacity = 1024,
+                const TimestampClock &clock = TimestampClock::MONOTONIC) : m_entries(std::max<uint32_t>(capacity, 1)),
+                                                                           m_clock(clock),
+                                                                           m_count(0),
+                                                                           m_pendingTimestamp(0),
+                                                                           m_lastFound(0)
+  {
+#ifdef RECEIVE_TIMESTAMPS_TSC
+    // Not on the first paste
+    if (clock == TimestampClock::TSC)
+    {
+      nsPerTick();
+    }
+#endif
+  }
+
+  /**
+   * Record a paste of the bytes [start, end) of the stream, called by the
+   * buffers
+   **/
+  void onPaste(const uint64_t &start, const uint64_t &end)
+  {
+    uint64_t timestamp = m_clock == TimestampClock::SOCKET && m_pendingTimestamp ? m_pendingTimestamp : now();
+    m_pendingTimestamp = 0;
+    m_entries[m_count++ % m_entries.size()] = {start, end, timestamp};
+  }
+
+  /**
+   * The kernel timestamp of the data about to be pasted, for the SOCKET
+   * clock, to be called by the IOInterface before it returns
+   **/
+  void setSocketTimestamp(const uint64_t &timestamp)
+  {
+    m_pendingTimestamp = timestamp;
+  }
+
+  /**
+   * When the byte at 'position' in the stream was received
+   *
+   * @return  ns, in the domain of the clock(see now()), std::nullopt if the
+   *          byte hasn't been received or its paste has been forgotten
+   **/
+  std::optional<uint64_t> timestampOf(const uint64_t &position)
+  {
+    uint64_t first = m_count > m_entries.size() ? m_count - m_entries.size() : 0;
+    uint64_t last = m_count;
+    // The bytes are mostly asked for in order, try where the last one was
+    // found first
+    if (m_lastFound >= first && m_lastFound < last &&
+        entry(m_lastFound).start <= position && position < entry(m_lastFound).end)
+    {
+      return entry(m_lastFound).timestamp;
+    }
+
+    // First entry with end > position
+    while (first < last)
+    {
+      uint64_t mid = first + (last - first) / 2;
+      if (entry(mid).end <= position)
+      {
+        first = mid + 1;
+      }
+      else
+      {
+        last = mid;
+      }
+    }
+
+    if (first == m_count || entry(first).start > position)
+    {
+      return std::nullopt;
+    }
+
+    m_lastFound = first;
+    return entry(first).timestamp;
+  }
+
+  // Current time in the domain of the clock, ns
+  uint64_t now()
+  {
+    switch (m_clock)
+    {
+    case TimestampClock::SOCKET:
+      return sinceEpoch<std::chrono::system_clock>();
+#ifdef RECEIVE_TIMESTAMPS_TSC
+    case TimestampClock::TSC:
+      return static_cast<uint64_t>(__rdtsc() * nsPerTick());
+#endif
+    default:
+      return sinceEpoch<std::chrono::steady_clock>();
+    }
+  }
+
+  // Forget everything, for when the stream is repositioned
+  void clear()
+  {
+    m_count = m_lastFound = 0;
+    m_pendingTimestamp = 0;
+  }
+
+  TimestampClock clock()
+  {
+    return m_clock;
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t start;
+    uint64_t end;
+    uint64_t timestamp;
+  };
+
+  Entry &entry(const uint64_t &index)
+  {
+    return m_entries[index % m_entries.size()];
+  }
+
+  template <class Clock>
+  static uint64_t sinceEpoch()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+#ifdef RECEIVE_TIMESTAMPS_TSC
+  // Calibrated once against the monotonic clock, assumes an invariant TSC
+  static double nsPerTick()
+  {
+    static const double ret = []()
+    {
+      uint64_t startNs = sinceEpoch<std::chrono::steady_clock>();
+      uint64_t startTicks = __rdtsc();
+      while (sinceEpoch<std::chrono::steady_clock>() - startNs < 10000000)
+        ;
+      return (sinceEpoch<std::chrono::steady_clock>() - startNs) / static_cast<double>(__rdtsc() - startTicks);
+    }();
+    return ret;
+  }
+#endif
+
+  std::vector<Entry> m_entries;
+  const TimestampClock m_clock;
+  uint64_t m_count;
+  uint64_t m_pendingTimestamp;
+  uint64_t m_lastFound;
+};
+
+#ifdef __linux__
+/**
+ * Turn on the kernel receive timestamps(SO_TIMESTAMPNS) on a socket
+ *
+ * @return  false on failure
+ **/
+inline bool enableSocketTimestamps(const int &fd)
+{
+  int on = 1;
+  return !setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+}
+
+/**
+ * IOInterface reading from a socket with SO_TIMESTAMPNS turned on, every
+ * read hands the kernel receive timestamp over to the ring(which should use
+ * TimestampClock::SOCKET)
+ **/
+template <class SizeType>
+std::function<SizeType(char *, const SizeType &)> socketTimestampReader(const int &fd, TimestampRing &timestamps)
+{
+  return [fd, &timestamps](char *out, const SizeType &len)
+  {
+    iovec iov = {out, len};
+    char control[CMSG_SPACE(sizeof(timespec))];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t ret = recvmsg(fd, &msg, 0);
+    if (ret <= 0)
+    {
+      return SizeType(0);
+    }
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+      {
+        timespec ts;
+        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        timestamps.setSocketTimestamp(static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec);
+      }
+    }
+
+    return static_cast<SizeType>(ret);
+  };
+}
+#endif
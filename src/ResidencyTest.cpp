@@ -0,0 +1,93 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "SmartBuffer.hpp"
+
+// Cost of receive timestamps and the buffer residency they measure. Lines
+// are read with readUntil from an in-memory source in chunks of <read size>
+// bytes, and each line is "processed" for <work per line in ns>, so a byte
+// waits in the buffer for the lines before it in its chunk.
+// Usage: ResidencyTest <total MB> <read size> <work per line in ns>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void work(const uint64_t &ns)
+{
+  uint64_t start = now();
+  while (now() - start < ns)
+    ;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <total MB> <read size> <work per line in ns>\n";
+    return 1;
+  }
+
+  uint64_t total = atoll(argv[1]) << 20;
+  uint32_t readSize = atoll(argv[2]);
+  uint64_t workNs = atoll(argv[3]);
+
+  std::string line(63, 'x');
+  line += '\n';
+  std::string source;
+  while (source.length() < (1 << 20))
+  {
+    source += line;
+  }
+
+  const char *names[] = {"No timestamps", "Monotonic clock", "TSC"};
+  for (int mode = 0; mode < 3; ++mode)
+  {
+    uint64_t offset = 0;
+    auto ioInterface = [&](char *out, const uint32_t &len)
+    {
+      uint32_t toRead = std::min<uint64_t>({len, readSize, total - offset});
+      for (uint32_t copied = 0; copied < toRead;)
+      {
+        uint32_t at = (offset + copied) % source.length();
+        uint32_t chunk = std::min<uint64_t>(toRead - copied, source.length() - at);
+        memcpy(out + copied, source.c_str() + at, chunk);
+        copied += chunk;
+      }
+      offset += toRead;
+      return toRead;
+    };
+
+    TimestampRing timestamps(1024, mode == 2 ? TimestampClock::TSC : TimestampClock::MONOTONIC);
+    BufferStats stats;
+    SyncIOReadBuffer<uint32_t> buffer(1 << 16);
+    if (mode)
+    {
+      buffer.setTimestamps(&timestamps);
+      buffer.setStats(&stats);
+    }
+
+    char out[128];
+    uint64_t lines = 0;
+    uint64_t start = now();
+    while (buffer.readUntil(out, ioInterface, '\n'))
+    {
+      work(workNs);
+      ++lines;
+    }
+    uint64_t elapsed = now() - start;
+
+    std::cout << names[mode] << ":\n"
+              << "  Time per line: " << static_cast<double>(elapsed) / lines << " ns\n";
+    if (mode)
+    {
+      std::cout << "  Residency p50: " << stats.residency.percentile(50) << " ns\n"
+                << "  Residency p99: " << stats.residency.percentile(99) << " ns\n"
+                << "  Residency max: " << stats.residency.max() << " ns\n";
+    }
+  }
+
+  return 0;
+}
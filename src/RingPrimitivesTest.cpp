@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "BufferTestAccess.hpp"
+
+// ns per call and GB/s of each private ring primitive of the sync buffers,
+// timed in isolation through BufferTestAccess, for every power of 2 length
+// from 1 byte to [max size](1 MB by default). Where a call changes the
+// layout of the buffer, it's put back with BufferTestAccess::place(a few
+// stores, timed along with the call) before every call:
+// copy(contiguous)     - SyncIOReadBuffer::copy, len bytes from offset 0
+// copy(wrapped)        - same, the bytes split around the end of the ring
+// put(contiguous)      - SyncIOLazyWriteBuffer::put, len bytes at offset 0
+// put(wrapped)         - same, split around the end of the ring
+// paste                - SyncIOReadBuffer::paste of len free bytes from a
+//                        source that returns at once without touching them
+// pasteFromInterface   - same, the contiguous variant
+// occupiedBytes        - of a wrapped ring holding len bytes
+// findLengthTill(char) - len buffered bytes, the ender the last of them
+// findLengthTill(pred) - same, with an std::function as the ender
+// GB/s is len bytes per call, so for paste it's the bookkeeping around a
+// source that costs nothing, and for occupiedBytes it's meaningless
+// Usage: RingPrimitivesTest [max size]
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+typedef SyncIOReadBuffer<uint32_t> ReadBuffer;
+typedef SyncIOLazyWriteBuffer<uint32_t> WriteBuffer;
+
+// About 64 MB worth of calls of a primitive, but not too few or too many
+static uint64_t iterationsFor(const uint32_t &len)
+{
+  return std::clamp<uint64_t>((1ull << 26) / len, 64, 1 << 22);
+}
+
+// Results consumed here can't be optimized away
+static volatile uint64_t g_sink;
+
+static void report(const char *name, const uint32_t &len, const uint64_t &iterations, const uint64_t &elapsed)
+{
+  double nsPerCall = static_cast<double>(elapsed) / iterations;
+  std::cout << name << "\t" << len << "\t" << nsPerCall << "\t" << len / nsPerCall << "\n";
+}
+
+// Runs 'call' iterationsFor(len) times, after a warmup of a tenth of that
+template <class Call>
+static void time(const char *name, const uint32_t &len, const Call &call)
+{
+  uint64_t iterations = iterationsFor(len);
+  for (uint64_t i = 0; i < iterations / 10; ++i)
+  {
+    call();
+  }
+
+  uint64_t start = now();
+  for (uint64_t i = 0; i < iterations; ++i)
+  {
+    call();
+  }
+  report(name, len, iterations, now() - start);
+}
+
+static void copy(const uint32_t &len, std::vector<char> &out)
+{
+  ReadBuffer buffer(2 * len);
+  time("copy(contiguous)", len, [&]()
+       {
+         BufferTestAccess::place(buffer, 0u, 2 * len);
+         BufferTestAccess::copy(buffer, out.data(), len); });
+
+  // Half of the bytes before the end of the ring, half after
+  if (len > 1)
+  {
+    time("copy(wrapped)", len, [&]()
+         {
+           BufferTestAccess::place(buffer, 2 * len - len / 2, 2 * len);
+           BufferTestAccess::copy(buffer, out.data(), len); });
+  }
+}
+
+static void put(const uint32_t &len, const std::vector<char> &in)
+{
+  WriteBuffer buffer(2 * len, [](const char *, const uint32_t &toWrite)
+                     { return toWrite; });
+  time("put(contiguous)", len, [&]()
+       {
+         BufferTestAccess::place(buffer, 0u, 0u);
+         BufferTestAccess::put(buffer, in.data(), len); });
+
+  if (len > 1)
+  {
+    time("put(wrapped)", len, [&]()
+         {
+           BufferTestAccess::place(buffer, 2 * len - len / 2, 0u);
+           BufferTestAccess::put(buffer, in.data(), len); });
+  }
+}
+
+static void paste(const uint32_t &len)
+{
+  ReadBuffer buffer(len);
+  ReadBuffer::IOInterface source = [](char *, const uint32_t &toRead)
+  {
+    return toRead;
+  };
+
+  time("paste", len, [&]()
+       {
+         BufferTestAccess::place(buffer, 0u, 0u);
+         g_sink = BufferTestAccess::paste(buffer, source); });
+  time("pasteFromInterface", len, [&]()
+       {
+         BufferTestAccess::place(buffer, 0u, 0u);
+         g_sink = BufferTestAccess::pasteFromInterface(buffer, source, len); });
+}
+
+static void occupiedBytes(const uint32_t &len)
+{
+  ReadBuffer buffer(2 * len);
+  BufferTestAccess::place(buffer, 2 * len - len / 2, len);
+  time("occupiedBytes", len, [&]()
+       { g_sink = BufferTestAccess::occupiedBytes(buffer); });
+}
+
+static void findLengthTill(const uint32_t &len)
+{
+  ReadBuffer buffer(len);
+  BufferTestAccess::place(buffer, 0u, len);
+  memset(BufferTestAccess::data(buffer), 'a', len);
+  BufferTestAccess::data(buffer)[len - 1] = '\n';
+  time("findLengthTill(char)", len, [&]()
+       { g_sink = *BufferTestAccess::findLengthTill(buffer, '\n'); });
+
+  std::function<bool(const char &)> ender = [](const char &c)
+  {
+    return c == '\n';
+  };
+  time("findLengthTill(pred)", len, [&]()
+       { g_sink = *BufferTestAccess::findLengthTill(buffer, ender); });
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t maxSize = argc > 1 ? atoll(argv[1]) : 1 << 20;
+  if (!maxSize)
+  {
+    std::cerr << "Usage: " << argv[0] << " [max size]\n";
+    return 1;
+  }
+
+  std::vector<char> bytes(maxSize, 'a');
+  std::cout << "Primitive\tBytes\tns/call\tGB/s\n";
+  for (uint32_t len = 1; len && len <= maxSize; len *= 2)
+  {
+    copy(len, bytes);
+    put(len, bytes);
+    paste(len);
+    occupiedBytes(len);
+    findLengthTill(len);
+  }
+
+  return 0;
+}
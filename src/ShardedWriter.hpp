@@ -0,0 +1,416 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include "SmartBuffer.hpp"
+
+// Order of the records in the output of a ShardedWriter
+enum class MergeOrder
+{
+  STRICT,  // The order the records were written in, across all the shards
+  BOUNDED, // Same, unless a shard has too much held back(see ShardedWriter)
+  RELAXED  // Every shard's records in order, records of different shards in
+           // timestamp order only among the ones flushed by the time they
+           // are merged
+};
+
+// Many threads writing records into one IOInterface without sharing a lock
+// or a buffer: every thread writes into a Shard of its own(a
+// SyncIOLazyWriteBuffer), whose flushes are handed over to a merger thread,
+// which does a k-way merge of the shards into the IOInterface. Every record
+// carries a key:
+//
+// shard buffer |key(u64)|len(SizeType)|record bytes|key|len|record bytes|...
+//
+// In STRICT order the key is a sequence no. taken from a counter shared by
+// the shards(an atomic increment per record) and the merger writes the
+// records in exactly that order, holding back whatever comes after a record
+// that is still sitting in a shard, for as long as it takes and in as much
+// memory as it takes. So the shards should flush whenever they go idle(e.g.
+// FlushDeadline). BOUNDED order bounds the wait: once a shard has 4 times its
+// size held back, the merger writes on past the missing records, and writes
+// them as they come(see lateRecords). In RELAXED order the key is a
+// timestamp(a steady_clock::now() per record, a vDSO call of some tens of ns
+// on Linux), the shards share nothing and the merger never waits.
+//
+// Whatever the order, a shard only ever waits for the merger to take what
+// it flushed, which the merger does on every pass, holding back or not
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct ShardedWriter
+{
+  typedef typename SyncIOLazyWriteBuffer<SizeType>::IOInterface IOInterface;
+
+  // The writing end of a thread, not thread safe, a shard per thread
+  struct Shard
+  {
+    Shard(ShardedWriter &writer,
+          const SizeType &size) : m_writer(writer),
+                                  m_buffer(size,
+                                           [this](const char *out, const SizeType &len)
+                                           {
+                                             handOver(out, len);
+                                             return len;
+                                           }),
+                                  m_limit(static_cast<size_t>(size) * 4)
+    {
+    }
+
+    /**
+     * Write a record, it is handed over to the merger when the shard
+     * flushes(when its buffer is full, or on flush)
+     * throws std::invalid_argument if 'len' doesn't fit in SizeType
+     **/
+    void write(const char *out, const size_t &len)
+    {
+      if constexpr (sizeof(SizeType) < sizeof(size_t))
+      {
+        if (len > std::numeric_limits<SizeType>::max())
+        {
+          throw std::invalid_argument("len should  be passed as at most the max of SizeType");
+        }
+      }
+
+      SizeType recordLen = static_cast<SizeType>(len);
+      char header[HEADER_SIZE];
+      uint64_t key = m_writer.m_order != MergeOrder::RELAXED ? m_writer.m_sequence.fetch_add(1, std::memory_order_relaxed)
+                                                             : now();
+      memcpy(header, &key, sizeof(key));
+      memcpy(header + sizeof(key), &recordLen, sizeof(recordLen));
+      m_buffer.write(header, HEADER_SIZE);
+      m_buffer.write(out, recordLen);
+    }
+
+    // Hand the buffered records over to the merger
+    void flush()
+    {
+      m_buffer.flush();
+    }
+
+    Shard(const Shard &) = delete;
+    Shard &operator=(const Shard &) = delete;
+    Shard(Shard &&) = delete;
+    Shard &operator=(Shard &&) = delete;
+
+  private:
+    friend struct ShardedWriter;
+
+    // A shard running ahead of the merger waits for it once it has m_limit
+    // bytes waiting to be taken, which bounds the memory of the shard. Not
+    // while closing, the merger waits for all the shards then. The merger
+    // takes everything flushed on every pass, before holding any of it back
+    // in writeMerged, so this never waits on another shard
+    void handOver(const char *out, const SizeType &len)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_taken.wait(lock, [this]()
+                     { return m_flushed.length() < m_limit || m_writer.m_flushingAll; });
+        m_flushed.append(out, len);
+      }
+      m_writer.notify();
+    }
+
+    ShardedWriter &m_writer;
+    // Flushed bytes not yet taken by the merger, guarded by m_mutex, which
+    // only this shard and the merger ever take
+    std::mutex m_mutex;
+    std::condition_variable m_taken;
+    std::string m_flushed;
+    SyncIOLazyWriteBuffer<SizeType> m_buffer;
+    const size_t m_limit;
+  };
+
+  /**
+   *  Constructor, starts the merger thread
+   *  @param numShards    No. of shards, throws if 0
+   *  @param shardSize    Size of the buffer of a shard, throws if 0
+   *  @param outputSize   Size of the buffer the merger writes through,
+   *                      throws if 0
+   *  @param ioInterface  The ioInterface to write the merged records to,
+   *                      called only by the merger
+   *  @param order        See MergeOrder
+   **/
+  ShardedWriter(const uint32_t &numShards,
+                const SizeType &shardSize,
+                const SizeType &outputSize,
+                const IOInterface &ioInterface,
+                const MergeOrder &order = MergeOrder::STRICT) : m_order(order),
+                                                                m_output(outputSize, ioInterface),
+                                                                m_nextSequence(0),
+                                                                m_lostBytes(0),
+                                                                m_lateRecords(0),
+                                                                m_sequence(0),
+                                                                m_dirty(false),
+                                                                m_flushingAll(false),
+                                                                m_closing(false),
+                                                                m_closed(false)
+  {
+    if (!numShards || !shardSize)
+    {
+      throw std::invalid_argument("numShards and shardSize should  be passed as positive integers");
+    }
+
+    for (uint32_t i = 0; i < numShards; ++i)
+    {
+      m_shards.emplace_back(std::make_unique<Shard>(*this, shardSize));
+    }
+    m_pending.resize(numShards);
+    m_merger = std::thread([this]()
+                           { merge(); });
+  }
+
+  Shard &shard(const uint32_t &index)
+  {
+    return *m_shards[index];
+  }
+
+  uint32_t numShards()
+  {
+    return static_cast<uint32_t>(m_shards.size());
+  }
+
+  /**
+   * Bytes of records the ioInterface didn't take, as it stopped accepting
+   * bytes(see SyncIOLazyWriteBuffer::write), or still not taken when the
+   * writer closed. Those records are cut short or missing in the output.
+   * Can be called from any thread
+   **/
+  uint64_t lostBytes()
+  {
+    return m_lostBytes.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * No. of records written after records that came after them, in BOUNDED
+   * order, as the merger stopped waiting for them(see above). Always 0 in
+   * the other orders. Can be called from any thread
+   **/
+  uint64_t lateRecords()
+  {
+    return m_lateRecords.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Flush all the shards, merge everything and stop the merger. The shards
+   * must not be written to any more
+   **/
+  void close()
+  {
+    if (m_closed)
+    {
+      return;
+    }
+
+    // The merger waits for all of them, so the last merge sees everything
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_flushingAll = true;
+    }
+
+    for (auto &shard : m_shards)
+    {
+      shard->flush();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closing = true;
+    }
+    m_condition.notify_one();
+    m_merger.join();
+    m_closed = true;
+  }
+
+  ~ShardedWriter()
+  {
+    close();
+  }
+
+  ShardedWriter(const ShardedWriter &) = delete;
+  ShardedWriter &operator=(const ShardedWriter &) = delete;
+  ShardedWriter(ShardedWriter &&) = delete;
+  ShardedWriter &operator=(ShardedWriter &&) = delete;
+
+private:
+  static constexpr uint32_t HEADER_SIZE = sizeof(uint64_t) + sizeof(SizeType);
+
+  // Records of a shard taken by the merger, not yet written
+  struct Pending
+  {
+    std::string bytes;
+    size_t offset = 0;
+  };
+
+  static uint64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void notify()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_dirty = true;
+    }
+    m_condition.notify_one();
+  }
+
+  void merge()
+  {
+    while (true)
+    {
+      bool closing;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]()
+                         { return (m_dirty && !m_flushingAll) || m_closing; });
+        closing = m_closing;
+        m_dirty = false;
+      }
+
+      for (uint32_t i = 0; i < m_shards.size(); ++i)
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_shards[i]->m_mutex);
+          if (m_pending[i].bytes.empty())
+          {
+            // The shard gets back the memory of the records already written
+            std::swap(m_pending[i].bytes, m_shards[i]->m_flushed);
+          }
+          else
+          {
+            m_pending[i].bytes.append(m_shards[i]->m_flushed);
+          }
+          m_shards[i]->m_flushed.clear();
+        }
+        m_shards[i]->m_taken.notify_one();
+      }
+
+      writeMerged();
+      // Nothing more for now
+      m_output.flush();
+      if (closing)
+      {
+        // What the ioInterface still didn't take
+        m_lostBytes.fetch_add(m_output.position() - m_output.flushedPosition(), std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+
+  // A shard has as many bytes held back as it may have waiting to be taken,
+  // not counting a record that is still being taken(e.g. a long one)
+  bool heldBackTooMuch()
+  {
+    uint64_t key;
+    SizeType len;
+    for (uint32_t i = 0; i < m_pending.size(); ++i)
+    {
+      if (m_pending[i].bytes.length() - m_pending[i].offset >= m_shards[i]->m_limit && head(i, key, len))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Key of the next complete record of a shard
+  bool head(const uint32_t &shard, uint64_t &key, SizeType &len)
+  {
+    Pending &pending = m_pending[shard];
+    if (pending.bytes.length() - pending.offset < HEADER_SIZE)
+    {
+      return false;
+    }
+
+    memcpy(&key, pending.bytes.data() + pending.offset, sizeof(key));
+    memcpy(&len, pending.bytes.data() + pending.offset + sizeof(key), sizeof(len));
+    return pending.bytes.length() - pending.offset - HEADER_SIZE >= len;
+  }
+
+  // k-way merge of the complete records taken from the shards, every
+  // shard's records are already in order of their keys
+  void writeMerged()
+  {
+    typedef std::pair<uint64_t, uint32_t> Head;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    uint64_t key = 0;
+    SizeType len = 0;
+    for (uint32_t i = 0; i < m_pending.size(); ++i)
+    {
+      if (head(i, key, len))
+      {
+        heads.push({key, i});
+      }
+    }
+
+    while (!heads.empty())
+    {
+      auto [minKey, shard] = heads.top();
+      if (m_order != MergeOrder::RELAXED && minKey > m_nextSequence)
+      {
+        // The next one is still in some shard
+        if (m_order == MergeOrder::STRICT || !heldBackTooMuch())
+        {
+          break;
+        }
+        m_nextSequence = minKey;
+      }
+      else if (m_order == MergeOrder::BOUNDED && minKey < m_nextSequence)
+      {
+        // Skipped earlier
+        m_lateRecords.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      heads.pop();
+      Pending &pending = m_pending[shard];
+      head(shard, key, len);
+      SizeType written = m_output.write(pending.bytes.data() + pending.offset + HEADER_SIZE, len);
+      m_lostBytes.fetch_add(len - written, std::memory_order_relaxed);
+      pending.offset += HEADER_SIZE + len;
+      m_nextSequence = std::max(m_nextSequence, minKey + 1);
+      if (head(shard, key, len))
+      {
+        heads.push({key, shard});
+      }
+    }
+
+    for (auto &pending : m_pending)
+    {
+      pending.bytes.erase(0, pending.offset);
+      pending.offset = 0;
+    }
+  }
+
+  const MergeOrder m_order;
+  std::vector<std::unique_ptr<Shard>> m_shards;
+  // The merger's
+  SyncIOLazyWriteBuffer<SizeType> m_output;
+  std::vector<Pending> m_pending;
+  uint64_t m_nextSequence;
+  std::atomic<uint64_t> m_lostBytes;
+  std::atomic<uint64_t> m_lateRecords;
+  // Alone on its cache line, the only thing the shards share per record
+  alignas(64) std::atomic<uint64_t> m_sequence;
+  alignas(64) std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_dirty;
+  std::atomic<bool> m_flushingAll;
+  bool m_closing;
+  bool m_closed;
+  std::thread m_merger;
+};
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ShardedWriter.hpp"
+
+// Many threads writing 64 byte records into one IOInterface(discarding the
+// bytes): a SyncIOLazyWriteBuffer shared under a mutex vs. ShardedWriter in
+// both orders, for 1, 2, 4 ... <max threads> threads, each writing
+// <records per thread> records
+// Usage: ShardedWriterTest <max threads> <records per thread> <shard size>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Records/s of 'numThreads' threads calling write(thread, record)
+template <class Write>
+static double run(const uint32_t &numThreads, const uint64_t &numRecords, const Write &write)
+{
+  std::vector<std::thread> threads;
+  uint64_t start = now();
+  for (uint32_t t = 0; t < numThreads; ++t)
+  {
+    threads.emplace_back([&, t]()
+                         {
+                           char record[64] = {};
+                           for (uint64_t i = 0; i < numRecords; ++i)
+                           {
+                             record[0] = static_cast<char>(i);
+                             write(t, record);
+                           } });
+  }
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  return numThreads * numRecords * 1e9 / (now() - start);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <max threads> <records per thread> <shard size>\n";
+    return 1;
+  }
+
+  uint32_t maxThreads = atoll(argv[1]);
+  uint64_t numRecords = atoll(argv[2]);
+  uint32_t shardSize = atoll(argv[3]);
+  std::atomic<uint64_t> written(0);
+  auto ioInterface = [&written](const char *, const uint32_t &len)
+  {
+    written.fetch_add(len, std::memory_order_relaxed);
+    return len;
+  };
+
+  std::cout << "Threads\tMutex(Mrecords/s)\tStrict(Mrecords/s)\tRelaxed(Mrecords/s)\n";
+  for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+  {
+    std::cout << numThreads;
+    {
+      std::mutex mutex;
+      SyncIOLazyWriteBuffer<uint32_t> buffer(shardSize, ioInterface);
+      std::cout << "\t" << run(numThreads, numRecords, [&](const uint32_t &, const char *record)
+                               {
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 buffer.write(record, 64); }) /
+                               1e6;
+    }
+
+    for (MergeOrder order : {MergeOrder::STRICT, MergeOrder::RELAXED})
+    {
+      // Timed till all the records are merged
+      uint64_t start = now();
+      {
+        ShardedWriter<uint32_t> writer(numThreads, shardSize, 1 << 16, ioInterface, order);
+        run(numThreads, numRecords, [&](const uint32_t &thread, const char *record)
+            { writer.shard(thread).write(record, 64); });
+      }
+      std::cout << "\t" << numThreads * numRecords * 1e3 / (now() - start);
+    }
+
+    std::cout << std::endl;
+  }
+
+  return written ? 0 : 1;
+}
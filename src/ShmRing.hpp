@@ -0,0 +1,329 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "BusyPoll.hpp"
+
+// Layout of the first page of a ShmRing mapping, the ring follows it.
+// head/tail are stream positions(no. of bytes written/read), the ring index
+// being position % capacity. Each side only ever stores to its own position,
+// the producer's and the consumer's fields are kept on separate cache lines
+struct ShmRingHeader
+{
+  explicit ShmRingHeader(const uint64_t &capacity) : capacity(capacity),
+                                                     closed(0),
+                                                     head(0),
+                                                     dataSeq(0),
+                                                     writerWaiting(0),
+                                                     tail(0),
+                                                     spaceSeq(0),
+                                                     readerWaiting(0)
+  {
+  }
+
+  uint64_t capacity;
+  std::atomic<uint32_t> closed;
+
+  // Producer side
+  alignas(64) std::atomic<uint64_t> head;
+  // Futex word the reader waits on when the ring is empty
+  std::atomic<uint32_t> dataSeq;
+  std::atomic<uint32_t> writerWaiting;
+
+  // Consumer side
+  alignas(64) std::atomic<uint64_t> tail;
+  // Futex word the writer waits on when the ring is full
+  std::atomic<uint32_t> spaceSeq;
+  std::atomic<uint32_t> readerWaiting;
+};
+
+// Single producer single consumer byte ring in shared memory(Linux only),
+// for moving a stream between processes(or threads) without the two kernel
+// copies of a pipe or a socket. One process writes, one reads, each through
+// its own ShmRing mapping the same memory:
+//
+//   int fd = ShmRing::create(1 << 20);        // memfd, inherited over fork()
+//   // or ShmRing::create(1 << 20, "/name") and ShmRing::open("/name")
+//   ShmRing ring(fd);
+//
+//   // Writer process
+//   SyncIOLazyWriteBuffer<uint32_t>::IOInterface ioInterface =
+//       [&ring](const char *data, const uint32_t &len) { return ring.write(data, len); };
+//   // Reader process
+//   SyncIOReadBuffer<uint32_t>::IOInterface ioInterface =
+//       [&ring](char *out, const uint32_t &len) { return ring.read(out, len); };
+//
+// read/write never block while there is something to read/room to write,
+// they take what is there. Only an empty(for read) or a full(for write) ring
+// blocks, on a futex, and the other side does a futex wake only when
+// someone is actually waiting
+struct ShmRing
+{
+  /**
+   * Create the shared memory for a ring
+   *
+   * @param capacity  Size of the ring in bytes
+   * @param name      nullptr for an anonymous memfd, to be shared by
+   *                  inheriting(fork) or passing the fd, otherwise the
+   *                  POSIX shared memory name(shm_open) to create
+   *
+   * @return          The fd to construct ShmRings with, throws
+   *                  std::runtime_error on failure
+   **/
+  static int create(const uint64_t &capacity, const char *name = nullptr)
+  {
+    if (!capacity)
+    {
+      throw std::invalid_argument("capacity should  be passed as a positive integer");
+    }
+
+    int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600) : memfd_create("ShmRing", 0);
+    if (fd < 0)
+    {
+      throw std::runtime_error("unable to create the shared memory");
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(headerSize() + capacity)) < 0)
+    {
+      ::close(fd);
+      throw std::runtime_error("unable to size the shared memory");
+    }
+
+    void *addr = mmap(nullptr, headerSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      ::close(fd);
+      throw std::runtime_error("unable to map the shared memory");
+    }
+    new (addr) ShmRingHeader(capacity);
+    munmap(addr, headerSize());
+    return fd;
+  }
+
+  /**
+   * Open the shared memory of a ring created with a name
+   *
+   * @return  The fd to construct ShmRings with, -1 on failure
+   **/
+  static int open(const char *name)
+  {
+    return shm_open(name, O_RDWR, 0600);
+  }
+
+  /**
+   *  Constructor, maps the ring, the fd is not needed afterwards
+   *  @param fd An fd returned by create or open, throws std::runtime_error
+   *            if it can't be mapped
+   **/
+  ShmRing(const int &fd) : m_header(nullptr),
+                           m_ring(nullptr),
+                           m_capacity(0),
+                           m_busyPoll(false)
+  {
+    struct stat fdStat;
+    if (fstat(fd, &fdStat) < 0 || static_cast<uint64_t>(fdStat.st_size) <= headerSize())
+    {
+      throw std::runtime_error("not a ShmRing");
+    }
+
+    void *addr = mmap(nullptr, fdStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      throw std::runtime_error("unable to map the shared memory");
+    }
+
+    m_header = static_cast<ShmRingHeader *>(addr);
+    m_ring = static_cast<char *>(addr) + headerSize();
+    m_capacity = m_header->capacity;
+    if (m_capacity != fdStat.st_size - headerSize())
+    {
+      munmap(addr, fdStat.st_size);
+      throw std::runtime_error("not a ShmRing");
+    }
+  }
+
+  /**
+   * Consumer side IOInterface, reads whatever is in the ring(at most len
+   * bytes), blocks only if the ring is empty
+   *
+   * @return  No. of bytes read, 0 once the ring is closed and drained
+   **/
+  template <class SizeType>
+  SizeType read(char *out, const SizeType &len)
+  {
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+    uint64_t head;
+    while ((head = m_header->head.load(std::memory_order_acquire)) == tail)
+    {
+      if (m_header->closed.load(std::memory_order_acquire))
+      {
+        // Bytes written before closing are still to be read
+        if (m_header->head.load(std::memory_order_acquire) == tail)
+        {
+          return 0;
+        }
+        continue;
+      }
+
+      if (m_busyPoll && m_spinWaiter.spin([this, tail]()
+                                          { return m_header->head.load(std::memory_order_acquire) != tail ||
+                                                   m_header->closed.load(std::memory_order_relaxed); }))
+      {
+        continue;
+      }
+
+      wait(m_header->dataSeq, m_header->readerWaiting,
+           [this, tail]()
+           { return m_header->head.load(std::memory_order_seq_cst) != tail; });
+    }
+
+    SizeType ret = static_cast<SizeType>(std::min<uint64_t>(head - tail, len));
+    uint64_t index = tail % m_capacity;
+    uint64_t l1 = std::min<uint64_t>(ret, m_capacity - index);
+    memcpy(out, m_ring + index, l1);
+    memcpy(out + l1, m_ring, ret - l1);
+    m_header->tail.store(tail + ret, std::memory_order_seq_cst);
+    wake(m_header->spaceSeq, m_header->writerWaiting);
+    return ret;
+  }
+
+  /**
+   * Producer side IOInterface, writes as much as there is room for(at most
+   * len bytes), blocks only if the ring is full
+   *
+   * @return  No. of bytes written, 0 once the ring is closed
+   **/
+  template <class SizeType>
+  SizeType write(const char *data, const SizeType &len)
+  {
+    uint64_t head = m_header->head.load(std::memory_order_relaxed);
+    uint64_t tail;
+    while (head - (tail = m_header->tail.load(std::memory_order_acquire)) == m_capacity)
+    {
+      if (m_header->closed.load(std::memory_order_acquire))
+      {
+        return 0;
+      }
+
+      if (m_busyPoll && m_spinWaiter.spin([this, head]()
+                                          { return head - m_header->tail.load(std::memory_order_acquire) != m_capacity ||
+                                                   m_header->closed.load(std::memory_order_relaxed); }))
+      {
+        continue;
+      }
+
+      wait(m_header->spaceSeq, m_header->writerWaiting,
+           [this, head]()
+           { return head - m_header->tail.load(std::memory_order_seq_cst) != m_capacity; });
+    }
+
+    if (m_header->closed.load(std::memory_order_acquire))
+    {
+      return 0;
+    }
+
+    SizeType ret = static_cast<SizeType>(std::min<uint64_t>(m_capacity - (head - tail), len));
+    uint64_t index = head % m_capacity;
+    uint64_t l1 = std::min<uint64_t>(ret, m_capacity - index);
+    memcpy(m_ring + index, data, l1);
+    memcpy(m_ring, data + l1, ret - l1);
+    m_header->head.store(head + ret, std::memory_order_seq_cst);
+    wake(m_header->dataSeq, m_header->readerWaiting);
+    return ret;
+  }
+
+  /**
+   * Close the ring from either side, a reader gets the bytes already
+   * written and then 0, a writer gets 0. Wakes up whoever is waiting
+   **/
+  void close()
+  {
+    m_header->closed.store(1, std::memory_order_seq_cst);
+    m_header->dataSeq.fetch_add(1, std::memory_order_seq_cst);
+    m_header->spaceSeq.fetch_add(1, std::memory_order_seq_cst);
+    futex(m_header->dataSeq, FUTEX_WAKE, INT32_MAX);
+    futex(m_header->spaceSeq, FUTEX_WAKE, INT32_MAX);
+  }
+
+  /**
+   * Spin on the other side's position, with pause, before blocking on the
+   * futex, for this side of the ring(the mapping it went through), see
+   * BusyPollOptions
+   *
+   * @return  false if the thread couldn't be pinned
+   **/
+  bool setBusyPoll(const BusyPollOptions &options)
+  {
+    m_spinWaiter = SpinWaiter(options);
+    m_busyPoll = true;
+    return options.cpu < 0 || pinToCpu(options.cpu);
+  }
+
+  uint64_t capacity()
+  {
+    return m_capacity;
+  }
+
+  ~ShmRing()
+  {
+    munmap(m_header, headerSize() + m_capacity);
+  }
+
+  ShmRing(const ShmRing &) = delete;
+  ShmRing &operator=(const ShmRing &) = delete;
+  ShmRing(ShmRing &&) = delete;
+  ShmRing &operator=(ShmRing &&) = delete;
+
+private:
+  static uint64_t headerSize()
+  {
+    static const uint64_t ret = std::max<uint64_t>(sysconf(_SC_PAGESIZE), sizeof(ShmRingHeader));
+    return ret;
+  }
+
+  // Not FUTEX_PRIVATE_FLAG, the word is shared between processes
+  static long futex(std::atomic<uint32_t> &word, const int &op, const uint32_t &val)
+  {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), op, val, nullptr, nullptr, 0);
+  }
+
+  // Announce the wait, then recheck, the other side publishes its position
+  // before checking for waiters, so(all of it being seq_cst) either the
+  // recheck sees the new position or the other side sees the waiter and
+  // bumps the sequence, failing the futex wait
+  template <class Ready>
+  void wait(std::atomic<uint32_t> &seq, std::atomic<uint32_t> &waiting, const Ready &ready)
+  {
+    uint32_t current = seq.load(std::memory_order_seq_cst);
+    waiting.store(1, std::memory_order_seq_cst);
+    if (!ready() && !m_header->closed.load(std::memory_order_seq_cst))
+    {
+      futex(seq, FUTEX_WAIT, current);
+    }
+    waiting.store(0, std::memory_order_relaxed);
+  }
+
+  void wake(std::atomic<uint32_t> &seq, std::atomic<uint32_t> &waiting)
+  {
+    if (waiting.load(std::memory_order_seq_cst))
+    {
+      seq.fetch_add(1, std::memory_order_seq_cst);
+      futex(seq, FUTEX_WAKE, 1);
+    }
+  }
+
+  ShmRingHeader *m_header;
+  char *m_ring;
+  uint64_t m_capacity;
+  bool m_busyPoll;
+  SpinWaiter m_spinWaiter;
+};
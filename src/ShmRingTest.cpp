@@ -0,0 +1,208 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "ShmRing.hpp"
+#include "SmartBuffer.hpp"
+
+// Throughput and round trip latency between two processes over a pipe, a
+// UNIX socket and a ShmRing
+// Usage: ShmRingTest <MB to stream> <buffer size> <no. of round trips> <message size>
+typedef SyncIOReadBuffer<uint32_t>::IOInterface Reader;
+typedef SyncIOLazyWriteBuffer<uint32_t>::IOInterface Writer;
+
+// One direction of a transport, 'close' ends the stream for the reader,
+// 'forget' lets the reading process drop its copy of the write end
+struct Channel
+{
+  Reader read;
+  Writer write;
+  std::function<void()> close;
+  std::function<void()> forget;
+};
+
+static double measure(const std::function<void()> &work)
+{
+  auto start = std::chrono::high_resolution_clock().now();
+  work();
+  auto duration = std::chrono::high_resolution_clock().now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / (double)1000000000;
+}
+
+static Channel fdChannel(const int &readFd, const int &writeFd)
+{
+  return {[readFd](char *out, const uint32_t &len)
+          {
+            ssize_t ret = ::read(readFd, out, len);
+            return static_cast<uint32_t>(ret < 0 ? 0 : ret);
+          },
+          [writeFd](const char *data, const uint32_t &len)
+          {
+            ssize_t ret = ::write(writeFd, data, len);
+            return static_cast<uint32_t>(ret < 0 ? 0 : ret);
+          },
+          [writeFd]()
+          {
+            ::close(writeFd);
+          },
+          [writeFd]()
+          {
+            ::close(writeFd);
+          }};
+}
+
+static Channel pipeChannel()
+{
+  int fds[2];
+  if (pipe(fds) < 0)
+  {
+    throw std::runtime_error("pipe failed");
+  }
+  return fdChannel(fds[0], fds[1]);
+}
+
+static Channel socketChannel()
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+  {
+    throw std::runtime_error("socketpair failed");
+  }
+  return fdChannel(fds[0], fds[1]);
+}
+
+static Channel shmChannel(const uint64_t &capacity)
+{
+  int fd = ShmRing::create(capacity);
+  // Shared by the two processes through fork, never unmapped
+  auto *ring = new ShmRing(fd);
+  ::close(fd);
+  return {[ring](char *out, const uint32_t &len)
+          {
+            return ring->read(out, len);
+          },
+          [ring](const char *data, const uint32_t &len)
+          {
+            return ring->write(data, len);
+          },
+          [ring]()
+          {
+            ring->close();
+          },
+          []() {}};
+}
+
+static void writeAll(Channel &channel, const char *data, const uint32_t &len)
+{
+  for (uint32_t done = 0; done < len;)
+  {
+    done += channel.write(data + done, len - done);
+  }
+}
+
+static void readAll(Channel &channel, char *out, const uint32_t &len)
+{
+  for (uint32_t done = 0; done < len;)
+  {
+    done += channel.read(out + done, len - done);
+  }
+}
+
+// Child reads everything through a SyncIOReadBuffer, the parent writes
+// through a SyncIOLazyWriteBuffer
+static double throughput(Channel channel, const uint64_t &total, const uint32_t &buffSize)
+{
+  pid_t child = fork();
+  if (!child)
+  {
+    channel.forget();
+    SyncIOReadBuffer<uint32_t> buffer(buffSize);
+    std::vector<char> out(buffSize);
+    while (buffer.read(out.data(), buffSize, channel.read))
+      ;
+    _exit(0);
+  }
+
+  double duration = measure(
+      [&]()
+      {
+        std::vector<char> data(4096, 'x');
+        SyncIOLazyWriteBuffer<uint32_t> buffer(buffSize, channel.write);
+        for (uint64_t written = 0; written < total; written += data.size())
+        {
+          buffer.write(data.data(), data.size());
+        }
+        buffer.flush();
+        channel.close();
+        waitpid(child, nullptr, 0);
+      });
+  return total / duration / (1 << 20);
+}
+
+// Child echoes the messages back, returns the one way latencies in ns
+static std::vector<uint64_t> pingPong(Channel ping, Channel pong, const uint32_t &numRoundTrips, const uint32_t &msgSize)
+{
+  pid_t child = fork();
+  std::vector<char> msg(msgSize, 'p');
+  if (!child)
+  {
+    for (uint32_t i = 0; i < numRoundTrips; ++i)
+    {
+      readAll(ping, msg.data(), msgSize);
+      writeAll(pong, msg.data(), msgSize);
+    }
+    _exit(0);
+  }
+
+  std::vector<uint64_t> ret;
+  ret.reserve(numRoundTrips);
+  for (uint32_t i = 0; i < numRoundTrips; ++i)
+  {
+    auto start = std::chrono::steady_clock::now();
+    writeAll(ping, msg.data(), msgSize);
+    readAll(pong, msg.data(), msgSize);
+    ret.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 2);
+  }
+  waitpid(child, nullptr, 0);
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 5)
+  {
+    std::cerr << "Usage: " << argv[0] << " <MB to stream> <buffer size> <no. of round trips> <message size>\n";
+    return 1;
+  }
+
+  uint64_t total = atoll(argv[1]) << 20;
+  uint32_t buffSize = atoll(argv[2]);
+  uint32_t numRoundTrips = atoll(argv[3]);
+  uint32_t msgSize = atoll(argv[4]);
+  const uint64_t ringCapacity = 1 << 20;
+
+  struct Transport
+  {
+    const char *name;
+    std::function<Channel()> make;
+  };
+  const Transport transports[] = {{"pipe", pipeChannel},
+                                  {"UNIX socket", socketChannel},
+                                  {"ShmRing", [&]()
+                                   { return shmChannel(ringCapacity); }}};
+
+  for (auto &transport : transports)
+  {
+    double mbps = throughput(transport.make(), total, buffSize);
+    auto latencies = pingPong(transport.make(), transport.make(), numRoundTrips, msgSize);
+    std::cout << transport.name << ":\n"
+              << "  Throughput:          " << mbps << " MB/s\n"
+              << "  One way latency p50: " << latencies[latencies.size() / 2] << " ns\n"
+              << "  One way latency p99: " << latencies[latencies.size() * 99 / 100] << " ns\n";
+  }
+  return 0;
+}
@@ -1,16 +1,59 @@
 #pragma once
 #include <concepts>
+#include <cstdint>
 #include <stdexcept>
 #include <functional>
+#include <new>
 #include <optional>
+#include <utility>
 #include <string.h>
+#include "BufferPolicies.hpp"
 
-// SizeType should be an unsigned integral type
+// Test-only access to the private ring primitives of the buffers, see
+// BufferTestAccess.hpp
+struct BufferTestAccess;
+
+// Outcome of a call to a non-blocking IOInterface
+enum class IOStatus
+{
+  OK,            // Some bytes were transferred
+  WOULD_BLOCK,   // Nothing can be transferred right now, retry when the source/sink is ready
+  END_OF_STREAM, // Nothing will ever be transferred again
+  FAILURE        // The IOInterface failed
+};
+
+// Result of a call to a non-blocking IOInterface
+// An IOInterface returning 0 bytes with IOStatus::OK is treated as
+// IOStatus::WOULD_BLOCK
 template <class SizeType>
 requires std::unsigned_integral<SizeType>
+struct IOResult
+{
+  SizeType bytes;
+  IOStatus status;
+};
+
+// When a sync buffer gets its memory
+enum class Allocation
+{
+  EAGER, // At construction
+  LAZY   // On the first paste/put, so that a buffer never used costs nothing
+};
+
+// SizeType should be an unsigned integral type
+// StoragePolicy, StatsPolicy and LockPolicy are described in
+// BufferPolicies.hpp, the defaults are a malloced buffer that a LineIndex,
+// a TimestampRing and BufferStats can be attached to, and that isn't thread
+// safe
+template <class SizeType,
+          class StoragePolicy = HeapStorage,
+          class StatsPolicy = AttachableStats,
+          class LockPolicy = NoLock>
+requires std::unsigned_integral<SizeType>
 struct SyncIOReadBuffer
 {
   typedef std::function<SizeType(char *, const SizeType &)> IOInterface;
+  typedef std::function<IOResult<SizeType>(char *, const SizeType &)> NonBlockingIOInterface;
   enum class LastOperation
   {
     COPY,
@@ -20,19 +63,36 @@ struct SyncIOReadBuffer
 
   /**
    *  Constructor
-   *  @param size Size of the Buffer
-   *              throws if size is 0
+   *  @param size       Size of the Buffer
+   *                    throws if size is 0 or doesn't fit in the
+   *                    StoragePolicy
+   *  @param allocation When to allocate the memory of the buffer, see
+   *                    Allocation and releaseIfIdle
    **/
-  SyncIOReadBuffer(const SizeType &size) : m_readBuff(reinterpret_cast<char *>(malloc(size))),
-                                           m_tail(0),
-                                           m_head(0),
-                                           m_size(size),
-                                           m_lastOperation(LastOperation::NONE)
+  SyncIOReadBuffer(const SizeType &size,
+                   const Allocation &allocation = Allocation::EAGER) : m_tail(0),
+                                                                       m_head(0),
+                                                                       m_size(size),
+                                                                       m_lastOperation(LastOperation::NONE),
+                                                                       m_pendingLen(0),
+                                                                       m_scannedLen(0),
+                                                                       m_position(0),
+                                                                       m_idleSweeps(0)
   {
     if (!size)
     {
       throw std::invalid_argument("size should  be passed as a positive integer");
     }
+
+    if (!StoragePolicy::fits(size))
+    {
+      throw std::invalid_argument("size should not exceed the capacity of the StoragePolicy");
+    }
+
+    if (allocation == Allocation::EAGER)
+    {
+      m_storage.allocate(size);
+    }
   }
 
   /**
@@ -48,6 +108,7 @@ struct SyncIOReadBuffer
                 const SizeType &len,
                 const IOInterface &ioInterface)
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     SizeType ret = 0;
     if (occupiedBytes() >= len)
     {
@@ -72,7 +133,7 @@ struct SyncIOReadBuffer
           // if remaining length to copy, i.e, len - ret <= occupiedBytes(),
           // then copy only the remaining Len, otherwise copy all the occupied
           // bytes and continue
-          uint32_t toCopy = std::min(occupiedBytes(), len - ret);
+          SizeType toCopy = std::min<SizeType>(occupiedBytes(), len - ret);
           copy(out + ret, toCopy);
           ret += toCopy;
         }
@@ -99,6 +160,7 @@ struct SyncIOReadBuffer
                      const IOInterface &ioInterface,
                      const char &ender)
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     SizeType ret = 0;
     SizeType occBytes = occupiedBytes();
     if (!occBytes)
@@ -108,7 +170,7 @@ struct SyncIOReadBuffer
 
     if (occBytes)
     {
-      auto len = findLengthTill(ender);
+      auto len = scan(ender);
       // Found ender
       if (len)
       {
@@ -124,7 +186,7 @@ struct SyncIOReadBuffer
           occBytes = occupiedBytes();
           copy(out + ret, occBytes);
           ret += occBytes;
-        } while (paste(ioInterface) && !(len = findLengthTill(ender)));
+        } while (paste(ioInterface) && !(len = scan(ender)));
 
         if (len)
         {
@@ -134,6 +196,12 @@ struct SyncIOReadBuffer
       }
     }
 
+    if (ret && out[ret - 1] == ender)
+    {
+      onLineEnd(ender);
+    }
+
+    onRecord(ret);
     return ret;
   }
 
@@ -154,6 +222,7 @@ struct SyncIOReadBuffer
                      const IOInterface &ioInterface,
                      const std::function<bool(const char &)> &ender)
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     SizeType ret = 0;
     SizeType occBytes = occupiedBytes();
     if (!occBytes)
@@ -163,7 +232,7 @@ struct SyncIOReadBuffer
 
     if (occBytes)
     {
-      auto len = findLengthTill(ender);
+      auto len = scan(ender);
       // Found ender
       if (len)
       {
@@ -179,7 +248,7 @@ struct SyncIOReadBuffer
           occBytes = occupiedBytes();
           copy(out + ret, occBytes);
           ret += occBytes;
-        } while (paste(ioInterface) && !(len = findLengthTill(ender)));
+        } while (paste(ioInterface) && !(len = scan(ender)));
 
         if (len)
         {
@@ -189,84 +258,383 @@ struct SyncIOReadBuffer
       }
     }
 
+    onRecord(ret);
     return ret;
   }
 
-  std::optional<SizeType> findLengthTill(const char& ender)
+  /**
+   * Non-blocking counterpart of read
+   * Copies whatever is buffered and then reads from the IOInterface until
+   * 'len' bytes are copied or the IOInterface stops yielding bytes
+   *
+   * @param out         The memory to read the bytes into
+   * @param len         The max no. of bytes to read
+   * @param ioInterface The non-blocking IOInterface to read bytes from,
+   *                    it's an std::function<IOResult<SizeType>(char *, const SizeType &)>
+   *
+   * @return            No. of bytes copied into 'out', the status is
+   *                    IOStatus::OK if any byte was copied, otherwise the
+   *                    status the IOInterface reported
+   **/
+  IOResult<SizeType> tryRead(char *const &out,
+                             const SizeType &len,
+                             const NonBlockingIOInterface &ioInterface)
   {
-    std::optional<SizeType> ret;
-    SizeType occBytes = occupiedBytes();
-
-    SizeType offset = 0;
-     for (;
-          offset < occBytes && ender != m_readBuff[(m_tail + offset) % m_size];
-          ++offset);
+    [[maybe_unused]] auto guard = m_lock.guard();
+    IOResult<SizeType> ret{std::min(occupiedBytes(), len), IOStatus::OK};
+    copy(out, ret.bytes);
 
-    if (offset < occBytes)
+    while (ret.bytes < len)
     {
-      ret = offset + 1;
+      auto pasted = paste(ioInterface);
+      if (!pasted.bytes)
+      {
+        ret.status = ret.bytes ? IOStatus::OK : pasted.status;
+        break;
+      }
+
+      SizeType toCopy = std::min<SizeType>(occupiedBytes(), len - ret.bytes);
+      copy(out + ret.bytes, toCopy);
+      ret.bytes += toCopy;
     }
 
     return ret;
   }
 
-  std::optional<SizeType> findLengthTill(const std::function<bool(const char&)>& ender)
+  /**
+   * Non-blocking counterpart of readUntil, meant to be driven by readiness
+   * notifications(e.g. edge-triggered epoll)
+   * If the IOInterface would block before the 'ender' is met, the progress
+   * is kept in the buffer and IOStatus::WOULD_BLOCK is returned, the next
+   * call resumes from there. As part of the record may already have been
+   * copied into 'out'(when it didn't fit in the buffer), the next call has to
+   * be made with the same 'out'
+   *
+   * @param out         The memory to read the bytes into
+   * @param ioInterface The non-blocking IOInterface to read bytes from,
+   *                    it's an std::function<IOResult<SizeType>(char *, const SizeType &)>
+   * @param ender       The character marking the end of this read
+   *
+   * @return            {length of the record including 'ender', IOStatus::OK}
+   *                    when a record is complete,
+   *                    {0, IOStatus::WOULD_BLOCK} when the record is incomplete,
+   *                    {length of the trailing bytes, END_OF_STREAM/FAILURE}
+   *                    when the IOInterface can't give any more data, the
+   *                    trailing bytes without an 'ender' are copied into 'out'
+   **/
+  IOResult<SizeType> tryReadUntil(char *const &out,
+                                  const NonBlockingIOInterface &ioInterface,
+                                  const char &ender)
   {
-    std::optional<SizeType> ret;
-    SizeType occBytes = occupiedBytes();
-
-    SizeType offset = 0;
-    for (;
-         offset < occBytes && !ender(m_readBuff[(m_tail + offset) % m_size]);
-         ++offset)
-      ;
-
-    if (offset < occBytes)
+    [[maybe_unused]] auto guard = m_lock.guard();
+    auto ret = tryReadUntilImpl(out, ioInterface, ender);
+    if (ret.bytes && out[ret.bytes - 1] == ender)
     {
-      ret = offset + 1;
+      onLineEnd(ender);
     }
 
+    onRecord(ret.bytes);
+    return ret;
+  }
+
+  /**
+   * Non-blocking counterpart of readUntil with a predicate as 'ender',
+   * behaves the same as the overload with a character as 'ender'
+   *
+   * @param out         The memory to read the bytes into
+   * @param ioInterface The non-blocking IOInterface to read bytes from,
+   *                    it's an std::function<IOResult<SizeType>(char *, const SizeType &)>
+   * @param ender       The predicate detrmining whether a character qualifies
+   *                    as end of the read
+   *
+   * @return            Same as the overload with a character as 'ender'
+   **/
+  IOResult<SizeType> tryReadUntil(char *const &out,
+                                  const NonBlockingIOInterface &ioInterface,
+                                  const std::function<bool(const char &)> &ender)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    auto ret = tryReadUntilImpl(out, ioInterface, ender);
+    onRecord(ret.bytes);
     return ret;
   }
 
+  /**
+   * Length of the buffered bytes up to and including the first 'ender',
+   * searched from the 'from'th buffered byte on
+   *
+   * @return  std::nullopt if no 'ender' is buffered
+   **/
+  std::optional<SizeType> findLengthTill(const char &ender, const SizeType &from = 0)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return scan(ender, from);
+  }
+
+  // Same as the overload with a character as 'ender', with a predicate
+  std::optional<SizeType> findLengthTill(const std::function<bool(const char &)> &ender,
+                                         const SizeType &from = 0)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return scan(ender, from);
+  }
+
   bool empty()
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     return occupiedBytes() == 0;
   }
 
   bool full()
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     return freeBytes() == 0;
   }
 
   SizeType size()
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     return occupiedBytes();
   }
 
   SizeType capacity()
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     return m_size;
   }
 
   SizeType vacancy()
   {
+    [[maybe_unused]] auto guard = m_lock.guard();
     return freeBytes();
   }
 
-  ~SyncIOReadBuffer()
+  /**
+   * Discard bytes from the provided IOInterface until the character
+   * provided as 'ender' is met, or the ioInterface reads 0 bytes.
+   * Same as readUntil, without copying the bytes anywhere
+   *
+   * @param ioInterface The sysnchronous IOInterface to read bytes from,
+   *                    it's an std::function<SizeType(char *, const SizeType &)>
+   * @param ender       The character marking the end of the skipped bytes
+   *
+   * @return            No. of bytes skipped
+   **/
+  uint64_t skipUntil(const IOInterface &ioInterface, const char &ender)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    uint64_t ret = 0;
+    while (occupiedBytes() || paste(ioInterface))
+    {
+      if (auto len = scan(ender); len)
+      {
+        discard(*len);
+        onLineEnd(ender);
+        onRecord(ret + *len);
+        return ret + *len;
+      }
+
+      SizeType occBytes = occupiedBytes();
+      discard(occBytes);
+      ret += occBytes;
+    }
+
+    onRecord(ret);
+    return ret;
+  }
+
+  /**
+   * Attach a LineIndex that gets the offset of every line ended by its
+   * delimiter, as the lines are consumed through readUntil, tryReadUntil or
+   * skipUntil with that delimiter as 'ender'. Bytes consumed through
+   * read/tryRead are not scanned.
+   * The index is borrowed, it has to outlive this buffer or be detached by
+   * passing nullptr. Only if the StatsPolicy allows it(LINE_INDEX)
+   **/
+  void setLineIndex(LineIndex *lineIndex) requires StatsPolicy::LINE_INDEX
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    m_attached.lineIndex = lineIndex;
+  }
+
+  /**
+   * Drop all the buffered bytes, for when the IOInterface has been
+   * repositioned(e.g. with lseek) and the buffered bytes are stale.
+   * Back at offset 0 an attached LineIndex is back at line 0 too, any other
+   * position has to be set on the index by the caller
+   *
+   * @param position  The absolute offset the IOInterface now reads from
+   **/
+  void reset(const uint64_t &position)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    m_head = m_tail = 0;
+    m_lastOperation = LastOperation::NONE;
+    m_pendingLen = m_scannedLen = 0;
+    m_position = position;
+    if constexpr (StatsPolicy::LINE_INDEX)
+    {
+      if (m_attached.lineIndex && !position)
+      {
+        m_attached.lineIndex->setCurrentLine(0);
+      }
+    }
+    if constexpr (StatsPolicy::TIMESTAMPS)
+    {
+      if (m_attached.timestamps)
+      {
+        m_attached.timestamps->clear();
+      }
+    }
+  }
+
+  /**
+   * Attach a TimestampRing that records when every paste from the
+   * IOInterface happened, see timestampOf.
+   * The ring is borrowed, it has to outlive this buffer or be detached by
+   * passing nullptr. Only if the StatsPolicy allows it(TIMESTAMPS)
+   **/
+  void setTimestamps(TimestampRing *timestamps) requires StatsPolicy::TIMESTAMPS
   {
-    free(m_readBuff);
+    [[maybe_unused]] auto guard = m_lock.guard();
+    m_attached.timestamps = timestamps;
   }
 
-  // Non copyable-assignable, Non moveable-move assinable for the reasons of
-  // Simplicity
+  /**
+   * Attach BufferStats to be kept up to date by this buffer. Residency is
+   * recorded only while a TimestampRing is attached too, record lengths and
+   * occupancy always.
+   * The stats are borrowed, they have to outlive this buffer or be detached
+   * by passing nullptr. Only if the StatsPolicy allows it(STATS)
+   **/
+  void setStats(BufferStats *stats) requires StatsPolicy::STATS
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    m_attached.stats = stats;
+  }
+
+  /**
+   * Export the calls to the IOInterface, the occupancy and the no. of
+   * records to a slot of a StatsExporter(see StatsExporter.hpp), with
+   * relaxed stores. The slot is borrowed, it has to outlive this buffer or
+   * be detached by passing nullptr
+   **/
+  void setExport(StatsSlot *slot) requires StatsPolicy::EXPORTED
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    m_attached.slot = slot;
+    if (m_attached.slot)
+    {
+      m_attached.slot->attach(SlotKind::READ, m_size);
+    }
+  }
+
+  /**
+   * When the byte at 'position'(see position()) was pasted from the
+   * IOInterface
+   *
+   * @return  ns, in the domain of the TimestampRing's clock, std::nullopt if
+   *          no TimestampRing is attached or it no longer remembers the byte
+   **/
+  std::optional<uint64_t> timestampOf(const uint64_t &position) requires StatsPolicy::TIMESTAMPS
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return m_attached.timestamps ? m_attached.timestamps->timestampOf(position) : std::nullopt;
+  }
+
+  /**
+   * Absolute offset in the stream of the next byte to be handed out, i.e.
+   * no. of bytes consumed from this buffer since construction.
+   * Always 64-bit, regardless of SizeType
+   **/
+  uint64_t position()
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return m_position;
+  }
+
+  /**
+   * Give the memory of the buffer back to the allocator if the buffer has
+   * stayed empty for a while, it is allocated again by the next paste.
+   * Meant to be called periodically for every buffer(e.g. from a TimerWheel
+   * timer), no clock is read on the read path: every call while the buffer
+   * is empty is counted as a sweep, every paste starts the count over
+   *
+   * @param sweeps  No. of consecutive sweeps the buffer has to be found
+   *                empty by, without a paste in between, i.e. it has been
+   *                idle for at least sweeps - 1 periods
+   *
+   * @return        true if the memory was released by this call
+   **/
+  bool releaseIfIdle(const uint32_t &sweeps = 1)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    if (!m_storage.allocated() || occupiedBytes())
+    {
+      m_idleSweeps = 0;
+      return false;
+    }
+
+    if (++m_idleSweeps < sweeps)
+    {
+      return false;
+    }
+
+    m_idleSweeps = 0;
+    return m_storage.release();
+  }
+
+  // Whether the buffer holds its memory right now
+  bool allocated()
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return m_storage.allocated();
+  }
+
+  // Non copyable-assignable, for the reasons of Simplicity
   SyncIOReadBuffer(const SyncIOReadBuffer &) = delete;
   SyncIOReadBuffer &operator=(const SyncIOReadBuffer &) = delete;
-  SyncIOReadBuffer(SyncIOReadBuffer &&) = delete;
-  SyncIOReadBuffer &operator=(SyncIOReadBuffer &&) = delete;
+
+  /**
+   * Takes over the memory, the buffered bytes and the attached helpers of
+   * 'other', which is left as if just constructed with Allocation::LAZY,
+   * so the buffers can be kept by value in containers. Whatever refers to
+   * 'other'(e.g. a CFileAdapter stream) still refers to 'other'
+   **/
+  SyncIOReadBuffer(SyncIOReadBuffer &&other) noexcept : m_size(other.m_size),
+                                                        m_storage(std::move(other.m_storage))
+  {
+    takeOver(other);
+  }
+
+  SyncIOReadBuffer &operator=(SyncIOReadBuffer &&other) noexcept
+  {
+    if (this != &other)
+    {
+      m_size = other.m_size;
+      m_storage = std::move(other.m_storage);
+      takeOver(other);
+    }
+
+    return *this;
+  }
 
 private:
+  friend struct BufferTestAccess;
+
+  // Move the state of 'other', other than its storage, into this buffer
+  void takeOver(SyncIOReadBuffer &other)
+  {
+    m_lastOperation = std::exchange(other.m_lastOperation, LastOperation::NONE);
+    m_tail = std::exchange(other.m_tail, 0);
+    m_head = std::exchange(other.m_head, 0);
+    m_pendingLen = std::exchange(other.m_pendingLen, 0);
+    m_scannedLen = std::exchange(other.m_scannedLen, 0);
+    m_position = std::exchange(other.m_position, 0);
+    m_attached = std::exchange(other.m_attached, StatsPolicy{});
+    m_idleSweeps = std::exchange(other.m_idleSweeps, 0);
+  }
+
 
   /**
    * Copy some bytes into the provided outBuffer
@@ -285,6 +653,8 @@ private:
       return;
     }
 
+    onConsume();
+
     // Case 1: m_tail < m_head:
     // Before:
     //                    len
@@ -333,18 +703,19 @@ private:
     if (m_tail < m_head ||        //  Case 1
         len <= (m_size - m_tail)) //  Case 2
     {
-      memcpy(out, m_readBuff + m_tail, len);
+      memcpy(out, m_storage.data() + m_tail, len);
       m_tail = (m_tail + len) % m_size;
     }
     else  // case 3
     {
       const SizeType l1 = m_size - m_tail;
       const SizeType l2 = len - l1;
-      memcpy(out, m_readBuff + m_tail, l1);
-      memcpy(out + l1, m_readBuff, l2);
+      memcpy(out, m_storage.data() + m_tail, l1);
+      memcpy(out + l1, m_storage.data(), l2);
       m_tail = l2;
     }
 
+    m_position += len;
     m_lastOperation = LastOperation::COPY;
     if (!occupiedBytes())
     {
@@ -397,6 +768,7 @@ private:
     SizeType bytesReadFromIOInterface = 0;
     if (auto free = freeBytes(); free)
     {
+      allocate();
       SizeType lengthTillEnd = m_size - m_head;
 
       // if freeBytes() < lengthTillEnd, then free memory contiguous ans a single read
@@ -424,15 +796,262 @@ private:
   {
     SizeType ret = 0;
     if (len &&
-        (ret = ioInterface(m_readBuff + m_head, len)))
+        (ret = ioInterface(m_storage.data() + m_head, len)))
     {
         m_head = (m_head + ret) % m_size;
         m_lastOperation = LastOperation::PASTE;
+        onPaste(ret);
+    }
+
+    if (len)
+    {
+      onIoCall(ret);
+    }
+
+    return ret;
+  }
+
+  // Drop len buffered bytes, assumes that len <= occupiedBytes
+  void discard(const SizeType &len)
+  {
+    if (!len)
+    {
+      return;
+    }
+
+    onConsume();
+    m_tail = (m_tail + len) % m_size;
+    m_position += len;
+    m_lastOperation = LastOperation::COPY;
+    if (!occupiedBytes())
+    {
+      m_head = m_tail = 0;
+    }
+  }
+
+  // About to paste, the memory may not have been allocated yet or may have
+  // been released, the buffer is empty then, so m_head and m_tail are at 0
+  void allocate()
+  {
+    m_idleSweeps = 0;
+    m_storage.allocate(m_size);
+  }
+
+  // 'len' bytes have just been pasted, they end at the occupied bytes
+  void onPaste(const SizeType &len)
+  {
+    if constexpr (StatsPolicy::TIMESTAMPS)
+    {
+      if (m_attached.timestamps)
+      {
+        uint64_t end = m_position + occupiedBytes();
+        m_attached.timestamps->onPaste(end - len, end);
+      }
+    }
+
+    if constexpr (StatsPolicy::STATS)
+    {
+      if (m_attached.stats)
+      {
+        m_attached.stats->occupancy.record(occupiedBytes());
+      }
+    }
+  }
+
+  // Buffered bytes from m_position on are about to be consumed(copied out
+  // or discarded), one residency sample for the first of them. A call
+  // consuming bytes already buffered records one sample, a call that
+  // refills the buffer on the way records one more per refill
+  void onConsume()
+  {
+    if constexpr (StatsPolicy::STATS && StatsPolicy::TIMESTAMPS)
+    {
+      if (m_attached.stats && m_attached.timestamps)
+      {
+        if (auto timestamp = m_attached.timestamps->timestampOf(m_position))
+        {
+          uint64_t now = m_attached.timestamps->now();
+          m_attached.stats->residency.record(now > *timestamp ? now - *timestamp : 0);
+        }
+      }
+    }
+  }
+
+  // A record of 'len' bytes(trailing bytes without an ender included) has
+  // just been consumed, 0 if there was none
+  void onRecord(const uint64_t &len)
+  {
+    if constexpr (StatsPolicy::STATS)
+    {
+      if (m_attached.stats && len)
+      {
+        m_attached.stats->recordLength.record(len);
+      }
+    }
+
+    if constexpr (StatsPolicy::EXPORTED)
+    {
+      if (m_attached.slot && len)
+      {
+        m_attached.slot->onRecord();
+      }
+    }
+  }
+
+  // The IOInterface has just been called and returned 'len'
+  void onIoCall(const SizeType &len)
+  {
+    if constexpr (StatsPolicy::EXPORTED)
+    {
+      if (m_attached.slot)
+      {
+        m_attached.slot->onIoCall(len, occupiedBytes());
+      }
+    }
+  }
+
+  // A record ended by 'ender' has just been consumed
+  void onLineEnd(const char &ender)
+  {
+    if constexpr (StatsPolicy::LINE_INDEX)
+    {
+      if (m_attached.lineIndex && ender == m_attached.lineIndex->delimiter())
+      {
+        m_attached.lineIndex->onLine(m_position);
+      }
+    }
+  }
+
+  std::optional<SizeType> scan(const char& ender, const SizeType& from = 0)
+  {
+    std::optional<SizeType> ret;
+    SizeType occBytes = occupiedBytes();
+
+    SizeType offset = from;
+     for (;
+          offset < occBytes && ender != m_storage.data()[(m_tail + offset) % m_size];
+          ++offset);
+
+    if (offset < occBytes)
+    {
+      ret = offset + 1;
     }
 
     return ret;
   }
 
+  std::optional<SizeType> scan(const std::function<bool(const char&)>& ender,
+                                         const SizeType& from = 0)
+  {
+    std::optional<SizeType> ret;
+    SizeType occBytes = occupiedBytes();
+
+    SizeType offset = from;
+    for (;
+         offset < occBytes && !ender(m_storage.data()[(m_tail + offset) % m_size]);
+         ++offset)
+      ;
+
+    if (offset < occBytes)
+    {
+      ret = offset + 1;
+    }
+
+    return ret;
+  }
+
+  // Common implementation of both tryReadUntil overloads
+  // m_pendingLen is the no. of bytes of the unfinished record already copied
+  // into 'out', m_scannedLen is the no. of buffered bytes already searched
+  // for the ender, so that they are not searched again on the next call
+  template <class Ender>
+  IOResult<SizeType> tryReadUntilImpl(char *const &out,
+                                      const NonBlockingIOInterface &ioInterface,
+                                      const Ender &ender)
+  {
+    while (true)
+    {
+      if (auto len = scan(ender, m_scannedLen); len)
+      {
+        copy(out + m_pendingLen, *len);
+        IOResult<SizeType> ret{static_cast<SizeType>(m_pendingLen + *len), IOStatus::OK};
+        m_pendingLen = m_scannedLen = 0;
+        return ret;
+      }
+
+      // No room left to read into, move the unfinished record out
+      if (!freeBytes())
+      {
+        SizeType occBytes = occupiedBytes();
+        copy(out + m_pendingLen, occBytes);
+        m_pendingLen += occBytes;
+        m_scannedLen = 0;
+      }
+      else
+      {
+        m_scannedLen = occupiedBytes();
+      }
+
+      auto pasted = paste(ioInterface);
+      if (!pasted.bytes)
+      {
+        if (pasted.status == IOStatus::WOULD_BLOCK)
+        {
+          return {0, IOStatus::WOULD_BLOCK};
+        }
+
+        // The IOInterface is done, hand over the trailing bytes
+        SizeType occBytes = occupiedBytes();
+        copy(out + m_pendingLen, occBytes);
+        IOResult<SizeType> ret{static_cast<SizeType>(m_pendingLen + occBytes), pasted.status};
+        m_pendingLen = m_scannedLen = 0;
+        return ret;
+      }
+    }
+  }
+
+  // Non-blocking counterpart of paste
+  IOResult<SizeType> paste(const NonBlockingIOInterface &ioInterface)
+  {
+    IOResult<SizeType> ret{0, IOStatus::WOULD_BLOCK};
+    if (auto free = freeBytes(); free)
+    {
+      allocate();
+      SizeType lengthTillEnd = m_size - m_head;
+      SizeType toRead = std::min(lengthTillEnd, free);
+
+      ret = pasteFromInterface(ioInterface, toRead);
+      free -= ret.bytes;
+      if (ret.bytes == toRead && free)
+      {
+        ret.bytes += pasteFromInterface(ioInterface, free).bytes;
+      }
+    }
+
+    return ret;
+  }
+
+  // Non-blocking counterpart of pasteFromInterface
+  IOResult<SizeType> pasteFromInterface(const NonBlockingIOInterface &ioInterface,
+                                        const SizeType &len)
+  {
+    IOResult<SizeType> ret = ioInterface(m_storage.data() + m_head, len);
+    if (ret.bytes)
+    {
+      m_head = (m_head + ret.bytes) % m_size;
+      m_lastOperation = LastOperation::PASTE;
+      ret.status = IOStatus::OK;
+      onPaste(ret.bytes);
+    }
+    else if (ret.status == IOStatus::OK)
+    {
+      ret.status = IOStatus::WOULD_BLOCK;
+    }
+    onIoCall(ret.bytes);
+
+    return ret;
+  }
+
   SizeType occupiedBytes()
   {
     if (m_tail == m_head)
@@ -459,15 +1078,86 @@ private:
   LastOperation m_lastOperation;
   SizeType m_tail;
   SizeType m_head;
-  const SizeType m_size;
-  char *const m_readBuff;
+  SizeType m_size;
+  [[no_unique_address]] StoragePolicy m_storage;
+  SizeType m_pendingLen;
+  SizeType m_scannedLen;
+  uint64_t m_position;
+  // The LineIndex, TimestampRing and BufferStats attached, if StatsPolicy
+  // lets them be
+  [[no_unique_address]] StatsPolicy m_attached;
+  // No. of sweeps of releaseIfIdle that found the buffer empty since the
+  // last paste
+  uint32_t m_idleSweeps;
+  [[no_unique_address]] LockPolicy m_lock;
 };
 
-template <class SizeType>
+// The loops of a lazy write buffer, shared by SyncIOLazyWriteBuffer and
+// PersistentLazyWriteBuffer, whose rings keep their head and tail apart
+
+// Put as much of 'out' as fits, drain just enough to make room for the
+// rest, until all of it is put or a drain gets nothing out.
+// freeBytes() is the room in the ring, put(data, len) copies bytes into it
+// and drain(atLeast) returns the no. of bytes it drained
+template <class SizeType, class FreeBytes, class Put, class Drain>
+SizeType lazyWrite(const char *out,
+                   const SizeType &len,
+                   const SizeType &size,
+                   const FreeBytes &freeBytes,
+                   const Put &put,
+                   const Drain &drain)
+{
+  SizeType ret = 0;
+  while (true)
+  {
+    SizeType toPut = std::min<SizeType>(len - ret, freeBytes());
+    put(out + ret, toPut);
+    ret += toPut;
+    if (ret == len || !drain(std::min<SizeType>(len - ret, size)))
+    {
+      break;
+    }
+  }
+
+  return ret;
+}
+
+// Hand the bytes at the tail of the ring to the ioInterface, until
+// 'toDrain' of them are accepted or a call accepts nothing.
+// ioCall() offers the contiguous bytes at the tail to the ioInterface and
+// returns its IOResult, consume(len) advances the tail
+template <class SizeType, class IOCall, class Consume>
+IOResult<SizeType> drainRing(const SizeType &toDrain, const IOCall &ioCall, const Consume &consume)
+{
+  IOResult<SizeType> ret{0, IOStatus::OK};
+  while (ret.bytes < toDrain)
+  {
+    IOResult<SizeType> written = ioCall();
+    if (!written.bytes)
+    {
+      ret.status = written.status == IOStatus::OK ? IOStatus::WOULD_BLOCK : written.status;
+      break;
+    }
+
+    consume(written.bytes);
+    ret.bytes += written.bytes;
+  }
+
+  return ret;
+}
+
+// StoragePolicy and LockPolicy are the same as SyncIOReadBuffer's. Of the
+// StatsPolicies only ExportedStats(see setExport) means anything to a write
+// buffer, it comes last as the policies before it were there first
+template <class SizeType,
+          class StoragePolicy = HeapStorage,
+          class LockPolicy = NoLock,
+          class StatsPolicy = NoStats>
 requires std::unsigned_integral<SizeType>
 struct SyncIOLazyWriteBuffer
 {
   typedef std::function<SizeType(const char*, const SizeType&)> IOInterface;
+  typedef std::function<IOResult<SizeType>(const char*, const SizeType&)> NonBlockingIOInterface;
   enum class LastOperation
   {
     FLUSH,
@@ -478,106 +1168,397 @@ struct SyncIOLazyWriteBuffer
   /**
    *  Constructor
    *  @param size         Size of the Buffer
-   *                      throws if size is 0
+   *                      throws if size is 0 or doesn't fit in the
+   *                      StoragePolicy
    *  @param ioInterface  The synchronous IOInterface to write bytes to,
    *                      it's an std::function<SizeType(const char*, const SizeType&)>
+   *  @param allocation   When to allocate the memory of the buffer, see
+   *                      Allocation and releaseIfIdle
    **/
-  SyncIOLazyWriteBuffer(const SizeType &size, const IOInterface &ioInterface) : m_outBuff(reinterpret_cast<char *>(malloc(size))),
-                                                                                m_tail(0),
+  SyncIOLazyWriteBuffer(const SizeType &size,
+                        const IOInterface &ioInterface,
+                        const Allocation &allocation = Allocation::EAGER) : m_tail(0),
                                                                                 m_head(0),
                                                                                 m_size(size),
-                                                                                m_ioInterface(ioInterface),
-                                                                                m_lastOperation(LastOperation::NONE)
+                                                                                m_blockingInterface(ioInterface),
+                                                                                m_lastOperation(LastOperation::NONE),
+                                                                                m_blocking(true),
+                                                                                m_position(0),
+                                                                                m_flushedPosition(0),
+                                                                                m_onDirty(nullptr),
+                                                                                m_idleSweeps(0)
   {
     if (!size)
     {
       throw std::invalid_argument("size should  be passed as a positive integer");
     }
+
+    if (!StoragePolicy::fits(size))
+    {
+      throw std::invalid_argument("size should not exceed the capacity of the StoragePolicy");
+    }
+
+    if (allocation == Allocation::EAGER)
+    {
+      m_storage.allocate(size);
+    }
+  }
+
+  /**
+   *  Constructor for the non-blocking mode, see tryWrite and tryFlush
+   *  write and flush still work, they stop whenever the ioInterface doesn't
+   *  accept any bytes
+   *  @param size         Size of the Buffer
+   *                      throws if size is 0 or doesn't fit in the
+   *                      StoragePolicy
+   *  @param ioInterface  The non-blocking IOInterface to write bytes to,
+   *                      it's an std::function<IOResult<SizeType>(const char*, const SizeType&)>
+   *  @param allocation   When to allocate the memory of the buffer, see
+   *                      Allocation and releaseIfIdle
+   **/
+  SyncIOLazyWriteBuffer(const SizeType &size,
+                        const NonBlockingIOInterface &ioInterface,
+                        const Allocation &allocation = Allocation::EAGER) : m_tail(0),
+                                                                                           m_head(0),
+                                                                                           m_size(size),
+                                                                                           m_ioInterface(ioInterface),
+                                                                                           m_lastOperation(LastOperation::NONE),
+                                                                                           m_blocking(false),
+                                                                                           m_position(0),
+                                                                                           m_flushedPosition(0),
+                                                                                           m_onDirty(nullptr),
+                                                                                           m_idleSweeps(0)
+  {
+    if (!size)
+    {
+      throw std::invalid_argument("size should  be passed as a positive integer");
+    }
+
+    if (!StoragePolicy::fits(size))
+    {
+      throw std::invalid_argument("size should not exceed the capacity of the StoragePolicy");
+    }
+
+    if (allocation == Allocation::EAGER)
+    {
+      m_storage.allocate(size);
+    }
   }
 
   /**
    *  Write data to interface
    *  It puts the data in the buffer and delays the IO call for as long as
    *  it can. If the buffer is already full or there is insufficint space in
-   *  the buffer to hold entire data, it will need to flush the buffered data
-   *  to the ioInterface
+   *  the buffer to hold entire data, it drains just enough of the buffered
+   *  data to the ioInterface to make room for the rest
    *
-   *  @param size         Size of the Buffer
-   *                      throws if size is 0
-   *  @param ioInterface  The synchronous IOInterface to write bytes to,
-   *                      it's an std::function<SizeType(const char*, const SizeType&)>
+   *  @param out  The data to write
+   *  @param len  No. of bytes to write
+   *
+   *  @return     No. of bytes accepted, less than len only if the
+   *              ioInterface stopped accepting bytes
    **/
   SizeType write(const char *out, const SizeType &len)
   {
-    SizeType remainingLen = len;
-    SizeType ret = 0;
-    bool flushfailed = false;
-    for (SizeType freeBytesBeforePut = freeBytes();
-         freeBytesBeforePut < remainingLen && !flushfailed;
-         flushfailed = !flush(), freeBytesBeforePut = freeBytes())
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return lazyWrite(out, len, m_size, [this]()
+                     { return freeBytes(); },
+                     [this](const char *data, const SizeType &toPut)
+                     { put(data, toPut); },
+                     [this](const SizeType &atLeast)
+                     { return drain(atLeast, FlushCause::FULL).bytes; });
+  }
+
+  /**
+   *  Make room for 'len' bytes, draining just enough of the buffered data to
+   *  the ioInterface, so that a write of up to 'len' bytes that follows is
+   *  accepted whole without calling the ioInterface, e.g. to never leave
+   *  part of a record in the buffer
+   *
+   *  @param len  No. of bytes to make room for
+   *
+   *  @return     false if len is more than the size of the buffer, or the
+   *              ioInterface stopped accepting bytes before there was room
+   **/
+  bool reserve(const SizeType &len)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    if (len > m_size)
     {
-      put(out, freeBytesBeforePut);
-      remainingLen -= freeBytesBeforePut;
-      out += freeBytesBeforePut;
-      ret += freeBytesBeforePut;
+      return false;
     }
 
-    SizeType bytestoPut = std::min(remainingLen, freeBytes());
-    put(out, bytestoPut);
-    ret += bytestoPut;
-    return ret;
+    while (freeBytes() < len)
+    {
+      if (!drain(len - freeBytes(), FlushCause::FULL).bytes)
+      {
+        return false;
+      }
+    }
+
+    return true;
   }
 
   /*
   * Put all of the buffered data to the ioInterface
+  * Short writes are resumed until the buffer is empty or the ioInterface
+  * stops accepting bytes
+  *
+  * @return No. of bytes flushed
   */
   SizeType flush()
   {
-    if (!occupiedBytes())
-    {
-      return 0;
-    }
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return drain(occupiedBytes(), FlushCause::EXPLICIT).bytes;
+  }
 
-    SizeType ret = 0;
-    if (m_tail <= m_head)
+  /*
+  * Put at least 'atLeast' of the buffered bytes(or all of them, if fewer
+  * are buffered) to the ioInterface, without insisting on emptying the buffer
+  *
+  * @return No. of bytes flushed, may be more than 'atLeast' as every call
+  *         to the ioInterface is offered all the contiguous buffered bytes
+  */
+  SizeType flush(const SizeType &atLeast)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return drain(atLeast, FlushCause::EXPLICIT).bytes;
+  }
+
+  /**
+   *  Non-blocking counterpart of write, meant to be driven by readiness
+   *  notifications(e.g. edge-triggered epoll)
+   *  Puts as much of the data in the buffer as it can, draining just enough
+   *  to the ioInterface to make room when it runs out of space. Whatever could not
+   *  be accepted has to be written again once the ioInterface is writable
+   *
+   *  @param out  The data to write
+   *  @param len  No. of bytes to write
+   *
+   *  @return     No. of bytes accepted, the status is IOStatus::OK if all of
+   *              them were accepted, otherwise the status reported by the
+   *              ioInterface
+   **/
+  IOResult<SizeType> tryWrite(const char *out, const SizeType &len)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    IOResult<SizeType> ret{0, IOStatus::OK};
+    ret.bytes = lazyWrite(out, len, m_size, [this]()
+                          { return freeBytes(); },
+                          [this](const char *data, const SizeType &toPut)
+                          { put(data, toPut); },
+                          [this, &ret](const SizeType &atLeast)
+                          {
+                            auto flushed = drain(atLeast, FlushCause::FULL);
+                            if (!flushed.bytes)
+                            {
+                              ret.status = flushed.status;
+                            }
+                            return flushed.bytes;
+                          });
+    return ret;
+  }
+
+  /**
+   *  Non-blocking counterpart of flush
+   *  Drains the buffer to the ioInterface until it is empty or the
+   *  ioInterface stops accepting bytes, short writes are resumed from where
+   *  they stopped
+   *
+   *  @return     No. of bytes drained, the status is IOStatus::OK if the
+   *              buffer is now empty, otherwise the status reported by the
+   *              ioInterface
+   **/
+  IOResult<SizeType> tryFlush()
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return drain(occupiedBytes(), FlushCause::EXPLICIT);
+  }
+
+  /**
+   *  Non-blocking counterpart of flush(atLeast)
+   *
+   *  @return     No. of bytes drained, the status is IOStatus::OK if at
+   *              least 'atLeast' bytes(or all the buffered bytes) were
+   *              drained, otherwise the status reported by the ioInterface
+   **/
+  IOResult<SizeType> tryFlush(const SizeType &atLeast)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return drain(atLeast, FlushCause::EXPLICIT);
+  }
+
+  /**
+   *  Absolute offset in the output stream of the next byte to be written,
+   *  i.e. no. of bytes accepted by this buffer since construction.
+   *  Always 64-bit, regardless of SizeType
+   **/
+  uint64_t position()
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return m_position;
+  }
+
+  /**
+   *  No. of bytes handed over to the ioInterface since construction,
+   *  everything before this offset has left the buffer
+   **/
+  uint64_t flushedPosition()
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return m_flushedPosition;
+  }
+
+  /**
+   *  Set a callback to be invoked whenever bytes are put into an empty
+   *  buffer, i.e. when the buffer gets something to flush, e.g. to schedule
+   *  a flush deadline(see FlushDeadline). nullptr removes it. It is invoked
+   *  with the lock of the LockPolicy held, it must not call this buffer
+   **/
+  void setOnDirty(const std::function<void()> &onDirty)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    m_onDirty = onDirty;
+  }
+
+  /**
+   *  Export the calls to the ioInterface, the occupancy before each and why
+   *  the buffer drained(see FlushCause) to a slot of a StatsExporter(see
+   *  StatsExporter.hpp), with relaxed stores. The slot is borrowed, it has
+   *  to outlive this buffer(the destructor reports its last flush) or be
+   *  detached by passing nullptr
+   **/
+  void setExport(StatsSlot *slot) requires StatsPolicy::EXPORTED
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    m_attached.slot = slot;
+    if (m_attached.slot)
     {
-      ret = m_ioInterface(m_outBuff + m_tail, occupiedBytes());
-      m_tail += (m_tail + ret) % m_size;
+      m_attached.slot->attach(SlotKind::WRITE, m_size);
     }
-    else
+  }
+
+  /**
+   *  Give the memory of the buffer back to the allocator if the buffer has
+   *  stayed empty(everything flushed) for a while, it is allocated again by
+   *  the next write. Same as SyncIOReadBuffer::releaseIfIdle, every put
+   *  starts the count of sweeps over
+   *
+   *  @param sweeps  No. of consecutive sweeps the buffer has to be found
+   *                 empty by, without a put in between
+   *
+   *  @return        true if the memory was released by this call
+   **/
+  bool releaseIfIdle(const uint32_t &sweeps = 1)
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    if (!m_storage.allocated() || occupiedBytes())
     {
-      SizeType lengthTillEnd = m_size - m_tail;
-      if (ret = m_ioInterface(m_outBuff + m_tail, lengthTillEnd) == lengthTillEnd)
-      {
-        m_tail = m_ioInterface(m_outBuff, m_head);
-        ret += m_tail;
-      }
+      m_idleSweeps = 0;
+      return false;
     }
 
-    if (ret)
+    if (++m_idleSweeps < sweeps)
     {
-      if (m_tail == m_head)
-      {
-        m_tail = m_head = 0;
-      }
-      m_lastOperation = LastOperation::FLUSH;
+      return false;
     }
 
-    return ret;
+    m_idleSweeps = 0;
+    return m_storage.release();
+  }
+
+  // Whether the buffer holds its memory right now
+  bool allocated()
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    return m_storage.allocated();
   }
 
   ~SyncIOLazyWriteBuffer()
   {
-    flush();
-    free(m_outBuff);
+    close();
+    destroyInterface();
   }
 
   SyncIOLazyWriteBuffer(const SyncIOLazyWriteBuffer &) = delete;
   SyncIOLazyWriteBuffer &operator=(const SyncIOLazyWriteBuffer &) = delete;
-  SyncIOLazyWriteBuffer(SyncIOLazyWriteBuffer &&) = delete;
-  SyncIOLazyWriteBuffer &operator=(SyncIOLazyWriteBuffer &&) = delete;
+
+  /**
+   *  Takes over the memory, the buffered bytes and the ioInterface of
+   *  'other', which is left empty and without memory, fit only to be
+   *  destroyed or assigned to. Not the onDirty callback, whatever refers to
+   *  'other'(e.g. a FlushDeadline or a BinaryLogger) still refers to 'other',
+   *  and has to be attached to this buffer again
+   **/
+  SyncIOLazyWriteBuffer(SyncIOLazyWriteBuffer &&other) noexcept : m_size(other.m_size),
+                                                                  m_storage(std::move(other.m_storage))
+  {
+    takeOver(other);
+  }
+
+  /**
+   *  The bytes buffered by this buffer are flushed first, as on destruction,
+   *  it keeps its own onDirty callback
+   **/
+  SyncIOLazyWriteBuffer &operator=(SyncIOLazyWriteBuffer &&other)
+  {
+    if (this != &other)
+    {
+      close();
+      destroyInterface();
+      m_size = other.m_size;
+      m_storage = std::move(other.m_storage);
+      takeOver(other);
+    }
+
+    return *this;
+  }
 
 private:
+  friend struct BufferTestAccess;
+
+  // Move the state of 'other', other than its storage, into this buffer,
+  // which has no ioInterface alive(see destroyInterface)
+  void takeOver(SyncIOLazyWriteBuffer &other)
+  {
+    m_lastOperation = std::exchange(other.m_lastOperation, LastOperation::NONE);
+    m_blocking = other.m_blocking;
+    if (m_blocking)
+    {
+      new (&m_blockingInterface) IOInterface(std::move(other.m_blockingInterface));
+    }
+    else
+    {
+      new (&m_ioInterface) NonBlockingIOInterface(std::move(other.m_ioInterface));
+    }
+    m_tail = std::exchange(other.m_tail, 0);
+    m_head = std::exchange(other.m_head, 0);
+    m_position = std::exchange(other.m_position, 0);
+    m_flushedPosition = std::exchange(other.m_flushedPosition, 0);
+    m_idleSweeps = std::exchange(other.m_idleSweeps, 0);
+    m_attached = std::exchange(other.m_attached, StatsPolicy{});
+  }
+
+  // End the life of whichever ioInterface the buffer holds
+  void destroyInterface()
+  {
+    if (m_blocking)
+    {
+      m_blockingInterface.~IOInterface();
+    }
+    else
+    {
+      m_ioInterface.~NonBlockingIOInterface();
+    }
+  }
+
+  // Flush everything, as this buffer is going away or being replaced
+  void close()
+  {
+    [[maybe_unused]] auto guard = m_lock.guard();
+    drain(occupiedBytes(), FlushCause::CLOSE);
+  }
+
   /**
    *  Copy some data to the internal buffer
    *  
@@ -595,22 +1576,125 @@ private:
       return;
     }
 
+    // Not allocated yet or released, the buffer is empty then, so m_head and
+    // m_tail are at 0
+    m_idleSweeps = 0;
+    m_storage.allocate(m_size);
+
     if (m_head < m_tail ||
         len <= m_size - m_head)
     {
-      memcpy(m_outBuff + m_head, outData, len);
+      memcpy(m_storage.data() + m_head, outData, len);
       m_head = (m_head + len) % m_size;
     }
     else
     {
       const SizeType l1 = m_size - m_head;
       const SizeType l2 = len - l1;
-      memcpy(m_outBuff + m_head, outData, l1);
-      memcpy(m_outBuff, outData + l1, l2);
+      memcpy(m_storage.data() + m_head, outData, l1);
+      memcpy(m_storage.data(), outData + l1, l2);
       m_head = l2;
     }
 
+    bool wasEmpty = m_position == m_flushedPosition;
+    m_position += len;
     m_lastOperation = LastOperation::PUT;
+    if (wasEmpty && m_onDirty)
+    {
+      m_onDirty();
+    }
+  }
+
+  /**
+   *  Hand the buffered bytes over to the ioInterface until at least
+   *  'atLeast' bytes(or all the buffered bytes, if fewer) are drained, or the
+   *  ioInterface doesn't accept anything. Every call to the ioInterface is
+   *  offered all the contiguous bytes starting at m_tail, and m_tail only
+   *  moves by what was actually accepted, so any sequence of short writes
+   *  just resumes on the next call
+   *
+   *  Case 1: m_tail < m_head, a single contiguous run:
+   *
+   *  m_outBuff |.........................................|
+   *                  ↑                  ↑
+   *                  m_tail             m_head
+   *
+   *  Case 2: m_tail >= m_head(full buffer when equal), the run till the end
+   *  is drained first, then m_tail wraps to 0 and it turns into case 1:
+   *
+   *  m_outBuff |.........................................|
+   *                  ↑                  ↑
+   *                  m_head             m_tail
+   **/
+  IOResult<SizeType> drain(const SizeType &atLeast, const FlushCause &cause)
+  {
+    SizeType toDrain = std::min(atLeast, occupiedBytes());
+    if (toDrain)
+    {
+      onFlush(cause);
+    }
+
+    // The mode is checked once per drain, not once per call
+    return m_blocking ? drainTo(m_blockingInterface, toDrain) : drainTo(m_ioInterface, toDrain);
+  }
+
+  // A blocking ioInterface reports a failure by accepting nothing
+  static IOResult<SizeType> resultOf(const SizeType &written)
+  {
+    return IOResult<SizeType>{written, written ? IOStatus::OK : IOStatus::FAILURE};
+  }
+
+  static IOResult<SizeType> resultOf(const IOResult<SizeType> &written)
+  {
+    return written;
+  }
+
+  // The loop of drain, for either kind of ioInterface
+  template <class Interface>
+  IOResult<SizeType> drainTo(const Interface &ioInterface, const SizeType &toDrain)
+  {
+    return drainRing(toDrain, [this, &ioInterface]()
+                     {
+                       SizeType toWrite = m_tail < m_head ? m_head - m_tail : m_size - m_tail;
+                       SizeType occupied = occupiedBytes();
+                       IOResult<SizeType> written = resultOf(ioInterface(m_storage.data() + m_tail, toWrite));
+                       onIoCall(written.bytes, occupied);
+                       return written; },
+                     [this](const SizeType &written)
+                     {
+                       m_tail = (m_tail + written) % m_size;
+                       m_lastOperation = LastOperation::FLUSH;
+                       m_flushedPosition += written;
+                       if (m_tail == m_head)
+                       {
+                         m_tail = m_head = 0;
+                       }
+                     });
+  }
+
+  // About to drain for 'cause'
+  void onFlush(const FlushCause &cause)
+  {
+    if constexpr (StatsPolicy::EXPORTED)
+    {
+      if (m_attached.slot)
+      {
+        m_attached.slot->onFlush(cause);
+      }
+    }
+  }
+
+  // The ioInterface has just been called with 'occupied' bytes buffered and
+  // accepted 'len' of them
+  void onIoCall(const SizeType &len, const SizeType &occupied)
+  {
+    if constexpr (StatsPolicy::EXPORTED)
+    {
+      if (m_attached.slot)
+      {
+        m_attached.slot->onIoCall(len, occupied);
+      }
+    }
   }
 
   SizeType occupiedBytes()
@@ -635,9 +1719,26 @@ private:
   }
 
   LastOperation m_lastOperation;
-  const IOInterface m_ioInterface;
+  // Which of the two ioInterfaces below is alive
+  bool m_blocking;
+  // The ioInterface the buffer was constructed with, kept as it was given so
+  // that the blocking one isn't called through an adapting std::function
+  union
+  {
+    IOInterface m_blockingInterface;
+    NonBlockingIOInterface m_ioInterface;
+  };
   SizeType m_tail;
   SizeType m_head;
-  const SizeType m_size;
-  char *const m_outBuff;
+  SizeType m_size;
+  [[no_unique_address]] StoragePolicy m_storage;
+  uint64_t m_position;
+  uint64_t m_flushedPosition;
+  std::function<void()> m_onDirty;
+  // No. of sweeps of releaseIfIdle that found the buffer empty since the
+  // last put
+  uint32_t m_idleSweeps;
+  // The StatsSlot exported to, if StatsPolicy lets it be
+  [[no_unique_address]] StatsPolicy m_attached;
+  [[no_unique_address]] LockPolicy m_lock;
 };
@@ -1,53 +1,777 @@
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include <chrono>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "FdSource.hpp"
+#include "MappedFileSink.hpp"
+#endif
 #include "SmartBuffer.hpp"
+#include "AsyncSmartBuffer.hpp"
+#include "ShardedWriter.hpp"
 
-int main(int argc, char** argv)
+// Reads the test cases(the no. of cases on the first line, then a pair of
+// numbers per line) and writes the larger number of every pair, a line each,
+// in four phases timed separately:
+// read   - the whole input into memory, through the reader backend
+// parse  - the pairs out of it, with the parsing mode
+// format - the output lines, into memory
+// write  - the output lines, through the writer backend
+//
+// Reader backends:
+// ring     - SyncIOReadBuffer::readUntil, a line at a time, every line
+//            parsed as soon as it is read, like DefaultIOTest does, so the
+//            parse time is part of the read time(parse is 0)
+// chunks   - SyncIOReadBuffer::read of the whole input, in chunks of the
+//            buffer size
+// async    - AsyncIOReadBuffer::read driven by an Engine, see --engine
+// mmap     - the input file mapped, every page touched(Linux only, needs
+//            --input)
+// prefetch - chunks over an FdSource with sequential AccessHints(Linux only)
+// Engines of the async reader:
+// inline   - the reads are made in the thread running the completions
+// thread   - the reads are made by a thread of their own
+// Writer backends:
+// lazy       - SyncIOLazyWriteBuffer::write, a line at a time
+// background - a ShardedWriter with a single shard, whose merger thread
+//              makes the write calls
+// mmap       - SyncIOLazyWriteBuffer into a MappedFileSink(Linux only,
+//              needs --output)
+// Parsing modes, the output is formatted to match:
+// sscanf     - sscanf on a NUL terminated copy of every line, sprintf
+// from_chars - std::from_chars on an std::string copy of every line,
+//              std::to_chars
+// views      - std::from_chars on std::string_views of the lines in place,
+//              std::to_chars
+// batch      - a single std::from_chars pass over the whole input, no lines
+//              (not with ring)
+//
+// The input is stdin unless --input is given, repetitions(and warmup runs)
+// need an input that can be read again, i.e. --input. Every run writes the
+// whole output, to stdout unless --output is given. The timings of every run
+// in ns, and their medians, are printed to stderr as a JSON object
+// Usage: SmartIOTest [buffer size] [--reader ring|chunks|async|mmap|prefetch] [--engine inline|thread]
+//                    [--writer lazy|background|mmap] [--parse sscanf|from_chars|views|batch]
+//                    [--repetitions n] [--warmup n] [--input file] [--output file]
+static uint64_t now()
 {
-    auto start = std::chrono::high_resolution_clock().now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Results consumed here can't be optimized away
+static volatile char g_sink;
+
+struct Options
+{
+  uint32_t bufferSize = 1024;
+  std::string reader = "ring";
+  std::string engine = "inline";
+  std::string writer = "lazy";
+  std::string parse = "sscanf";
+  uint32_t repetitions = 1;
+  uint32_t warmup = 0;
+  std::string input;
+  std::string output;
+};
+
+struct Timings
+{
+  uint64_t read;
+  uint64_t parse;
+  uint64_t format;
+  uint64_t write;
+  uint64_t total;
+};
+
+// The bytes of the whole input, in memory or mapped
+struct Input
+{
+  Input() : data(nullptr),
+            len(0),
+            mapped(false)
+  {
+  }
+
+  ~Input()
+  {
+#ifdef __linux__
+    if (mapped)
+    {
+      munmap(const_cast<char *>(data), len);
+    }
+#endif
+  }
+
+  std::string bytes;
+  const char *data;
+  size_t len;
+  bool mapped;
+};
+
+// Completes the reads of an AsyncIOReadBuffer. Either way the completions run
+// in the thread calling run(), the reads are made there too(inline) or by a
+// thread of their own(threaded)
+struct Engine
+{
+  typedef AsyncIOReadBuffer<uint32_t>::ReadResultHandler Handler;
+
+  Engine(std::istream &in,
+         const bool &threaded) : m_in(in),
+                                 m_threaded(threaded),
+                                 m_pending(0),
+                                 m_stopping(false)
+  {
+    if (m_threaded)
+    {
+      m_reader = std::thread([this]()
+                             { readLoop(); });
+    }
+  }
+
+  // The IOInterface for the AsyncIOReadBuffer
+  AsyncIOReadBuffer<uint32_t>::IOInterface ioInterface()
+  {
+    return [this](char *out, const uint32_t &len, const Handler &handler)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ++m_pending;
+      m_requests.push_back({out, len, handler, 0});
+      m_requested.notify_one();
+    };
+  }
+
+  // Run the completions till no read is pending
+  void run()
+  {
+    while (true)
+    {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_pending)
+        {
+          return;
+        }
+
+        if (m_threaded)
+        {
+          m_completed.wait(lock, [this]()
+                           { return !m_completions.empty(); });
+          request = std::move(m_completions.front());
+          m_completions.pop_front();
+        }
+        else
+        {
+          request = std::move(m_requests.front());
+          m_requests.pop_front();
+        }
+        --m_pending;
+      }
+
+      if (!m_threaded)
+      {
+        request.result = read(request.out, request.len);
+      }
+      request.handler(request.result);
+    }
+  }
+
+  ~Engine()
+  {
+    if (m_threaded)
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+      }
+      m_requested.notify_one();
+      m_reader.join();
+    }
+  }
+
+private:
+  struct Request
+  {
+    char *out;
+    uint32_t len;
+    Handler handler;
+    uint32_t result;
+  };
+
+  uint32_t read(char *out, const uint32_t &len)
+  {
+    m_in.read(out, len);
+    return static_cast<uint32_t>(m_in.gcount());
+  }
+
+  void readLoop()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+      m_requested.wait(lock, [this]()
+                       { return !m_requests.empty() || m_stopping; });
+      if (m_requests.empty())
+      {
+        return;
+      }
+
+      Request request = std::move(m_requests.front());
+      m_requests.pop_front();
+      lock.unlock();
+      request.result = read(request.out, request.len);
+      lock.lock();
+      m_completions.push_back(std::move(request));
+      m_completed.notify_one();
+    }
+  }
+
+  std::istream &m_in;
+  const bool m_threaded;
+  std::mutex m_mutex;
+  std::condition_variable m_requested;
+  std::condition_variable m_completed;
+  std::deque<Request> m_requests;
+  std::deque<Request> m_completions;
+  uint32_t m_pending;
+  bool m_stopping;
+  std::thread m_reader;
+};
+
+// Read into 'input' in chunks of 'size' through a SyncIOReadBuffer
+template <class Source>
+static void readChunks(Input &input, const uint32_t &size, Source &&source)
+{
+  SyncIOReadBuffer<uint32_t> buffer(size);
+  SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = source;
+  size_t total = 0;
+  while (true)
+  {
+    input.bytes.resize(total + size);
+    uint32_t len = buffer.read(input.bytes.data() + total, size, ioInterface);
+    total += len;
+    if (len < size)
     {
-      auto io_console_reader = 
-      [](char* out, const uint32_t len)
+      break;
+    }
+  }
+  input.bytes.resize(total);
+}
+
+static void readInput(Input &input, const Options &options)
+{
+  std::ifstream file;
+  if (!options.input.empty())
+  {
+    file.open(options.input, std::ios::binary);
+  }
+  std::istream &in = options.input.empty() ? std::cin : file;
+
+  if (options.reader == "chunks")
+  {
+    readChunks(input, options.bufferSize, [&in](char *out, const uint32_t &len)
+               {
+                 in.read(out, len);
+                 return static_cast<uint32_t>(in.gcount()); });
+  }
+  else if (options.reader == "async")
+  {
+    Engine engine(in, options.engine == "thread");
+    AsyncIOReadBuffer<uint32_t> buffer(options.bufferSize);
+    auto ioInterface = engine.ioInterface();
+    size_t total = 0;
+    std::function<void(const uint32_t &)> onRead = [&](const uint32_t &len)
+    {
+      total += len;
+      if (len == options.bufferSize)
       {
-          std::cin.read(out, len);
-          return std::cin.gcount();
-      };
+        input.bytes.resize(total + options.bufferSize);
+        buffer.read(input.bytes.data() + total, options.bufferSize, ioInterface, onRead);
+      }
+    };
 
-      auto io_console_writer = 
-      [](const char* out, const uint32_t len)
+    input.bytes.resize(options.bufferSize);
+    buffer.read(input.bytes.data(), options.bufferSize, ioInterface, onRead);
+    engine.run();
+    input.bytes.resize(total);
+  }
+#ifdef __linux__
+  else if (options.reader == "prefetch")
+  {
+    int fd = options.input.empty() ? STDIN_FILENO : ::open(options.input.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      throw std::runtime_error("unable to open the input");
+    }
+    {
+      FdSource source(fd);
+      AccessHints hints;
+      hints.sequential = true;
+      hints.readaheadWindow = 1 << 20;
+      source.setAccessHints(hints);
+      readChunks(input, options.bufferSize, std::ref(source));
+    }
+    if (fd != STDIN_FILENO)
+    {
+      ::close(fd);
+    }
+  }
+  else if (options.reader == "mmap")
+  {
+    int fd = options.input.empty() ? STDIN_FILENO : ::open(options.input.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && !fstat(fd, &st) && st.st_size)
+    {
+      void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED)
       {
-          std::cout.write(out, len);
-          return len;
-      };    
-      
-      uint32_t buffSize = atoll(argv[1]);
-      SyncIOReadBuffer<uint32_t> smartReadBuffer(buffSize);
-      SyncIOLazyWriteBuffer<uint32_t> smartWriteBuffer(buffSize, io_console_writer);
+        madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+        input.data = reinterpret_cast<const char *>(mapping);
+        input.len = st.st_size;
+        input.mapped = true;
+        // Fault the pages in here, not while parsing
+        char sum = 0;
+        for (size_t offset = 0; offset < input.len; offset += 4096)
+        {
+          sum += input.data[offset];
+        }
+        g_sink = sum;
+      }
+    }
+    if (fd >= 0 && fd != STDIN_FILENO)
+    {
+      ::close(fd);
+    }
+    if (!input.mapped)
+    {
+      throw std::runtime_error("unable to map the input");
+    }
+    return;
+  }
+#endif
+
+  input.data = input.bytes.data();
+  input.len = input.bytes.length();
+}
+
+// Calls 'onLine' with every line of the input, without the '\n'
+template <class OnLine>
+static void forEachLine(const Input &input, OnLine &onLine)
+{
+  const char *line = input.data;
+  const char *end = input.data + input.len;
+  while (line < end)
+  {
+    const char *ender = reinterpret_cast<const char *>(memchr(line, '\n', end - line));
+    const char *next = ender ? ender : end;
+    onLine(line, static_cast<size_t>(next - line));
+    line = next + 1;
+  }
+}
 
-      char input[128];
-      smartReadBuffer.readUntil(input, io_console_reader, '\n');
+static const char *parseNumber(const char *begin, const char *end, uint32_t &value)
+{
+  while (begin < end && (*begin == ' ' || *begin == '\n' || *begin == '\r'))
+  {
+    ++begin;
+  }
+  return std::from_chars(begin, end, value).ptr;
+}
 
-      uint32_t numTestCases;
-      sscanf(input, "%u", &numTestCases);
+// Parses the input a line(without the '\n') at a time with a line by line
+// parsing mode, the first line is the no. of cases
+struct LineParser
+{
+  LineParser(const std::string &mode,
+             std::vector<std::pair<uint32_t, uint32_t>> &cases) : m_mode(mode),
+                                                                   m_cases(cases),
+                                                                   m_numCases(0),
+                                                                   m_first(true)
+  {
+  }
 
-      for (uint32_t i = 0; i < numTestCases; ++i)
+  void operator()(const char *data, const size_t &len)
+  {
+    if (m_mode == "sscanf")
+    {
+      char line[128];
+      size_t toCopy = std::min(len, sizeof(line) - 1);
+      memcpy(line, data, toCopy);
+      line[toCopy] = 0;
+      uint32_t n1 = 0, n2 = 0;
+      if (m_first)
+      {
+        sscanf(line, "%u", &m_numCases);
+        m_first = false;
+      }
+      else if (m_cases.size() < m_numCases && sscanf(line, "%u %u", &n1, &n2) == 2)
       {
-        char out[128];
-        uint32_t n1, n2;
-        smartReadBuffer.readUntil(input, io_console_reader, '\n');
-        sscanf(input, "%u %u", &n1, &n2);
-        auto len = sprintf(out, "%u\n", n1 > n2? n1 : n2);
-        smartWriteBuffer.write(out, len);
+        m_cases.emplace_back(n1, n2);
       }
+      return;
+    }
+
+    std::string owned;
+    std::string_view line(data, len);
+    if (m_mode == "from_chars")
+    {
+      owned.assign(data, len);
+      line = owned;
+    }
+
+    const char *end = line.data() + line.length();
+    if (m_first)
+    {
+      parseNumber(line.data(), end, m_numCases);
+      m_first = false;
+    }
+    else if (m_cases.size() < m_numCases)
+    {
+      m_cases.emplace_back(0, 0);
+      parseNumber(parseNumber(line.data(), end, m_cases.back().first), end, m_cases.back().second);
+    }
+  }
+
+private:
+  const std::string &m_mode;
+  std::vector<std::pair<uint32_t, uint32_t>> &m_cases;
+  uint32_t m_numCases;
+  bool m_first;
+};
+
+// The ring reader, the lines are parsed as they are read
+static void readLines(const Options &options, std::vector<std::pair<uint32_t, uint32_t>> &cases)
+{
+  std::ifstream file;
+  if (!options.input.empty())
+  {
+    file.open(options.input, std::ios::binary);
+  }
+  std::istream &in = options.input.empty() ? std::cin : file;
+
+  SyncIOReadBuffer<uint32_t> buffer(options.bufferSize);
+  SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = [&in](char *out, const uint32_t &len)
+  {
+    in.read(out, len);
+    return static_cast<uint32_t>(in.gcount());
+  };
+
+  LineParser parse(options.parse, cases);
+  // readUntil doesn't bound the line, the lines of the test cases are short
+  char line[4096];
+  while (uint32_t len = buffer.readUntil(line, ioInterface, '\n'))
+  {
+    parse(line, line[len - 1] == '\n' ? len - 1 : len);
+  }
+}
+
+static void parseCases(const Input &input, const std::string &mode, std::vector<std::pair<uint32_t, uint32_t>> &cases)
+{
+  if (mode != "batch")
+  {
+    LineParser parse(mode, cases);
+    forEachLine(input, parse);
+  }
+  else
+  {
+    uint32_t numCases = 0;
+    const char *end = input.data + input.len;
+    const char *next = parseNumber(input.data, end, numCases);
+    cases.resize(numCases);
+    for (auto &[n1, n2] : cases)
+    {
+      next = parseNumber(parseNumber(next, end, n1), end, n2);
+    }
+  }
+}
+
+static void formatCases(const std::vector<std::pair<uint32_t, uint32_t>> &cases,
+                        const std::string &mode,
+                        std::string &output,
+                        std::vector<uint32_t> &ends)
+{
+  output.reserve(cases.size() * 11);
+  ends.reserve(cases.size());
+  char line[16];
+  for (auto &[n1, n2] : cases)
+  {
+    size_t len;
+    if (mode == "sscanf")
+    {
+      len = sprintf(line, "%u\n", n1 > n2 ? n1 : n2);
+    }
+    else
+    {
+      char *end = std::to_chars(line, line + sizeof(line) - 1, n1 > n2 ? n1 : n2).ptr;
+      *end++ = '\n';
+      len = end - line;
+    }
+    output.append(line, len);
+    ends.push_back(static_cast<uint32_t>(output.length()));
+  }
+}
+
+static void writeOutput(const std::string &output, const std::vector<uint32_t> &ends, const Options &options)
+{
+  std::ofstream file;
+  if (!options.output.empty() && options.writer != "mmap")
+  {
+    file.open(options.output, std::ios::binary | std::ios::trunc);
+  }
+  std::ostream &out = options.output.empty() ? std::cout : file;
+  auto sink = [&out](const char *data, const uint32_t &len)
+  {
+    out.write(data, len);
+    return len;
+  };
+
+  auto eachLine = [&](const auto &write)
+  {
+    uint32_t start = 0;
+    for (auto &end : ends)
+    {
+      write(output.c_str() + start, end - start);
+      start = end;
+    }
+  };
+
+  if (options.writer == "lazy")
+  {
+    SyncIOLazyWriteBuffer<uint32_t> buffer(options.bufferSize, sink);
+    eachLine([&buffer](const char *data, const uint32_t &len)
+             { buffer.write(data, len); });
+  }
+  else if (options.writer == "background")
+  {
+    ShardedWriter<uint32_t> writer(1, options.bufferSize, options.bufferSize, sink);
+    auto &shard = writer.shard(0);
+    eachLine([&shard](const char *data, const uint32_t &len)
+             { shard.write(data, len); });
+    writer.close();
+  }
+#ifdef __linux__
+  else if (options.writer == "mmap")
+  {
+    MappedFileSink mappedSink(options.output.c_str());
+    {
+      SyncIOLazyWriteBuffer<uint32_t> buffer(options.bufferSize, std::ref(mappedSink));
+      eachLine([&buffer](const char *data, const uint32_t &len)
+               { buffer.write(data, len); });
+    }
+    mappedSink.close();
+  }
+#endif
+  out.flush();
+}
+
+static Timings runOnce(const Options &options, size_t &numCases)
+{
+  Timings timings;
+  uint64_t start = now();
+  Input input;
+  std::vector<std::pair<uint32_t, uint32_t>> cases;
+  if (options.reader == "ring")
+  {
+    readLines(options, cases);
+  }
+  else
+  {
+    readInput(input, options);
+  }
+  uint64_t read = now();
+
+  uint64_t parsed = read;
+  if (options.reader != "ring")
+  {
+    parseCases(input, options.parse, cases);
+    parsed = now();
+  }
+
+  std::string output;
+  std::vector<uint32_t> ends;
+  formatCases(cases, options.parse, output, ends);
+  uint64_t formatted = now();
+
+  writeOutput(output, ends, options);
+  uint64_t written = now();
+
+  timings.read = read - start;
+  timings.parse = parsed - read;
+  timings.format = formatted - parsed;
+  timings.write = written - formatted;
+  timings.total = written - start;
+  numCases = cases.size();
+  return timings;
+}
+
+static std::string toJson(const Timings &timings)
+{
+  std::ostringstream json;
+  json << "{\"read\": " << timings.read
+       << ", \"parse\": " << timings.parse
+       << ", \"format\": " << timings.format
+       << ", \"write\": " << timings.write
+       << ", \"total\": " << timings.total << "}";
+  return json.str();
+}
+
+static bool oneOf(const std::string &value, const std::vector<std::string> &values)
+{
+  return std::find(values.begin(), values.end(), value) != values.end();
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  bool valid = true;
+  for (int i = 1; i < argc && valid; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg.rfind("--", 0))
+    {
+      options.bufferSize = atoll(argv[i]);
+      continue;
+    }
+
+    if (i + 1 == argc)
+    {
+      valid = false;
+      break;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--reader")
+    {
+      options.reader = value;
+    }
+    else if (arg == "--engine")
+    {
+      options.engine = value;
+    }
+    else if (arg == "--writer")
+    {
+      options.writer = value;
+    }
+    else if (arg == "--parse")
+    {
+      options.parse = value;
+    }
+    else if (arg == "--repetitions")
+    {
+      options.repetitions = atoll(value.c_str());
+    }
+    else if (arg == "--warmup")
+    {
+      options.warmup = atoll(value.c_str());
+    }
+    else if (arg == "--input")
+    {
+      options.input = value;
+    }
+    else if (arg == "--output")
+    {
+      options.output = value;
+    }
+    else
+    {
+      valid = false;
+    }
+  }
+
+#ifdef __linux__
+  std::vector<std::string> readers = {"ring", "chunks", "async", "mmap", "prefetch"};
+  std::vector<std::string> writers = {"lazy", "background", "mmap"};
+#else
+  std::vector<std::string> readers = {"ring", "chunks", "async"};
+  std::vector<std::string> writers = {"lazy", "background"};
+#endif
+  valid = valid && options.bufferSize && options.repetitions &&
+          oneOf(options.reader, readers) &&
+          oneOf(options.engine, {"inline", "thread"}) &&
+          oneOf(options.writer, writers) &&
+          oneOf(options.parse, {"sscanf", "from_chars", "views", "batch"}) &&
+          (options.reader != "ring" || options.parse != "batch") &&
+          (options.reader != "mmap" || !options.input.empty()) &&
+          (options.writer != "mmap" || !options.output.empty()) &&
+          (options.repetitions + options.warmup == 1 || !options.input.empty());
+  if (!valid)
+  {
+    std::cerr << "Usage: " << argv[0] << " [buffer size] [--reader ring|chunks|async|mmap|prefetch] [--engine inline|thread]\n"
+              << "       [--writer lazy|background|mmap] [--parse sscanf|from_chars|views|batch]\n"
+              << "       [--repetitions n] [--warmup n] [--input file] [--output file]\n"
+              << "mmap/prefetch are Linux only, the mmap reader needs --input, the mmap writer needs --output,\n"
+              << "repetitions and warmup need --input, batch needs a reader other than ring\n";
+    return 1;
+  }
+
+  size_t numCases = 0;
+  std::vector<Timings> runs;
+  try
+  {
+    for (uint32_t i = 0; i < options.warmup; ++i)
+    {
+      runOnce(options, numCases);
+    }
+
+    for (uint32_t i = 0; i < options.repetitions; ++i)
+    {
+      runs.push_back(runOnce(options, numCases));
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << argv[0] << ": " << e.what() << "\n";
+    return 1;
+  }
+
+  // Median of every phase, and of the total, on its own
+  Timings median;
+  auto medianOf = [&runs](uint64_t Timings::*phase)
+  {
+    std::vector<uint64_t> values;
+    for (auto &run : runs)
+    {
+      values.push_back(run.*phase);
     }
-    auto duration = std::chrono::high_resolution_clock().now() - start;
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+  };
+  median.read = medianOf(&Timings::read);
+  median.parse = medianOf(&Timings::parse);
+  median.format = medianOf(&Timings::format);
+  median.write = medianOf(&Timings::write);
+  median.total = medianOf(&Timings::total);
 
-    char endingBuff[1024];
-    char* currWriteHead = endingBuff;
-    std::string durationStr = std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()/(double)1000000000) + " s"; 
-    currWriteHead += sprintf(currWriteHead, "Duration: %s", durationStr.c_str());
-    std::cout.write(endingBuff, currWriteHead - endingBuff + 1);
+  std::cerr << "{\"bufferSize\": " << options.bufferSize
+            << ", \"reader\": \"" << options.reader << "\""
+            << ", \"engine\": \"" << options.engine << "\""
+            << ", \"writer\": \"" << options.writer << "\""
+            << ", \"parse\": \"" << options.parse << "\""
+            << ", \"warmup\": " << options.warmup
+            << ", \"cases\": " << numCases
+            << ", \"runs\": [";
+  for (size_t i = 0; i < runs.size(); ++i)
+  {
+    std::cerr << (i ? ", " : "") << toJson(runs[i]);
+  }
+  std::cerr << "], \"median\": " << toJson(median) << "}" << std::endl;
 
-    return 0;
-}
\ No newline at end of file
+  return 0;
+}
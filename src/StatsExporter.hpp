@@ -0,0 +1,402 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SmartBuffer.hpp"
+
+// Live stats of running buffers, published into a POSIX shared memory
+// segment(Linux only) that the bufstat tool(or anything else) attaches to,
+// without the process being stopped, traced or logging anything:
+//
+//   StatsExporter exporter("/myDaemon", 64);
+//   SyncIOReadBuffer<uint32_t, HeapStorage, ExportedStats> in(4096);
+//   in.setExport(exporter.add("client 1 in"));
+//   SyncIOLazyWriteBuffer<uint32_t, HeapStorage, NoLock, ExportedStats> out(4096, ioInterface);
+//   out.setExport(exporter.add("client 1 out"));
+//   ...
+//   // After the buffers are gone
+//   exporter.remove(...);
+//
+//   $ bufstat /myDaemon
+//
+// Every buffer has a slot of its own that only the thread using the buffer
+// writes to, so there is no contention between buffers. A slot is guarded by
+// a seqlock: the writer makes its sequence odd, updates the counters and
+// makes it even again, a reader retries if the sequence was odd or changed
+// while it copied the counters. The writer does relaxed stores only(single
+// writer, so no read-modify-write either), the release fences around them
+// cost no instructions on x86, readers never make the writer wait
+
+// One buffer's counters, all since the buffer was attached
+struct alignas(64) StatsSlot
+{
+  static constexpr uint32_t NAME_SIZE = 40;
+  static constexpr uint32_t NUM_FLUSH_CAUSES = 3;
+
+  // A call to the ioInterface has just returned 'len', 'occupancy' is the
+  // no. of bytes buffered after it(read buffers) or before it(write buffers)
+  void onIoCall(const uint64_t &len, const uint64_t &occupancy)
+  {
+    begin();
+    add(ioCalls, 1);
+    add(bytes, len);
+    if (!len)
+    {
+      add(emptyCalls, 1);
+    }
+    occupancyNow.store(occupancy, std::memory_order_relaxed);
+    if (occupancy > maxOccupancy.load(std::memory_order_relaxed))
+    {
+      maxOccupancy.store(occupancy, std::memory_order_relaxed);
+    }
+    end();
+  }
+
+  // A record has just been consumed from a read buffer
+  void onRecord()
+  {
+    begin();
+    add(records, 1);
+    end();
+  }
+
+  // A write buffer has started draining its bytes to the ioInterface
+  void onFlush(const FlushCause &cause)
+  {
+    begin();
+    add(flushes[static_cast<uint32_t>(cause)], 1);
+    end();
+  }
+
+  // A buffer of 'size' bytes has just been attached
+  void attach(const SlotKind &slotKind, const uint64_t &size)
+  {
+    begin();
+    kind.store(static_cast<uint32_t>(slotKind), std::memory_order_relaxed);
+    capacity.store(size, std::memory_order_relaxed);
+    end();
+  }
+
+  std::atomic<uint32_t> seq;
+  // A SlotKind, FREE till a buffer is attached
+  std::atomic<uint32_t> kind;
+  char name[NAME_SIZE];
+  std::atomic<uint64_t> capacity;
+  std::atomic<uint64_t> ioCalls;
+  // Calls to the ioInterface that transferred nothing(would block, end of
+  // stream or failure)
+  std::atomic<uint64_t> emptyCalls;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> records;
+  std::atomic<uint64_t> occupancyNow;
+  std::atomic<uint64_t> maxOccupancy;
+  // Indexed by FlushCause
+  std::atomic<uint64_t> flushes[NUM_FLUSH_CAUSES];
+
+private:
+  friend struct StatsExporter;
+
+  void begin()
+  {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void end()
+  {
+    std::atomic_thread_fence(std::memory_order_release);
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  static void add(std::atomic<uint64_t> &counter, const uint64_t &n)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+};
+
+// A consistent copy of a StatsSlot
+struct StatsSnapshot
+{
+  SlotKind kind;
+  char name[StatsSlot::NAME_SIZE];
+  uint64_t capacity;
+  uint64_t ioCalls;
+  uint64_t emptyCalls;
+  uint64_t bytes;
+  uint64_t records;
+  uint64_t occupancy;
+  uint64_t maxOccupancy;
+  uint64_t flushes[StatsSlot::NUM_FLUSH_CAUSES];
+};
+
+// Layout of the start of the segment, the slots follow it
+struct StatsSegmentHeader
+{
+  static constexpr uint64_t MAGIC = 0x5354415453465542; // "BUFSTATS"
+
+  uint64_t magic;
+  uint32_t slotSize;
+  uint32_t numSlots;
+  int64_t pid;
+};
+
+// StatsPolicy of the buffers: what AttachableStats allows, plus a StatsSlot,
+// see SyncIOReadBuffer::setExport and SyncIOLazyWriteBuffer::setExport
+struct ExportedStats : AttachableStats
+{
+  static constexpr bool EXPORTED = true;
+  StatsSlot *slot = nullptr;
+};
+
+// Owner of a segment, creates it and hands out its slots
+struct StatsExporter
+{
+  /**
+   * Constructor, creates the segment, replacing any segment of the same name
+   *
+   * @param name      The POSIX shared memory name(shm_open), e.g. "/myDaemon"
+   * @param numSlots  Max no. of buffers exported at once
+   *
+   * throws std::runtime_error if the segment can't be created
+   **/
+  StatsExporter(const char *name, const uint32_t &numSlots) : m_name(name),
+                                                               m_header(nullptr),
+                                                               m_slots(nullptr),
+                                                               m_used(numSlots, false)
+  {
+    if (!numSlots)
+    {
+      throw std::invalid_argument("numSlots should  be passed as a positive integer");
+    }
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+      throw std::runtime_error("unable to create the shared memory");
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(segmentSize(numSlots))) < 0)
+    {
+      ::close(fd);
+      shm_unlink(name);
+      throw std::runtime_error("unable to size the shared memory");
+    }
+
+    void *addr = mmap(nullptr, segmentSize(numSlots), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+      shm_unlink(name);
+      throw std::runtime_error("unable to map the shared memory");
+    }
+
+    // The memory is zero filled, i.e. every slot is FREE
+    m_header = new (addr) StatsSegmentHeader{StatsSegmentHeader::MAGIC, sizeof(StatsSlot), numSlots, getpid()};
+    m_slots = reinterpret_cast<StatsSlot *>(static_cast<char *>(addr) + headerSize());
+  }
+
+  /**
+   * Claim a slot for a buffer, to be passed to its setExport. The counters
+   * start at 0, the slot shows up once the buffer is attached
+   *
+   * @param name  Shown by bufstat, truncated to StatsSlot::NAME_SIZE - 1
+   *
+   * @return      nullptr if all the slots are in use
+   **/
+  StatsSlot *add(const char *name)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t i = 0; i < m_used.size(); ++i)
+    {
+      if (!m_used[i])
+      {
+        m_used[i] = true;
+        StatsSlot &slot = m_slots[i];
+        slot.begin();
+        slot.kind.store(static_cast<uint32_t>(SlotKind::FREE), std::memory_order_relaxed);
+        strncpy(slot.name, name, StatsSlot::NAME_SIZE - 1);
+        slot.name[StatsSlot::NAME_SIZE - 1] = 0;
+        for (auto *counter : {&slot.capacity, &slot.ioCalls, &slot.emptyCalls, &slot.bytes, &slot.records,
+                              &slot.occupancyNow, &slot.maxOccupancy, &slot.flushes[0], &slot.flushes[1], &slot.flushes[2]})
+        {
+          counter->store(0, std::memory_order_relaxed);
+        }
+        slot.end();
+        return &slot;
+      }
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * Give a slot back, once the buffer it was passed to is gone(a write
+   * buffer reports its last flush from its destructor)
+   **/
+  void remove(StatsSlot *slot)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slot->begin();
+    slot->kind.store(static_cast<uint32_t>(SlotKind::FREE), std::memory_order_relaxed);
+    slot->end();
+    m_used[slot - m_slots] = false;
+  }
+
+  // Removes the segment, attached readers keep their mapping
+  ~StatsExporter()
+  {
+    munmap(m_header, segmentSize(m_used.size()));
+    shm_unlink(m_name.c_str());
+  }
+
+  StatsExporter(const StatsExporter &) = delete;
+  StatsExporter &operator=(const StatsExporter &) = delete;
+  StatsExporter(StatsExporter &&) = delete;
+  StatsExporter &operator=(StatsExporter &&) = delete;
+
+  // The slots start on a cache line of their own
+  static constexpr uint64_t headerSize()
+  {
+    return sizeof(StatsSlot);
+  }
+
+  static uint64_t segmentSize(const uint64_t &numSlots)
+  {
+    return headerSize() + numSlots * sizeof(StatsSlot);
+  }
+
+private:
+  std::string m_name;
+  StatsSegmentHeader *m_header;
+  StatsSlot *m_slots;
+  std::mutex m_mutex;
+  std::vector<bool> m_used;
+};
+
+// Read only view of a segment, from any process
+struct StatsView
+{
+  static constexpr uint32_t MAX_ATTEMPTS = 1 << 16;
+
+  /**
+   * Constructor, maps the segment
+   *
+   * throws std::runtime_error if it doesn't exist or isn't a stats segment
+   **/
+  StatsView(const char *name) : m_header(nullptr),
+                                m_slots(nullptr),
+                                m_size(0)
+  {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+      throw std::runtime_error("unable to open the shared memory");
+    }
+
+    struct stat fdStat;
+    if (fstat(fd, &fdStat) < 0 || static_cast<uint64_t>(fdStat.st_size) < StatsExporter::headerSize())
+    {
+      ::close(fd);
+      throw std::runtime_error("not a stats segment");
+    }
+
+    m_size = fdStat.st_size;
+    void *addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+      throw std::runtime_error("unable to map the shared memory");
+    }
+
+    m_header = static_cast<const StatsSegmentHeader *>(addr);
+    m_slots = reinterpret_cast<const StatsSlot *>(static_cast<const char *>(addr) + StatsExporter::headerSize());
+    if (m_header->magic != StatsSegmentHeader::MAGIC ||
+        m_header->slotSize != sizeof(StatsSlot) ||
+        m_size != StatsExporter::segmentSize(m_header->numSlots))
+    {
+      munmap(addr, m_size);
+      throw std::runtime_error("not a stats segment");
+    }
+  }
+
+  uint32_t numSlots()
+  {
+    return m_header->numSlots;
+  }
+
+  // pid of the exporting process
+  int64_t pid()
+  {
+    return m_header->pid;
+  }
+
+  /**
+   * Copy slot 'index', retrying while its writer is in the middle of an
+   * update
+   *
+   * @return  false if the slot is FREE, or its writer didn't get out of an
+   *          update in MAX_ATTEMPTS attempts(e.g. it died in one)
+   **/
+  bool read(const uint32_t &index, StatsSnapshot &snapshot)
+  {
+    const StatsSlot &slot = m_slots[index];
+    for (uint32_t attempt = 0; attempt < MAX_ATTEMPTS; ++attempt)
+    {
+      uint32_t seq = slot.seq.load(std::memory_order_acquire);
+      if (seq & 1)
+      {
+        // The writer may have been preempted in the middle of the update
+        std::this_thread::yield();
+        continue;
+      }
+
+      snapshot.kind = static_cast<SlotKind>(slot.kind.load(std::memory_order_relaxed));
+      memcpy(snapshot.name, slot.name, StatsSlot::NAME_SIZE);
+      snapshot.capacity = slot.capacity.load(std::memory_order_relaxed);
+      snapshot.ioCalls = slot.ioCalls.load(std::memory_order_relaxed);
+      snapshot.emptyCalls = slot.emptyCalls.load(std::memory_order_relaxed);
+      snapshot.bytes = slot.bytes.load(std::memory_order_relaxed);
+      snapshot.records = slot.records.load(std::memory_order_relaxed);
+      snapshot.occupancy = slot.occupancyNow.load(std::memory_order_relaxed);
+      snapshot.maxOccupancy = slot.maxOccupancy.load(std::memory_order_relaxed);
+      for (uint32_t cause = 0; cause < StatsSlot::NUM_FLUSH_CAUSES; ++cause)
+      {
+        snapshot.flushes[cause] = slot.flushes[cause].load(std::memory_order_relaxed);
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == seq)
+      {
+        snapshot.name[StatsSlot::NAME_SIZE - 1] = 0;
+        return snapshot.kind != SlotKind::FREE;
+      }
+    }
+
+    return false;
+  }
+
+  ~StatsView()
+  {
+    munmap(const_cast<StatsSegmentHeader *>(m_header), m_size);
+  }
+
+  StatsView(const StatsView &) = delete;
+  StatsView &operator=(const StatsView &) = delete;
+  StatsView(StatsView &&) = delete;
+  StatsView &operator=(StatsView &&) = delete;
+
+private:
+  const StatsSegmentHeader *m_header;
+  const StatsSlot *m_slots;
+  uint64_t m_size;
+};
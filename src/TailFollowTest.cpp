@@ -0,0 +1,85 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "FdSource.hpp"
+
+// Latency from a line being appended to a file till a follower reads it, the
+// writer sleeps between lines so the follower is idle(waiting) most of the time
+// Usage: TailFollowTest <file> <no. of lines> <interval between lines in us>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <file> <no. of lines> <interval between lines in us>\n";
+    return 1;
+  }
+
+  const char *path = argv[1];
+  uint32_t numLines = atoll(argv[2]);
+  uint32_t interval = atoll(argv[3]);
+
+  int writeFd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (writeFd < 0)
+  {
+    std::cerr << "Unable to open " << path << "\n";
+    return 1;
+  }
+
+  FdSource source(path);
+  if (!source.follow())
+  {
+    std::cerr << "Unable to follow " << path << "\n";
+    return 1;
+  }
+
+  std::thread writer(
+      [&]()
+      {
+        for (uint32_t i = 0; i < numLines; ++i)
+        {
+          std::this_thread::sleep_for(std::chrono::microseconds(interval));
+          std::string line = std::to_string(now()) + " some log line payload\n";
+          if (::write(writeFd, line.c_str(), line.length()) < 0)
+          {
+            break;
+          }
+        }
+        source.stop();
+      });
+
+  SyncIOReadBuffer<uint32_t> buffer(1 << 16);
+  std::vector<uint64_t> latencies;
+  latencies.reserve(numLines);
+  char line[1 << 12];
+  while (auto len = source.followUntil(buffer, line, '\n'))
+  {
+    uint64_t readAt = now();
+    line[len - 1] = 0;
+    latencies.push_back(readAt - strtoull(line, nullptr, 10));
+  }
+
+  writer.join();
+  ::close(writeFd);
+  if (latencies.empty())
+  {
+    std::cerr << "No lines read\n";
+    return 1;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << "Lines read:   " << latencies.size() << "\n"
+            << "Latency p50:  " << latencies[latencies.size() / 2] / 1000.0 << " us\n"
+            << "Latency p99:  " << latencies[latencies.size() * 99 / 100] / 1000.0 << " us\n"
+            << "Latency max:  " << latencies.back() / 1000.0 << " us\n";
+  return 0;
+}
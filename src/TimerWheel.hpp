@@ -0,0 +1,283 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include "SmartBuffer.hpp"
+
+// A timer of a TimerWheel, owned by the user and linked into the wheel while
+// it is pending, so scheduling and cancelling never allocate
+struct WheelTimer
+{
+  WheelTimer(const std::function<void()> &callback = nullptr) : callback(callback),
+                                                                 m_prev(nullptr),
+                                                                 m_next(nullptr),
+                                                                 m_expiry(0)
+  {
+  }
+
+  bool pending()
+  {
+    return m_next != nullptr;
+  }
+
+  // Called by TimerWheel::advance when the timer expires, the timer is no
+  // longer pending by then, so it can schedule itself again
+  std::function<void()> callback;
+
+  WheelTimer(const WheelTimer &) = delete;
+  WheelTimer &operator=(const WheelTimer &) = delete;
+  WheelTimer(WheelTimer &&) = delete;
+  WheelTimer &operator=(WheelTimer &&) = delete;
+
+private:
+  friend struct TimerWheel;
+  WheelTimer *m_prev;
+  WheelTimer *m_next;
+  uint64_t m_expiry;
+};
+
+// Hierarchical timer wheel, driven by a single(reactor) thread calling
+// advance with the current time. Time is counted in ticks, LEVELS wheels of
+// SLOTS slots each cover 1, SLOTS, SLOTS^2 ... ticks per slot:
+//
+// level 0 |t|t|t|t|...|    a slot per tick
+// level 1 |.|.|.|.|...|    a slot per SLOTS ticks
+// ...
+//
+// A timer goes into the lowest level whose range covers its expiry, and
+// moves down a level every time the wheel gets to its slot, so scheduling,
+// cancelling and firing are O(1) per timer(a timer is moved at most
+// LEVELS - 1 times). Expiries further out than SLOTS^LEVELS ticks are
+// clamped to that
+struct TimerWheel
+{
+  static constexpr unsigned SLOT_BITS = 8;
+  static constexpr unsigned SLOTS = 1 << SLOT_BITS;
+  static constexpr unsigned LEVELS = 4;
+
+  /**
+   *  Constructor
+   *  @param tickNs   Resolution of the wheel, in ns, throws if 0
+   *  @param startNs  Current time, in ns, in whatever clock advance is
+   *                  going to be called with
+   **/
+  TimerWheel(const uint64_t &tickNs, const uint64_t &startNs) : m_tickNs(tickNs),
+                                                                m_startNs(startNs),
+                                                                m_current(0),
+                                                                m_pending(0)
+  {
+    if (!tickNs)
+    {
+      throw std::invalid_argument("tickNs should  be passed as a positive integer");
+    }
+
+    for (auto &level : m_slots)
+    {
+      for (auto &slot : level)
+      {
+        slot.m_prev = slot.m_next = &slot;
+      }
+    }
+  }
+
+  /**
+   * Schedule 'timer' to fire 'delayNs' after the time the wheel was last
+   * advanced to(see now()), rounded up to a tick, without reading the
+   * clock. A pending timer is rescheduled
+   **/
+  void schedule(WheelTimer &timer, const uint64_t &delayNs)
+  {
+    cancel(timer);
+    uint64_t ticks = std::max<uint64_t>((delayNs + m_tickNs - 1) / m_tickNs, 1);
+    timer.m_expiry = m_current + std::min<uint64_t>(ticks, MAX_TICKS);
+    insert(timer);
+    ++m_pending;
+  }
+
+  void cancel(WheelTimer &timer)
+  {
+    if (timer.pending())
+    {
+      unlink(timer);
+      --m_pending;
+    }
+  }
+
+  /**
+   * Move the wheel to 'nowNs', firing all the timers expiring on the way,
+   * in order of expiry
+   *
+   * @return  No. of timers fired
+   **/
+  uint64_t advance(const uint64_t &nowNs)
+  {
+    uint64_t target = nowNs > m_startNs ? (nowNs - m_startNs) / m_tickNs : 0;
+    uint64_t ret = 0;
+    while (m_current < target)
+    {
+      if (!m_pending)
+      {
+        m_current = target;
+        break;
+      }
+
+      ++m_current;
+      // Higher levels first, what they hand down may land in the slot of
+      // a lower level due this very tick
+      for (unsigned level = LEVELS - 1; level; --level)
+      {
+        if (!(m_current & ((uint64_t(1) << (SLOT_BITS * level)) - 1)))
+        {
+          WheelTimer &slot = m_slots[level][slotOf(m_current, level)];
+          while (slot.m_next != &slot)
+          {
+            WheelTimer &timer = *slot.m_next;
+            unlink(timer);
+            insert(timer);
+          }
+        }
+      }
+
+      WheelTimer &slot = m_slots[0][slotOf(m_current, 0)];
+      while (slot.m_next != &slot)
+      {
+        WheelTimer &timer = *slot.m_next;
+        unlink(timer);
+        --m_pending;
+        ++ret;
+        timer.callback();
+      }
+    }
+
+    return ret;
+  }
+
+  // The time the wheel was last advanced to, in ns, rounded down to a tick
+  uint64_t now()
+  {
+    return m_startNs + m_current * m_tickNs;
+  }
+
+  // No. of timers pending
+  uint64_t pending()
+  {
+    return m_pending;
+  }
+
+  ~TimerWheel()
+  {
+    for (auto &level : m_slots)
+    {
+      for (auto &slot : level)
+      {
+        while (slot.m_next != &slot)
+        {
+          unlink(*slot.m_next);
+        }
+      }
+    }
+  }
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+  TimerWheel(TimerWheel &&) = delete;
+  TimerWheel &operator=(TimerWheel &&) = delete;
+
+private:
+  static constexpr uint64_t MAX_TICKS = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+  static unsigned slotOf(const uint64_t &tick, const unsigned &level)
+  {
+    return (tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+  }
+
+  // Into the lowest level covering the expiry. Scheduled timers expire
+  // after m_current, the ones moved down may expire at m_current, in which
+  // case they land in the level 0 slot about to be fired
+  void insert(WheelTimer &timer)
+  {
+    const uint64_t &expiry = timer.m_expiry;
+    uint64_t delta = expiry - m_current;
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1))))
+    {
+      ++level;
+    }
+
+    WheelTimer &slot = m_slots[level][slotOf(expiry, level)];
+    timer.m_prev = slot.m_prev;
+    timer.m_next = &slot;
+    slot.m_prev->m_next = &timer;
+    slot.m_prev = &timer;
+  }
+
+  static void unlink(WheelTimer &timer)
+  {
+    timer.m_prev->m_next = timer.m_next;
+    timer.m_next->m_prev = timer.m_prev;
+    timer.m_prev = timer.m_next = nullptr;
+  }
+
+  const uint64_t m_tickNs;
+  const uint64_t m_startNs;
+  uint64_t m_current;
+  uint64_t m_pending;
+  // Heads of the circular lists of the slots
+  WheelTimer m_slots[LEVELS][SLOTS];
+};
+
+// Bounds how long the bytes can sit in a SyncIOLazyWriteBuffer: the first
+// write into an empty buffer schedules a flush 'maxDelayNs' later on the
+// wheel, so the writers never read the clock. The bytes are flushed within
+// maxDelayNs + a tick + the interval between the calls to
+// TimerWheel::advance. Both the wheel and the buffer are borrowed and have
+// to be used from the same thread
+template <class SizeType>
+  requires std::unsigned_integral<SizeType>
+struct FlushDeadline
+{
+  FlushDeadline(TimerWheel &wheel,
+                SyncIOLazyWriteBuffer<SizeType> &buffer,
+                const uint64_t &maxDelayNs) : m_wheel(wheel),
+                                              m_buffer(buffer),
+                                              m_maxDelayNs(maxDelayNs),
+                                              m_timer([this]()
+                                                      { onDeadline(); })
+  {
+    buffer.setOnDirty([this]()
+                      {
+                        if (!m_timer.pending())
+                        {
+                          m_wheel.schedule(m_timer, m_maxDelayNs);
+                        }
+                      });
+  }
+
+  ~FlushDeadline()
+  {
+    m_wheel.cancel(m_timer);
+    m_buffer.setOnDirty(nullptr);
+  }
+
+  FlushDeadline(const FlushDeadline &) = delete;
+  FlushDeadline &operator=(const FlushDeadline &) = delete;
+  FlushDeadline(FlushDeadline &&) = delete;
+  FlushDeadline &operator=(FlushDeadline &&) = delete;
+
+private:
+  // Whatever the ioInterface didn't take gets another deadline
+  void onDeadline()
+  {
+    m_buffer.flush();
+    if (m_buffer.flushedPosition() != m_buffer.position())
+    {
+      m_wheel.schedule(m_timer, m_maxDelayNs);
+    }
+  }
+
+  TimerWheel &m_wheel;
+  SyncIOLazyWriteBuffer<SizeType> &m_buffer;
+  const uint64_t m_maxDelayNs;
+  WheelTimer m_timer;
+};
@@ -0,0 +1,113 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include "BufferStats.hpp"
+#include "TimerWheel.hpp"
+
+// Bounding the flush delay of many SyncIOLazyWriteBuffers from a reactor
+// loop. Messages of 64 bytes go to randomly picked writers, the loop reads
+// the clock once per 256 messages and then either scans all the writers for
+// the ones dirty for longer than <max flush delay>, or advances a
+// TimerWheel(FlushDeadline per writer). Neither reads the clock per write.
+// The flush delay is measured from the loop iteration the oldest flushed
+// message was written in
+// Usage: TimerWheelTest <no. of writers> <no. of messages> <max flush delay in us>
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    std::cerr << "Usage: " << argv[0] << " <no. of writers> <no. of messages> <max flush delay in us>\n";
+    return 1;
+  }
+
+  uint32_t numWriters = atoll(argv[1]);
+  uint64_t numMessages = atoll(argv[2]);
+  uint64_t maxDelay = atoll(argv[3]) * 1000;
+  const uint64_t tick = std::max<uint64_t>(maxDelay / 10, 1);
+
+  for (bool useWheel : {false, true})
+  {
+    LatencyHistogram delays;
+    uint64_t flushes = 0;
+    SyncIOLazyWriteBuffer<uint32_t>::IOInterface ioInterface = [&](const char *out, const uint32_t &len)
+    {
+      // Buffers are a multiple of the message size, the oldest message is
+      // at the start of the first run
+      uint64_t writtenAt;
+      memcpy(&writtenAt, out, sizeof(writtenAt));
+      delays.record(now() - writtenAt);
+      ++flushes;
+      return len;
+    };
+
+    uint64_t loopTime = now();
+    TimerWheel wheel(tick, loopTime);
+    std::vector<std::unique_ptr<SyncIOLazyWriteBuffer<uint32_t>>> writers;
+    std::vector<std::unique_ptr<FlushDeadline<uint32_t>>> deadlines;
+    std::vector<uint64_t> dirtySince(numWriters, 0);
+    for (uint32_t i = 0; i < numWriters; ++i)
+    {
+      writers.push_back(std::make_unique<SyncIOLazyWriteBuffer<uint32_t>>(1024, ioInterface));
+      if (useWheel)
+      {
+        deadlines.push_back(std::make_unique<FlushDeadline<uint32_t>>(wheel, *writers.back(), maxDelay));
+      }
+      else
+      {
+        writers.back()->setOnDirty([&, i]()
+                                   { dirtySince[i] = loopTime; });
+      }
+    }
+
+    std::mt19937 random(1);
+    char message[64] = {};
+    uint64_t nextScan = loopTime + tick;
+    uint64_t start = now();
+    for (uint64_t i = 0; i < numMessages; ++i)
+    {
+      if (!(i % 256))
+      {
+        loopTime = now();
+        if (useWheel)
+        {
+          wheel.advance(loopTime);
+        }
+        else if (loopTime >= nextScan)
+        {
+          for (uint32_t writer = 0; writer < numWriters; ++writer)
+          {
+            if (writers[writer]->position() != writers[writer]->flushedPosition() &&
+                loopTime - dirtySince[writer] >= maxDelay)
+            {
+              writers[writer]->flush();
+            }
+          }
+          nextScan = loopTime + tick;
+        }
+      }
+
+      memcpy(message, &loopTime, sizeof(loopTime));
+      writers[random() % numWriters]->write(message, sizeof(message));
+    }
+    uint64_t elapsed = now() - start;
+
+    std::cout << (useWheel ? "Timer wheel" : "Scan every " + std::to_string(tick / 1000) + " us") << ":\n"
+              << "  Time per message: " << static_cast<double>(elapsed) / numMessages << " ns\n"
+              << "  Flushes: " << flushes << "\n"
+              << "  Flush delay p50: " << delays.percentile(50) / 1000 << " us\n"
+              << "  Flush delay p99: " << delays.percentile(99) / 1000 << " us\n"
+              << "  Flush delay max: " << delays.max() / 1000 << " us\n";
+  }
+
+  return 0;
+}
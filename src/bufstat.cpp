@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include "StatsExporter.hpp"
+
+// top-like live view of the buffers a process exports with a StatsExporter:
+// every [interval ms](1000 by default) the slots of the segment <name> are
+// read and a line is printed per buffer, busiest(calls to its ioInterface
+// per second) first:
+// Occ/Max   - bytes buffered at the last call to the ioInterface, and the
+//             most ever, as a % of the size
+// Calls/s   - calls to the ioInterface(i.e. syscalls, for an fd) per second,
+//             Empty/s those that transferred nothing
+// MB/s      - bytes through the ioInterface per second
+// Records/s - records consumed per second(read buffers)
+// Flushes   - drains since attached, by cause: full/explicit/close(write
+//             buffers)
+// The screen is cleared between views if stdout is a terminal. Runs
+// [iterations] times, forever if 0(the default)
+// Usage: bufstat <name> [interval ms] [iterations]
+static uint64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static const char *kindName(const SlotKind &kind)
+{
+  return kind == SlotKind::READ ? "read" : "write";
+}
+
+static double percentOf(const uint64_t &value, const uint64_t &capacity)
+{
+  return capacity ? 100.0 * value / capacity : 0;
+}
+
+// Counters of a slot that was reused since the last view start over
+static uint64_t delta(const uint64_t &current, const uint64_t &previous)
+{
+  return current >= previous ? current - previous : current;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <name> [interval ms] [iterations]\n";
+    return 1;
+  }
+
+  uint64_t intervalMs = argc > 2 ? atoll(argv[2]) : 1000;
+  uint64_t iterations = argc > 3 ? atoll(argv[3]) : 0;
+  if (!intervalMs)
+  {
+    std::cerr << "interval should be a positive no. of ms\n";
+    return 1;
+  }
+
+  try
+  {
+    StatsView view(argv[1]);
+    bool terminal = isatty(STDOUT_FILENO);
+    std::map<uint32_t, StatsSnapshot> previous;
+    uint64_t previousTime = now();
+    for (uint64_t iteration = 0; !iterations || iteration < iterations; ++iteration)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+      uint64_t currentTime = now();
+      double seconds = (currentTime - previousTime) / 1e9;
+      previousTime = currentTime;
+
+      struct Line
+      {
+        uint32_t index;
+        StatsSnapshot snapshot;
+        double callsPerSec;
+      };
+
+      std::vector<Line> lines;
+      std::map<uint32_t, StatsSnapshot> current;
+      for (uint32_t index = 0; index < view.numSlots(); ++index)
+      {
+        StatsSnapshot snapshot;
+        if (!view.read(index, snapshot))
+        {
+          continue;
+        }
+
+        current[index] = snapshot;
+        StatsSnapshot before{};
+        if (auto it = previous.find(index); it != previous.end())
+        {
+          before = it->second;
+        }
+        lines.push_back({index, snapshot, delta(snapshot.ioCalls, before.ioCalls) / seconds});
+      }
+
+      std::sort(lines.begin(), lines.end(), [](const Line &a, const Line &b)
+                { return a.callsPerSec > b.callsPerSec; });
+
+      if (terminal)
+      {
+        printf("\033[H\033[2J");
+      }
+      printf("bufstat %s  pid %lld  %zu buffers  every %llu ms\n", argv[1],
+             static_cast<long long>(view.pid()), lines.size(), static_cast<unsigned long long>(intervalMs));
+      printf("%-4s %-24s %-5s %9s %7s %7s %10s %10s %9s %10s  %s\n",
+             "Slot", "Name", "Kind", "Size", "Occ%", "Max%", "Calls/s", "Empty/s", "MB/s", "Records/s", "Flushes(full/explicit/close)");
+      for (auto &line : lines)
+      {
+        const StatsSnapshot &snapshot = line.snapshot;
+        StatsSnapshot before{};
+        if (auto it = previous.find(line.index); it != previous.end())
+        {
+          before = it->second;
+        }
+
+        printf("%-4u %-24.24s %-5s %9llu %7.1f %7.1f %10.0f %10.0f %9.2f %10.0f  ",
+               line.index, snapshot.name, kindName(snapshot.kind),
+               static_cast<unsigned long long>(snapshot.capacity),
+               percentOf(snapshot.occupancy, snapshot.capacity),
+               percentOf(snapshot.maxOccupancy, snapshot.capacity),
+               line.callsPerSec,
+               delta(snapshot.emptyCalls, before.emptyCalls) / seconds,
+               delta(snapshot.bytes, before.bytes) / seconds / (1 << 20),
+               delta(snapshot.records, before.records) / seconds);
+        if (snapshot.kind == SlotKind::WRITE)
+        {
+          printf("%llu/%llu/%llu",
+                 static_cast<unsigned long long>(snapshot.flushes[static_cast<uint32_t>(FlushCause::FULL)]),
+                 static_cast<unsigned long long>(snapshot.flushes[static_cast<uint32_t>(FlushCause::EXPLICIT)]),
+                 static_cast<unsigned long long>(snapshot.flushes[static_cast<uint32_t>(FlushCause::CLOSE)]));
+        }
+        printf("\n");
+      }
+      fflush(stdout);
+      previous = std::move(current);
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << argv[1] << ": " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
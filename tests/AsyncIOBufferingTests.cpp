@@ -415,6 +415,165 @@ TEST_F(AsyncBufferTest, SearialWrites_BufferSizeLessThanTotalWriteSize)
   EXPECT_EQ(mockOutPut, expectedBuff);
 }
 
+// Positions are 64-bit even when SizeType is 32-bit. Streams 5 GB, too slow
+// for every run: --gtest_also_run_disabled_tests
+TEST_F(AsyncBufferTest, DISABLED_Position_StreamsLongerThan4GB)
+{
+  const uint64_t streamLen = 5ull << 30;
+  const uint32_t chunk = 1 << 20;
+  std::vector<char> scratch(chunk);
+
+  uint64_t produced = 0;
+  AsyncIOReadBuffer<uint32_t> reader(chunk);
+  auto readInterface = [&](char *, const uint32_t &len, const ReadResultHandler &resHandler)
+  {
+    uint32_t ret = static_cast<uint32_t>(std::min<uint64_t>(len, streamLen - produced));
+    produced += ret;
+    resHandler(ret);
+  };
+
+  bool more = true;
+  while (more)
+  {
+    reader.read(scratch.data(), chunk, readInterface, [&](const uint32_t &len)
+                { more = len == chunk; });
+  }
+  EXPECT_EQ(reader.position(), streamLen);
+
+  uint64_t consumed = 0;
+  AsyncIOWriteBuffer<uint32_t> writer(chunk,
+                                      [&](const char *, const uint32_t &len, const WriteResultHandler &resHandler)
+                                      {
+                                        consumed += len;
+                                        resHandler(len);
+                                      });
+  for (uint64_t written = 0; written < streamLen; written += chunk)
+  {
+    writer.write(scratch.data(), chunk, [](const uint32_t &) {});
+  }
+  EXPECT_EQ(writer.position(), streamLen);
+  EXPECT_EQ(writer.flushedPosition(), streamLen);
+  EXPECT_EQ(consumed, streamLen);
+}
+
+// The IOInterface completes a read/write only when told to, after the
+// buffer has moved
+TEST_F(AsyncBufferTest, Move_CompletesInFlightOperationsIntoTheNewBuffer)
+{
+  mockInput = "HelloWorld";
+  std::function<void()> complete;
+  auto readInterface = [&](char *out, const uint32_t &len, const ReadResultHandler &resHandler)
+  {
+    complete = [this, out, len, resHandler]()
+    {
+      resHandler(mockReader(out, len));
+    };
+  };
+
+  std::vector<AsyncIOReadBuffer<uint32_t>> readers;
+  readers.emplace_back(4);
+  char output[16];
+  uint32_t totalLenRead = 0;
+  readers[0].read(output, 6, readInterface, [&](const uint32_t &len)
+                  { totalLenRead = len; });
+  // Reallocation, the read loop goes on in the moved buffer
+  for (uint32_t i = 0; i < 10; ++i)
+  {
+    readers.emplace_back(4);
+  }
+  while (!totalLenRead)
+  {
+    auto next = std::move(complete);
+    next();
+  }
+  EXPECT_EQ(totalLenRead, 6);
+  EXPECT_EQ(std::string(output, 6), "HelloW");
+  EXPECT_EQ(readers[0].position(), 6);
+  EXPECT_EQ(readers[0].size(), 2);
+
+  std::vector<std::function<void()>> completions;
+  auto writeInterface = [&](const char *out, const uint32_t &len, const WriteResultHandler &resHandler)
+  {
+    completions.push_back([this, out, len, resHandler]()
+                          { resHandler(mockWriter(out, std::min<uint32_t>(len, 3))); });
+  };
+  AsyncIOWriteBuffer<uint32_t> first(8, writeInterface);
+  uint32_t written = 0;
+  first.write("ByeWorld!", 9, [&](const uint32_t &len)
+              { written = len; });
+  AsyncIOWriteBuffer<uint32_t> second(std::move(first));
+  while (!completions.empty())
+  {
+    auto next = std::move(completions.back());
+    completions.pop_back();
+    next();
+  }
+  EXPECT_EQ(written, 9);
+  EXPECT_EQ(mockOutPut, "ByeWorld!");
+  EXPECT_EQ(second.flushedPosition(), 9);
+}
+
+TEST_F(AsyncBufferTest, Move_AbandonsInFlightOperationsOfTheReplacedBuffer)
+{
+  mockInput = "HelloWorld";
+  // Reads complete with 'len' bytes, completions of abandoned reads must not
+  // touch the memory of the buffer, it's gone
+  std::vector<std::function<void(bool)>> completions;
+  auto readInterface = [&](char *out, const uint32_t &len, const ReadResultHandler &resHandler)
+  {
+    completions.push_back([this, out, len, resHandler](const bool &abandoned)
+                          { resHandler(abandoned ? len : mockReader(out, len)); });
+  };
+
+  uint32_t movedRead = 0;
+  bool replacedCalled = false;
+  char movedOutput[16];
+  char replacedOutput[16];
+  AsyncIOReadBuffer<uint32_t> moved(4);
+  AsyncIOReadBuffer<uint32_t> replaced(4);
+  moved.read(movedOutput, 6, readInterface, [&](const uint32_t &len)
+             { movedRead = len; });
+  replaced.read(replacedOutput, 6, readInterface, [&](const uint32_t &)
+                { replacedCalled = true; });
+  ASSERT_EQ(completions.size(), 2);
+
+  // The read of 'replaced' is abandoned, the one of 'moved' goes on in it
+  replaced = std::move(moved);
+  completions[1](true);
+  EXPECT_FALSE(replacedCalled);
+  completions[0](false);
+  ASSERT_EQ(completions.size(), 3);
+  completions[2](false);
+  EXPECT_EQ(movedRead, 6);
+  EXPECT_EQ(std::string(movedOutput, 6), "HelloW");
+  EXPECT_EQ(replaced.position(), 6);
+
+  // Destroyed with a read in flight
+  {
+    AsyncIOReadBuffer<uint32_t> destroyed(4);
+    destroyed.read(movedOutput, 6, readInterface, [&](const uint32_t &)
+                   { replacedCalled = true; });
+  }
+  completions.back()(true);
+  EXPECT_FALSE(replacedCalled);
+
+  // Same for a write loop, the late completion frees the anchor
+  std::vector<std::function<void()>> writeCompletions;
+  auto writeInterface = [&](const char *, const uint32_t &len, const WriteResultHandler &resHandler)
+  {
+    writeCompletions.push_back([len, resHandler]()
+                               { resHandler(len); });
+  };
+  {
+    AsyncIOWriteBuffer<uint32_t> destroyed(8, writeInterface);
+    destroyed.write("Bye", 3, [&](const uint32_t &)
+                    { replacedCalled = true; });
+  }
+  ASSERT_EQ(writeCompletions.size(), 1);
+  writeCompletions[0]();
+  EXPECT_FALSE(replacedCalled);
+}
+
 int main(int argc, char **argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BinaryLog.hpp"
+
+// A logger writing into 'sink', decode() reads the records back from it
+struct LogStream
+{
+  LogStream(const uint32_t &size = 64) : buffer(size, [this](const char *out, const uint32_t &len)
+                                                {
+                                                  sink.append(out, len);
+                                                  return len;
+                                                }),
+                                         logger(buffer)
+  {
+  }
+
+  std::vector<std::string> decode(const uint32_t &readSize = 32)
+  {
+    buffer.flush();
+    uint64_t offset = 0;
+    auto ioInterface = [&](char *out, const uint32_t &len)
+    {
+      uint32_t toRead = std::min<uint64_t>(len, sink.length() - offset);
+      memcpy(out, sink.c_str() + offset, toRead);
+      offset += toRead;
+      return toRead;
+    };
+
+    std::vector<std::string> ret;
+    SyncIOReadBuffer<uint32_t> readBuffer(readSize);
+    BinaryLogDecoder<uint32_t> decoder;
+    while (auto line = decoder.next(readBuffer, ioInterface))
+    {
+      ret.push_back(*line);
+    }
+    return ret;
+  }
+
+  std::string sink;
+  SyncIOLazyWriteBuffer<uint32_t> buffer;
+  BinaryLogger<uint32_t> logger;
+};
+
+TEST(BinaryLogTest, DecodesLikePrintf)
+{
+  static const LogFormat<int, unsigned, int64_t, uint64_t, double, float, const char *> all(
+      "%d %u %ld %lu %.3f %g %s");
+  static const LogFormat<int16_t, uint8_t, char, std::string> specs(
+      "[%5d|%-4u|%c|%10s] 100%%");
+  static const LogFormat<> plain("no arguments");
+  static const LogFormat<double, int, std::string_view> mismatched("%d %f %x %s");
+
+  LogStream stream;
+  ASSERT_TRUE(stream.logger.log(all, -42, 42u, INT64_MIN, UINT64_MAX, 3.14159, 2.5f, "text"));
+  ASSERT_TRUE(stream.logger.log(specs, -7, 200, 'z', std::string("right")));
+  ASSERT_TRUE(stream.logger.log(plain));
+  ASSERT_TRUE(stream.logger.log(all, 0, 0u, 0, 0, 0.0, 0.0f, ""));
+  ASSERT_TRUE(stream.logger.log(mismatched, 7.9, 255, "sv"));
+
+  char expected[4][256];
+  snprintf(expected[0], 256, "%d %u %lld %llu %.3f %g %s", -42, 42u, (long long)INT64_MIN, (unsigned long long)UINT64_MAX, 3.14159, 2.5, "text");
+  snprintf(expected[1], 256, "[%5d|%-4u|%c|%10s] 100%%", -7, 200u, 'z', "right");
+  snprintf(expected[2], 256, "no arguments");
+  snprintf(expected[3], 256, "%d %u %d %u %.3f %g %s", 0, 0u, 0, 0u, 0.0, 0.0, "");
+
+  auto lines = stream.decode();
+  ASSERT_EQ(lines.size(), 5);
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    EXPECT_EQ(lines[i], expected[i]);
+  }
+  // The recorded type wins over the conversion, a specification without an
+  // argument is left as is
+  EXPECT_EQ(lines[4], "7 255.000000 sv %s");
+}
+
+TEST(BinaryLogTest, DefinitionsAreWrittenOncePerStream)
+{
+  static const LogFormat<uint32_t> format("value %u");
+  LogStream first;
+  first.logger.log(format, 1);
+  size_t withDefinition = first.sink.length() + first.buffer.position() - first.buffer.flushedPosition();
+  first.logger.log(format, 2);
+  size_t record = first.sink.length() + first.buffer.position() - first.buffer.flushedPosition() - withDefinition;
+  // Just the id and the argument
+  EXPECT_EQ(record, 8);
+  EXPECT_GT(withDefinition, record + strlen("value %u"));
+
+  // Another stream gets its own definition
+  LogStream second;
+  second.logger.log(format, 3);
+  EXPECT_EQ(first.decode(), (std::vector<std::string>{"value 1", "value 2"}));
+  EXPECT_EQ(second.decode(), (std::vector<std::string>{"value 3"}));
+}
+
+TEST(BinaryLogTest, LongStringsAndTinyBuffers)
+{
+  static const LogFormat<std::string, uint64_t> format("%s=%lu");
+  // Room for the longest record, the read buffers are the tiny ones
+  LogStream stream(1024);
+  std::vector<std::string> expected;
+  for (uint64_t i = 0; i < 50; ++i)
+  {
+    std::string key(i * 37 % 1000, 'a' + i % 26);
+    ASSERT_TRUE(stream.logger.log(format, key, i));
+    expected.push_back(key + "=" + std::to_string(i));
+  }
+
+  EXPECT_EQ(stream.decode(1), expected);
+  EXPECT_EQ(stream.decode(4096), expected);
+
+  // Never written, it doesn't fit in the buffer
+  EXPECT_FALSE(stream.logger.log(format, std::string(1024, 'x'), 0));
+  EXPECT_EQ(stream.decode(), expected);
+}
+
+TEST(BinaryLogTest, LoggerPerThread)
+{
+  static const LogFormat<uint32_t, uint32_t> format("thread %u line %u");
+  std::vector<LogStream> streams(4);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < streams.size(); ++t)
+  {
+    threads.emplace_back([&, t]()
+                         {
+                           for (uint32_t i = 0; i < 1000; ++i)
+                           {
+                             streams[t].logger.log(format, t, i);
+                           } });
+  }
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  for (uint32_t t = 0; t < streams.size(); ++t)
+  {
+    auto lines = streams[t].decode();
+    ASSERT_EQ(lines.size(), 1000);
+    EXPECT_EQ(lines[999], "thread " + std::to_string(t) + " line 999");
+  }
+}
+
+TEST(BinaryLogTest, TruncatedStreamThrows)
+{
+  static const LogFormat<uint64_t> format("%lu");
+  LogStream stream;
+  stream.logger.log(format, 1);
+  stream.buffer.flush();
+  stream.sink.pop_back();
+  EXPECT_THROW(stream.decode(), std::runtime_error);
+
+  // Records without their definition
+  LogStream other;
+  other.logger.log(format, 1);
+  other.logger.log(format, 2);
+  other.buffer.flush();
+  other.sink = other.sink.substr(other.sink.length() - 12);
+  EXPECT_THROW(other.decode(), std::runtime_error);
+}
+
+// The sink takes nothing the first time, when room is made for the first
+// definition of 'format'
+TEST(BinaryLogTest, NoRecordWithoutItsDefinition)
+{
+  static const LogFormat<uint64_t> filler("%lu");
+  static const LogFormat<uint32_t> format("a format for the rest %u");
+  std::string sink;
+  uint32_t calls = 0;
+  SyncIOLazyWriteBuffer<uint32_t> buffer(64, [&](const char *out, const uint32_t &len)
+                                         {
+                                           if (!calls++)
+                                           {
+                                             return 0u;
+                                           }
+                                           sink.append(out, len);
+                                           return len; });
+  BinaryLogger<uint32_t> logger(buffer);
+  for (uint64_t i = 0; i < 3; ++i)
+  {
+    ASSERT_TRUE(logger.log(filler, i));
+  }
+  uint64_t position = buffer.position();
+  EXPECT_FALSE(logger.log(format, 1));
+  EXPECT_EQ(calls, 1u);
+  EXPECT_EQ(buffer.position(), position);
+  EXPECT_TRUE(logger.log(format, 2));
+  EXPECT_TRUE(logger.log(format, 3));
+  buffer.flush();
+
+  LogStream stream;
+  stream.sink = sink;
+  EXPECT_EQ(stream.decode(), (std::vector<std::string>{"0", "1", "2",
+                                                       "a format for the rest 2",
+                                                       "a format for the rest 3"}));
+}
+
+// The sink takes nothing every 5th call, records longer than the chunks of
+// a Record included, the records that were written decode in order
+TEST(BinaryLogTest, NoRecordCutBySinkFailures)
+{
+  static const LogFormat<std::string, uint32_t> format("%s %u");
+  std::string sink;
+  uint32_t calls = 0;
+  SyncIOLazyWriteBuffer<uint32_t> buffer(512, [&](const char *out, const uint32_t &len)
+                                         {
+                                           if (++calls % 5 == 0)
+                                           {
+                                             return 0u;
+                                           }
+                                           sink.append(out, len);
+                                           return len; });
+  BinaryLogger<uint32_t> logger(buffer);
+  std::vector<std::string> expected;
+  uint32_t failed = 0;
+  for (uint32_t i = 0; i < 200; ++i)
+  {
+    std::string text(i * 53 % 400, 'a' + i % 26);
+    if (logger.log(format, text, i))
+    {
+      expected.push_back(text + " " + std::to_string(i));
+    }
+    else
+    {
+      ++failed;
+    }
+  }
+  while (buffer.flushedPosition() != buffer.position())
+  {
+    buffer.flush();
+  }
+  EXPECT_GT(failed, 0u);
+
+  LogStream stream;
+  stream.sink = sink;
+  EXPECT_EQ(stream.decode(), expected);
+}
+
+TEST(BinaryLogTest, DefinitionIdOutOfRangeThrows)
+{
+  LogStream stream;
+  for (uint32_t id : {0u, BinaryLogDecoder<uint32_t>::MAX_FORMAT_ID + 1})
+  {
+    stream.sink.clear();
+    uint32_t definition[] = {0, id};
+    stream.sink.append(reinterpret_cast<const char *>(definition), sizeof(definition));
+    stream.sink.append(std::string(6, '\0'));
+    EXPECT_THROW(stream.decode(), std::runtime_error);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
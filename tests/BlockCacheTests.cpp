@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <stdio.h>
+#include "BlockCache.hpp"
+
+class BlockCacheTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    path = "/tmp/BlockCacheTest_" + std::to_string(getpid()) + ".txt";
+    std::mt19937 rng(1);
+    for (uint32_t i = 0; i < 2000; ++i)
+    {
+      content += "record " + std::to_string(i) + " " + std::string(rng() % 40, 'a' + i % 26) + "\n";
+    }
+
+    FILE *file = fopen(path.c_str(), "w");
+    fwrite(content.c_str(), 1, content.length(), file);
+    fclose(file);
+  }
+
+  void TearDown() override
+  {
+    unlink(path.c_str());
+  }
+
+  std::string path;
+  std::string content;
+};
+
+TEST_F(BlockCacheTest, ReadAtAcrossBlocksAndAtEndOfFile)
+{
+  SharedBlockCache cache(64, 64 * 64, 4);
+  RandomAccessReader reader(cache, path.c_str());
+  std::mt19937 rng(2);
+  std::vector<char> out(1000);
+
+  for (uint32_t i = 0; i < 500; ++i)
+  {
+    uint64_t offset = rng() % content.length();
+    uint64_t len = rng() % out.size();
+    uint64_t expectedLen = std::min<uint64_t>(len, content.length() - offset);
+    ASSERT_EQ(reader.readAt(out.data(), offset, len), expectedLen);
+    EXPECT_EQ(std::string(out.data(), expectedLen), content.substr(offset, expectedLen));
+  }
+
+  EXPECT_EQ(reader.readAt(out.data(), content.length(), 10), 0);
+  EXPECT_GT(cache.hits(), 0);
+  EXPECT_GT(cache.misses(), 0);
+}
+
+TEST_F(BlockCacheTest, ReadUntilAtFindsRecordsSpanningBlocks)
+{
+  SharedBlockCache cache(16, 16 * 8, 2);
+  RandomAccessReader reader(cache, path.c_str());
+  char out[128];
+
+  uint64_t offset = 0;
+  for (uint32_t i = 0; i < 2000; ++i)
+  {
+    uint64_t end = content.find('\n', offset) + 1;
+    ASSERT_EQ(reader.readUntilAt(out, offset, '\n', sizeof(out)), end - offset);
+    EXPECT_EQ(std::string(out, end - offset), content.substr(offset, end - offset));
+    offset = end;
+  }
+
+  // maxLen caps the read
+  EXPECT_EQ(reader.readUntilAt(out, 0, '\n', 3), 3);
+  // No ender till the end of file
+  EXPECT_EQ(reader.readUntilAt(out, content.length() - 1, 'z', sizeof(out)), 1);
+}
+
+TEST_F(BlockCacheTest, SequentialAccessTriggersReadahead)
+{
+  SharedBlockCache cache(256, 256 * 64, 4);
+  RandomAccessReader reader(cache, path.c_str(), 8);
+  char out[64];
+
+  for (uint64_t offset = 0; offset < content.length(); offset += sizeof(out))
+  {
+    reader.readAt(out, offset, sizeof(out));
+  }
+
+  uint64_t blocks = (content.length() + 255) / 256;
+  EXPECT_GT(cache.prefetches(), 0);
+  // Only the first blocks, before the run is detected, are demand misses,
+  // the read past the end of file hits the last, short, block
+  ASSERT_NE(content.length() % sizeof(out), 0);
+  EXPECT_LE(cache.misses(), 3);
+  EXPECT_EQ(cache.misses() + cache.prefetches(), blocks);
+}
+
+TEST_F(BlockCacheTest, ReadersOfTheSameFileShareBlocks)
+{
+  SharedBlockCache cache(64, 64 * 64, 4);
+  std::vector<char> out(content.length());
+  {
+    RandomAccessReader reader(cache, path.c_str(), 0);
+    ASSERT_EQ(reader.readAt(out.data(), 0, 1000), 1000);
+  }
+  uint64_t misses = cache.misses();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  RandomAccessReader other(cache, fd, 0);
+  ASSERT_EQ(other.readAt(out.data(), 0, 1000), 1000);
+  EXPECT_EQ(std::string(out.data(), 1000), content.substr(0, 1000));
+  EXPECT_EQ(cache.misses(), misses);
+
+  // Another file, at the same offsets, is not mistaken for this one
+  std::string otherPath = path + ".other";
+  FILE *file = fopen(otherPath.c_str(), "w");
+  fwrite(std::string(1000, 'x').c_str(), 1, 1000, file);
+  fclose(file);
+  RandomAccessReader third(cache, otherPath.c_str(), 0);
+  ASSERT_EQ(third.readAt(out.data(), 0, 1000), 1000);
+  EXPECT_EQ(std::string(out.data(), 1000), std::string(1000, 'x'));
+  EXPECT_GT(cache.misses(), misses);
+  unlink(otherPath.c_str());
+  close(fd);
+}
+
+// The last block is cut short by the end of file, the bytes appended later
+// are read rather than the cached end of file
+TEST_F(BlockCacheTest, ShortBlockIsReloadedWhenTheFileGrows)
+{
+  SharedBlockCache cache(4096, 4096 * 16, 4);
+  RandomAccessReader reader(cache, path.c_str(), 0);
+  std::vector<char> out(content.length() + 100);
+  uint64_t tail = content.length() - 10;
+  ASSERT_EQ(reader.readAt(out.data(), tail, 100), 10);
+
+  FILE *file = fopen(path.c_str(), "a");
+  fwrite("appended\n", 1, 9, file);
+  fclose(file);
+  ASSERT_EQ(reader.readAt(out.data(), tail, 100), 19);
+  EXPECT_EQ(std::string(out.data(), 19), content.substr(tail) + "appended\n");
+}
+
+// Reads past the end of file hit the short last block, until the file grows
+TEST_F(BlockCacheTest, ShortBlockIsAHitUntilTheFileGrows)
+{
+  SharedBlockCache cache(4096, 4096 * 16, 4);
+  RandomAccessReader reader(cache, path.c_str(), 0);
+  std::vector<char> out(100);
+  uint64_t tail = content.length() - 10;
+  ASSERT_EQ(reader.readAt(out.data(), tail, 100), 10);
+  uint64_t misses = cache.misses();
+  for (uint32_t i = 0; i < 10; ++i)
+  {
+    ASSERT_EQ(reader.readAt(out.data(), tail, 100), 10);
+    ASSERT_EQ(reader.readUntilAt(out.data(), tail, '\0', 100), 10);
+  }
+  EXPECT_EQ(cache.misses(), misses);
+
+  FILE *file = fopen(path.c_str(), "a");
+  fwrite("appended\n", 1, 9, file);
+  fclose(file);
+  ASSERT_EQ(reader.readAt(out.data(), tail, 100), 19);
+  EXPECT_EQ(cache.misses(), misses + 1);
+}
+
+// The file is rewritten in place, so its device and inode stay, the cached
+// blocks are stale until it's forgotten
+TEST_F(BlockCacheTest, ForgottenFileIsReadAgain)
+{
+  SharedBlockCache cache(64, 64 * 64, 4);
+  std::vector<char> out(100);
+  uint64_t fileId;
+  {
+    RandomAccessReader reader(cache, path.c_str(), 0);
+    fileId = reader.fileId();
+    ASSERT_EQ(reader.readAt(out.data(), 0, 100), 100);
+  }
+
+  std::string rewritten(content.length(), 'z');
+  FILE *file = fopen(path.c_str(), "r+");
+  fwrite(rewritten.c_str(), 1, rewritten.length(), file);
+  fclose(file);
+  {
+    RandomAccessReader reader(cache, path.c_str(), 0);
+    EXPECT_EQ(reader.fileId(), fileId);
+    ASSERT_EQ(reader.readAt(out.data(), 0, 100), 100);
+    EXPECT_EQ(std::string(out.data(), 100), content.substr(0, 100));
+  }
+
+  cache.forgetFile(fileId);
+  RandomAccessReader reader(cache, path.c_str(), 0);
+  EXPECT_NE(reader.fileId(), fileId);
+  ASSERT_EQ(reader.readAt(out.data(), 0, 100), 100);
+  EXPECT_EQ(std::string(out.data(), 100), rewritten.substr(0, 100));
+}
+
+TEST_F(BlockCacheTest, FailsWithoutAFile)
+{
+  SharedBlockCache cache(64, 64 * 4, 1);
+  EXPECT_THROW(RandomAccessReader(cache, "/nonexistent/BlockCacheTest"), std::runtime_error);
+  EXPECT_THROW(RandomAccessReader(cache, -1), std::runtime_error);
+}
+
+TEST_F(BlockCacheTest, SharedByReadersOnManyThreads)
+{
+  SharedBlockCache cache(128, 128 * 32, 8);
+  std::vector<std::thread> threads;
+  std::atomic<uint32_t> mismatches(0);
+  for (uint32_t t = 0; t < 4; ++t)
+  {
+    threads.emplace_back(
+        [&, t]()
+        {
+          RandomAccessReader reader(cache, path.c_str());
+          std::mt19937 rng(t);
+          char out[200];
+          for (uint32_t i = 0; i < 2000; ++i)
+          {
+            uint64_t offset = rng() % content.length();
+            uint64_t len = reader.readAt(out, offset, sizeof(out));
+            mismatches += std::string(out, len) != content.substr(offset, len);
+          }
+        });
+  }
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  EXPECT_EQ(mismatches, 0);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
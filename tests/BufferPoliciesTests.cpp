@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SmartBuffer.hpp"
+
+// The defaults are laid out as the buffers were before the policies, an
+// unused policy takes no room
+TEST(BufferPoliciesTest, UnusedPoliciesTakeNoRoom)
+{
+  static_assert(sizeof(SyncIOReadBuffer<uint32_t, HeapStorage, NoStats>) + 3 * sizeof(void *) ==
+                sizeof(SyncIOReadBuffer<uint32_t>));
+  // Every attachment costs its pointer only
+  static_assert(sizeof(SyncIOReadBuffer<uint32_t, HeapStorage, Attachable<true, false, false>>) ==
+                sizeof(SyncIOReadBuffer<uint32_t, HeapStorage, NoStats>) + sizeof(void *));
+  static_assert(sizeof(SyncIOReadBuffer<uint32_t, HeapStorage, Attachable<false, true, true>>) ==
+                sizeof(SyncIOReadBuffer<uint32_t, HeapStorage, NoStats>) + 2 * sizeof(void *));
+  static_assert(sizeof(SyncIOReadBuffer<uint32_t, InlineStorage<64>, NoStats>) ==
+                sizeof(SyncIOReadBuffer<uint32_t, HeapStorage, NoStats>) - sizeof(void *) + 64);
+  if constexpr (sizeof(void *) == 8)
+  {
+    EXPECT_EQ(sizeof(SyncIOReadBuffer<uint32_t>), 72u);
+    EXPECT_EQ(sizeof(SyncIOLazyWriteBuffer<uint32_t>), 120u);
+  }
+}
+
+// Same records out of every combination of policies, for random records
+// pasted in random chunks
+template <class Buffer>
+static std::vector<std::string> readRecords(const uint32_t &seed, const uint32_t &size)
+{
+  std::mt19937 random(seed);
+  std::string input;
+  for (uint32_t i = 0; i < 200; ++i)
+  {
+    input += std::string(random() % (size - 1), 'a' + i % 26) + "\n";
+  }
+
+  uint32_t offset = 0;
+  auto source = [&](char *out, const uint32_t &len)
+  {
+    uint32_t toRead = std::min<uint32_t>({len, static_cast<uint32_t>(input.length()) - offset, 1 + static_cast<uint32_t>(random() % 20)});
+    memcpy(out, input.c_str() + offset, toRead);
+    offset += toRead;
+    return toRead;
+  };
+
+  Buffer buffer(size);
+  std::vector<std::string> records;
+  std::vector<char> record(size);
+  while (uint32_t len = buffer.readUntil(record.data(), source, '\n'))
+  {
+    records.emplace_back(record.data(), len);
+  }
+
+  return records;
+}
+
+TEST(BufferPoliciesTest, SameRecordsWithEveryPolicy)
+{
+  for (uint32_t seed = 0; seed < 10; ++seed)
+  {
+    auto expected = readRecords<SyncIOReadBuffer<uint32_t>>(seed, 64);
+    EXPECT_EQ(expected.size(), 200u);
+    EXPECT_EQ((readRecords<SyncIOReadBuffer<uint32_t, HeapStorage, NoStats>>(seed, 64)), expected);
+    EXPECT_EQ((readRecords<SyncIOReadBuffer<uint32_t, InlineStorage<64>, NoStats>>(seed, 64)), expected);
+    EXPECT_EQ((readRecords<SyncIOReadBuffer<uint32_t, HeapStorage, AttachableStats, MutexLock>>(seed, 64)), expected);
+  }
+}
+
+TEST(BufferPoliciesTest, InlineStorage)
+{
+  EXPECT_THROW((SyncIOReadBuffer<uint32_t, InlineStorage<64>>(65)), std::invalid_argument);
+  EXPECT_THROW((SyncIOLazyWriteBuffer<uint32_t, InlineStorage<64>>(65, [](const char *, const uint32_t &len)
+                                                                     { return len; })),
+               std::invalid_argument);
+
+  std::string written;
+  SyncIOLazyWriteBuffer<uint32_t, InlineStorage<8>> buffer(8, [&](const char *out, const uint32_t &len)
+                                                           {
+                                                             written.append(out, len);
+                                                             return len; },
+                                                           Allocation::LAZY);
+  // Never allocated, never released
+  EXPECT_TRUE(buffer.allocated());
+  buffer.write("0123456789", 10);
+  EXPECT_EQ(written, "01234567");
+
+  // Moving copies the bytes
+  SyncIOLazyWriteBuffer<uint32_t, InlineStorage<8>> moved(std::move(buffer));
+  moved.flush();
+  EXPECT_EQ(written, "0123456789");
+  EXPECT_FALSE(moved.releaseIfIdle());
+  EXPECT_TRUE(moved.allocated());
+}
+
+// Writers on many threads, each record comes out whole
+TEST(BufferPoliciesTest, MutexLockKeepsRecordsWhole)
+{
+  std::string written;
+  {
+    SyncIOLazyWriteBuffer<uint32_t, HeapStorage, MutexLock> buffer(64, [&](const char *out, const uint32_t &len)
+                                                                   {
+                                                                     written.append(out, len);
+                                                                     return len; });
+    std::vector<std::thread> writers;
+    for (char c = 'a'; c < 'e'; ++c)
+    {
+      writers.emplace_back([&buffer, c]()
+                           {
+                             std::string record = std::string(15, c) + "\n";
+                             for (uint32_t i = 0; i < 10000; ++i)
+                             {
+                               buffer.write(record.c_str(), record.length());
+                             } });
+    }
+
+    for (auto &writer : writers)
+    {
+      writer.join();
+    }
+  }
+
+  ASSERT_EQ(written.length(), 4u * 10000 * 16);
+  for (size_t i = 0; i < written.length(); i += 16)
+  {
+    ASSERT_EQ(written.substr(i, 16), std::string(15, written[i]) + "\n") << "at " << i;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include "FdSource.hpp"
+#include "ShmRing.hpp"
+
+static std::string record(const uint32_t &i)
+{
+  return std::to_string(i) + " " + std::string(i % 50, 'b') + "\n";
+}
+
+TEST(BusyPollTest, SpinBudgetAdapts)
+{
+  BusyPollOptions options;
+  options.maxSpins = 1024;
+  options.minSpins = 16;
+  SpinWaiter waiter(options);
+  EXPECT_EQ(waiter.budget(), 1024);
+
+  // Nothing ever shows up, the budget shrinks down to the minimum
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    EXPECT_FALSE(waiter.spin([]()
+                             { return false; }));
+  }
+  EXPECT_EQ(waiter.budget(), 16);
+
+  // Data showing up after 100 polls is caught by the next full length probe,
+  // after which the budget is twice that
+  uint32_t caught = 0;
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    uint32_t polls = 0;
+    caught += waiter.spin([&]()
+                          { return polls++ == 100; });
+  }
+  EXPECT_EQ(waiter.budget(), 200);
+  EXPECT_GT(caught, 80);
+}
+
+TEST(BusyPollTest, FdSourceOverAPipe)
+{
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  const uint32_t numRecords = 2000;
+  std::thread writer(
+      [&]()
+      {
+        for (uint32_t i = 0; i < numRecords; ++i)
+        {
+          auto line = record(i);
+          ASSERT_EQ(::write(fds[1], line.c_str(), line.length()), static_cast<ssize_t>(line.length()));
+          if (i % 100 == 0)
+          {
+            // Long enough for the reader to park
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+          }
+        }
+        ::close(fds[1]);
+      });
+
+  FdSource source(fds[0]);
+  BusyPollOptions options;
+  options.maxSpins = 1000;
+  ASSERT_TRUE(source.setBusyPoll(options));
+  SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+  SyncIOReadBuffer<uint32_t> buffer(64);
+  char line[128];
+  for (uint32_t i = 0; i < numRecords; ++i)
+  {
+    auto len = buffer.readUntil(line, ioInterface, '\n');
+    ASSERT_EQ(std::string(line, len), record(i));
+  }
+
+  EXPECT_EQ(buffer.readUntil(line, ioInterface, '\n'), 0);
+  writer.join();
+  ::close(fds[0]);
+}
+
+TEST(BusyPollTest, ShmRingWithAndWithoutParking)
+{
+  for (bool park : {true, false})
+  {
+    // Roomy, a spinner that never parks only gives up the cpu when preempted
+    int fd = ShmRing::create(1 << 16);
+    ShmRing writerRing(fd), readerRing(fd);
+    ::close(fd);
+    BusyPollOptions options;
+    options.park = park;
+    options.maxSpins = 500;
+    readerRing.setBusyPoll(options);
+    writerRing.setBusyPoll(options);
+
+    const uint32_t numRecords = 2000;
+    std::thread writer(
+        [&]()
+        {
+          for (uint32_t i = 0; i < numRecords; ++i)
+          {
+            auto line = record(i);
+            for (uint32_t done = 0; done < line.length();)
+            {
+              done += writerRing.write(line.c_str() + done, static_cast<uint32_t>(line.length() - done));
+            }
+            if (i % 500 == 0)
+            {
+              std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+          }
+          writerRing.close();
+        });
+
+    SyncIOReadBuffer<uint32_t>::IOInterface ioInterface =
+        [&readerRing](char *out, const uint32_t &len)
+    {
+      return readerRing.read(out, len);
+    };
+    SyncIOReadBuffer<uint32_t> buffer(32);
+    char line[128];
+    for (uint32_t i = 0; i < numRecords; ++i)
+    {
+      auto len = buffer.readUntil(line, ioInterface, '\n');
+      ASSERT_EQ(std::string(line, len), record(i));
+    }
+
+    EXPECT_EQ(buffer.readUntil(line, ioInterface, '\n'), 0);
+    writer.join();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <cstring>
+#include "CFileAdapter.hpp"
+
+class CFileAdapterTest : public ::testing::Test
+{
+protected:
+  std::string mockInput;
+  std::string mockOutput;
+  size_t readPos = 0;
+  uint32_t ioCalls = 0;
+
+  uint32_t mockReader(char *out, uint32_t len)
+  {
+    uint32_t toCopy = std::min(len, static_cast<uint32_t>(mockInput.length() - readPos));
+    std::memcpy(out, mockInput.c_str() + readPos, toCopy);
+    readPos += toCopy;
+    ++ioCalls;
+    return toCopy;
+  }
+
+  uint32_t mockWriter(const char *buf, uint32_t len)
+  {
+    mockOutput.append(buf, len);
+    ++ioCalls;
+    return len;
+  }
+};
+
+TEST_F(CFileAdapterTest, FprintfGoesThroughTheBuffer)
+{
+  SyncIOLazyWriteBuffer<uint32_t> buffer(64, [this](const char *buf, uint32_t len)
+                                         { return mockWriter(buf, len); });
+  FILE *file = CFileAdapter<uint32_t>::open(buffer);
+  ASSERT_NE(file, nullptr);
+
+  fprintf(file, "%d-%s\n", 42, "answer");
+  fputs("tail", file);
+  EXPECT_EQ(mockOutput, "");
+
+  buffer.flush();
+  EXPECT_EQ(mockOutput, "42-answer\ntail");
+
+  fprintf(file, "!");
+  fclose(file);
+  EXPECT_EQ(mockOutput, "42-answer\ntail!");
+}
+
+TEST_F(CFileAdapterTest, OwnedWriterFlushesOnClose)
+{
+  FILE *file = CFileAdapter<uint32_t>::openWriter(8, [this](const char *buf, uint32_t len)
+                                                  { return mockWriter(buf, len); });
+  ASSERT_NE(file, nullptr);
+
+  for (int i = 0; i < 10; ++i)
+  {
+    fprintf(file, "%d,", i);
+  }
+  fclose(file);
+
+  EXPECT_EQ(mockOutput, "0,1,2,3,4,5,6,7,8,9,");
+  // 20 bytes through an 8 byte buffer
+  EXPECT_EQ(ioCalls, 3);
+}
+
+TEST_F(CFileAdapterTest, FgetsGoesThroughTheBuffer)
+{
+  mockInput = "first line\nsecond\nlast";
+  FILE *file = CFileAdapter<uint32_t>::openReader(1024, [this](char *out, uint32_t len)
+                                                  { return mockReader(out, len); });
+  ASSERT_NE(file, nullptr);
+
+  char line[32];
+  ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+  EXPECT_STREQ(line, "first line\n");
+  ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+  EXPECT_STREQ(line, "second\n");
+  ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+  EXPECT_STREQ(line, "last");
+  EXPECT_EQ(fgets(line, sizeof(line), file), nullptr);
+  EXPECT_TRUE(feof(file));
+  fclose(file);
+
+  // One call filled the buffer, one more found the end of stream
+  EXPECT_EQ(ioCalls, 2);
+}
+
+TEST_F(CFileAdapterTest, FreadThroughBorrowedReader)
+{
+  mockInput = "HelloWorld";
+  SyncIOReadBuffer<uint32_t> buffer(3);
+  FILE *file = CFileAdapter<uint32_t>::open(buffer, [this](char *out, uint32_t len)
+                                            { return mockReader(out, len); });
+  ASSERT_NE(file, nullptr);
+
+  char out[16];
+  EXPECT_EQ(fread(out, 1, sizeof(out), file), mockInput.length());
+  EXPECT_EQ(std::string(out, mockInput.length()), mockInput);
+  fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
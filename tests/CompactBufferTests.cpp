@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "CompactBuffer.hpp"
+
+// Random writes through random short writes, the output of a
+// CompactLazyWriteBuffer is the same as a SyncIOLazyWriteBuffer's
+template <class SizeType>
+static void fuzz(const uint32_t &seed)
+{
+  std::mt19937 random(seed);
+  std::string compactOut, syncOut;
+  typename CompactLazyWriteBuffer<SizeType>::IOInterface sink = [&](const char *out, const SizeType &len)
+  {
+    SizeType toWrite = std::min<SizeType>(len, 1 + random() % 50);
+    compactOut.append(out, toWrite);
+    return toWrite;
+  };
+
+  SizeType size = 1 + random() % 100;
+  std::string input;
+  {
+    CompactLazyWriteBuffer<SizeType> compact(size, sink, Allocation::LAZY);
+    SyncIOLazyWriteBuffer<SizeType> sync(size, [&](const char *out, const SizeType &len)
+                                         {
+                                           syncOut.append(out, len);
+                                           return len;
+                                         });
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+      std::string chunk(random() % 300, 'a' + i % 26);
+      input += chunk;
+      EXPECT_EQ(compact.write(chunk.c_str(), chunk.length()), chunk.length());
+      sync.write(chunk.c_str(), chunk.length());
+      EXPECT_LE(compact.size(), compact.capacity());
+      if (random() % 10 == 0)
+      {
+        compact.flush();
+        EXPECT_TRUE(compact.empty());
+        compact.releaseIfIdle();
+      }
+    }
+  }
+
+  EXPECT_EQ(compactOut, input) << "seed " << seed;
+  EXPECT_EQ(syncOut, input) << "seed " << seed;
+}
+
+TEST(CompactBufferTest, SameOutputAsSyncIOLazyWriteBuffer)
+{
+  for (uint32_t seed = 0; seed < 20; ++seed)
+  {
+    fuzz<uint16_t>(seed);
+    fuzz<uint32_t>(seed);
+  }
+}
+
+TEST(CompactBufferTest, FullBitTellsFullFromEmpty)
+{
+  std::string out;
+  CompactLazyWriteBuffer<uint16_t>::IOInterface sink = [&](const char *buf, const uint16_t &len)
+  {
+    out.append(buf, len);
+    return len;
+  };
+
+  CompactLazyWriteBuffer<uint16_t> buffer(4, sink);
+  buffer.write("abcd", 4);
+  EXPECT_EQ(buffer.size(), 4);
+  EXPECT_EQ(buffer.capacity(), 4);
+  EXPECT_EQ(out, "");
+  EXPECT_EQ(buffer.flush(2), 4);
+  EXPECT_TRUE(buffer.empty());
+
+  // Full again after wrapping around
+  buffer.write("ef", 2);
+  buffer.flush();
+  buffer.write("ghi", 3);
+  buffer.write("j", 1);
+  EXPECT_EQ(buffer.size(), 4);
+  buffer.write("k", 1);
+  EXPECT_EQ(out, "abcdefghij");
+  EXPECT_EQ(buffer.size(), 1);
+
+  // The top bit is the full bit
+  EXPECT_THROW(CompactLazyWriteBuffer<uint16_t>(0, sink), std::invalid_argument);
+  EXPECT_THROW(CompactLazyWriteBuffer<uint16_t>(32768, sink), std::invalid_argument);
+  CompactLazyWriteBuffer<uint16_t> largest(32767, sink, Allocation::LAZY);
+  EXPECT_EQ(largest.capacity(), 32767);
+}
+
+TEST(CompactBufferTest, ManyBuffersShareASink)
+{
+  std::vector<std::string> keys(1000);
+  uint32_t key = 0;
+  CompactLazyWriteBuffer<uint16_t>::IOInterface sink = [&](const char *out, const uint16_t &len)
+  {
+    keys[key].append(out, len);
+    return len;
+  };
+
+  std::vector<CompactLazyWriteBuffer<uint16_t>> buffers;
+  for (uint32_t i = 0; i < keys.size(); ++i)
+  {
+    buffers.emplace_back(8, sink, Allocation::LAZY);
+  }
+  EXPECT_FALSE(buffers[0].allocated());
+
+  for (uint32_t round = 0; round < 5; ++round)
+  {
+    for (key = 0; key < keys.size(); ++key)
+    {
+      std::string record = std::to_string(key) + ";";
+      buffers[key].write(record.c_str(), record.length());
+    }
+  }
+
+  for (key = 0; key < keys.size(); ++key)
+  {
+    buffers[key].flush();
+    std::string record = std::to_string(key) + ";";
+    EXPECT_EQ(keys[key], record + record + record + record + record);
+    EXPECT_TRUE(buffers[key].releaseIfIdle());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
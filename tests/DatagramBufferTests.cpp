@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "DatagramBuffer.hpp"
+
+static std::string message(const uint32_t &i)
+{
+  // Empty messages included
+  return std::string(i % 200, 'a' + i % 26);
+}
+
+TEST(DatagramBufferTest, BoundariesSurviveBatching)
+{
+  // Reliable and message preserving, the writer blocks instead of dropping
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0);
+  const uint32_t numMessages = 5000;
+
+  std::thread writer(
+      [&]()
+      {
+        DatagramWriteBuffer<uint32_t> buffer(1000, 16, sendmmsgInterface(fds[1]));
+        for (uint32_t i = 0; i < numMessages; ++i)
+        {
+          auto msg = message(i);
+          ASSERT_TRUE(buffer.write(msg.c_str(), msg.length()));
+        }
+        buffer.flush();
+        EXPECT_EQ(buffer.pending(), 0);
+      });
+
+  DatagramReadBuffer<uint32_t> buffer(256, 32);
+  char out[256];
+  for (uint32_t i = 0; i < numMessages; ++i)
+  {
+    auto len = buffer.read(out, recvmmsgInterface(fds[0]));
+    ASSERT_TRUE(len);
+    ASSERT_EQ(std::string(out, *len), message(i));
+  }
+
+  writer.join();
+  EXPECT_EQ(buffer.pending(), 0);
+  EXPECT_EQ(buffer.truncated(), 0);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(DatagramBufferTest, ReceivesAWholeBatchPerCall)
+{
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0);
+  for (uint32_t i = 0; i < 10; ++i)
+  {
+    auto msg = message(i);
+    ASSERT_EQ(send(fds[1], msg.c_str(), msg.length(), 0), static_cast<ssize_t>(msg.length()));
+  }
+  // Longer than the largest datagram expected
+  std::string big(100, 'B');
+  send(fds[1], big.c_str(), big.length(), 0);
+
+  uint32_t calls = 0;
+  DatagramIOInterface ioInterface = [&](mmsghdr *msgs, const unsigned &len)
+  {
+    ++calls;
+    return recvmmsg(fds[0], msgs, len, MSG_DONTWAIT, nullptr);
+  };
+
+  DatagramReadBuffer<uint16_t> buffer(64, 8);
+  for (uint32_t i = 0; i < 10; ++i)
+  {
+    auto datagram = buffer.next(ioInterface);
+    ASSERT_TRUE(datagram);
+    EXPECT_EQ(*datagram, message(i));
+  }
+  EXPECT_EQ(calls, 2);
+
+  auto datagram = buffer.next(ioInterface);
+  ASSERT_TRUE(datagram);
+  EXPECT_EQ(*datagram, big.substr(0, 64));
+  EXPECT_EQ(buffer.truncated(), 1);
+
+  // Nothing more to receive
+  EXPECT_FALSE(buffer.next(ioInterface));
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(DatagramBufferTest, FailedSendKeepsMessagesQueued)
+{
+  uint32_t accepting = 3;
+  std::vector<std::string> sent;
+  DatagramIOInterface ioInterface = [&](mmsghdr *msgs, const unsigned &len)
+  {
+    unsigned ret = std::min(len, accepting);
+    for (unsigned i = 0; i < ret; ++i)
+    {
+      sent.emplace_back(static_cast<char *>(msgs[i].msg_hdr.msg_iov->iov_base), msgs[i].msg_hdr.msg_iov->iov_len);
+    }
+    accepting -= ret;
+    return static_cast<int>(ret);
+  };
+
+  DatagramWriteBuffer<uint32_t> buffer(100, 4, ioInterface);
+  EXPECT_TRUE(buffer.write("one", 3));
+  EXPECT_TRUE(buffer.write("two", 3));
+  EXPECT_TRUE(buffer.write("three", 5));
+  // Batch full, only 3 of them go out
+  EXPECT_TRUE(buffer.write("four", 4));
+  EXPECT_EQ(buffer.pending(), 1);
+  EXPECT_FALSE(buffer.write(std::string(101, 'x').c_str(), 101));
+
+  accepting = 10;
+  EXPECT_EQ(buffer.flush(), 1);
+  EXPECT_EQ(sent, (std::vector<std::string>{"one", "two", "three", "four"}));
+}
+
+TEST(DatagramBufferTest, UdpLoopback)
+{
+  int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(bind(receiver, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+  socklen_t addrLen = sizeof(addr);
+  getsockname(receiver, reinterpret_cast<sockaddr *>(&addr), &addrLen);
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_EQ(connect(sender, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+
+  {
+    // Few enough to fit in the socket buffer, nothing gets dropped
+    DatagramWriteBuffer<uint32_t> buffer(1 << 16, 64, sendmmsgInterface(sender));
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+      auto msg = message(i);
+      ASSERT_TRUE(buffer.write(msg.c_str(), msg.length()));
+    }
+  }
+
+  DatagramReadBuffer<uint32_t> buffer(1500);
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    auto datagram = buffer.next(recvmmsgInterface(receiver));
+    ASSERT_TRUE(datagram);
+    EXPECT_EQ(*datagram, message(i));
+  }
+
+  ::close(sender);
+  ::close(receiver);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
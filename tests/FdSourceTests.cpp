@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "FdSource.hpp"
+
+class FdSourceTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    path = "/tmp/FdSourceTest_" + std::to_string(getpid()) + ".txt";
+    std::mt19937 rng(3);
+    content.resize(8 << 20);
+    for (auto &ch : content)
+    {
+      ch = (rng() % 64) ? 'a' + rng() % 26 : '\n';
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_EQ(::write(fd, content.c_str(), content.length()), static_cast<ssize_t>(content.length()));
+    // Start cold, dirty pages can't be dropped from the page cache
+    fsync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+
+  void TearDown() override
+  {
+    unlink(path.c_str());
+  }
+
+  // No. of pages of the file in the page cache
+  uint64_t residentPages()
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    void *addr = mmap(nullptr, content.length(), PROT_READ, MAP_SHARED, fd, 0);
+    uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> residency((content.length() + pageSize - 1) / pageSize);
+    mincore(addr, content.length(), residency.data());
+    munmap(addr, content.length());
+    ::close(fd);
+
+    uint64_t ret = 0;
+    for (auto page : residency)
+    {
+      ret += page & 1;
+    }
+    return ret;
+  }
+
+  void append(const std::string &data)
+  {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    ASSERT_EQ(::write(fd, data.c_str(), data.length()), static_cast<ssize_t>(data.length()));
+    ::close(fd);
+  }
+
+  std::string readAll(FdSource &source)
+  {
+    SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+    SyncIOReadBuffer<uint32_t> buffer(64 << 10);
+    std::string ret;
+    char line[1 << 12];
+    while (auto len = buffer.readUntil(line, ioInterface, '\n'))
+    {
+      ret.append(line, len);
+    }
+    return ret;
+  }
+
+  std::string path;
+  std::string content;
+};
+
+TEST_F(FdSourceTest, SequentialHintsKeepContentIntact)
+{
+  FdSource source(path.c_str());
+  AccessHints hints;
+  hints.sequential = true;
+  hints.readaheadWindow = 1 << 20;
+  source.setAccessHints(hints);
+  EXPECT_EQ(readAll(source), content);
+  EXPECT_EQ(source.offset(), content.length());
+}
+
+TEST_F(FdSourceTest, DropBehindReleasesReadPages)
+{
+  FdSource source(path.c_str());
+  AccessHints hints;
+  hints.dropBehind = true;
+  hints.dropChunk = 256 << 10;
+  source.setAccessHints(hints);
+  EXPECT_EQ(readAll(source), content);
+
+  // What is left is the last chunk plus the kernel's own readahead, a small
+  // fraction of the file
+  uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  EXPECT_LT(residentPages(), content.length() / pageSize / 8);
+}
+
+TEST_F(FdSourceTest, NoHintsLeaveReadPagesCached)
+{
+  FdSource source(path.c_str());
+  EXPECT_EQ(readAll(source), content);
+
+  uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  EXPECT_GT(residentPages(), content.length() / pageSize / 2);
+}
+
+// Nothing to watch at the path, follow keeps failing until there is
+TEST_F(FdSourceTest, FollowFailsUntilTheFileCanBeWatched)
+{
+  FdSource source(path.c_str());
+  unlink(path.c_str());
+  EXPECT_FALSE(source.follow());
+  EXPECT_FALSE(source.follow());
+
+  append("line\n");
+  EXPECT_TRUE(source.follow());
+  EXPECT_TRUE(source.follow());
+}
+
+TEST_F(FdSourceTest, FollowWaitsForCompletedLines)
+{
+  ASSERT_EQ(truncate(path.c_str(), 0), 0);
+  FdSource source(path.c_str());
+  ASSERT_TRUE(source.follow());
+  SyncIOReadBuffer<uint32_t> buffer(8);
+  char line[64];
+
+  std::thread writer(
+      [&]()
+      {
+        for (uint32_t i = 0; i < 20; ++i)
+        {
+          // Lines longer than the buffer, written in pieces
+          append("line " + std::to_string(i));
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          append(" is complete\n");
+        }
+        append("trailing");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        source.stop();
+      });
+
+  for (uint32_t i = 0; i < 20; ++i)
+  {
+    auto len = source.followUntil(buffer, line, '\n');
+    EXPECT_EQ(std::string(line, len), "line " + std::to_string(i) + " is complete\n");
+  }
+
+  // The partial line is handed over only once following is stopped
+  auto len = source.followUntil(buffer, line, '\n');
+  EXPECT_EQ(std::string(line, len), "trailing");
+  EXPECT_EQ(source.followUntil(buffer, line, '\n'), 0);
+  writer.join();
+}
+
+TEST_F(FdSourceTest, FollowSurvivesTruncationAndRotation)
+{
+  ASSERT_EQ(truncate(path.c_str(), 0), 0);
+  append("first\nsecond\n");
+  FdSource source(path.c_str());
+  ASSERT_TRUE(source.follow());
+  SyncIOReadBuffer<uint32_t> buffer(64);
+  char line[64];
+
+  EXPECT_EQ(std::string(line, source.followUntil(buffer, line, '\n')), "first\n");
+  EXPECT_EQ(std::string(line, source.followUntil(buffer, line, '\n')), "second\n");
+
+  std::thread writer(
+      [&]()
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        // copytruncate style, the follower has to see the file shrink before
+        // it grows past the read offset again
+        ASSERT_EQ(truncate(path.c_str(), 0), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        append("after truncation\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        // Rename and recreate style
+        ASSERT_EQ(rename(path.c_str(), (path + ".1").c_str()), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        append("after rotation\n");
+      });
+
+  EXPECT_EQ(std::string(line, source.followUntil(buffer, line, '\n')), "after truncation\n");
+  EXPECT_EQ(std::string(line, source.followUntil(buffer, line, '\n')), "after rotation\n");
+  writer.join();
+  unlink((path + ".1").c_str());
+
+  source.stop();
+  EXPECT_EQ(source.followUntil(buffer, line, '\n'), 0);
+}
+
+TEST_F(FdSourceTest, FollowDropsThePartialLineOnTruncation)
+{
+  ASSERT_EQ(truncate(path.c_str(), 0), 0);
+  append("first\npartial");
+  FdSource source(path.c_str());
+  ASSERT_TRUE(source.follow());
+  SyncIOReadBuffer<uint32_t> buffer(64);
+  LineIndex lineIndex(1);
+  buffer.setLineIndex(&lineIndex);
+  char line[64];
+
+  EXPECT_EQ(std::string(line, source.followUntil(buffer, line, '\n')), "first\n");
+  EXPECT_EQ(lineIndex.currentLine(), 1);
+
+  std::thread writer(
+      [&]()
+      {
+        // "partial" is in the buffer by now, waiting for its '\n'
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ASSERT_EQ(truncate(path.c_str(), 0), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        append("new line\n");
+      });
+
+  EXPECT_EQ(std::string(line, source.followUntil(buffer, line, '\n')), "new line\n");
+  EXPECT_EQ(buffer.position(), 9);
+  EXPECT_EQ(lineIndex.currentLine(), 1);
+  writer.join();
+
+  source.stop();
+  EXPECT_EQ(source.followUntil(buffer, line, '\n'), 0);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -3,7 +3,9 @@
 #include <string>
 #include <cstring>
 #include <sstream>
-#include "SmartBuffer.hpp"
+#include <vector>
+#include <random>
+#include "BufferTestAccess.hpp"
 
 // Test fixture for common setup
 class BufferTest : public ::testing::Test
@@ -275,6 +277,504 @@ TEST_F(BufferTest, Write_BufferSizeLessThanWriteSize)
   EXPECT_EQ(smartOutput, "Hello");
 }
 
+// Non-blocking source yielding the given chunks, an empty chunk stands for
+// "would block", the end of the list for the end of stream
+struct ScriptedNonBlockingReader
+{
+  std::vector<std::string> chunks;
+  size_t chunkIdx = 0;
+  size_t chunkPos = 0;
+
+  IOResult<uint32_t> operator()(char *out, const uint32_t &len)
+  {
+    if (chunkIdx == chunks.size())
+    {
+      return {0, IOStatus::END_OF_STREAM};
+    }
+
+    std::string &chunk = chunks[chunkIdx];
+    if (chunk.empty())
+    {
+      ++chunkIdx;
+      return {0, IOStatus::WOULD_BLOCK};
+    }
+
+    uint32_t toCopy = std::min(len, static_cast<uint32_t>(chunk.length() - chunkPos));
+    std::memcpy(out, chunk.c_str() + chunkPos, toCopy);
+    chunkPos += toCopy;
+    if (chunkPos == chunk.length())
+    {
+      ++chunkIdx;
+      chunkPos = 0;
+    }
+    return {toCopy, IOStatus::OK};
+  }
+};
+
+TEST_F(BufferTest, TryReadUntil_KeepsProgressAcrossWouldBlock)
+{
+  ScriptedNonBlockingReader reader{{"He", "", "llo\nWo", "", "", "rld\nEnd"}};
+  SyncIOReadBuffer<uint32_t> buffer(16);
+  char output[32];
+
+  auto ret = buffer.tryReadUntil(output, std::ref(reader), '\n');
+  EXPECT_EQ(ret.status, IOStatus::WOULD_BLOCK);
+
+  ret = buffer.tryReadUntil(output, std::ref(reader), '\n');
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  EXPECT_EQ(std::string(output, ret.bytes), "Hello\n");
+
+  ret = buffer.tryReadUntil(output, std::ref(reader), '\n');
+  EXPECT_EQ(ret.status, IOStatus::WOULD_BLOCK);
+  ret = buffer.tryReadUntil(output, std::ref(reader), '\n');
+  EXPECT_EQ(ret.status, IOStatus::WOULD_BLOCK);
+
+  ret = buffer.tryReadUntil(output, std::ref(reader), [](const char &ch)
+                            { return ch == '\n'; });
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  EXPECT_EQ(std::string(output, ret.bytes), "World\n");
+
+  ret = buffer.tryReadUntil(output, std::ref(reader), '\n');
+  EXPECT_EQ(ret.status, IOStatus::END_OF_STREAM);
+  EXPECT_EQ(std::string(output, ret.bytes), "End");
+}
+
+TEST_F(BufferTest, TryReadUntil_RecordLongerThanBuffer)
+{
+  ScriptedNonBlockingReader reader{{"Hello", "", "World", "", "!rest"}};
+  SyncIOReadBuffer<uint32_t> buffer(3);
+  char output[32];
+
+  auto ret = buffer.tryReadUntil(output, std::ref(reader), '!');
+  EXPECT_EQ(ret.status, IOStatus::WOULD_BLOCK);
+  ret = buffer.tryReadUntil(output, std::ref(reader), '!');
+  EXPECT_EQ(ret.status, IOStatus::WOULD_BLOCK);
+
+  ret = buffer.tryReadUntil(output, std::ref(reader), '!');
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  EXPECT_EQ(std::string(output, ret.bytes), "HelloWorld!");
+}
+
+TEST_F(BufferTest, TryRead_StopsOnWouldBlock)
+{
+  ScriptedNonBlockingReader reader{{"Hello", "", "World"}};
+  SyncIOReadBuffer<uint32_t> buffer(4);
+  char output[16];
+
+  auto ret = buffer.tryRead(output, 10, std::ref(reader));
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  EXPECT_EQ(std::string(output, ret.bytes), "Hello");
+
+  ret = buffer.tryRead(output, 10, std::ref(reader));
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  EXPECT_EQ(std::string(output, ret.bytes), "World");
+
+  ret = buffer.tryRead(output, 10, std::ref(reader));
+  EXPECT_EQ(ret.bytes, 0);
+  EXPECT_EQ(ret.status, IOStatus::END_OF_STREAM);
+}
+
+TEST_F(BufferTest, TryWriteAndTryFlush_ResumeAfterWouldBlock)
+{
+  uint32_t budget = 3;
+  SyncIOLazyWriteBuffer<uint32_t> buffer(4,
+                                         [&](const char *buf, const uint32_t &len)
+                                         {
+                                           uint32_t toWrite = std::min(len, budget);
+                                           budget -= toWrite;
+                                           mockWriter(buf, toWrite);
+                                           return IOResult<uint32_t>{toWrite, IOStatus::OK};
+                                         });
+
+  auto ret = buffer.tryWrite("HelloWorld", 10);
+  EXPECT_EQ(ret.bytes, 7);
+  EXPECT_EQ(ret.status, IOStatus::WOULD_BLOCK);
+  EXPECT_EQ(smartOutput, "Hel");
+
+  budget = 2;
+  ret = buffer.tryFlush();
+  EXPECT_EQ(ret.bytes, 2);
+  EXPECT_EQ(ret.status, IOStatus::WOULD_BLOCK);
+  EXPECT_EQ(smartOutput, "Hello");
+
+  budget = 100;
+  ret = buffer.tryWrite("rld", 3);
+  EXPECT_EQ(ret.bytes, 3);
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  ret = buffer.tryFlush();
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  EXPECT_EQ(smartOutput, "HelloWorld");
+}
+
+// Feeds random sized writes through a sink accepting a random short prefix
+// of every call, interleaved with random full and partial flushes
+TEST_F(BufferTest, Flush_FuzzRandomShortWrites)
+{
+  for (uint32_t seed = 0; seed < 200; ++seed)
+  {
+    std::mt19937 rng(seed);
+    std::string expected;
+    smartOutput.clear();
+    {
+      SyncIOLazyWriteBuffer<uint32_t> buffer(1 + rng() % 64,
+                                             [&](const char *buf, const uint32_t &len)
+                                             {
+                                               uint32_t accepted = 1 + rng() % len;
+                                               return mockWriter(buf, accepted);
+                                             });
+
+      for (uint32_t i = 0; i < 100; ++i)
+      {
+        std::string data(rng() % 100, '\0');
+        for (auto &ch : data)
+        {
+          ch = 'a' + rng() % 26;
+        }
+
+        EXPECT_EQ(buffer.write(data.c_str(), data.length()), data.length());
+        expected += data;
+        ASSERT_EQ(smartOutput, expected.substr(0, smartOutput.length())) << "seed " << seed;
+
+        switch (rng() % 4)
+        {
+        case 0:
+          buffer.flush();
+          ASSERT_EQ(smartOutput, expected) << "seed " << seed;
+          break;
+        case 1:
+        {
+          auto before = smartOutput.length();
+          uint32_t atLeast = rng() % 32;
+          auto flushed = buffer.flush(atLeast);
+          EXPECT_EQ(smartOutput.length() - before, flushed);
+          EXPECT_GE(flushed, std::min<size_t>(atLeast, expected.length() - before));
+          break;
+        }
+        default:
+          break;
+        }
+      }
+    }
+
+    EXPECT_EQ(smartOutput, expected) << "seed " << seed;
+  }
+}
+
+// Same as above with a non-blocking sink that randomly would block
+TEST_F(BufferTest, TryFlush_FuzzRandomShortWritesAndWouldBlock)
+{
+  for (uint32_t seed = 0; seed < 200; ++seed)
+  {
+    std::mt19937 rng(seed);
+    std::string expected;
+    smartOutput.clear();
+    SyncIOLazyWriteBuffer<uint32_t> buffer(1 + rng() % 64,
+                                           [&](const char *buf, const uint32_t &len)
+                                           {
+                                             if (rng() % 3 == 0)
+                                             {
+                                               return IOResult<uint32_t>{0, IOStatus::WOULD_BLOCK};
+                                             }
+                                             uint32_t accepted = 1 + rng() % len;
+                                             return IOResult<uint32_t>{mockWriter(buf, accepted), IOStatus::OK};
+                                           });
+
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+      std::string data(rng() % 100, '\0');
+      for (auto &ch : data)
+      {
+        ch = 'a' + rng() % 26;
+      }
+
+      uint32_t accepted = 0;
+      while (accepted < data.length())
+      {
+        auto ret = buffer.tryWrite(data.c_str() + accepted, data.length() - accepted);
+        accepted += ret.bytes;
+        EXPECT_TRUE(ret.status == IOStatus::OK || ret.status == IOStatus::WOULD_BLOCK);
+      }
+      expected += data;
+      ASSERT_EQ(smartOutput, expected.substr(0, smartOutput.length())) << "seed " << seed;
+    }
+
+    while (buffer.tryFlush().status != IOStatus::OK)
+      ;
+    EXPECT_EQ(smartOutput, expected) << "seed " << seed;
+  }
+}
+
+TEST_F(BufferTest, Position_TracksConsumedAndWrittenBytes)
+{
+  mockInput = "Hello\nWorld\n";
+  SyncIOReadBuffer<uint32_t> reader(4);
+  char output[16];
+  EXPECT_EQ(reader.position(), 0);
+  reader.readUntil(output, [this](char *out, uint32_t len)
+                   { return mockReader(out, len); }, '\n');
+  EXPECT_EQ(reader.position(), 6);
+  reader.read(output, 3, [this](char *out, uint32_t len)
+              { return mockReader(out, len); });
+  EXPECT_EQ(reader.position(), 9);
+
+  SyncIOLazyWriteBuffer<uint32_t> writer(4, [this](const char *buf, uint32_t len)
+                                         { return mockWriter(buf, len); });
+  writer.write("Hello", 5);
+  EXPECT_EQ(writer.position(), 5);
+  EXPECT_EQ(writer.flushedPosition(), smartOutput.length());
+  writer.flush();
+  EXPECT_EQ(writer.flushedPosition(), 5);
+}
+
+// Positions are 64-bit even when SizeType is 32-bit
+TEST_F(BufferTest, Position_CrossesTheFirst4GB)
+{
+  const uint64_t start = (1ull << 32) - 3;
+  mockInput = "Hello\nWorld\n";
+  SyncIOReadBuffer<uint32_t> reader(4);
+  reader.reset(start);
+  char output[16];
+  reader.readUntil(output, [this](char *out, uint32_t len)
+                   { return mockReader(out, len); }, '\n');
+  EXPECT_EQ(reader.position(), start + 6);
+
+  SyncIOLazyWriteBuffer<uint32_t> writer(4, [this](const char *buf, uint32_t len)
+                                         { return mockWriter(buf, len); });
+  BufferTestAccess::seek(writer, start);
+  writer.write("Hello", 5);
+  EXPECT_EQ(writer.position(), start + 5);
+  writer.flush();
+  EXPECT_EQ(writer.flushedPosition(), start + 5);
+  EXPECT_EQ(smartOutput, "Hello");
+}
+
+// Same, streaming the 5 GB for real, too slow for every run:
+// --gtest_also_run_disabled_tests
+TEST_F(BufferTest, DISABLED_Position_StreamsLongerThan4GB)
+{
+  const uint64_t streamLen = 5ull << 30;
+  const uint32_t chunk = 1 << 20;
+  std::vector<char> scratch(chunk);
+
+  uint64_t produced = 0;
+  SyncIOReadBuffer<uint32_t> reader(chunk);
+  auto source = [&](char *, const uint32_t &len)
+  {
+    uint32_t ret = static_cast<uint32_t>(std::min<uint64_t>(len, streamLen - produced));
+    produced += ret;
+    return ret;
+  };
+
+  while (reader.read(scratch.data(), chunk, source))
+    ;
+  EXPECT_EQ(reader.position(), streamLen);
+
+  uint64_t consumed = 0;
+  SyncIOLazyWriteBuffer<uint32_t> writer(chunk, [&](const char *, const uint32_t &len)
+                                         {
+                                           consumed += len;
+                                           return len;
+                                         });
+  for (uint64_t written = 0; written < streamLen; written += chunk)
+  {
+    writer.write(scratch.data(), chunk);
+  }
+  writer.flush();
+  EXPECT_EQ(writer.position(), streamLen);
+  EXPECT_EQ(writer.flushedPosition(), streamLen);
+  EXPECT_EQ(consumed, streamLen);
+}
+
+TEST_F(BufferTest, LazyAllocation_AllocatesOnFirstUseAndReleasesWhenIdle)
+{
+  mockInput = "Hello\nWorld\n";
+  SyncIOReadBuffer<uint32_t> reader(4, Allocation::LAZY);
+  EXPECT_FALSE(reader.allocated());
+  EXPECT_FALSE(reader.releaseIfIdle());
+
+  char output[16];
+  auto ioInterface = [this](char *out, uint32_t len)
+  { return mockReader(out, len); };
+  EXPECT_EQ(reader.readUntil(output, ioInterface, '\n'), 6);
+  EXPECT_TRUE(reader.allocated());
+  EXPECT_EQ(std::string(output, 6), "Hello\n");
+
+  // "Wo" is still buffered
+  reader.read(output, 1, ioInterface);
+  EXPECT_FALSE(reader.releaseIfIdle());
+  EXPECT_TRUE(reader.allocated());
+
+  // Empty for 2 sweeps in a row
+  reader.read(output, 1, ioInterface);
+  EXPECT_FALSE(reader.releaseIfIdle(2));
+  EXPECT_TRUE(reader.releaseIfIdle(2));
+  EXPECT_FALSE(reader.allocated());
+
+  // Allocated again, with nothing lost
+  EXPECT_EQ(reader.readUntil(output, ioInterface, '\n'), 4);
+  EXPECT_EQ(std::string(output, 4), "rld\n");
+  EXPECT_EQ(reader.position(), 12);
+
+  SyncIOLazyWriteBuffer<uint32_t> writer(4, [this](const char *buf, uint32_t len)
+                                         { return mockWriter(buf, len); },
+                                         Allocation::LAZY);
+  EXPECT_FALSE(writer.allocated());
+  writer.write("Hel", 3);
+  EXPECT_TRUE(writer.allocated());
+  EXPECT_FALSE(writer.releaseIfIdle());
+  writer.flush();
+  EXPECT_FALSE(writer.releaseIfIdle(2));
+  // A put in between starts the count over
+  writer.write("lo", 2);
+  writer.flush();
+  EXPECT_FALSE(writer.releaseIfIdle(2));
+  EXPECT_TRUE(writer.releaseIfIdle(2));
+  EXPECT_FALSE(writer.allocated());
+  writer.write("World", 5);
+  writer.flush();
+  EXPECT_EQ(smartOutput, "HelloWorld");
+  EXPECT_EQ(writer.flushedPosition(), 10);
+}
+
+TEST_F(BufferTest, LazyAllocation_NonBlockingKeepsUnfinishedRecord)
+{
+  // A record cut by WOULD_BLOCK keeps the memory, the rest of it completes
+  // after a sweep
+  std::vector<std::string> chunks = {"par", "tial\n"};
+  size_t next = 0;
+  auto ioInterface = [&](char *out, const uint32_t &len)
+  {
+    if (next == chunks.size() || chunks[next].empty())
+    {
+      ++next;
+      return IOResult<uint32_t>{0, next > chunks.size() ? IOStatus::END_OF_STREAM : IOStatus::WOULD_BLOCK};
+    }
+    uint32_t toCopy = std::min<uint32_t>(len, chunks[next].length());
+    memcpy(out, chunks[next].c_str(), toCopy);
+    chunks[next].erase(0, toCopy);
+    return IOResult<uint32_t>{toCopy, IOStatus::OK};
+  };
+
+  SyncIOReadBuffer<uint32_t> reader(64, Allocation::LAZY);
+  char output[64];
+  EXPECT_EQ(reader.tryReadUntil(output, ioInterface, '\n').status, IOStatus::WOULD_BLOCK);
+  EXPECT_FALSE(reader.releaseIfIdle());
+  EXPECT_TRUE(reader.allocated());
+  auto ret = reader.tryReadUntil(output, ioInterface, '\n');
+  EXPECT_EQ(ret.status, IOStatus::OK);
+  EXPECT_EQ(std::string(output, ret.bytes), "partial\n");
+  EXPECT_TRUE(reader.releaseIfIdle());
+}
+
+TEST_F(BufferTest, Move_BuffersKeptByValueInAVector)
+{
+  // Every reader has part of its line still buffered when the vector grows
+  std::vector<std::string> inputs;
+  std::vector<size_t> offsets;
+  std::vector<SyncIOReadBuffer<uint32_t>> readers;
+  char output[64];
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    inputs.push_back("line " + std::to_string(i) + "\nnext " + std::to_string(i) + "\n");
+    offsets.push_back(0);
+    readers.emplace_back(8);
+    auto ioInterface = [&, i](char *out, const uint32_t &len)
+    {
+      uint32_t toCopy = std::min<uint32_t>(len, inputs[i].length() - offsets[i]);
+      memcpy(out, inputs[i].c_str() + offsets[i], toCopy);
+      offsets[i] += toCopy;
+      return toCopy;
+    };
+    uint32_t len = readers[i].readUntil(output, ioInterface, '\n');
+    EXPECT_EQ(std::string(output, len), "line " + std::to_string(i) + "\n");
+  }
+
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    auto ioInterface = [&, i](char *out, const uint32_t &len)
+    {
+      uint32_t toCopy = std::min<uint32_t>(len, inputs[i].length() - offsets[i]);
+      memcpy(out, inputs[i].c_str() + offsets[i], toCopy);
+      offsets[i] += toCopy;
+      return toCopy;
+    };
+    uint32_t len = readers[i].readUntil(output, ioInterface, '\n');
+    EXPECT_EQ(std::string(output, len), "next " + std::to_string(i) + "\n");
+    EXPECT_EQ(readers[i].position(), inputs[i].length());
+  }
+
+  std::vector<std::string> sinks(100);
+  std::vector<SyncIOLazyWriteBuffer<uint32_t>> writers;
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    writers.emplace_back(16, [&sinks, i](const char *out, const uint32_t &len)
+                         {
+                           sinks[i].append(out, len);
+                           return len;
+                         });
+    writers[i].write("buffered ", 9);
+  }
+
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    writers[i].write(std::to_string(i).c_str(), std::to_string(i).length());
+  }
+  writers.erase(writers.begin(), writers.begin() + 50);
+  for (uint32_t i = 0; i < 50; ++i)
+  {
+    EXPECT_EQ(sinks[i], "buffered " + std::to_string(i));
+    EXPECT_EQ(sinks[50 + i], "");
+    writers[i].flush();
+    EXPECT_EQ(sinks[50 + i], "buffered " + std::to_string(50 + i));
+  }
+}
+
+TEST_F(BufferTest, Move_LeavesTheSourceReusable)
+{
+  mockInput = "Hello\nWorld\n";
+  auto ioInterface = [this](char *out, uint32_t len)
+  { return mockReader(out, len); };
+  char output[16];
+  SyncIOReadBuffer<uint32_t> first(4);
+  first.readUntil(output, ioInterface, '\n');
+  SyncIOReadBuffer<uint32_t> second(std::move(first));
+  EXPECT_EQ(second.size(), 2);
+  EXPECT_EQ(second.position(), 6);
+  EXPECT_EQ(first.size(), 0);
+  EXPECT_FALSE(first.allocated());
+
+  // The moved from buffer is a lazily allocated one
+  mockInput = "Again\n";
+  readPos = 0;
+  EXPECT_EQ(first.readUntil(output, ioInterface, '\n'), 6);
+  EXPECT_EQ(std::string(output, 6), "Again\n");
+
+  // Assigning drops what was buffered
+  first = std::move(second);
+  EXPECT_EQ(first.position(), 6);
+  EXPECT_EQ(first.size(), 2);
+  first.read(output, 2, ioInterface);
+  EXPECT_EQ(std::string(output, 2), "Wo");
+
+  // Assigning flushes what was buffered
+  SyncIOLazyWriteBuffer<uint32_t> writer(16, [this](const char *buf, uint32_t len)
+                                         { return mockWriter(buf, len); });
+  std::string other;
+  SyncIOLazyWriteBuffer<uint32_t> otherWriter(16, [&other](const char *buf, const uint32_t &len)
+                                              {
+                                                other.append(buf, len);
+                                                return len;
+                                              });
+  writer.write("mine", 4);
+  otherWriter.write("theirs", 6);
+  writer = std::move(otherWriter);
+  EXPECT_EQ(smartOutput, "mine");
+  EXPECT_EQ(other, "");
+  writer.flush();
+  EXPECT_EQ(other, "theirs");
+  EXPECT_EQ(writer.flushedPosition(), 6);
+}
+
 int main(int argc, char **argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
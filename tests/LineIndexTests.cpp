@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <cstring>
+#include <random>
+#include <stdio.h>
+#include "FdSource.hpp"
+
+class LineIndexTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    path = "/tmp/LineIndexTest_" + std::to_string(getpid()) + ".txt";
+    indexPath = path + ".lidx";
+    FILE *file = fopen(path.c_str(), "w");
+    for (uint32_t i = 0; i < numLines; ++i)
+    {
+      // Variable length lines
+      fprintf(file, "line %u %s\n", i, std::string(i % 13, 'x').c_str());
+    }
+    fclose(file);
+  }
+
+  void TearDown() override
+  {
+    unlink(path.c_str());
+    unlink(indexPath.c_str());
+  }
+
+  static std::string expectedLine(const uint32_t &i)
+  {
+    return "line " + std::to_string(i) + " " + std::string(i % 13, 'x') + "\n";
+  }
+
+  std::string path;
+  std::string indexPath;
+  const uint32_t numLines = 1000;
+};
+
+TEST_F(LineIndexTest, IndexIsBuiltWhileReading)
+{
+  FdSource source(path.c_str());
+  SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+  SyncIOReadBuffer<uint32_t> buffer(64);
+  LineIndex lineIndex(7);
+  buffer.setLineIndex(&lineIndex);
+
+  char line[64];
+  uint64_t offset = 0;
+  std::vector<uint64_t> offsets;
+  for (uint32_t i = 0; i < numLines; ++i)
+  {
+    offsets.push_back(offset);
+    offset += buffer.readUntil(line, ioInterface, '\n');
+  }
+
+  EXPECT_EQ(lineIndex.indexedLines(), 994);
+  EXPECT_EQ(lineIndex.currentLine(), numLines);
+  for (uint32_t i = 0; i < numLines; ++i)
+  {
+    auto [lineOffset, indexedLine] = lineIndex.locate(i);
+    EXPECT_EQ(indexedLine, std::min(i - i % 7, 994u));
+    EXPECT_EQ(lineOffset, offsets[indexedLine]);
+  }
+}
+
+// The line index alone, without any stats
+TEST_F(LineIndexTest, IndexWithoutStats)
+{
+  FdSource source(path.c_str());
+  SyncIOReadBuffer<uint32_t, HeapStorage, Attachable<true, false, false>>::IOInterface ioInterface = std::ref(source);
+  SyncIOReadBuffer<uint32_t, HeapStorage, Attachable<true, false, false>> buffer(64);
+  LineIndex lineIndex(7);
+  buffer.setLineIndex(&lineIndex);
+
+  char line[64];
+  for (uint32_t i = 0; i < numLines; ++i)
+  {
+    ASSERT_EQ(std::string(line, buffer.readUntil(line, ioInterface, '\n')), expectedLine(i));
+  }
+
+  EXPECT_EQ(lineIndex.indexedLines(), 994);
+  EXPECT_EQ(lineIndex.currentLine(), numLines);
+}
+
+TEST_F(LineIndexTest, SeekToLineFromSavedIndex)
+{
+  {
+    FdSource source(path.c_str());
+    SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+    SyncIOReadBuffer<uint32_t> buffer(64);
+    LineIndex lineIndex(16);
+    buffer.setLineIndex(&lineIndex);
+    char line[64];
+    // Index only the first half
+    for (uint32_t i = 0; i < numLines / 2; ++i)
+    {
+      buffer.readUntil(line, ioInterface, '\n');
+    }
+    ASSERT_TRUE(lineIndex.save(indexPath.c_str()));
+  }
+
+  LineIndex lineIndex = LineIndex::load(indexPath.c_str());
+  EXPECT_EQ(lineIndex.every(), 16);
+  EXPECT_EQ(lineIndex.indexedLines(), 496);
+
+  FdSource source(path.c_str());
+  SyncIOReadBuffer<uint32_t>::IOInterface ioInterface = std::ref(source);
+  SyncIOReadBuffer<uint32_t> buffer(32);
+  buffer.setLineIndex(&lineIndex);
+
+  std::mt19937 rng(7);
+  char line[64];
+  for (uint32_t i = 0; i < 200; ++i)
+  {
+    uint32_t target = rng() % numLines;
+    ASSERT_TRUE(source.seekToLine(buffer, lineIndex, target));
+    auto len = buffer.readUntil(line, ioInterface, '\n');
+    EXPECT_EQ(std::string(line, len), expectedLine(target));
+  }
+
+  // Lines beyond the saved index got indexed on the way
+  EXPECT_GT(lineIndex.indexedLines(), 496);
+  EXPECT_FALSE(source.seekToLine(buffer, lineIndex, numLines + 1));
+}
+
+TEST_F(LineIndexTest, LoadRejectsGarbage)
+{
+  FILE *file = fopen(indexPath.c_str(), "w");
+  fputs("garbage", file);
+  fclose(file);
+  EXPECT_THROW(LineIndex::load(indexPath.c_str()), std::runtime_error);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <random>
+#include <sys/stat.h>
+#include "MappedFileSink.hpp"
+#include "SmartBuffer.hpp"
+
+class MappedFileSinkTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    path = "/tmp/MappedFileSinkTest_" + std::to_string(getpid()) + ".bin";
+    // Small windows and growth steps, so that the tests slide the window a lot
+    options.windowSize = 16 << 10;
+    options.growthStep = 40 << 10;
+  }
+
+  void TearDown() override
+  {
+    unlink(path.c_str());
+  }
+
+  std::string fileContent()
+  {
+    std::string ret;
+    FILE *file = fopen(path.c_str(), "r");
+    char chunk[4096];
+    while (auto len = fread(chunk, 1, sizeof(chunk), file))
+    {
+      ret.append(chunk, len);
+    }
+    fclose(file);
+    return ret;
+  }
+
+  std::string path;
+  MappedSinkOptions options;
+};
+
+TEST_F(MappedFileSinkTest, FlushedBytesLandInTheFile)
+{
+  std::mt19937 rng(11);
+  std::string expected;
+  {
+    MappedFileSink sink(path.c_str(), options);
+    SyncIOLazyWriteBuffer<uint32_t>::IOInterface ioInterface = std::ref(sink);
+    SyncIOLazyWriteBuffer<uint32_t> buffer(5000, ioInterface);
+    while (expected.length() < (1 << 20))
+    {
+      std::string record(rng() % 9000, 'a' + rng() % 26);
+      EXPECT_EQ(buffer.write(record.c_str(), record.length()), record.length());
+      expected += record;
+    }
+    buffer.flush();
+    EXPECT_EQ(sink.size(), expected.length());
+    EXPECT_TRUE(sink.close());
+  }
+
+  // Cut to the bytes written, not to the preallocated size
+  EXPECT_EQ(fileContent(), expected);
+}
+
+TEST_F(MappedFileSinkTest, ReserveCommitAcrossWindows)
+{
+  options.syncCompleted = true;
+  options.dropCompleted = true;
+  std::string expected;
+  {
+    MappedFileSink sink(path.c_str(), options);
+    for (uint32_t i = 0; i < 200; ++i)
+    {
+      // Some reservations are bigger than a window
+      uint64_t len = (i * 977) % (40 << 10);
+      char *out = sink.reserve(len);
+      ASSERT_NE(out, nullptr);
+      std::string record(len, 'a' + i % 26);
+      memcpy(out, record.c_str(), len / 2);
+      sink.commit(len / 2);
+      expected += record.substr(0, len / 2);
+    }
+    EXPECT_EQ(sink.size(), expected.length());
+  }
+
+  // The destructor closes the file
+  EXPECT_EQ(fileContent(), expected);
+}
+
+TEST_F(MappedFileSinkTest, CommitNoMoreThanReserved)
+{
+  {
+    MappedFileSink sink(path.c_str(), options);
+    EXPECT_THROW(sink.commit(1), std::invalid_argument);
+    char *out = sink.reserve(4);
+    ASSERT_NE(out, nullptr);
+    memcpy(out, "abcd", 4);
+    EXPECT_THROW(sink.commit(5), std::invalid_argument);
+    sink.commit(3);
+    sink.commit(1);
+    EXPECT_THROW(sink.commit(1), std::invalid_argument);
+
+    ASSERT_NE(sink.reserve(4), nullptr);
+    sink("ef", 2u);
+    EXPECT_THROW(sink.commit(1), std::invalid_argument);
+    EXPECT_EQ(sink.size(), 6u);
+  }
+
+  EXPECT_EQ(fileContent(), "abcdef");
+}
+
+TEST_F(MappedFileSinkTest, EmptyFile)
+{
+  {
+    MappedFileSink sink(path.c_str(), options);
+    ASSERT_NE(sink.reserve(100), nullptr);
+  }
+
+  struct stat fileStat;
+  ASSERT_EQ(stat(path.c_str(), &fileStat), 0);
+  EXPECT_EQ(fileStat.st_size, 0);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
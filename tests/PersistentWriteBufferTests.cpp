@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <random>
+#include <sys/wait.h>
+#include "PersistentWriteBuffer.hpp"
+
+class PersistentWriteBufferTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    path = "/tmp/PersistentWriteBufferTest_" + std::to_string(getpid()) + ".ring";
+    outPath = "/tmp/PersistentWriteBufferTest_" + std::to_string(getpid()) + ".out";
+  }
+
+  void TearDown() override
+  {
+    unlink(path.c_str());
+    unlink(outPath.c_str());
+  }
+
+  // Appends to the output file, like a log sink would
+  PersistentLazyWriteBuffer<uint32_t>::IOInterface fileWriter(const int &fd)
+  {
+    return [fd](const char *out, const uint32_t &len)
+    {
+      ssize_t ret = ::write(fd, out, len);
+      return static_cast<uint32_t>(ret < 0 ? 0 : ret);
+    };
+  }
+
+  std::string outContent()
+  {
+    std::string ret;
+    FILE *file = fopen(outPath.c_str(), "r");
+    char chunk[4096];
+    while (auto len = fread(chunk, 1, sizeof(chunk), file))
+    {
+      ret.append(chunk, len);
+    }
+    fclose(file);
+    return ret;
+  }
+
+  static std::string record(const uint32_t &i)
+  {
+    return "record " + std::to_string(i) + " " + std::string(i % 97, 'p') + "\n";
+  }
+
+  std::string path;
+  std::string outPath;
+};
+
+TEST_F(PersistentWriteBufferTest, UnflushedBytesSurviveACrash)
+{
+  const uint32_t numRecords = 10000;
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (!child)
+  {
+    int fd = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    auto *buffer = new PersistentLazyWriteBuffer<uint32_t>(path.c_str(), 1 << 16, fileWriter(fd));
+    for (uint32_t i = 0; i < numRecords; ++i)
+    {
+      auto line = record(i);
+      buffer->write(line.c_str(), line.length());
+    }
+    // Die without flushing or running any destructors
+    _exit(0);
+  }
+
+  int status;
+  waitpid(child, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status));
+
+  std::string expected;
+  for (uint32_t i = 0; i < numRecords; ++i)
+  {
+    expected += record(i);
+  }
+  auto beforeRecovery = outContent();
+  ASSERT_LT(beforeRecovery.length(), expected.length());
+
+  int fd = ::open(outPath.c_str(), O_WRONLY | O_APPEND);
+  EXPECT_EQ(PersistentLazyWriteBuffer<uint32_t>::recover(path.c_str(), fileWriter(fd)),
+            expected.length() - beforeRecovery.length());
+  ::close(fd);
+  EXPECT_EQ(outContent(), expected);
+
+  // Nothing left to recover the second time
+  EXPECT_EQ(PersistentLazyWriteBuffer<uint32_t>::recover(path.c_str(), fileWriter(-1)), 0);
+}
+
+TEST_F(PersistentWriteBufferTest, ConstructorRecoversBeforeStarting)
+{
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (!child)
+  {
+    int fd = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    auto *buffer = new PersistentLazyWriteBuffer<uint32_t>(path.c_str(), 1000, fileWriter(fd));
+    buffer->write("lost?", 5);
+    _exit(0);
+  }
+
+  int status;
+  waitpid(child, &status, 0);
+  int fd = ::open(outPath.c_str(), O_WRONLY | O_APPEND);
+  {
+    // A different size this time
+    PersistentLazyWriteBuffer<uint32_t> buffer(path.c_str(), 64, fileWriter(fd));
+    EXPECT_EQ(buffer.recoveredBytes(), 5);
+    std::mt19937 rng(5);
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+      std::string data(rng() % 200, 'a' + i % 26);
+      EXPECT_EQ(buffer.write(data.c_str(), data.length()), data.length());
+    }
+    EXPECT_LE(buffer.position() - buffer.flushedPosition(), 64);
+  }
+  ::close(fd);
+  EXPECT_EQ(outContent().substr(0, 5), "lost?");
+
+  // A clean shutdown flushes everything
+  EXPECT_EQ(PersistentLazyWriteBuffer<uint32_t>::recover(path.c_str(), fileWriter(-1)), 0);
+}
+
+TEST_F(PersistentWriteBufferTest, RejectsForeignFiles)
+{
+  FILE *file = fopen(path.c_str(), "w");
+  fputs(std::string(8192, 'g').c_str(), file);
+  fclose(file);
+  EXPECT_THROW(PersistentLazyWriteBuffer<uint32_t>(path.c_str(), 100, fileWriter(-1)), std::runtime_error);
+}
+
+// A character device opens but can't be sized, the fd is not leaked
+TEST_F(PersistentWriteBufferTest, UnsizableFileThrowsWithoutLeaking)
+{
+  int nextFd = dup(0);
+  ::close(nextFd);
+  EXPECT_THROW(PersistentLazyWriteBuffer<uint32_t>("/dev/null", 100, fileWriter(-1)), std::runtime_error);
+  int fd = dup(0);
+  ::close(fd);
+  EXPECT_EQ(fd, nextFd);
+}
+
+// A live ring is neither replayed nor reinitialised by a second user of its
+// file, in another process or this one
+TEST_F(PersistentWriteBufferTest, BackingFileIsLockedWhileInUse)
+{
+  int fd = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  {
+    PersistentLazyWriteBuffer<uint32_t> buffer(path.c_str(), 100, fileWriter(fd));
+    buffer.write("live", 4);
+    EXPECT_THROW(PersistentLazyWriteBuffer<uint32_t>(path.c_str(), 100, fileWriter(fd)), std::runtime_error);
+    EXPECT_THROW(PersistentLazyWriteBuffer<uint32_t>::recover(path.c_str(), fileWriter(fd)), std::runtime_error);
+
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (!child)
+    {
+      try
+      {
+        PersistentLazyWriteBuffer<uint32_t> other(path.c_str(), 100, fileWriter(fd));
+      }
+      catch (const std::runtime_error &)
+      {
+        _exit(0);
+      }
+      _exit(1);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(buffer.position() - buffer.flushedPosition(), 4);
+  }
+  ::close(fd);
+  EXPECT_EQ(outContent(), "live");
+
+  // Free again
+  EXPECT_EQ(PersistentLazyWriteBuffer<uint32_t>::recover(path.c_str(), fileWriter(-1)), 0);
+  PersistentLazyWriteBuffer<uint32_t> buffer(path.c_str(), 100, fileWriter(-1));
+}
+
+TEST_F(PersistentWriteBufferTest, IncompleteRecoveryThrows)
+{
+  {
+    // Nothing gets accepted, the bytes stay in the ring
+    PersistentLazyWriteBuffer<uint32_t> buffer(path.c_str(), 100, fileWriter(-1));
+    buffer.write("pending", 7);
+  }
+
+  EXPECT_THROW(PersistentLazyWriteBuffer<uint32_t>::recover(path.c_str(), fileWriter(-1)), std::runtime_error);
+  int fd = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  EXPECT_EQ(PersistentLazyWriteBuffer<uint32_t>::recover(path.c_str(), fileWriter(fd)), 7);
+  ::close(fd);
+  EXPECT_EQ(outContent(), "pending");
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
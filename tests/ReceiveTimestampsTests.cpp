@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "SmartBuffer.hpp"
+#include "AsyncSmartBuffer.hpp"
+
+TEST(LatencyHistogramTest, PercentilesWithinBucketError)
+{
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.percentile(50), 0);
+  for (uint64_t i = 1; i <= 10000; ++i)
+  {
+    histogram.record(i * 1000);
+  }
+
+  EXPECT_EQ(histogram.count(), 10000);
+  EXPECT_EQ(histogram.max(), 10000000);
+  EXPECT_DOUBLE_EQ(histogram.mean(), 5000500);
+  // A bucket is at most 1/8th of its values wide
+  for (double percent : {1.0, 50.0, 90.0, 99.0, 99.9})
+  {
+    double expected = percent * 100 * 1000;
+    double actual = histogram.percentile(percent);
+    EXPECT_GE(actual, expected) << percent;
+    EXPECT_LE(actual, expected * 1.125) << percent;
+  }
+  EXPECT_EQ(histogram.percentile(100), 10000000);
+
+  for (uint64_t value : {0ull, 7ull, 8ull, 1000ull, 1ull << 40, ~0ull})
+  {
+    unsigned bucket = LatencyHistogram::bucketOf(value);
+    ASSERT_LT(bucket, LatencyHistogram::NUM_BUCKETS);
+    EXPECT_GE(LatencyHistogram::upperBoundOf(bucket), value);
+    if (bucket)
+    {
+      EXPECT_LT(LatencyHistogram::upperBoundOf(bucket - 1), value);
+    }
+  }
+
+  histogram.reset();
+  EXPECT_EQ(histogram.count(), 0);
+}
+
+TEST(ReceiveTimestampsTest, EveryByteMapsToItsPaste)
+{
+  std::string data;
+  for (uint32_t i = 0; i < 1000; ++i)
+  {
+    data += std::to_string(i) + "\n";
+  }
+
+  // Short reads, so that there are many pastes
+  uint64_t offset = 0;
+  auto ioInterface = [&](char *out, const uint32_t &len)
+  {
+    uint32_t toRead = std::min<uint64_t>({len, 7, data.length() - offset});
+    memcpy(out, data.c_str() + offset, toRead);
+    offset += toRead;
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+    return toRead;
+  };
+
+  TimestampRing timestamps(4096);
+  SyncIOReadBuffer<uint32_t> buffer(64);
+  EXPECT_FALSE(buffer.timestampOf(0));
+  buffer.setTimestamps(&timestamps);
+  EXPECT_FALSE(buffer.timestampOf(0));
+
+  char out[32];
+  std::optional<uint64_t> previous;
+  uint64_t pastes = 0;
+  while (buffer.readUntil(out, ioInterface, '\n'))
+  {
+    ASSERT_TRUE(buffer.timestampOf(buffer.position() - 1));
+  }
+
+  // Bytes of the same paste share the timestamp, timestamps grow
+  for (uint64_t position = 0; position < data.length(); ++position)
+  {
+    auto timestamp = buffer.timestampOf(position);
+    ASSERT_TRUE(timestamp) << position;
+    if (!previous || *timestamp != *previous)
+    {
+      ++pastes;
+      EXPECT_TRUE(!previous || *timestamp > *previous);
+      previous = timestamp;
+    }
+  }
+  EXPECT_GE(pastes, data.length() / 7);
+  EXPECT_FALSE(buffer.timestampOf(data.length()));
+
+  // Repositioning forgets them
+  buffer.reset(0);
+  EXPECT_FALSE(buffer.timestampOf(0));
+}
+
+TEST(ReceiveTimestampsTest, OldPastesAreForgotten)
+{
+  TimestampRing timestamps(4);
+  for (uint64_t i = 0; i < 10; ++i)
+  {
+    timestamps.onPaste(i * 10, i * 10 + 10);
+  }
+
+  EXPECT_FALSE(timestamps.timestampOf(59));
+  for (uint64_t position = 60; position < 100; ++position)
+  {
+    EXPECT_TRUE(timestamps.timestampOf(position)) << position;
+  }
+  EXPECT_FALSE(timestamps.timestampOf(100));
+}
+
+TEST(ReceiveTimestampsTest, ResidencyIsRecorded)
+{
+  auto ioInterface = [](char *out, const uint32_t &len)
+  {
+    memset(out, 'x', len);
+    return len;
+  };
+
+  TimestampRing timestamps(16, TimestampClock::TSC);
+  BufferStats stats;
+  SyncIOReadBuffer<uint32_t> buffer(1000);
+  buffer.setStats(&stats);
+  char out[100];
+  // No timestamps, no residency
+  buffer.read(out, 100, ioInterface);
+  EXPECT_EQ(stats.residency.count(), 0);
+
+  buffer.reset(0);
+  buffer.setTimestamps(&timestamps);
+  buffer.read(out, 100, ioInterface);
+  // The rest of the paste sits in the buffer
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  for (uint32_t i = 0; i < 9; ++i)
+  {
+    buffer.read(out, 100, ioInterface);
+  }
+
+  EXPECT_EQ(stats.residency.count(), 10);
+  EXPECT_GE(stats.residency.max(), 20000000);
+  EXPECT_LT(stats.residency.percentile(10), 20000000);
+
+  // The async buffer does the same
+  stats.residency.reset();
+  AsyncIOReadBuffer<uint32_t> asyncBuffer(1000);
+  asyncBuffer.setTimestamps(&timestamps);
+  asyncBuffer.setStats(&stats);
+  auto asyncIOInterface = [](char *out, const uint32_t &len, const std::function<void(const uint32_t &)> &handler)
+  {
+    memset(out, 'y', len);
+    handler(len);
+  };
+  asyncBuffer.read(out, 100, asyncIOInterface, [](const uint32_t &) {});
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  asyncBuffer.read(out, 100, asyncIOInterface, [](const uint32_t &) {});
+  EXPECT_TRUE(asyncBuffer.timestampOf(150));
+  EXPECT_EQ(stats.residency.count(), 2);
+  EXPECT_GE(stats.residency.max(), 20000000);
+}
+
+TEST(ReceiveTimestampsTest, RecordLengthAndOccupancyAreRecorded)
+{
+  std::string input = "a\nbbb\ncccccccccc\ndd";
+  uint32_t offset = 0;
+  auto ioInterface = [&](char *out, const uint32_t &len)
+  {
+    uint32_t toRead = std::min<uint32_t>({len, 4, static_cast<uint32_t>(input.length()) - offset});
+    memcpy(out, input.c_str() + offset, toRead);
+    offset += toRead;
+    return toRead;
+  };
+
+  // Without timestamps
+  BufferStats stats;
+  SyncIOReadBuffer<uint32_t> buffer(8);
+  buffer.setStats(&stats);
+  char out[32];
+  EXPECT_EQ(buffer.readUntil(out, ioInterface, '\n'), 2);
+  EXPECT_EQ(buffer.skipUntil(ioInterface, '\n'), 4);
+  EXPECT_EQ(buffer.readUntil(out, ioInterface, '\n'), 11);
+  // Trailing bytes without an ender
+  EXPECT_EQ(buffer.readUntil(out, ioInterface, '\n'), 2);
+  EXPECT_EQ(buffer.readUntil(out, ioInterface, '\n'), 0);
+
+  EXPECT_EQ(stats.recordLength.count(), 4);
+  EXPECT_EQ(stats.recordLength.max(), 11);
+  EXPECT_EQ(stats.recordLength.percentile(50), 2);
+  EXPECT_EQ(stats.residency.count(), 0);
+  // Every read from the IOInterface is at most 4 bytes, into a buffer of 8
+  EXPECT_GT(stats.occupancy.count(), 0);
+  EXPECT_LE(stats.occupancy.max(), 8);
+}
+
+TEST(ReceiveTimestampsTest, KernelTimestampsFromASocket)
+{
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0);
+  ASSERT_TRUE(enableSocketTimestamps(fds[0]));
+
+  TimestampRing timestamps(16, TimestampClock::SOCKET);
+  uint64_t before = timestamps.now();
+  ASSERT_EQ(send(fds[1], "hello", 5, 0), 5);
+  // The kernel stamps on arrival, not when the reader gets around to it
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  SyncIOReadBuffer<uint32_t> buffer(64);
+  buffer.setTimestamps(&timestamps);
+  char out[5];
+  ASSERT_EQ(buffer.read(out, 5, socketTimestampReader<uint32_t>(fds[0], timestamps)), 5);
+  auto timestamp = buffer.timestampOf(0);
+  ASSERT_TRUE(timestamp);
+  EXPECT_GE(*timestamp, before);
+  EXPECT_LT(*timestamp, before + 20000000);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "BufferTestAccess.hpp"
+
+// The layouts the microbenchmarks put the buffers into, and the primitives
+// on them, reached through BufferTestAccess
+TEST(RingPrimitivesTest, CopyAroundTheEnd)
+{
+  SyncIOReadBuffer<uint32_t> buffer(8);
+  BufferTestAccess::place(buffer, 6u, 8u);
+  EXPECT_EQ(BufferTestAccess::occupiedBytes(buffer), 8u);
+  memcpy(BufferTestAccess::data(buffer), "cdefghab", 8);
+
+  char out[8];
+  BufferTestAccess::copy(buffer, out, 4u);
+  EXPECT_EQ(std::string(out, 4), "abcd");
+  EXPECT_EQ(BufferTestAccess::occupiedBytes(buffer), 4u);
+  EXPECT_EQ(buffer.position(), 4u);
+
+  BufferTestAccess::copy(buffer, out, 4u);
+  EXPECT_EQ(std::string(out, 4), "efgh");
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(RingPrimitivesTest, PutAroundTheEnd)
+{
+  std::string written;
+  SyncIOLazyWriteBuffer<uint32_t> buffer(8, [&](const char *out, const uint32_t &len)
+                                         {
+                                           written.append(out, len);
+                                           return len; });
+  BufferTestAccess::place(buffer, 5u, 0u);
+  BufferTestAccess::put(buffer, "abcdef", 6u);
+  EXPECT_EQ(BufferTestAccess::occupiedBytes(buffer), 6u);
+  EXPECT_EQ(std::string(BufferTestAccess::data(buffer) + 5, 3), "abc");
+  EXPECT_EQ(std::string(BufferTestAccess::data(buffer), 3), "def");
+
+  buffer.flush();
+  EXPECT_EQ(written, "abcdef");
+}
+
+TEST(RingPrimitivesTest, PasteAndFindLengthTill)
+{
+  SyncIOReadBuffer<uint32_t> buffer(8);
+  BufferTestAccess::place(buffer, 3u, 0u);
+  uint32_t calls = 0;
+  SyncIOReadBuffer<uint32_t>::IOInterface source = [&](char *out, const uint32_t &len)
+  {
+    ++calls;
+    memset(out, calls == 1 ? 'a' : '\n', len);
+    return len;
+  };
+
+  // The free bytes are split around the end, so 2 calls
+  EXPECT_EQ(BufferTestAccess::paste(buffer, source), 8u);
+  EXPECT_EQ(calls, 2u);
+  EXPECT_EQ(BufferTestAccess::pasteFromInterface(buffer, source, 0u), 0u);
+  EXPECT_EQ(*BufferTestAccess::findLengthTill(buffer, '\n'), 6u);
+  std::function<bool(const char &)> ender = [](const char &c)
+  {
+    return c == '\n';
+  };
+  EXPECT_EQ(*BufferTestAccess::findLengthTill(buffer, ender), 6u);
+  EXPECT_FALSE(BufferTestAccess::findLengthTill(buffer, 'x'));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
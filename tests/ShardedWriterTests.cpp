@@ -0,0 +1,257 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ShardedWriter.hpp"
+
+static std::vector<std::string> lines(const std::string &text)
+{
+  std::vector<std::string> ret;
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line))
+  {
+    ret.push_back(line);
+  }
+  return ret;
+}
+
+TEST(ShardedWriterTest, StrictOrderAcrossShards)
+{
+  // A single thread writing to the shards in turns, with small shard
+  // buffers flushing at different times, the output is in the order of the
+  // calls
+  std::string sink;
+  std::vector<std::string> expected;
+  {
+    ShardedWriter<uint32_t> writer(5, 64, 100, [&](const char *out, const uint32_t &len)
+                                   {
+                                     sink.append(out, len);
+                                     return len; });
+    for (uint32_t i = 0; i < 10000; ++i)
+    {
+      std::string record = std::to_string(i) + std::string(i % 7, '.') + "\n";
+      writer.shard(i * i % 5).write(record.c_str(), record.length());
+      expected.push_back(record.substr(0, record.length() - 1));
+    }
+  }
+
+  EXPECT_EQ(lines(sink), expected);
+}
+
+TEST(ShardedWriterTest, StrictOrderWaitsForTheShards)
+{
+  std::string sink;
+  std::mutex mutex;
+  auto ioInterface = [&](const char *out, const uint32_t &len)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    sink.append(out, len);
+    return len;
+  };
+
+  ShardedWriter<uint32_t> writer(2, 1024, 1024, ioInterface);
+  writer.shard(0).write("first\n", 6);
+  writer.shard(1).write("second\n", 7);
+  // The first record is still in shard 0
+  writer.shard(1).flush();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(sink, "");
+  }
+
+  writer.shard(0).flush();
+  for (uint32_t i = 0; i < 100; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sink.length() == 13)
+    {
+      break;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ(sink, "first\nsecond\n");
+}
+
+class ShardedWriterThreadsTest : public ::testing::TestWithParam<MergeOrder>
+{
+};
+
+TEST_P(ShardedWriterThreadsTest, EveryThreadsRecordsInOrder)
+{
+  const uint32_t numThreads = 8;
+  const uint32_t numRecords = 20000;
+  std::string sink;
+  {
+    ShardedWriter<uint32_t> writer(numThreads, 4096, 1 << 16, [&](const char *out, const uint32_t &len)
+                                   {
+                                     sink.append(out, len);
+                                     return len; }, GetParam());
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < numThreads; ++t)
+    {
+      threads.emplace_back([&, t]()
+                           {
+                             auto &shard = writer.shard(t);
+                             for (uint32_t i = 0; i < numRecords; ++i)
+                             {
+                               std::string record = std::to_string(t) + " " + std::to_string(i) + "\n";
+                               shard.write(record.c_str(), record.length());
+                             } });
+    }
+
+    for (auto &thread : threads)
+    {
+      thread.join();
+    }
+  }
+
+  auto output = lines(sink);
+  ASSERT_EQ(output.size(), numThreads * numRecords);
+  std::map<uint32_t, uint32_t> next;
+  for (auto &line : output)
+  {
+    uint32_t t, i;
+    ASSERT_EQ(sscanf(line.c_str(), "%u %u", &t, &i), 2) << line;
+    ASSERT_EQ(i, next[t]++) << line;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Orders, ShardedWriterThreadsTest, ::testing::Values(MergeOrder::STRICT, MergeOrder::BOUNDED, MergeOrder::RELAXED));
+
+TEST(ShardedWriterTest, RelaxedOrderMergesByTimestamp)
+{
+  // Everything is flushed before merging, so timestamps order it all
+  std::string sink;
+  {
+    ShardedWriter<uint32_t> writer(3, 1 << 16, 1 << 16, [&](const char *out, const uint32_t &len)
+                                   {
+                                     sink.append(out, len);
+                                     return len; }, MergeOrder::RELAXED);
+    for (uint32_t i = 0; i < 30; ++i)
+    {
+      std::string record = std::to_string(i) + "\n";
+      writer.shard(i % 3).write(record.c_str(), record.length());
+      std::this_thread::sleep_for(std::chrono::microseconds(10));
+    }
+  }
+
+  std::string expected;
+  for (uint32_t i = 0; i < 30; ++i)
+  {
+    expected += std::to_string(i) + "\n";
+  }
+  EXPECT_EQ(sink, expected);
+}
+
+// Shard 1 runs far ahead of the record in shard 0, far past what it may
+// have waiting to be taken, it never waits on shard 0 and nothing is written
+// out of order
+TEST(ShardedWriterTest, StrictOrderHoldsBackWithoutBlockingTheShards)
+{
+  std::string sink;
+  const uint32_t numRecords = 1000;
+  {
+    ShardedWriter<uint32_t> writer(2, 64, 1024, [&](const char *out, const uint32_t &len)
+                                   {
+                                     sink.append(out, len);
+                                     return len; });
+    writer.shard(0).write("first\n", 6);
+    for (uint32_t i = 0; i < numRecords; ++i)
+    {
+      writer.shard(1).write("record\n", 7);
+    }
+    writer.shard(1).flush();
+    writer.shard(0).flush();
+    writer.close();
+    EXPECT_EQ(writer.lateRecords(), 0u);
+  }
+
+  auto output = lines(sink);
+  ASSERT_EQ(output.size(), numRecords + 1);
+  EXPECT_EQ(output.front(), "first");
+}
+
+// Shard 1 runs far ahead of the record in shard 0, the merger stops
+// waiting for it
+TEST(ShardedWriterTest, BoundedOrderBoundsTheRecordsHeldBack)
+{
+  std::string sink;
+  std::mutex mutex;
+  auto ioInterface = [&](const char *out, const uint32_t &len)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    sink.append(out, len);
+    return len;
+  };
+
+  const uint32_t numRecords = 1000;
+  {
+    ShardedWriter<uint32_t> writer(2, 64, 1024, ioInterface, MergeOrder::BOUNDED);
+    writer.shard(0).write("first\n", 6);
+    for (uint32_t i = 0; i < numRecords; ++i)
+    {
+      writer.shard(1).write("record\n", 7);
+    }
+
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!sink.empty())
+      {
+        break;
+      }
+    }
+    writer.shard(0).flush();
+    writer.close();
+    EXPECT_EQ(writer.lateRecords(), 1u);
+  }
+
+  auto output = lines(sink);
+  ASSERT_EQ(output.size(), numRecords + 1);
+  EXPECT_NE(output.front(), "first");
+  EXPECT_EQ(std::count(output.begin(), output.end(), "first"), 1);
+}
+
+// The ioInterface takes nothing, the records are lost, and counted
+TEST(ShardedWriterTest, LostBytesCountsWhatTheIOInterfaceRefused)
+{
+  ShardedWriter<uint32_t> writer(1, 64, 16, [](const char *, const uint32_t &)
+                                 { return 0u; });
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    writer.shard(0).write("0123456789", 10);
+    writer.shard(0).flush();
+  }
+  writer.close();
+  EXPECT_EQ(writer.lostBytes(), 30u);
+}
+
+TEST(ShardedWriterTest, RejectsRecordsLongerThanSizeType)
+{
+  std::string sink;
+  {
+    ShardedWriter<uint8_t> writer(1, 16, 16, [&](const char *out, const uint8_t &len)
+                                  {
+                                    sink.append(out, len);
+                                    return len; });
+    std::string record(255, 'r');
+    EXPECT_THROW(writer.shard(0).write(record.c_str(), 256), std::invalid_argument);
+    writer.shard(0).write(record.c_str(), record.length());
+  }
+
+  EXPECT_EQ(sink, std::string(255, 'r'));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
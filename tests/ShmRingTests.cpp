@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <random>
+#include <thread>
+#include <sys/wait.h>
+#include "ShmRing.hpp"
+#include "SmartBuffer.hpp"
+
+static std::string record(const uint32_t &i)
+{
+  return std::to_string(i) + " " + std::string(i % 300, 'a' + i % 26) + "\n";
+}
+
+TEST(ShmRingTest, StreamBetweenThreads)
+{
+  // Smaller than most records, so both sides keep blocking on each other
+  int fd = ShmRing::create(97);
+  ShmRing writerRing(fd), readerRing(fd);
+  ::close(fd);
+  const uint32_t numRecords = 5000;
+
+  std::thread writer(
+      [&]()
+      {
+        SyncIOLazyWriteBuffer<uint32_t>::IOInterface ioInterface =
+            [&writerRing](const char *data, const uint32_t &len)
+        {
+          return writerRing.write(data, len);
+        };
+        SyncIOLazyWriteBuffer<uint32_t> buffer(200, ioInterface);
+        for (uint32_t i = 0; i < numRecords; ++i)
+        {
+          auto line = record(i);
+          buffer.write(line.c_str(), line.length());
+        }
+        buffer.flush();
+        writerRing.close();
+      });
+
+  SyncIOReadBuffer<uint32_t>::IOInterface ioInterface =
+      [&readerRing](char *out, const uint32_t &len)
+  {
+    return readerRing.read(out, len);
+  };
+  SyncIOReadBuffer<uint32_t> buffer(128);
+  char line[512];
+  for (uint32_t i = 0; i < numRecords; ++i)
+  {
+    auto len = buffer.readUntil(line, ioInterface, '\n');
+    ASSERT_EQ(std::string(line, len), record(i));
+  }
+
+  // Closed and drained
+  EXPECT_EQ(buffer.readUntil(line, ioInterface, '\n'), 0);
+  writer.join();
+}
+
+TEST(ShmRingTest, StreamBetweenProcesses)
+{
+  int fd = ShmRing::create(4096);
+  const uint64_t total = 64 << 20;
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (!child)
+  {
+    ShmRing ring(fd);
+    std::mt19937 rng(1);
+    char chunk[1000];
+    for (uint64_t written = 0; written < total;)
+    {
+      uint32_t len = std::min<uint64_t>(rng() % sizeof(chunk) + 1, total - written);
+      for (uint32_t i = 0; i < len; ++i)
+      {
+        chunk[i] = static_cast<char>(written + i);
+      }
+      for (uint32_t done = 0; done < len;)
+      {
+        done += ring.write(chunk + done, len - done);
+      }
+      written += len;
+    }
+    ring.close();
+    _exit(0);
+  }
+
+  ShmRing ring(fd);
+  ::close(fd);
+  char chunk[3000];
+  uint64_t read = 0;
+  bool intact = true;
+  while (auto len = ring.read(chunk, static_cast<uint32_t>(sizeof(chunk))))
+  {
+    for (uint32_t i = 0; i < len; ++i)
+    {
+      intact &= chunk[i] == static_cast<char>(read + i);
+    }
+    read += len;
+  }
+
+  EXPECT_TRUE(intact);
+  EXPECT_EQ(read, total);
+  int status;
+  waitpid(child, &status, 0);
+}
+
+TEST(ShmRingTest, CloseWakesABlockedWriter)
+{
+  int fd = ShmRing::create(16, ("/ShmRingTest_" + std::to_string(getpid())).c_str());
+  ShmRing writerRing(fd);
+  ::close(fd);
+  int otherFd = ShmRing::open(("/ShmRingTest_" + std::to_string(getpid())).c_str());
+  ASSERT_GE(otherFd, 0);
+  shm_unlink(("/ShmRingTest_" + std::to_string(getpid())).c_str());
+  ShmRing readerRing(otherFd);
+  ::close(otherFd);
+
+  EXPECT_EQ(writerRing.write("0123456789abcdefXYZ", 19u), 16u);
+  std::thread closer(
+      [&]()
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        readerRing.close();
+      });
+  // Full, blocks till the reader closes the ring
+  EXPECT_EQ(writerRing.write("XYZ", 3u), 0u);
+  closer.join();
+
+  char out[32];
+  EXPECT_EQ(readerRing.read(out, 32u), 16u);
+  EXPECT_EQ(std::string(out, 16), "0123456789abcdef");
+  EXPECT_EQ(readerRing.read(out, 32u), 0u);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
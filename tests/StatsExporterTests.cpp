@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "StatsExporter.hpp"
+
+static const char *SEGMENT = "/StatsExporterTests";
+
+// An exported buffer takes no room unless exported
+TEST(StatsExporterTest, DefaultsUnchanged)
+{
+  static_assert(sizeof(SyncIOLazyWriteBuffer<uint32_t>) == sizeof(SyncIOLazyWriteBuffer<uint32_t, HeapStorage, NoLock, NoStats>));
+  static_assert(sizeof(SyncIOReadBuffer<uint32_t, HeapStorage, ExportedStats>) == sizeof(SyncIOReadBuffer<uint32_t>) + sizeof(void *));
+}
+
+TEST(StatsExporterTest, BuffersReportToTheirSlots)
+{
+  StatsExporter exporter(SEGMENT, 4);
+  StatsView view(SEGMENT);
+  EXPECT_EQ(view.numSlots(), 4u);
+  EXPECT_EQ(view.pid(), getpid());
+
+  std::string input = "one\ntwo\nthree\n";
+  uint32_t offset = 0;
+  SyncIOReadBuffer<uint32_t>::IOInterface source = [&](char *out, const uint32_t &len)
+  {
+    uint32_t toRead = std::min<uint32_t>({len, static_cast<uint32_t>(input.length()) - offset, 5});
+    memcpy(out, input.c_str() + offset, toRead);
+    offset += toRead;
+    return toRead;
+  };
+
+  StatsSlot *inSlot = exporter.add("in");
+  StatsSlot *outSlot = exporter.add("out");
+  StatsSnapshot snapshot;
+  // Not attached yet
+  EXPECT_FALSE(view.read(0, snapshot));
+
+  std::string written;
+  {
+    SyncIOReadBuffer<uint32_t, HeapStorage, ExportedStats> in(8);
+    in.setExport(inSlot);
+    SyncIOLazyWriteBuffer<uint32_t, HeapStorage, NoLock, ExportedStats> out(6, [&](const char *data, const uint32_t &len)
+                                                                             {
+                                                                               written.append(data, len);
+                                                                               return len; });
+    out.setExport(outSlot);
+
+    char record[8];
+    while (uint32_t len = in.readUntil(record, source, '\n'))
+    {
+      out.write(record, len);
+    }
+    out.flush(1);
+    out.write("x", 1);
+
+    ASSERT_TRUE(view.read(0, snapshot));
+    EXPECT_EQ(snapshot.kind, SlotKind::READ);
+    EXPECT_EQ(std::string(snapshot.name), "in");
+    EXPECT_EQ(snapshot.capacity, 8u);
+    EXPECT_EQ(snapshot.bytes, input.length());
+    EXPECT_EQ(snapshot.records, 3u);
+    // 5 byte reads and the 0 at the end
+    EXPECT_EQ(snapshot.emptyCalls, 1u);
+    EXPECT_GE(snapshot.ioCalls, 4u);
+    EXPECT_LE(snapshot.maxOccupancy, 8u);
+  }
+
+  EXPECT_EQ(written, input + "x");
+  ASSERT_TRUE(view.read(1, snapshot));
+  EXPECT_EQ(snapshot.kind, SlotKind::WRITE);
+  EXPECT_EQ(snapshot.bytes, input.length() + 1);
+  EXPECT_GT(snapshot.flushes[static_cast<uint32_t>(FlushCause::FULL)], 0u);
+  EXPECT_EQ(snapshot.flushes[static_cast<uint32_t>(FlushCause::EXPLICIT)], 1u);
+  EXPECT_EQ(snapshot.flushes[static_cast<uint32_t>(FlushCause::CLOSE)], 1u);
+  EXPECT_EQ(snapshot.maxOccupancy, 6u);
+
+  // Slots are reused once removed, and start over
+  exporter.remove(inSlot);
+  EXPECT_FALSE(view.read(0, snapshot));
+  EXPECT_EQ(exporter.add("again"), inSlot);
+  EXPECT_NE(exporter.add("3"), nullptr);
+  EXPECT_NE(exporter.add("4"), nullptr);
+  EXPECT_EQ(exporter.add("5"), nullptr);
+  inSlot->attach(SlotKind::READ, 1);
+  ASSERT_TRUE(view.read(0, snapshot));
+  EXPECT_EQ(std::string(snapshot.name), "again");
+  EXPECT_EQ(snapshot.bytes, 0u);
+}
+
+// Every update of the writer keeps bytes == 3 * ioCalls, a reader never sees
+// them apart
+TEST(StatsExporterTest, ReadersSeeConsistentSnapshots)
+{
+  StatsExporter exporter(SEGMENT, 1);
+  StatsSlot *slot = exporter.add("busy");
+  slot->attach(SlotKind::READ, 64);
+  std::atomic<bool> done(false);
+  std::thread writer([&]()
+                     {
+                       for (uint32_t i = 0; i < 2000000; ++i)
+                       {
+                         slot->onIoCall(3, i % 64);
+                       }
+                       done = true; });
+
+  StatsView view(SEGMENT);
+  StatsSnapshot snapshot;
+  uint64_t reads = 0;
+  while (!done || !reads)
+  {
+    ASSERT_TRUE(view.read(0, snapshot));
+    ASSERT_EQ(snapshot.bytes, 3 * snapshot.ioCalls);
+    ASSERT_LT(snapshot.occupancy, 64u);
+    ++reads;
+  }
+  writer.join();
+
+  ASSERT_TRUE(view.read(0, snapshot));
+  EXPECT_EQ(snapshot.ioCalls, 2000000u);
+}
+
+TEST(StatsExporterTest, NotASegment)
+{
+  EXPECT_THROW(StatsView("/StatsExporterTestsMissing"), std::runtime_error);
+  EXPECT_THROW(StatsExporter(SEGMENT, 0), std::invalid_argument);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "TimerWheel.hpp"
+
+TEST(TimerWheelTest, TimersFireAtTheirTick)
+{
+  // Expiries across all the levels, including the ones moved down more
+  // than once
+  const uint64_t tick = 1000;
+  TimerWheel wheel(tick, 5000);
+  std::mt19937_64 random(7);
+  std::vector<uint64_t> delays = {1, 1000, 1001, 255000, 256000, 257000, 65536000, 65537000, 16777216000};
+  for (uint32_t i = 0; i < 2000; ++i)
+  {
+    delays.push_back(random() % 1000000000);
+  }
+
+  std::vector<std::unique_ptr<WheelTimer>> timers;
+  std::vector<uint64_t> firedAt(delays.size(), 0);
+  for (uint32_t i = 0; i < delays.size(); ++i)
+  {
+    timers.push_back(std::make_unique<WheelTimer>([&, i]()
+                                                  { firedAt[i] = wheel.now(); }));
+    wheel.schedule(*timers.back(), delays[i]);
+  }
+  EXPECT_EQ(wheel.pending(), delays.size());
+
+  // Uneven steps
+  uint64_t fired = 0;
+  for (uint64_t now = 5000; wheel.pending(); now += random() % (1 << 24))
+  {
+    fired += wheel.advance(now);
+  }
+  fired += wheel.advance(5000 + 16777216000 + tick);
+
+  EXPECT_EQ(fired, delays.size());
+  for (uint32_t i = 0; i < delays.size(); ++i)
+  {
+    uint64_t due = 5000 + std::max<uint64_t>((delays[i] + tick - 1) / tick, 1) * tick;
+    ASSERT_EQ(firedAt[i], due) << delays[i];
+  }
+}
+
+TEST(TimerWheelTest, FiresInOrderOfExpiry)
+{
+  TimerWheel wheel(1, 0);
+  std::vector<uint64_t> order;
+  std::vector<std::unique_ptr<WheelTimer>> timers;
+  for (uint64_t delay : {70000, 3, 300, 70000, 1, 299})
+  {
+    timers.push_back(std::make_unique<WheelTimer>([&, delay]()
+                                                  { order.push_back(delay); }));
+    wheel.schedule(*timers.back(), delay);
+  }
+
+  wheel.advance(1000000);
+  EXPECT_EQ(order, (std::vector<uint64_t>{1, 3, 299, 300, 70000, 70000}));
+}
+
+TEST(TimerWheelTest, CancelAndReschedule)
+{
+  TimerWheel wheel(10, 0);
+  uint32_t fired = 0;
+  WheelTimer timer([&]()
+                   { ++fired; });
+  wheel.schedule(timer, 100);
+  EXPECT_TRUE(timer.pending());
+  wheel.cancel(timer);
+  EXPECT_FALSE(timer.pending());
+  EXPECT_EQ(wheel.advance(1000), 0);
+  EXPECT_EQ(fired, 0);
+
+  // Relative to the time the wheel was advanced to
+  wheel.schedule(timer, 100);
+  wheel.schedule(timer, 50);
+  EXPECT_EQ(wheel.pending(), 1);
+  EXPECT_EQ(wheel.advance(1049), 0);
+  EXPECT_EQ(wheel.advance(1050), 1);
+  EXPECT_EQ(fired, 1);
+
+  // A timer rescheduling itself from its callback
+  timer.callback = [&]()
+  {
+    if (++fired < 5)
+    {
+      wheel.schedule(timer, 0);
+    }
+  };
+  wheel.schedule(timer, 0);
+  EXPECT_EQ(wheel.advance(2000), 4);
+  EXPECT_EQ(fired, 5);
+}
+
+TEST(TimerWheelTest, FlushDeadlineBoundsTheDelay)
+{
+  std::string sink;
+  bool accepting = true;
+  SyncIOLazyWriteBuffer<uint32_t>::NonBlockingIOInterface ioInterface = [&](const char *out, const uint32_t &len)
+  {
+    if (!accepting)
+    {
+      return IOResult<uint32_t>{0, IOStatus::WOULD_BLOCK};
+    }
+
+    sink.append(out, len);
+    return IOResult<uint32_t>{len, IOStatus::OK};
+  };
+
+  TimerWheel wheel(100, 0);
+  SyncIOLazyWriteBuffer<uint32_t> buffer(1024, ioInterface);
+  {
+    FlushDeadline<uint32_t> deadline(wheel, buffer, 1000);
+    EXPECT_EQ(wheel.pending(), 0);
+    buffer.write("abc", 3);
+    wheel.advance(500);
+    // Not dirty for the first time, doesn't move the deadline
+    buffer.write("def", 3);
+    EXPECT_EQ(wheel.pending(), 1);
+    wheel.advance(999);
+    EXPECT_EQ(sink, "");
+    wheel.advance(1000);
+    EXPECT_EQ(sink, "abcdef");
+    EXPECT_EQ(wheel.pending(), 0);
+
+    // The bytes the ioInterface doesn't take get another deadline
+    accepting = false;
+    buffer.write("ghi", 3);
+    wheel.advance(2000);
+    EXPECT_EQ(wheel.pending(), 1);
+    accepting = true;
+    wheel.advance(2999);
+    EXPECT_EQ(sink, "abcdef");
+    wheel.advance(3000);
+    EXPECT_EQ(sink, "abcdefghi");
+
+    buffer.write("jkl", 3);
+    EXPECT_EQ(wheel.pending(), 1);
+  }
+
+  // Detached with the deadline
+  EXPECT_EQ(wheel.pending(), 0);
+  buffer.write("mno", 3);
+  EXPECT_EQ(wheel.pending(), 0);
+  wheel.advance(10000);
+  EXPECT_EQ(sink, "abcdefghi");
+}
+
+// The deadline stays with the buffer it was attached to, the one moved into
+// has to get a deadline of its own
+TEST(TimerWheelTest, FlushDeadlineStaysWithTheMovedFromBuffer)
+{
+  std::string sink;
+  auto ioInterface = [&](const char *out, const uint32_t &len)
+  {
+    sink.append(out, len);
+    return len;
+  };
+
+  TimerWheel wheel(100, 0);
+  SyncIOLazyWriteBuffer<uint32_t> buffer(1024, ioInterface);
+  auto deadline = std::make_unique<FlushDeadline<uint32_t>>(wheel, buffer, 1000);
+  buffer.write("abc", 3);
+  SyncIOLazyWriteBuffer<uint32_t> moved(std::move(buffer));
+  deadline.reset();
+  EXPECT_EQ(wheel.pending(), 0);
+
+  moved.flush();
+  moved.write("def", 3);
+  EXPECT_EQ(wheel.pending(), 0);
+  FlushDeadline<uint32_t> again(wheel, moved, 1000);
+  moved.flush();
+  moved.write("ghi", 3);
+  EXPECT_EQ(wheel.pending(), 1);
+  wheel.advance(1000);
+  EXPECT_EQ(sink, "abcdefghi");
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}